@@ -1,6 +1,7 @@
 // client.c — ncurses TUI client that hex-encodes and sends attendance
-// Build: gcc -std=c17 -O2 -Wall -Wextra client.c -lncurses -o client
-// Run:   ./client <server_ip> 5555
+// Build: gcc -std=c17 -O2 -Wall -Wextra -I../common client.c ../common/hexcodec.c ../common/wire.c ../common/netbuf.c ../common/datetime.c -lncurses -o client
+// Run:   ./client <server_ip> 5555 [--bin]
+// --bin negotiates the binary framing from wire.h instead of hex text.
 
 #include <arpa/inet.h>
 #include <ncurses.h>
@@ -12,20 +13,21 @@
 #include <time.h>
 #include <unistd.h>
 
-static void bytes_to_hex(const unsigned char *in, size_t len, char *out, size_t outcap) {
-    static const char *H = "0123456789ABCDEF";
-    if (outcap < (len * 2 + 1)) { if (outcap) out[0] = 0; return; }
-    for (size_t i = 0; i < len; ++i) {
-        out[2*i]   = H[(in[i] >> 4) & 0xF];
-        out[2*i+1] = H[in[i] & 0xF];
-    }
-    out[len*2] = 0;
-}
-
-static void utc_iso(char *buf, size_t n) {
-    time_t t = time(NULL);
-    struct tm gm; gmtime_r(&t, &gm);
-    strftime(buf, n, "%Y-%m-%dT%H:%M:%SZ", &gm);
+#include "datetime.h"
+#include "hexcodec.h"
+#include "wire.h"
+
+// Build a WIRE_ATT frame; returns its size or 0 if a field is too long.
+static size_t build_att_frame(uint8_t *out, size_t cap, const char *roll,
+                              const char *course, time_t ts, const char *status) {
+    uint8_t payload[512];
+    WireWriter w = { payload, payload + sizeof payload, 0 };
+    wire_put_str(&w, roll, strlen(roll));
+    wire_put_str(&w, course, strlen(course));
+    wire_put_u32(&w, (uint32_t)ts);
+    wire_put_u8(&w, status[0] == '1' ? 1 : 0);
+    if (w.bad) return 0;
+    return wire_frame(out, cap, WIRE_ATT, payload, (size_t)(w.p - payload));
 }
 
 static int connect_tcp(const char *ip, int port) {
@@ -40,12 +42,20 @@ static int connect_tcp(const char *ip, int port) {
 
 int main(int argc, char **argv) {
     if (argc < 3) {
-        fprintf(stderr,"Usage: %s <server_ip> <port>\n", argv[0]);
+        fprintf(stderr,"Usage: %s <server_ip> <port> [--bin]\n", argv[0]);
         return 1;
     }
     const char *ip = argv[1]; int port = atoi(argv[2]);
+    int binary = argc > 3 && strcmp(argv[3], "--bin") == 0;
     int sock = connect_tcp(ip, port);
     if (sock < 0) { perror("connect"); return 1; }
+    if (binary) {
+        char ack[64];
+        ssize_t an = (send(sock, "BIN\n", 4, 0) == 4) ? recv(sock, ack, sizeof ack - 1, 0) : -1;
+        if (an <= 0 || strncmp(ack, "OK|BIN", 6) != 0) {
+            fprintf(stderr, "server does not support binary mode\n"); close(sock); return 1;
+        }
+    }
 
     initscr(); cbreak(); noecho(); keypad(stdscr, TRUE);
     int row, col; getmaxyx(stdscr, row, col);
@@ -68,16 +78,22 @@ int main(int argc, char **argv) {
         move(4, 16); echo(); getnstr(course, sizeof course - 1); noecho();
         move(5, 31); echo(); getnstr(status, sizeof status - 1); noecho();
 
-        utc_iso(ts, sizeof ts);
+        size_t len;
+        if (binary) {
+            len = build_att_frame((uint8_t*)line, sizeof line, roll, course, time(NULL), status);
+        } else {
+            format_iso8601((int64_t)time(NULL), ts);   // what the server's parse_iso8601 takes
 
-        bytes_to_hex((unsigned char*)roll,   strlen(roll),   hroll,   sizeof hroll);
-        bytes_to_hex((unsigned char*)course, strlen(course), hcourse, sizeof hcourse);
-        bytes_to_hex((unsigned char*)ts,     strlen(ts),     hts,     sizeof hts);
-        bytes_to_hex((unsigned char*)status, strlen(status), hstat,   sizeof hstat);
+            hex_encode(roll,   strlen(roll),   hroll,   sizeof hroll, 1);
+            hex_encode(course, strlen(course), hcourse, sizeof hcourse, 1);
+            hex_encode(ts,     strlen(ts),     hts,     sizeof hts, 1);
+            hex_encode(status, strlen(status), hstat,   sizeof hstat, 1);
 
-        snprintf(line, sizeof line, "ATT|%s|%s|%s|%s\n", hroll, hcourse, hts, hstat);
+            snprintf(line, sizeof line, "ATT|%s|%s|%s|%s\n", hroll, hcourse, hts, hstat);
+            len = strlen(line);
+        }
 
-        ssize_t n = send(sock, line, strlen(line), 0);
+        ssize_t n = send(sock, line, len, 0);
         if (n <= 0) { mvprintw(9,2,"Send failed (connection lost)."); getch(); break; }
 
         int rn = recv(sock, srv, sizeof srv - 1, 0);
@@ -0,0 +1,133 @@
+// connbench.c — connection-count benchmark for server.c
+// Build: gcc -std=c17 -O2 -Wall -Wextra -I../common connbench.c ../common/hexcodec.c -o connbench
+// Run:   ./connbench 127.0.0.1 5555 <idle_conns> [requests] [active]
+//
+// Opens <idle_conns> connections that never send anything, then drives
+// <active> connections (default 1), each with one ATT round-trip in flight,
+// until <requests> replies arrived, and reports throughput and p50/p99
+// latency. With a select()-style loop the latency grows with the idle count
+// (and stops at FD_SETSIZE); with the epoll reactor it stays flat.
+//
+// Connection sweep (DB on tmpfs so fsync does not hide the loop cost; raise
+// `ulimit -n` on both sides first):
+//   ./server 127.0.0.1 5555 /dev/shm/bench.db &
+//   for n in 0 1000 5000 20000 50000; do ./connbench 127.0.0.1 5555 $n; done
+//
+// Group-commit sweep (DB on the real disk so every COMMIT pays an fsync):
+//   for b in 1 8 32 128; do
+//     ./server 127.0.0.1 5555 bench.db --batch $b --batch-ms 5 & sleep 1
+//     ./connbench 127.0.0.1 5555 0 20000 64; kill $!
+//   done
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hexcodec.h"
+
+static int connect_tcp(const char *ip, int port) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    struct sockaddr_in a = {0};
+    a.sin_family = AF_INET; a.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &a.sin_addr) != 1) { close(s); return -2; }
+    if (connect(s, (struct sockaddr*)&a, sizeof a) < 0) { close(s); return -3; }
+    return s;
+}
+
+static double now_us(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static int build_att(char *line, size_t cap, int i) {
+    char roll[32], hroll[64], hcourse[64], hts[64], hstat[8];
+    const char *course = "BENCH101", *ts = "2025-01-01T08:00:00Z";
+    snprintf(roll, sizeof roll, "%d", 100000 + i % 5000);
+    hex_encode(roll,   strlen(roll),   hroll,   sizeof hroll, 1);
+    hex_encode(course, strlen(course), hcourse, sizeof hcourse, 1);
+    hex_encode(ts,     strlen(ts),     hts,     sizeof hts, 1);
+    hex_encode("1",    1,              hstat,   sizeof hstat, 1);
+    return snprintf(line, cap, "ATT|%s|%s|%s|%s\n", hroll, hcourse, hts, hstat);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s <server_ip> <port> <idle_conns> [requests] [active]\n", argv[0]);
+        return 1;
+    }
+    const char *ip = argv[1]; int port = atoi(argv[2]);
+    int idle = atoi(argv[3]); int reqs = argc > 4 ? atoi(argv[4]) : 2000;
+    int active = argc > 5 ? atoi(argv[5]) : 1;
+    if (idle < 0 || reqs <= 0 || active <= 0) { fprintf(stderr, "bad counts\n"); return 1; }
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) { rl.rlim_cur = rl.rlim_max; setrlimit(RLIMIT_NOFILE, &rl); }
+
+    int *fds = calloc((size_t)idle + 1, sizeof *fds);
+    if (!fds) { perror("calloc"); return 1; }
+    for (int i = 0; i < idle; ++i) {
+        fds[i] = connect_tcp(ip, port);
+        if (fds[i] < 0) { fprintf(stderr, "idle connect %d failed\n", i); return 1; }
+    }
+
+    struct pollfd *pfd = calloc((size_t)active, sizeof *pfd);
+    double *sent_at = calloc((size_t)active, sizeof *sent_at);
+    double *lat = malloc((size_t)reqs * sizeof *lat);
+    if (!pfd || !sent_at || !lat) { perror("malloc"); return 1; }
+    for (int i = 0; i < active; ++i) {
+        pfd[i].fd = connect_tcp(ip, port);
+        pfd[i].events = POLLIN;
+        if (pfd[i].fd < 0) { perror("connect"); return 1; }
+    }
+
+    char line[512], resp[256];
+    int issued = 0, done = 0, errs = 0;
+    double t0 = now_us();
+    for (int i = 0; i < active && issued < reqs; ++i, ++issued) {
+        int len = build_att(line, sizeof line, issued);
+        sent_at[i] = now_us();
+        if (send(pfd[i].fd, line, (size_t)len, 0) != len) { perror("send"); return 1; }
+    }
+    while (done < reqs) {
+        if (poll(pfd, (nfds_t)active, -1) < 0) { perror("poll"); return 1; }
+        for (int i = 0; i < active; ++i) {
+            if (!(pfd[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            // one request in flight per conn, so one recv holds its whole reply
+            ssize_t n = recv(pfd[i].fd, resp, sizeof resp - 1, 0);
+            if (n <= 0) { fprintf(stderr, "server closed\n"); return 1; }
+            resp[n] = 0;
+            if (strncmp(resp, "OK|", 3) != 0) errs++;
+            lat[done++] = now_us() - sent_at[i];
+            if (issued < reqs) {
+                int len = build_att(line, sizeof line, issued++);
+                sent_at[i] = now_us();
+                if (send(pfd[i].fd, line, (size_t)len, 0) != len) { perror("send"); return 1; }
+            }
+        }
+    }
+    double secs = (now_us() - t0) / 1e6;
+
+    qsort(lat, (size_t)reqs, sizeof *lat, cmp_double);
+    printf("idle=%d active=%d reqs=%d errs=%d  %.0f req/s  p50=%.1fus p99=%.1fus max=%.1fus\n",
+           idle, active, reqs, errs, reqs / secs, lat[reqs / 2], lat[(size_t)(reqs * 0.99)],
+           lat[reqs - 1]);
+
+    for (int i = 0; i < active; ++i) close(pfd[i].fd);
+    for (int i = 0; i < idle; ++i) close(fds[i]);
+    free(fds); free(pfd); free(sent_at); free(lat);
+    return 0;
+}
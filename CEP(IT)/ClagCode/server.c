@@ -1,22 +1,182 @@
 // server.c — TCP attendance server with SQLite3
-// Build: gcc -std=c17 -O2 -Wall -Wextra server.c -lsqlite3 -o server
-// Run:   ./server 0.0.0.0 5555 attendance.db
+// Build: gcc -std=c17 -O2 -Wall -Wextra -pthread -I../common server.c ../common/netbuf.c ../common/stmtcache.c ../common/idmap.c ../common/hexcodec.c ../common/wire.c ../common/datetime.c ../common/workq.c ../common/mpscring.c ../common/dbtune.c ../common/ingestlog.c -lsqlite3 -o server
+// Run:   ./server 0.0.0.0 5555 attendance.db [--batch N] [--batch-ms T] [--log-dir DIR] [--log-seg-mb N] [--reactors N] [--pin] [--rebuild-counts] [--migrate-dates] [storage flags, dbtune.h]
 // Proto: "ATT|<HEX_ROLL>|<HEX_COURSE>|<HEX_ISO8601>|<HEX_STATUS>\n"
+//        or, after a "BIN" line (answered "OK|BIN"), WIRE_ATT frames from
+//        wire.h: str roll, str course, u32 epoch seconds, u8 status.
+//        Text mode also takes "SUM|DAY|<HEX_COURSE>|<HEX_YYYY-MM-DD>\n" and
+//        "SUM|STUDENT|<HEX_ROLL>|<HEX_COURSE>\n", answered
+//        "OK|SUM|present|absent|total|pct\n".
+//
+// I/O model: one edge-triggered epoll reactor. Sockets are non-blocking and
+// every connection carries its own Conn state (pending output), so a wakeup
+// only costs work for the fds that are actually ready and the server is not
+// bound by FD_SETSIZE. The fd limit is raised to the hard RLIMIT_NOFILE.
+// Input is framed per connection (LineBuf), so clients may pipeline: every
+// complete line of a read is handled in order and the replies go out in one
+// send().
+//
+// --reactors N runs N such loops (0: one per online CPU) on threads, each
+// with its own SO_REUSEPORT listener, epoll set, connections and reply
+// eventfd; the kernel spreads new connections over the listeners and a
+// connection stays on its loop. All of them feed the one logger through an
+// MpscQueue (workq.h), which producers push into without a lock. --pin
+// binds loop i to the i-th CPU the process may run on; common/scalebench.c
+// measures throughput from 1 to N loops.
+//
+// Rows are acknowledged once they are in the ingest log (ingestlog.h), not
+// once they are in SQLite. The loop parses rows and hands them over a
+// bounded queue (workq.h) to a logger thread, which group-commits them:
+// the first row and then up to --batch rows in total or whatever arrives
+// within --batch-ms go out as one O_APPEND write and one fdatasync, and
+// only then are their "OK|Recorded" replies posted back through an
+// eventfd. When the queue is full a connection is parked (its input stays
+// in the kernel, and a row the queue refused waits on the connection) and
+// retried every STALL_RETRY_MS, since with several loops the room may come
+// from another loop's replies.
+//
+// An applier thread owns the SQLite connection and drains the log into it,
+// up to APPLY_BATCH rows per transaction, storing the last applied record's
+// sequence number (ingest_state) in the same transaction. A slow or locked
+// database therefore delays only the applier: the log keeps taking rows, a
+// failed COMMIT is retried from the last applied record, and nothing that
+// was acknowledged is lost. After a crash (kill -9 included) the log's torn
+// tail is cut off and the applier replays every record past applied_seq
+// once. The log directory defaults to <db>-ilog, in segments of
+// --log-seg-mb (64); segments are deleted once applied. A row the database
+// rejects at apply time (it was already acknowledged) is reported on stderr
+// with its sequence number.
+//
+// SUM goes to the applier too, after the rows before it are applied, so it
+// counts every row sent before it on the connection; the loop puts replies
+// back in request order on each connection.
+//
+// The database runs in WAL mode (dbtune.h); a checkpointer thread keeps the
+// WAL short so the applier never checkpoints inside a COMMIT.
+//
+// Roll and course ids and known enrollments are cached in memory (idmap.h),
+// warmed at startup, so a mark for an existing student touches SQLite only
+// for the attendance INSERT itself.
+//
+// Present/absent counts per (course, UTC day) and per (student, course) are
+// kept by triggers on attendance, inside the same applier transaction as the
+// rows, so SUM is a primary-key lookup. The counters are backfilled when the
+// triggers are first created; --rebuild-counts recounts them from attendance
+// at startup.
+//
+// timestamp_utc is INTEGER epoch seconds (schema version 1, PRAGMA
+// user_version): text timestamps are validated with parse_iso8601() on the
+// way in, binary frames are stored as sent, and the counters' day is
+// timestamp_utc / 86400. A version 0 database (ISO-8601 text) is refused
+// until the server is started once with --migrate-dates.
 
+#define _GNU_SOURCE
 #include <arpa/inet.h>
-#include <ctype.h>
 #include <errno.h>
 #include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <sqlite3.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <time.h>
 #include <unistd.h>
 
-#define MAX_LINE 4096
+#include "datetime.h"
+#include "dbtune.h"
+#include "hexcodec.h"
+#include "idmap.h"
+#include "ingestlog.h"
+#include "netbuf.h"
+#include "stmtcache.h"
+#include "wire.h"
+#include "workq.h"
+
+#define MAX_LINE   4096
+#define MAX_EVENTS 1024
+#define MAX_REACTORS 64
+#define WRITEQ_CAP 4096   // rows waiting for the logger before conns are parked
+#define CONN_PENDING_MAX 4096   // replies owed to one conn before it is parked
+#define STALL_RETRY_MS 1   // epoll_wait timeout while conns are parked
+#define APPLY_BATCH 4096  // log records per applier transaction
+#define RECORD_MAX  (3 * MAX_LINE + 64)   // encoded ATT (raw is hex of a frame)
+
+typedef struct Reactor Reactor;
+
+typedef struct Conn {
+    int     fd;
+    Reactor *rx;      // the loop that owns it
+    LineBuf in;       // partial request bytes
+    OutBuf  out;      // response bytes the kernel has not accepted yet
+    int     pending;  // entries handed to the logger for this conn
+    int     dead;     // socket closed; freed once pending drops to 0
+    int     binary;   // switched to wire.h frames by a "BIN" line
+    int     eof;      // peer half-closed; close after the last reply
+    int     stalled;  // on rx->stalled, waiting for room in the logger queue
+    struct Conn *next_stalled;
+    struct Pending *held;       // taken from in, refused by the full queue; goes first
+    uint64_t sent, delivered;   // entries numbered / replies written, in request order
+    struct Pending *early;      // replies that came back ahead of their turn, by order
+    int     flushing;
+    struct Conn *next_flush;
+} Conn;
+
+typedef struct {
+    char    roll[129], course[129];
+    int64_t ts;        // epoch seconds, or the day number of a SUM|DAY
+    int     status;
+    int     sum;       // 'D' / 'S': a SUM query (course + day in ts / roll + course)
+} AttReq;
+
+// One entry for the logger. Entries with raw == NULL carry a SUM query or an
+// already-decided reply (e.g. a parse error) that must not overtake earlier
+// queued rows; the logger passes the latter straight back.
+typedef struct Pending {
+    WorkItem link;
+    Conn    *conn;
+    uint64_t order;    // position among the conn's entries
+    char    *raw;
+    AttReq   req;
+    char     resp[96];
+} Pending;
+
+static struct {
+    int max;   // rows per log write
+    int ms;    // how long the logger waits for more after the first row
+} g_batch = { .max = 128, .ms = 10 };
+
+static IdMap     g_students, g_courses;   // roll / course_code -> id (applier only)
+static PairSet   g_enrolled;              // (student_id, course_id) (applier only)
+static MpscQueue g_writeq;                // loops -> logger
+static DbTune    g_tune = DBTUNE_DEFAULTS;
+static IngestLog g_log;                   // appended by the logger only
+
+// One event loop and what only it touches.
+struct Reactor {
+    pthread_t tid;
+    int       ep, srv;
+    int       cpu;       // pinned to, -1 if not
+    DoneQueue done;      // logger, applier -> this loop
+    Conn     *stalled;   // conns parked on a full g_writeq
+    size_t    nconns;
+};
+
+// Logger -> applier: how far the log is on disk, and the SUMs that wait for
+// the rows before them.
+static struct {
+    pthread_mutex_t mu;
+    pthread_cond_t  cv;
+    uint64_t        durable;
+    WorkItem       *sums, *sums_tail;
+    int             closed;
+} g_apply = { .mu = PTHREAD_MUTEX_INITIALIZER, .cv = PTHREAD_COND_INITIALIZER };
+
+#define SCHEMA_VERSION 1   // attendance.timestamp_utc as epoch seconds
 
 static const char *DDL =
     "PRAGMA foreign_keys=ON;"
@@ -43,120 +203,309 @@ static const char *DDL =
     "  attendance_id INTEGER PRIMARY KEY,"
     "  student_id    INTEGER NOT NULL,"
     "  course_id     INTEGER NOT NULL,"
-    "  timestamp_utc TEXT NOT NULL,"
+    "  timestamp_utc INTEGER NOT NULL,"
     "  status        INTEGER NOT NULL,"
     "  raw_msg_hex   TEXT,"
     "  FOREIGN KEY(student_id) REFERENCES students(student_id),"
     "  FOREIGN KEY(course_id)  REFERENCES courses(course_id)"
-    ");";
+    ");"
+    // last ingest log record applied, committed with the rows it applied
+    "CREATE TABLE IF NOT EXISTS ingest_state ("
+    "  id          INTEGER PRIMARY KEY CHECK (id = 1),"
+    "  applied_seq INTEGER NOT NULL"
+    ");"
+    "INSERT OR IGNORE INTO ingest_state VALUES (1, 0);"
+    "PRAGMA user_version = 1;";
+
+// Counters behind SUM. status is 1 for present, anything else is absent.
+static const char *COUNTS_DDL =
+    "CREATE TABLE IF NOT EXISTS course_day_counts ("
+    "  course_id INTEGER NOT NULL,"
+    "  day       INTEGER NOT NULL,"
+    "  present   INTEGER NOT NULL,"
+    "  absent    INTEGER NOT NULL,"
+    "  PRIMARY KEY (course_id, day)"
+    ") WITHOUT ROWID;"
+    "CREATE TABLE IF NOT EXISTS student_course_counts ("
+    "  student_id INTEGER NOT NULL,"
+    "  course_id  INTEGER NOT NULL,"
+    "  present    INTEGER NOT NULL,"
+    "  absent     INTEGER NOT NULL,"
+    "  PRIMARY KEY (student_id, course_id)"
+    ") WITHOUT ROWID;"
+    "CREATE TRIGGER IF NOT EXISTS att_count_ins AFTER INSERT ON attendance BEGIN"
+    "  INSERT INTO course_day_counts VALUES (NEW.course_id, NEW.timestamp_utc / 86400,"
+    "    NEW.status = 1, NEW.status <> 1)"
+    "  ON CONFLICT (course_id, day) DO UPDATE SET"
+    "    present = present + excluded.present, absent = absent + excluded.absent;"
+    "  INSERT INTO student_course_counts VALUES (NEW.student_id, NEW.course_id,"
+    "    NEW.status = 1, NEW.status <> 1)"
+    "  ON CONFLICT (student_id, course_id) DO UPDATE SET"
+    "    present = present + excluded.present, absent = absent + excluded.absent;"
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS att_count_del AFTER DELETE ON attendance BEGIN"
+    "  UPDATE course_day_counts SET present = present - (OLD.status = 1), absent = absent - (OLD.status <> 1)"
+    "    WHERE course_id = OLD.course_id AND day = OLD.timestamp_utc / 86400;"
+    "  UPDATE student_course_counts SET present = present - (OLD.status = 1), absent = absent - (OLD.status <> 1)"
+    "    WHERE student_id = OLD.student_id AND course_id = OLD.course_id;"
+    "END;";
+
+static const char *COUNTS_REBUILD =
+    "SAVEPOINT rebuild_counts;"
+    "DELETE FROM course_day_counts;"
+    "DELETE FROM student_course_counts;"
+    "INSERT INTO course_day_counts"
+    "  SELECT course_id, timestamp_utc / 86400, sum(status = 1), sum(status <> 1)"
+    "  FROM attendance GROUP BY 1, 2;"
+    "INSERT INTO student_course_counts"
+    "  SELECT student_id, course_id, sum(status = 1), sum(status <> 1)"
+    "  FROM attendance GROUP BY 1, 2;"
+    "RELEASE rebuild_counts;";
+
+// Hot-path statements, compiled once by init_db().
+enum {
+    Q_STUDENT_BY_ROLL,
+    Q_STUDENT_INSERT,
+    Q_COURSE_BY_CODE,
+    Q_COURSE_INSERT,
+    Q_ENROLL,
+    Q_ATT_INSERT,
+    Q_SUM_DAY,
+    Q_SUM_STUDENT,
+    Q_ALL_STUDENTS,
+    Q_ALL_COURSES,
+    Q_ALL_ENROLLMENTS,
+    Q_APPLIED_SET,
+    Q_COUNT
+};
+
+static const char *const SQL[Q_COUNT] = {
+    [Q_STUDENT_BY_ROLL] = "SELECT student_id FROM students WHERE roll_hex = upper(hex(?1))",
+    [Q_STUDENT_INSERT]  = "INSERT INTO students (roll_int, roll_hex) VALUES (CAST(?1 AS INTEGER), upper(hex(?1)))",
+    [Q_COURSE_BY_CODE]  = "SELECT course_id FROM courses WHERE course_code = ?1",
+    [Q_COURSE_INSERT]   = "INSERT INTO courses (course_code, course_hex) VALUES (?1, upper(hex(?1)))",
+    [Q_ENROLL]          = "INSERT OR IGNORE INTO enrollments (student_id, course_id) VALUES (?1, ?2)",
+    [Q_ATT_INSERT]      = "INSERT INTO attendance (student_id, course_id, timestamp_utc, status, raw_msg_hex) "
+                          "VALUES (?1, ?2, ?3, ?4, ?5)",
+    [Q_SUM_DAY]         = "SELECT present, absent FROM course_day_counts WHERE course_id = "
+                          "(SELECT course_id FROM courses WHERE course_code = ?1) AND day = ?2",
+    [Q_SUM_STUDENT]     = "SELECT present, absent FROM student_course_counts WHERE student_id = "
+                          "(SELECT student_id FROM students WHERE roll_hex = upper(hex(?1))) AND course_id = "
+                          "(SELECT course_id FROM courses WHERE course_code = ?2)",
+    [Q_ALL_STUDENTS]    = "SELECT student_id, roll_hex FROM students",
+    [Q_ALL_COURSES]     = "SELECT course_id, course_code FROM courses",
+    [Q_ALL_ENROLLMENTS] = "SELECT student_id, course_id FROM enrollments",
+    [Q_APPLIED_SET]     = "UPDATE ingest_state SET applied_seq = ?1 WHERE id = 1",
+};
+
+static int has_trigger(sqlite3 *db, const char *name) {
+    sqlite3_stmt *st;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE type = 'trigger' AND name = ?1",
+                           -1, &st, NULL) != SQLITE_OK)
+        return 0;
+    sqlite3_bind_text(st, 1, name, -1, SQLITE_STATIC);
+    int found = sqlite3_step(st) == SQLITE_ROW;
+    sqlite3_finalize(st);
+    return found;
+}
+
+static int64_t applied_seq(sqlite3 *db) {
+    sqlite3_stmt *st = NULL;
+    int64_t v = -1;
+    if (sqlite3_prepare_v2(db, "SELECT applied_seq FROM ingest_state WHERE id = 1", -1, &st, NULL) == SQLITE_OK &&
+        sqlite3_step(st) == SQLITE_ROW) v = sqlite3_column_int64(st, 0);
+    sqlite3_finalize(st);
+    return v;
+}
 
-static int hex_to_bytes(const char *hex, unsigned char *out, size_t outcap) {
-    size_t len = strlen(hex);
-    if (len % 2) return -1;
-    size_t n = len / 2;
-    if (n > outcap) return -2;
-    for (size_t i = 0; i < n; ++i) {
-        unsigned int v;
-        if (!isxdigit((unsigned char)hex[2*i]) || !isxdigit((unsigned char)hex[2*i+1]))
-            return -3;
-        if (sscanf(&hex[2*i], "%2x", &v) != 1) return -4;
-        out[i] = (unsigned char)v;
+static int query_int(sqlite3 *db, const char *sql) {
+    sqlite3_stmt *st;
+    int v = -1;
+    if (sqlite3_prepare_v2(db, sql, -1, &st, NULL) != SQLITE_OK) return -1;
+    if (sqlite3_step(st) == SQLITE_ROW) v = sqlite3_column_int(st, 0);
+    sqlite3_finalize(st);
+    return v;
+}
+
+// iso_epoch('YYYY-MM-DDTHH:MM:SSZ') -> epoch seconds, NULL if invalid or
+// before 1970 (the counters' day is a plain division).
+static void sql_iso_epoch(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    const char *s = (const char*)sqlite3_value_text(argv[0]);
+    int64_t t;
+    if (s && parse_iso8601(s, (size_t)sqlite3_value_bytes(argv[0]), &t) == 0 && t >= 0)
+        sqlite3_result_int64(ctx, t);
+    else
+        sqlite3_result_null(ctx);
+}
+
+// Schema 0 -> 1: rewrite attendance with epoch seconds in one transaction,
+// after checking that every stored timestamp parses. The counters are
+// dropped and rebuilt from the new rows.
+static int migrate_dates(sqlite3 *db) {
+    sqlite3_create_function(db, "iso_epoch", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+                            sql_iso_epoch, NULL, NULL);
+    int bad = query_int(db, "SELECT count(*) FROM attendance WHERE iso_epoch(timestamp_utc) IS NULL");
+    if (bad != 0) {
+        fprintf(stderr, "migrate: %d attendance rows have no valid ISO-8601 UTC timestamp\n", bad);
+        return -1;
     }
-    return (int)n;
+    char *err = NULL;
+    if (sqlite3_exec(db,
+            "BEGIN IMMEDIATE;"
+            "DROP TRIGGER IF EXISTS att_count_ins;"
+            "DROP TRIGGER IF EXISTS att_count_del;"
+            "DROP TABLE IF EXISTS course_day_counts;"
+            "ALTER TABLE attendance RENAME TO attendance_v0;"
+            "CREATE TABLE attendance ("
+            "  attendance_id INTEGER PRIMARY KEY,"
+            "  student_id    INTEGER NOT NULL,"
+            "  course_id     INTEGER NOT NULL,"
+            "  timestamp_utc INTEGER NOT NULL,"
+            "  status        INTEGER NOT NULL,"
+            "  raw_msg_hex   TEXT,"
+            "  FOREIGN KEY(student_id) REFERENCES students(student_id),"
+            "  FOREIGN KEY(course_id)  REFERENCES courses(course_id)"
+            ");"
+            "INSERT INTO attendance SELECT attendance_id, student_id, course_id,"
+            "  iso_epoch(timestamp_utc), status, raw_msg_hex FROM attendance_v0 ORDER BY attendance_id;"
+            "DROP TABLE attendance_v0;"
+            "PRAGMA user_version = 1;"
+            "COMMIT;", NULL, NULL, &err) != SQLITE_OK) {
+        fprintf(stderr, "migrate: %s\n", err);
+        sqlite3_free(err);
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+        return -1;
+    }
+    printf("Migrated %d attendance rows to epoch seconds\n", query_int(db, "SELECT count(*) FROM attendance"));
+    return 0;
 }
 
-static int init_db(sqlite3 **pdb, const char *path) {
+static int init_db(sqlite3 **pdb, StmtCache *sc, const char *path, int rebuild_counts, int migrate) {
     if (sqlite3_open(path, pdb) != SQLITE_OK) {
         fprintf(stderr, "DB open: %s\n", sqlite3_errmsg(*pdb));
         return -1;
     }
+    sqlite3_busy_timeout(*pdb, 5000);   // wait out a TRUNCATE checkpoint
+    if (dbtune_apply(*pdb, &g_tune) != 0) return -4;
+    int version = query_int(*pdb, "PRAGMA user_version");
+    if (query_int(*pdb, "SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = 'attendance'") > 0) {
+        if (version > SCHEMA_VERSION) {
+            fprintf(stderr, "DB schema version %d is newer than this server (%d)\n", version, SCHEMA_VERSION);
+            return -2;
+        }
+        if (version < SCHEMA_VERSION && !migrate) {
+            fprintf(stderr, "DB stores timestamps as text (schema %d); run once with --migrate-dates\n", version);
+            return -2;
+        }
+        if (version < SCHEMA_VERSION && migrate_dates(*pdb) != 0) return -2;
+    }
     char *err = NULL;
     if (sqlite3_exec(*pdb, DDL, NULL, NULL, &err) != SQLITE_OK) {
         fprintf(stderr, "DB init: %s\n", err);
         sqlite3_free(err);
         return -2;
     }
+    // rows inserted before the triggers existed are not counted yet
+    if (!has_trigger(*pdb, "att_count_ins")) rebuild_counts = 1;
+    if (sqlite3_exec(*pdb, COUNTS_DDL, NULL, NULL, &err) != SQLITE_OK ||
+        (rebuild_counts && sqlite3_exec(*pdb, COUNTS_REBUILD, NULL, NULL, &err) != SQLITE_OK)) {
+        fprintf(stderr, "DB counters: %s\n", err);
+        sqlite3_free(err);
+        return -2;
+    }
+    if (stmtcache_init(sc, *pdb, SQL, Q_COUNT) != 0) return -3;
     return 0;
 }
 
-static int get_or_create_ids(sqlite3 *db, const char *roll_str, const char *course_code,
-                             int *out_student_id, int *out_course_id) {
-    sqlite3_stmt *st = NULL;
-    int rc;
+// (Re)load the identity caches from the tables.
+static int warm_caches(StmtCache *sc) {
+    idmap_clear(&g_students); idmap_clear(&g_courses); pairset_clear(&g_enrolled);
+    sqlite3_stmt *st = stmtcache_get(sc, Q_ALL_STUDENTS);
+    while (sqlite3_step(st) == SQLITE_ROW) {
+        const char *rh = (const char*)sqlite3_column_text(st, 1);
+        unsigned char roll[129];
+        int n = rh ? hex_decode(rh, strlen(rh), roll, sizeof roll - 1) : -1;
+        if (n < 0) continue;
+        roll[n] = 0;
+        idmap_put(&g_students, (const char*)roll, sqlite3_column_int(st, 0));
+    }
+    stmtcache_put(st);
+    st = stmtcache_get(sc, Q_ALL_COURSES);
+    while (sqlite3_step(st) == SQLITE_ROW) {
+        const char *code = (const char*)sqlite3_column_text(st, 1);
+        if (code) idmap_put(&g_courses, code, sqlite3_column_int(st, 0));
+    }
+    stmtcache_put(st);
+    st = stmtcache_get(sc, Q_ALL_ENROLLMENTS);
+    while (sqlite3_step(st) == SQLITE_ROW)
+        pairset_add(&g_enrolled, sqlite3_column_int(st, 0), sqlite3_column_int(st, 1));
+    stmtcache_put(st);
+    return 0;
+}
 
-    // STUDENT by roll_hex(roll_str)
-    rc = sqlite3_prepare_v2(db,
-        "SELECT student_id FROM students WHERE roll_hex = upper(hex(?1))", -1, &st, NULL);
-    if (rc != SQLITE_OK) return -1;
-    sqlite3_bind_text(st, 1, roll_str, -1, SQLITE_STATIC);
-    rc = sqlite3_step(st);
-    if (rc == SQLITE_ROW) {
-        *out_student_id = sqlite3_column_int(st, 0);
-        sqlite3_finalize(st);
-    } else {
-        sqlite3_finalize(st);
-        rc = sqlite3_prepare_v2(db,
-            "INSERT INTO students (roll_int, roll_hex) VALUES (CAST(?1 AS INTEGER), upper(hex(?1)))",
-            -1, &st, NULL);
-        if (rc != SQLITE_OK) return -2;
-        sqlite3_bind_text(st, 1, roll_str, -1, SQLITE_STATIC);
-        if (sqlite3_step(st) != SQLITE_DONE) { sqlite3_finalize(st); return -3; }
-        sqlite3_finalize(st);
-        *out_student_id = (int)sqlite3_last_insert_rowid(db);
+// Resolve key through the cache; on a miss fall back to `sel`, and create
+// the row with `ins` if the table does not have it either.
+static int lookup_or_insert(StmtCache *sc, IdMap *cache, int sel, int ins,
+                            const char *key, int *out_id) {
+    int id = idmap_get(cache, key);
+    if (id >= 0) { *out_id = id; return 0; }
+
+    sqlite3_stmt *st = stmtcache_get(sc, sel);
+    sqlite3_bind_text(st, 1, key, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(st);
+    if (rc == SQLITE_ROW) *out_id = sqlite3_column_int(st, 0);
+    stmtcache_put(st);
+    if (rc != SQLITE_ROW) {
+        if (rc != SQLITE_DONE) return -1;
+        st = stmtcache_get(sc, ins);
+        sqlite3_bind_text(st, 1, key, -1, SQLITE_STATIC);
+        rc = sqlite3_step(st);
+        stmtcache_put(st);
+        if (rc != SQLITE_DONE) return -2;
+        *out_id = (int)sqlite3_last_insert_rowid(sc->db);
     }
+    idmap_put(cache, key, *out_id);
+    return 0;
+}
 
+static int get_or_create_ids(StmtCache *sc, const char *roll_str, const char *course_code,
+                             int *out_student_id, int *out_course_id) {
+    // STUDENT by roll_hex(roll_str)
+    if (lookup_or_insert(sc, &g_students, Q_STUDENT_BY_ROLL, Q_STUDENT_INSERT,
+                         roll_str, out_student_id) != 0)
+        return -1;
     // COURSE by course_code
-    rc = sqlite3_prepare_v2(db,
-        "SELECT course_id FROM courses WHERE course_code = ?1", -1, &st, NULL);
-    if (rc != SQLITE_OK) return -4;
-    sqlite3_bind_text(st, 1, course_code, -1, SQLITE_STATIC);
-    rc = sqlite3_step(st);
-    if (rc == SQLITE_ROW) {
-        *out_course_id = sqlite3_column_int(st, 0);
-        sqlite3_finalize(st);
-    } else {
-        sqlite3_finalize(st);
-        rc = sqlite3_prepare_v2(db,
-            "INSERT INTO courses (course_code, course_hex) VALUES (?1, upper(hex(?1)))",
-            -1, &st, NULL);
-        if (rc != SQLITE_OK) return -5;
-        sqlite3_bind_text(st, 1, course_code, -1, SQLITE_STATIC);
-        if (sqlite3_step(st) != SQLITE_DONE) { sqlite3_finalize(st); return -6; }
-        sqlite3_finalize(st);
-        *out_course_id = (int)sqlite3_last_insert_rowid(db);
-    }
-
-    // ensure enrollment (best effort)
-    rc = sqlite3_prepare_v2(db,
-        "INSERT OR IGNORE INTO enrollments (student_id, course_id) VALUES (?1, ?2)",
-        -1, &st, NULL);
-    if (rc == SQLITE_OK) {
-        sqlite3_bind_int(st, 1, *out_student_id);
-        sqlite3_bind_int(st, 2, *out_course_id);
-        sqlite3_step(st);
-        sqlite3_finalize(st);
-    }
+    if (lookup_or_insert(sc, &g_courses, Q_COURSE_BY_CODE, Q_COURSE_INSERT,
+                         course_code, out_course_id) != 0)
+        return -2;
+
+    // ensure enrollment (best effort), skipped once the pair is known
+    if (pairset_has(&g_enrolled, *out_student_id, *out_course_id)) return 0;
+    sqlite3_stmt *st = stmtcache_get(sc, Q_ENROLL);
+    sqlite3_bind_int(st, 1, *out_student_id);
+    sqlite3_bind_int(st, 2, *out_course_id);
+    if (sqlite3_step(st) == SQLITE_DONE)
+        pairset_add(&g_enrolled, *out_student_id, *out_course_id);
+    stmtcache_put(st);
     return 0;
 }
 
-static int insert_attendance(sqlite3 *db, int sid, int cid, const char *ts, int status,
+static int insert_attendance(StmtCache *sc, int sid, int cid, int64_t ts, int status,
                              const char *raw_hex_line) {
-    sqlite3_stmt *st = NULL;
-    int rc = sqlite3_prepare_v2(db,
-        "INSERT INTO attendance (student_id, course_id, timestamp_utc, status, raw_msg_hex) "
-        "VALUES (?1, ?2, ?3, ?4, ?5)", -1, &st, NULL);
-    if (rc != SQLITE_OK) return -1;
+    sqlite3_stmt *st = stmtcache_get(sc, Q_ATT_INSERT);
     sqlite3_bind_int(st, 1, sid);
     sqlite3_bind_int(st, 2, cid);
-    sqlite3_bind_text(st, 3, ts, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(st, 3, ts);
     sqlite3_bind_int(st, 4, status);
     sqlite3_bind_text(st, 5, raw_hex_line, -1, SQLITE_STATIC);
-    rc = sqlite3_step(st);
-    sqlite3_finalize(st);
+    int rc = sqlite3_step(st);
+    stmtcache_put(st);
     return rc == SQLITE_DONE ? 0 : -2;
 }
 
-static int handle_line(sqlite3 *db, const char *line, char *resp, size_t rcap) {
+// Validate and decode one request. On error fills resp and returns < 0.
+static int parse_line(const char *line, AttReq *r, char *resp, size_t rcap) {
     // ATT|HEX_ROLL|HEX_COURSE|HEX_TS|HEX_STATUS
     char tmp[MAX_LINE]; strncpy(tmp, line, sizeof(tmp)); tmp[sizeof(tmp)-1] = 0;
     char *save = NULL;
@@ -173,75 +522,649 @@ static int handle_line(sqlite3 *db, const char *line, char *resp, size_t rcap) {
     }
 
     unsigned char broll[128], bcourse[128], bts[128], bstat[8];
-    int nr = hex_to_bytes(hroll,   broll,   sizeof broll);
-    int nc = hex_to_bytes(hcourse, bcourse, sizeof bcourse);
-    int nt = hex_to_bytes(hts,     bts,     sizeof bts);
-    int ns = hex_to_bytes(hstat,   bstat,   sizeof bstat);
+    int nr = hex_decode(hroll,   strlen(hroll),   broll,   sizeof broll);
+    int nc = hex_decode(hcourse, strlen(hcourse), bcourse, sizeof bcourse);
+    int nt = hex_decode(hts,     strlen(hts),     bts,     sizeof bts);
+    int ns = hex_decode(hstat,   strlen(hstat),   bstat,   sizeof bstat);
     if (nr < 0 || nc < 0 || nt < 0 || ns < 0) {
         snprintf(resp, rcap, "ERR|HEX_DECODE|Invalid hex\n");
         return -2;
     }
 
-    char roll[129]={0}, course[129]={0}, ts[129]={0};
-    memcpy(roll,   broll,   (size_t)nr);
-    memcpy(course, bcourse, (size_t)nc);
-    memcpy(ts,     bts,     (size_t)nt);
+    memset(r, 0, sizeof *r);
+    if (parse_iso8601((const char*)bts, (size_t)nt, &r->ts) != 0 || r->ts < 0) {
+        snprintf(resp, rcap, "ERR|BAD_FORMAT|Timestamp must be YYYY-MM-DDTHH:MM:SSZ\n");
+        return -3;
+    }
+    memcpy(r->roll,   broll,   (size_t)nr);
+    memcpy(r->course, bcourse, (size_t)nc);
+
+    // accept ASCII '1' or byte 0x01
+    if (ns == 1) r->status = (bstat[0] == '1' || bstat[0] == 1) ? 1 : 0;
+    else         r->status = (memchr(bstat, '1', (size_t)ns) != NULL) ? 1 : 0;
+    return 0;
+}
+
+// "SUM|DAY|HEX_COURSE|HEX_DATE" or "SUM|STUDENT|HEX_ROLL|HEX_COURSE".
+// On error fills resp and returns < 0.
+static int parse_sum(const char *line, AttReq *r, char *resp, size_t rcap) {
+    char tmp[MAX_LINE]; strncpy(tmp, line, sizeof(tmp)); tmp[sizeof(tmp)-1] = 0;
+    char *save = NULL;
+    strtok_r(tmp, "|", &save);
+    char *kind = strtok_r(NULL, "|", &save);
+    char *ha = strtok_r(NULL, "|", &save);
+    char *hb = strtok_r(NULL, "\r\n", &save);
+    int day = kind && !strcmp(kind, "DAY");
+    if (!kind || (!day && strcmp(kind, "STUDENT")) || !ha || !hb) {
+        snprintf(resp, rcap, "ERR|BAD_FORMAT|Use SUM|DAY|HEX_COURSE|HEX_DATE or SUM|STUDENT|HEX_ROLL|HEX_COURSE\n");
+        return -1;
+    }
+    memset(r, 0, sizeof *r);
+    char date[129];
+    char *a = day ? r->course : r->roll, *b = day ? date : r->course;
+    int na = hex_decode(ha, strlen(ha), (unsigned char*)a, sizeof r->roll - 1);
+    int nb = hex_decode(hb, strlen(hb), (unsigned char*)b, sizeof date - 1);
+    if (na < 0 || nb < 0) {
+        snprintf(resp, rcap, "ERR|HEX_DECODE|Invalid hex\n");
+        return -2;
+    }
+    if (day && parse_ymd(b, (size_t)nb, &r->ts) != 0) {
+        snprintf(resp, rcap, "ERR|BAD_FORMAT|Date must be YYYY-MM-DD\n");
+        return -3;
+    }
+    r->sum = day ? 'D' : 'S';
+    return 0;
+}
 
-    int status = 0; // accept ASCII '1' or byte 0x01
-    if (ns == 1) status = (bstat[0] == '1' || bstat[0] == 1) ? 1 : 0;
-    else         status = (memchr(bstat, '1', (size_t)ns) != NULL) ? 1 : 0;
+// Decode a WIRE_ATT frame payload. On error fills resp and returns < 0.
+static int parse_frame(uint8_t op, const uint8_t *payload, size_t n, AttReq *r,
+                       char *resp, size_t rcap) {
+    if (op != WIRE_ATT) { snprintf(resp, rcap, "ERR|BAD_FORMAT|Unknown opcode\n"); return -1; }
+    WireReader rd = { payload, payload + n, 0 };
+    size_t nr, nc;
+    const char *roll = wire_get_str(&rd, &nr);
+    const char *course = wire_get_str(&rd, &nc);
+    uint32_t epoch = wire_get_u32(&rd);
+    uint8_t stat = wire_get_u8(&rd);
+    if (rd.bad || rd.p != rd.end || nr >= sizeof r->roll || nc >= sizeof r->course) {
+        snprintf(resp, rcap, "ERR|BAD_FORMAT|Bad ATT frame\n");
+        return -2;
+    }
+    memset(r, 0, sizeof *r);
+    memcpy(r->roll, roll, nr);
+    memcpy(r->course, course, nc);
+    r->ts = epoch;
+    r->status = (stat == '1' || stat == 1) ? 1 : 0;
+    return 0;
+}
 
+// Apply one decoded row inside the current applier transaction.
+static int record_att(StmtCache *sc, const AttReq *r, const char *line, char *resp, size_t rcap) {
     int sid=0, cid=0;
-    if (get_or_create_ids(db, roll, course, &sid, &cid) != 0) {
+    if (get_or_create_ids(sc, r->roll, r->course, &sid, &cid) != 0) {
         snprintf(resp, rcap, "ERR|DB_LOOKUP|IDs\n"); return -3;
     }
-    if (insert_attendance(db, sid, cid, ts, status, line) != 0) {
+    if (insert_attendance(sc, sid, cid, r->ts, r->status, line) != 0) {
         snprintf(resp, rcap, "ERR|DB_INSERT\n"); return -4;
     }
     snprintf(resp, rcap, "OK|Recorded\n");
     return 0;
 }
 
-int main(int argc, char **argv) {
-    if (argc < 4) {
-        fprintf(stderr, "Usage: %s <bind_ip> <port> <sqlite_db_path>\n", argv[0]);
-        return 1;
+// Answer a SUM from the counters; sees every row applied so far.
+static void run_sum(StmtCache *sc, const AttReq *r, char *resp, size_t rcap) {
+    int day = r->sum == 'D';
+    sqlite3_stmt *st = stmtcache_get(sc, day ? Q_SUM_DAY : Q_SUM_STUDENT);
+    sqlite3_bind_text(st, 1, day ? r->course : r->roll, -1, SQLITE_STATIC);
+    if (day) sqlite3_bind_int64(st, 2, r->ts);
+    else     sqlite3_bind_text(st, 2, r->course, -1, SQLITE_STATIC);
+    long long present = 0, absent = 0;
+    int rc = sqlite3_step(st);
+    if (rc == SQLITE_ROW) {
+        present = sqlite3_column_int64(st, 0);
+        absent = sqlite3_column_int64(st, 1);
     }
-    const char *bind_ip = argv[1]; int port = atoi(argv[2]); const char *dbp = argv[3];
+    stmtcache_put(st);
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) { snprintf(resp, rcap, "ERR|DB_SELECT\n"); return; }
+    long long total = present + absent;
+    snprintf(resp, rcap, "OK|SUM|%lld|%lld|%lld|%.1f\n", present, absent, total,
+             total ? 100.0 * present / total : 0.0);
+}
 
-    sqlite3 *db = NULL; if (init_db(&db, dbp) != 0) return 1;
+static void raise_nofile_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
 
-    int srv = socket(AF_INET, SOCK_STREAM, 0);
-    if (srv < 0) { perror("socket"); return 1; }
-    int one = 1; setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+// ---- ingest log ----
 
-    struct sockaddr_in addr = {0};
-    addr.sin_family = AF_INET; addr.sin_port = htons(port);
-    if (inet_pton(AF_INET, bind_ip, &addr.sin_addr) != 1) { fprintf(stderr,"bad IP\n"); return 1; }
-    if (bind(srv, (struct sockaddr*)&addr, sizeof addr) < 0) { perror("bind"); return 1; }
-    if (listen(srv, 16) < 0) { perror("listen"); return 1; }
-    printf("Server listening on %s:%d, DB=%s\n", bind_ip, port, dbp);
+// Log record of one row: u8 status, u32 ts low, u32 ts high, then roll,
+// course and the raw request as wire.h strs. Returns its size, 0 if too big.
+static size_t encode_att(const AttReq *r, const char *raw, uint8_t *out, size_t cap) {
+    WireWriter w = { out, out + cap, 0 };
+    wire_put_u8(&w, (uint8_t)r->status);
+    wire_put_u32(&w, (uint32_t)r->ts);
+    wire_put_u32(&w, (uint32_t)((uint64_t)r->ts >> 32));
+    wire_put_str(&w, r->roll, strlen(r->roll));
+    wire_put_str(&w, r->course, strlen(r->course));
+    wire_put_str(&w, raw, strlen(raw));
+    return w.bad ? 0 : (size_t)(w.p - out);
+}
+
+// The reverse; raw is NUL-terminated into rawbuf. -1 if malformed.
+static int decode_att(const uint8_t *p, size_t n, AttReq *r, char *rawbuf, size_t rawcap) {
+    WireReader rd = { p, p + n, 0 };
+    memset(r, 0, sizeof *r);
+    r->status = wire_get_u8(&rd);
+    uint64_t lo = wire_get_u32(&rd), hi = wire_get_u32(&rd);
+    r->ts = (int64_t)(lo | hi << 32);
+    size_t nr, nc, nraw;
+    const char *roll = wire_get_str(&rd, &nr);
+    const char *course = wire_get_str(&rd, &nc);
+    const char *raw = wire_get_str(&rd, &nraw);
+    if (rd.bad || rd.p != rd.end || nr >= sizeof r->roll || nc >= sizeof r->course || nraw >= rawcap) return -1;
+    memcpy(r->roll, roll, nr);
+    memcpy(r->course, course, nc);
+    memcpy(rawbuf, raw, nraw); rawbuf[nraw] = 0;
+    return 0;
+}
+
+// Logger thread: the only appender of the ingest log. Rows of a batch are
+// acknowledged after one write and one fdatasync; SUMs are passed to the
+// applier along with how far the log is durable. The log's stats line goes
+// out every report_s seconds (dbtune.h), as the checkpointer's does.
+static void *logger_main(void *arg) {
+    (void)arg;
+    Pending **q = calloc((size_t)g_batch.max, sizeof *q);
+    uint8_t *rec = malloc(RECORD_MAX);
+    if (!q || !rec) { perror("malloc"); exit(1); }
+    time_t next_report = time(NULL) + g_tune.report_s;
+    WorkItem *it;
+    while ((it = mpscq_pop(&g_writeq, NULL))) {
+        int n = 0;
+        q[n++] = (Pending*)it;
+        struct timespec dl = workq_deadline(g_batch.ms);
+        while (n < g_batch.max && (it = mpscq_pop(&g_writeq, &dl))) q[n++] = (Pending*)it;
+        for (int i = 0; i < n; ++i) {
+            if (!q[i]->raw) continue;
+            size_t len = encode_att(&q[i]->req, q[i]->raw, rec, RECORD_MAX);
+            if (!len || !ilog_append(&g_log, rec, len)) snprintf(q[i]->resp, sizeof q[i]->resp, "ERR|LOG_WRITE\n");
+        }
+        uint64_t durable = ilog_sync(&g_log);
+        if (g_tune.report_s > 0 && time(NULL) >= next_report) {
+            ilog_report(&g_log, "stats");
+            next_report = time(NULL) + g_tune.report_s;
+        }
+        pthread_mutex_lock(&g_apply.mu);
+        if (durable) g_apply.durable = durable;
+        for (int i = 0; i < n; ++i) {
+            Pending *p = q[i];
+            if (p->raw && !p->resp[0])
+                snprintf(p->resp, sizeof p->resp, durable ? "OK|Recorded\n" : "ERR|LOG_WRITE\n");
+            if (!p->raw && p->req.sum) {
+                p->link.next = NULL;
+                if (g_apply.sums_tail) g_apply.sums_tail->next = &p->link; else g_apply.sums = &p->link;
+                g_apply.sums_tail = &p->link;
+            }
+        }
+        pthread_cond_signal(&g_apply.cv);
+        pthread_mutex_unlock(&g_apply.mu);
+        for (int i = 0; i < n; ++i)
+            if (q[i]->raw || !q[i]->req.sum) doneq_push(&q[i]->conn->rx->done, &q[i]->link);
+    }
+    pthread_mutex_lock(&g_apply.mu);
+    g_apply.closed = 1;
+    pthread_cond_signal(&g_apply.cv);
+    pthread_mutex_unlock(&g_apply.mu);
+    free(rec); free(q);
+    return NULL;
+}
+
+// Apply log records after *applied, up to upto and at most APPLY_BATCH, in
+// one transaction that also moves ingest_state on. Returns 0 (and advances
+// *applied) or -1 if the transaction failed and must be retried.
+static int apply_batch(StmtCache *sc, IlogCursor *cur, uint64_t upto, uint64_t *applied) {
+    if (sqlite3_exec(sc->db, "BEGIN IMMEDIATE", NULL, NULL, NULL) != SQLITE_OK) return -1;
+    uint64_t last = *applied, seq;
+    const uint8_t *p;
+    size_t n;
+    char raw[RECORD_MAX], resp[96];
+    AttReq r;
+    int k = 0, rc = 0;
+    while (k < APPLY_BATCH && (rc = ilog_next(cur, upto, &seq, &p, &n)) == 1) {
+        k++; last = seq;
+        if (decode_att(p, n, &r, raw, sizeof raw) != 0)
+            fprintf(stderr, "apply %llu: malformed record\n", (unsigned long long)seq);
+        else if (record_att(sc, &r, raw, resp, sizeof resp) != 0)
+            fprintf(stderr, "apply %llu: %s rejected %s", (unsigned long long)seq, raw, resp);
+    }
+    if (rc < 0) { fprintf(stderr, "ingest log unreadable after record %llu\n", (unsigned long long)last); exit(1); }
+    sqlite3_stmt *st = stmtcache_get(sc, Q_APPLIED_SET);
+    sqlite3_bind_int64(st, 1, (sqlite3_int64)last);
+    int ok = sqlite3_step(st) == SQLITE_DONE;
+    stmtcache_put(st);
+    if (!ok || sqlite3_exec(sc->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "apply commit: %s\n", sqlite3_errmsg(sc->db));
+        sqlite3_exec(sc->db, "ROLLBACK", NULL, NULL, NULL);
+        return -1;
+    }
+    *applied = last;
+    return 0;
+}
+
+// Applier thread: the only user of the database connection and the id
+// caches. Drains the log into SQLite, then answers the SUMs that were
+// waiting for those rows.
+static void *applier_main(void *arg) {
+    StmtCache *sc = arg;
+    uint64_t applied = (uint64_t)applied_seq(sc->db);
+    IlogCursor cur;
+    if (ilog_cursor_open(&cur, &g_log, applied + 1) != 0) { perror("malloc"); exit(1); }
+    for (;;) {
+        pthread_mutex_lock(&g_apply.mu);
+        while (!g_apply.closed && g_apply.durable == applied && !g_apply.sums)
+            pthread_cond_wait(&g_apply.cv, &g_apply.mu);
+        uint64_t durable = g_apply.durable;
+        WorkItem *sums = g_apply.sums;
+        g_apply.sums = g_apply.sums_tail = NULL;
+        int closed = g_apply.closed;
+        pthread_mutex_unlock(&g_apply.mu);
+
+        while (applied < durable) {
+            if (apply_batch(sc, &cur, durable, &applied) == 0) { ilog_release(&g_log, applied); continue; }
+            // the rollback undid the batch: reload the ids, reread it, retry
+            warm_caches(sc);
+            ilog_cursor_close(&cur);
+            if (ilog_cursor_open(&cur, &g_log, applied + 1) != 0) { perror("malloc"); exit(1); }
+            struct timespec pause = { 0, 100 * 1000000L };
+            nanosleep(&pause, NULL);
+        }
+        while (sums) {
+            Pending *p = (Pending*)sums;
+            sums = sums->next;
+            run_sum(sc, &p->req, p->resp, sizeof p->resp);
+            doneq_push(&p->conn->rx->done, &p->link);
+        }
+        if (closed && applied == durable) break;
+    }
+    ilog_cursor_close(&cur);
+    return NULL;
+}
+
+static void conn_close(Conn *c) {
+    epoll_ctl(c->rx->ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    linebuf_free(&c->in);
+    outbuf_free(&c->out);
+    c->rx->nconns--;
+    if (c->pending || c->stalled) c->dead = 1;   // on_done() / resume_stalled() frees it
+    else free(c);
+}
 
-    fd_set master, rfds; FD_ZERO(&master); FD_SET(srv, &master); int fdmax = srv;
-    char buf[MAX_LINE], resp[256];
+// Push pending output until done or EAGAIN. The fd is registered with
+// EPOLLOUT|EPOLLET, so a later writable edge resumes the flush.
+// Returns -1 if the peer is gone.
+static int conn_flush(Conn *c) {
+    while (outbuf_pending(&c->out)) {
+        ssize_t n = send(c->fd, outbuf_data(&c->out), outbuf_pending(&c->out), MSG_NOSIGNAL);
+        if (n > 0) { outbuf_consume(&c->out, (size_t)n); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return -1;
+    }
+    return 0;
+}
+
+static void conn_stall(Conn *c) {
+    if (c->stalled) return;
+    c->stalled = 1;
+    c->next_stalled = c->rx->stalled;
+    c->rx->stalled = c;
+}
 
+// Hand a row (raw != NULL), a SUM (r->sum) or an in-order reply to the logger.
+// Other loops push too, so the queue may fill after the caller checked it:
+// then the entry becomes c->held and the conn is parked; resume_stalled()
+// pushes it before anything else of the conn. -1 only if out of memory.
+static int writer_push(Conn *c, const AttReq *r, const char *raw, const char *resp) {
+    Pending *p = calloc(1, sizeof *p);
+    if (!p) return -1;
+    p->conn = c;
+    if (raw && !(p->raw = strdup(raw))) { free(p); return -1; }
+    if (r) p->req = *r;
+    else   snprintf(p->resp, sizeof p->resp, "%s", resp);
+    p->order = ++c->sent;
+    c->pending++;
+    if (mpscq_push(&g_writeq, &p->link) != 0) { c->held = p; conn_stall(c); }
+    return 0;
+}
+
+// Reply now, or behind the rows this conn still has queued.
+static int conn_reply(Conn *c, const char *resp) {
+    if (c->pending) return writer_push(c, NULL, NULL, resp);
+    return outbuf_puts(&c->out, resp);
+}
+
+// Binary mode: every complete frame goes to the logger; raw_msg_hex keeps
+// the hex of the whole frame.
+static int conn_process_frames(Conn *c) {
+    uint8_t payload[MAX_LINE], raw[MAX_LINE + WIRE_MAX_HDR], op;
+    char rawhex[2 * sizeof raw + 1], resp[256];
+    AttReq r;
     for (;;) {
-        rfds = master;
-        if (select(fdmax+1, &rfds, NULL, NULL, NULL) < 0) { perror("select"); break; }
-        for (int fd = 0; fd <= fdmax; ++fd) if (FD_ISSET(fd, &rfds)) {
-            if (fd == srv) {
-                int cfd = accept(srv, NULL, NULL);
-                if (cfd >= 0) { FD_SET(cfd, &master); if (cfd > fdmax) fdmax = cfd; }
-            } else {
-                ssize_t n = recv(fd, buf, sizeof(buf)-1, 0);
-                if (n <= 0) { close(fd); FD_CLR(fd, &master); continue; }
-                buf[n] = 0;
-                if (handle_line(db, buf, resp, sizeof resp) == 0)
-                    send(fd, resp, strlen(resp), 0);
-                else
-                    send(fd, resp, strlen(resp), 0);
+        if (c->held || mpscq_full(&g_writeq) || c->pending >= CONN_PENDING_MAX) { conn_stall(c); return 0; }
+        size_t rawlen;
+        int n = wire_next_frame(&c->in, &op, payload, sizeof payload, raw, &rawlen);
+        if (n == LB_NOLINE) return 0;
+        if (n == WIRE_BAD) {   // framing is lost; say so and drop the conn
+            outbuf_puts(&c->out, "ERR|BAD_FORMAT|Bad frame\n");
+            conn_flush(c);
+            return -1;
+        }
+        if (parse_frame(op, payload, (size_t)n, &r, resp, sizeof resp) != 0) {
+            if (conn_reply(c, resp) != 0) return -1;
+            continue;
+        }
+        hex_encode(raw, rawlen, rawhex, sizeof rawhex, 1);
+        if (writer_push(c, &r, rawhex, NULL) != 0) return -1;
+    }
+}
+
+// Handle every complete line buffered so far. Valid rows go to the logger;
+// errors are answered at once unless earlier rows are still queued. Stops
+// early (conn parked) when the logger queue is full or the conn is owed
+// CONN_PENDING_MAX replies.
+static int conn_process(Conn *c) {
+    char line[MAX_LINE], resp[256];
+    AttReq r;
+    int n;
+    while (!c->binary) {
+        if (c->held || mpscq_full(&g_writeq) || c->pending >= CONN_PENDING_MAX) { conn_stall(c); return 0; }
+        if ((n = linebuf_getline(&c->in, line, sizeof line)) == LB_NOLINE) break;
+        if (n == 0) continue;
+        if (n == LB_TOOLONG)
+            snprintf(resp, sizeof resp, "ERR|BAD_FORMAT|Line too long\n");
+        else if (strcmp(line, "BIN") == 0) {
+            snprintf(resp, sizeof resp, "OK|BIN\n");
+            c->binary = 1;
+        }
+        else if (strncmp(line, "SUM|", 4) == 0) {
+            if (parse_sum(line, &r, resp, sizeof resp) == 0) {
+                if (writer_push(c, &r, NULL, NULL) != 0) return -1;
+                continue;
             }
         }
+        else if (parse_line(line, &r, resp, sizeof resp) == 0) {
+            if (writer_push(c, &r, line, NULL) != 0) return -1;
+            continue;
+        }
+        if (conn_reply(c, resp) != 0) return -1;
+    }
+    return c->binary ? conn_process_frames(c) : 0;
+}
+
+// Drain the socket (required with EPOLLET), unless the conn gets parked.
+// Returns -1 when the conn must close.
+static int conn_on_readable(Conn *c) {
+    for (;;) {
+        char *p;
+        size_t room = linebuf_space(&c->in, &p);
+        if (room == 0) {
+            if (conn_process(c) != 0) return -1;
+            if (c->stalled) break;   // resume_stalled() reads the rest
+            continue;
+        }
+        ssize_t n = recv(c->fd, p, room, 0);
+        if (n == 0) { c->eof = 1; break; }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        linebuf_commit(&c->in, (size_t)n);
+    }
+    if (!c->stalled && conn_process(c) != 0) return -1;
+    if (conn_flush(c) != 0) return -1;
+    // answer a half-closed peer before closing
+    return c->eof && !c->pending && !c->stalled ? -1 : 0;
+}
+
+static void deliver(Conn *c, Pending *p) {
+    if (!c->dead) outbuf_puts(&c->out, p->resp);
+    free(p->raw); free(p);
+    c->pending--;
+    c->delivered++;
+}
+
+// Give finished entries back to their connections in request order: a SUM
+// comes back from the applier after the log acks of rows sent behind it, so
+// those wait in c->early until it is there. A conn is flushed once per
+// round. Conns that are done are shut down rather than closed: they may
+// still sit in this round's epoll events, and the hangup they report closes
+// them there.
+static void on_done(Reactor *rx) {
+    Conn *touched = NULL;
+    for (WorkItem *it = doneq_take(&rx->done); it; ) {
+        Pending *p = (Pending*)it;
+        Conn *c = p->conn;
+        it = it->next;
+        if (p->order != c->delivered + 1) {
+            Pending **at = &c->early;
+            while (*at && (*at)->order < p->order) at = (Pending**)&(*at)->link.next;
+            p->link.next = (WorkItem*)*at;
+            *at = p;
+            continue;
+        }
+        deliver(c, p);
+        while (c->early && c->early->order == c->delivered + 1) {
+            Pending *e = c->early;
+            c->early = (Pending*)e->link.next;
+            deliver(c, e);
+        }
+        if (!c->flushing) { c->flushing = 1; c->next_flush = touched; touched = c; }
+    }
+    while (touched) {
+        Conn *c = touched;
+        touched = c->next_flush;
+        c->flushing = 0;
+        if (c->dead) { if (!c->pending && !c->stalled) free(c); }
+        else if (conn_flush(c) != 0 || (c->eof && !c->pending && !c->stalled)) shutdown(c->fd, SHUT_RDWR);
+    }
+}
+
+// Replies drained or the retry timer ran out: let parked conns continue,
+// each with its held entry first. Those that still find no room stay parked.
+static void resume_stalled(Reactor *rx) {
+    Conn *list = rx->stalled;
+    rx->stalled = NULL;
+    while (list) {
+        Conn *c = list;
+        list = c->next_stalled;
+        c->stalled = 0;
+        if (c->dead) {
+            if (c->held) { free(c->held->raw); free(c->held); c->held = NULL; c->pending--; }
+            if (!c->pending) free(c);
+            continue;
+        }
+        if (c->held) {
+            if (mpscq_push(&g_writeq, &c->held->link) != 0) { conn_stall(c); continue; }
+            c->held = NULL;
+        }
+        if (mpscq_full(&g_writeq)) { conn_stall(c); continue; }
+        if (conn_on_readable(c) != 0) shutdown(c->fd, SHUT_RDWR);
+    }
+}
+
+static void accept_all(Reactor *rx) {
+    for (;;) {
+        int cfd = accept4(rx->srv, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE)
+                fprintf(stderr, "accept: fd limit reached at %zu conns on this loop\n", rx->nconns);
+            else if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("accept");
+            return;
+        }
+        Conn *c = calloc(1, sizeof *c);
+        if (!c || linebuf_init(&c->in, 2 * MAX_LINE) != 0) { free(c); close(cfd); continue; }
+        c->fd = cfd;
+        c->rx = rx;
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                                  .data.ptr = c };
+        if (epoll_ctl(rx->ep, EPOLL_CTL_ADD, cfd, &ev) < 0) {
+            perror("epoll_ctl"); close(cfd); linebuf_free(&c->in); free(c); continue;
+        }
+        rx->nconns++;
+    }
+}
+
+static void *reactor_main(void *arg) {
+    Reactor *rx = arg;
+    if (rx->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(rx->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof set, &set) != 0)
+            fprintf(stderr, "could not pin to CPU %d\n", rx->cpu);
     }
-    close(srv); sqlite3_close(db); return 0;
+    struct epoll_event evs[MAX_EVENTS];
+    for (;;) {
+        if (rx->stalled) resume_stalled(rx);
+        int n = epoll_wait(rx->ep, evs, MAX_EVENTS, rx->stalled ? STALL_RETRY_MS : -1);
+        if (n < 0) { if (errno == EINTR) continue; perror("epoll_wait"); break; }
+        for (int i = 0; i < n; ++i) {
+            Conn *c = evs[i].data.ptr;
+            if (!c) { accept_all(rx); continue; }
+            if (evs[i].data.ptr == &rx->done) { on_done(rx); resume_stalled(rx); continue; }
+            uint32_t e = evs[i].events;
+            int dead = (e & EPOLLERR) != 0;
+            if (!dead && (e & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)))
+                dead = conn_on_readable(c) != 0;
+            if (!dead && (e & EPOLLOUT) && outbuf_pending(&c->out))
+                dead = conn_flush(c) != 0;
+            if (dead) conn_close(c);
+        }
+    }
+    return NULL;
+}
+
+// Listening socket on ip:port; with reuseport set, every loop binds its own
+// and the kernel balances incoming connections across them.
+static int listen_on(const char *ip, int port, int reuseport) {
+    int srv = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (srv < 0) { perror("socket"); return -1; }
+    int one = 1;
+    setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (reuseport && setsockopt(srv, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one) < 0) {
+        perror("SO_REUSEPORT"); close(srv); return -1;
+    }
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET; addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1) { fprintf(stderr, "bad IP\n"); close(srv); return -1; }
+    if (bind(srv, (struct sockaddr*)&addr, sizeof addr) < 0) { perror("bind"); close(srv); return -1; }
+    if (listen(srv, SOMAXCONN) < 0) { perror("listen"); close(srv); return -1; }
+    return srv;
+}
+
+// The i-th CPU (modulo their count) this process may run on, or -1.
+static int nth_cpu(int i) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof set, &set) != 0 || CPU_COUNT(&set) < 1) return -1;
+    i %= CPU_COUNT(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &set) && i-- == 0) return cpu;
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s <bind_ip> <port> <sqlite_db_path> [--batch N] [--batch-ms T] [--log-dir DIR] [--log-seg-mb N] "
+                "[--reactors N] [--pin] [--rebuild-counts] [--migrate-dates] " DBTUNE_USAGE "\n", argv[0]);
+        return 1;
+    }
+    const char *bind_ip = argv[1]; int port = atoi(argv[2]); const char *dbp = argv[3];
+    const char *log_dir = NULL;
+    int rebuild_counts = 0, migrate = 0, seg_mb = 64, nreactors = 1, pin = 0;
+    for (int i = 4; i < argc; ++i) {
+        int r;
+        if (!strcmp(argv[i], "--rebuild-counts"))                rebuild_counts = 1;
+        else if (!strcmp(argv[i], "--migrate-dates"))            migrate = 1;
+        else if (!strcmp(argv[i], "--batch") && i + 1 < argc)    g_batch.max = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--batch-ms") && i + 1 < argc) g_batch.ms = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--log-dir") && i + 1 < argc)  log_dir = argv[++i];
+        else if (!strcmp(argv[i], "--log-seg-mb") && i + 1 < argc) seg_mb = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--reactors") && i + 1 < argc) nreactors = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--pin"))                      pin = 1;
+        else if ((r = dbtune_option(&g_tune, argc, argv, &i)) < 0) { fprintf(stderr, "bad value for %s\n", argv[i - 1]); return 1; }
+        else if (r == 0) { fprintf(stderr, "unknown option %s\n", argv[i]); return 1; }
+    }
+    if (g_batch.max < 1 || g_batch.ms < 0) { fprintf(stderr, "bad batch settings\n"); return 1; }
+    if (seg_mb < 1) { fprintf(stderr, "bad --log-seg-mb\n"); return 1; }
+    if (nreactors == 0) nreactors = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nreactors < 1 || nreactors > MAX_REACTORS) { fprintf(stderr, "--reactors must be 0..%d\n", MAX_REACTORS); return 1; }
+    char log_path[4096];
+    if (!log_dir) { snprintf(log_path, sizeof log_path, "%s-ilog", dbp); log_dir = log_path; }
+
+    sqlite3 *db = NULL; StmtCache sc;
+    if (init_db(&db, &sc, dbp, rebuild_counts, migrate) != 0) return 1;
+    if (idmap_init(&g_students, 1024) || idmap_init(&g_courses, 64) ||
+        pairset_init(&g_enrolled, 4096) || warm_caches(&sc) != 0) {
+        fprintf(stderr, "cache init failed\n"); return 1;
+    }
+    printf("Cached %zu students, %zu courses, %zu enrollments\n",
+           g_students.count, g_courses.count, g_enrolled.count);
+    int64_t applied = applied_seq(db);
+    if (applied < 0) { fprintf(stderr, "ingest_state: %s\n", sqlite3_errmsg(db)); return 1; }
+    if (ilog_open(&g_log, log_dir, (uint64_t)seg_mb << 20, (uint64_t)applied) != 0) return 1;
+    g_apply.durable = g_log.durable;
+    printf("Ingest log %s: %llu records to replay\n", log_dir,
+           (unsigned long long)(g_log.durable - (uint64_t)applied));
+    signal(SIGPIPE, SIG_IGN);
+    raise_nofile_limit();
+    if (mpscq_init(&g_writeq, WRITEQ_CAP) != 0) { fprintf(stderr, "queue init failed\n"); return 1; }
+    Checkpointer ckpt;
+    if (checkpointer_start(&ckpt, dbp, &g_tune) != 0) { fprintf(stderr, "checkpointer failed\n"); return 1; }
+    pthread_t applier, logger;
+    if (pthread_create(&applier, NULL, applier_main, &sc) != 0 ||
+        pthread_create(&logger, NULL, logger_main, NULL) != 0) { fprintf(stderr, "ingest threads failed\n"); return 1; }
+
+    Reactor *rxs = calloc((size_t)nreactors, sizeof *rxs);
+    if (!rxs) { perror("calloc"); return 1; }
+    for (int k = 0; k < nreactors; ++k) {
+        Reactor *rx = &rxs[k];
+        rx->cpu = pin ? nth_cpu(k) : -1;
+        if ((rx->srv = listen_on(bind_ip, port, nreactors > 1)) < 0) return 1;
+        if (doneq_init(&rx->done) != 0) { fprintf(stderr, "queue init failed\n"); return 1; }
+        if ((rx->ep = epoll_create1(EPOLL_CLOEXEC)) < 0) { perror("epoll_create1"); return 1; }
+        // listener is the only registration with a NULL data.ptr
+        struct epoll_event lev = { .events = EPOLLIN | EPOLLET, .data.ptr = NULL };
+        // replies from the logger and applier; &rx->done marks it apart from Conn pointers
+        struct epoll_event dev = { .events = EPOLLIN, .data.ptr = &rx->done };
+        if (epoll_ctl(rx->ep, EPOLL_CTL_ADD, rx->srv, &lev) < 0 ||
+            epoll_ctl(rx->ep, EPOLL_CTL_ADD, rx->done.efd, &dev) < 0) { perror("epoll_ctl"); return 1; }
+    }
+    printf("Server listening on %s:%d, DB=%s, batch=%d rows/%d ms, %d loop%s%s\n",
+           bind_ip, port, dbp, g_batch.max, g_batch.ms, nreactors, nreactors > 1 ? "s" : "",
+           pin ? " (pinned)" : "");
+    fflush(stdout);
+    for (int k = 0; k < nreactors; ++k)
+        if (pthread_create(&rxs[k].tid, NULL, reactor_main, &rxs[k]) != 0) { fprintf(stderr, "loop thread failed\n"); return 1; }
+    for (int k = 0; k < nreactors; ++k) pthread_join(rxs[k].tid, NULL);
+
+    mpscq_close(&g_writeq);
+    pthread_join(logger, NULL);
+    pthread_join(applier, NULL);
+    ilog_report(&g_log, "final");
+    ilog_close(&g_log);
+    checkpointer_stop(&ckpt);
+    for (int k = 0; k < nreactors; ++k) { doneq_free(&rxs[k].done); close(rxs[k].ep); close(rxs[k].srv); }
+    free(rxs);
+    mpscq_free(&g_writeq);
+    idmap_free(&g_students); idmap_free(&g_courses); pairset_free(&g_enrolled);
+    stmtcache_free(&sc); sqlite3_close(db); return 0;
 }
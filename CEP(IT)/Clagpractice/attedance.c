@@ -1,7 +1,7 @@
 // attendance.c
 // Simple CLI attendance system using SQLite3
-// Build (Linux/Mac):   gcc attendance.c -lsqlite3 -o attendance
-// Build (MSYS2 UCRT):  gcc attendance.c -lsqlite3 -o attendance.exe
+// Build (Linux/Mac):   gcc -pthread -I../common attedance.c ../common/dbtune.c -lsqlite3 -o attendance
+// Build (MSYS2 UCRT):  gcc -pthread -I../common attedance.c ../common/dbtune.c -lsqlite3 -o attendance.exe
 // Run: ./attendance attendance.db
 
 #include <stdio.h>
@@ -9,6 +9,7 @@
 #include <string.h>
 #include <time.h>
 #include <sqlite3.h>
+#include "dbtune.h"
 
 #define LINE 256
 
@@ -309,6 +310,11 @@ int main(int argc, char **argv){
     sqlite3 *db=NULL;
     int rc=sqlite3_open(argv[1], &db);
     if(rc!=SQLITE_OK) die(db,"open db", rc);
+    // WAL so the servers can share the file; one interactive writer is
+    // light enough for SQLite's own auto-checkpoint
+    DbTune tune=DBTUNE_DEFAULTS;
+    tune.checkpoint_ms=0;
+    if(dbtune_apply(db,&tune)!=0) die(db,"storage settings", SQLITE_ERROR);
 
     init_schema(db);
 
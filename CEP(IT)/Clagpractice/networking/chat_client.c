@@ -1,64 +1,286 @@
-// chat_client.c (robust)
-// gcc chat_client.c -lws2_32 -o chat_client.exe
-#define _WINSOCK_DEPRECATED_NO_WARNINGS
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#include <windows.h>
-#include <process.h>
+// chat_client.c — line chat client for chat_server (POSIX, one poll loop)
+// Build: gcc -std=c17 -O2 -Wall -Wextra -I../../common chat_client.c ../../common/netbuf.c -o chat_client
+// Run:   ./chat_client <server-ip> <port> <name> [--join ROOM]
+//        ./chat_client <server-ip> <port> <name> --bot [--join ROOM] [--every MS] [--count N]
+//
+// One poll() loop watches stdin and the socket; nothing else runs. Input
+// on either side goes through a LineBuf (netbuf.h), so a line is acted on
+// once it is complete however the reads split it: a typed line is queued
+// in an OutBuf and sent as far as the socket takes it (the rest on
+// POLLOUT), a line from the server is printed. /quit exits. At the end of
+// stdin the client keeps listening, as when launched without a console.
+//
+// The connect is non-blocking too, so a dead server never stalls the loop.
+// When the connection drops (or a connect fails or takes longer than
+// CONNECT_TIMEOUT_MS) the client tries again after a delay that starts at
+// BACKOFF_MIN_MS and doubles up to BACKOFF_MAX_MS, each one jittered by
+// up to a quarter either way so a crowd of clients does not come back in
+// step. A connection that stayed up STABLE_MS resets the delay. Each new
+// connection sends the name (the server then replays the lobby's recent
+// lines) and --join's room again. Stdin is only read while connected, so
+// lines typed (or piped in) before that wait in the tty or pipe.
+//
+// --bot runs headless for load tests: stdin is ignored and what the server
+// sends is read as fast as it comes and counted instead of printed. The
+// bot says a numbered line every --every MS milliseconds (default 1000,
+// each gap jittered by up to half; 0: only listen) and, after --count N
+// lines (default 0: no limit) or on SIGINT/SIGTERM, prints one summary
+// line to stderr and exits. One process is one connection and a few KiB,
+// so hundreds can be started from a shell loop:
+//
+//   for i in $(seq 300); do ./chat_client 127.0.0.1 5555 bot$i --bot --join load & done
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "netbuf.h"
+
+#define MAXMSG             1024
+#define MAXLINE            (MAXMSG + 128)   // the longest line the server sends
+#define CONNECT_TIMEOUT_MS 5000
+#define BACKOFF_MIN_MS     250
+#define BACKOFF_MAX_MS     30000
+#define STABLE_MS          10000
+
+enum { ST_WAIT, ST_CONNECTING, ST_UP };
+
+static struct sockaddr_in g_addr;
+static const char *g_name, *g_room;
+static int      g_bot, g_every = 1000;
+static long     g_count;
+
+static int      g_fd = -1, g_state = ST_WAIT, g_stdin = 1;
+static LineBuf  g_in, g_keys;          // from the server, from stdin
+static OutBuf   g_out;                 // to the server, not yet sent
+static int64_t  g_deadline;            // ST_WAIT: connect then; ST_CONNECTING: give up then
+static int64_t  g_up_since, g_next_say;
+static int      g_backoff = BACKOFF_MIN_MS;
+static long     g_said, g_heard, g_retries;
+static volatile sig_atomic_t g_stop;
+
+static void die(const char *m) { fprintf(stderr, "%s\n", m); exit(1); }
+
+static int64_t now_ms(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// ms, give or take up to ms/div.
+static int64_t jitter(int64_t ms, int div) {
+    int64_t span = ms / div;
+    return span ? ms - span + rand() % (2 * span + 1) : ms;
+}
+
+static void on_signal(int sig) { (void)sig; g_stop = 1; }
+
+static void queue_line(const char *text) {
+    if (outbuf_puts(&g_out, text) != 0 || outbuf_puts(&g_out, "\n") != 0) die("out of memory");
+}
+
+// The connection is gone (or never came): close it and schedule the next try.
+static void lost(const char *why) {
+    if (g_state == ST_UP && now_ms() - g_up_since >= STABLE_MS) g_backoff = BACKOFF_MIN_MS;
+    close(g_fd);
+    g_fd = -1;
+    g_state = ST_WAIT;
+    outbuf_consume(&g_out, outbuf_pending(&g_out));
+    int64_t wait = jitter(g_backoff, 4);
+    g_deadline = now_ms() + wait;
+    if (g_backoff < BACKOFF_MAX_MS) g_backoff = g_backoff * 2 < BACKOFF_MAX_MS ? g_backoff * 2 : BACKOFF_MAX_MS;
+    g_retries++;
+    if (!g_bot) { printf("[%s, reconnecting in %.1f s]\n", why, wait / 1000.0); fflush(stdout); }
+}
+
+static void on_connected(void) {
+    g_state = ST_UP;
+    g_up_since = now_ms();
+    linebuf_free(&g_in);   // nothing of the last connection's partial line
+    if (linebuf_init(&g_in, 4 * MAXLINE) != 0) die("out of memory");
+    queue_line(g_name);
+    if (g_room) {
+        char join[64];
+        snprintf(join, sizeof join, "/join %s", g_room);
+        queue_line(join);
+    }
+    g_next_say = g_up_since + (g_every ? jitter(g_every, 2) : 0);
+    if (!g_bot) { puts("[connected] Type messages. Use /quit to exit."); fflush(stdout); }
+}
 
-#pragma comment(lib, "ws2_32.lib")
-#define MAXMSG 1024
+static void start_connect(void) {
+    g_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (g_fd < 0) die("socket failed");
+    int one = 1;
+    setsockopt(g_fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof one);
+    setsockopt(g_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    if (connect(g_fd, (struct sockaddr *)&g_addr, sizeof g_addr) == 0) { on_connected(); return; }
+    if (errno != EINPROGRESS) { lost("connect failed"); return; }
+    g_state = ST_CONNECTING;
+    g_deadline = now_ms() + CONNECT_TIMEOUT_MS;
+}
 
-typedef struct { SOCKET sock; volatile int running; } ctx_t;
+// POLLOUT on a connecting socket: it either connected or failed.
+static void finish_connect(void) {
+    int err = 0;
+    socklen_t len = sizeof err;
+    if (getsockopt(g_fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) lost("connect failed");
+    else on_connected();
+}
 
-unsigned __stdcall recv_thread(void* arg){
-    ctx_t* c=(ctx_t*)arg; char buf[MAXMSG+1];
-    while(c->running){
-        int n=recv(c->sock,buf,MAXMSG,0);
-        if(n<=0){ puts("\n[disconnected from server]"); c->running=0; break; }
-        buf[n]=0; fputs(buf,stdout); fflush(stdout);
+// Send what the socket takes now. -1 if the connection is broken.
+static int flush_out(void) {
+    while (outbuf_pending(&g_out)) {
+        ssize_t w = send(g_fd, outbuf_data(&g_out), outbuf_pending(&g_out), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        outbuf_consume(&g_out, (size_t)w);
     }
     return 0;
 }
 
-int main(int argc, char** argv){
-    if(argc<4){ fprintf(stderr,"Usage: %s <server-ipv4> <port> <YourName>\n",argv[0]); return 1; }
-    const char* host=argv[1]; int port=atoi(argv[2]); const char* name=argv[3];
+static void print_lines(void) {
+    char line[MAXLINE + 1];
+    int n;
+    while ((n = linebuf_getline(&g_in, line, sizeof line)) != LB_NOLINE) {
+        g_heard++;
+        if (g_bot) continue;
+        if (n == LB_TOOLONG) fputs("[line too long, not shown]\n", stdout);
+        else { fputs(line, stdout); fputc('\n', stdout); }
+    }
+}
 
-    WSADATA wsa; if(WSAStartup(MAKEWORD(2,2),&wsa)!=0){ fputs("WSAStartup failed\n",stderr); return 1; }
+// Drain the socket. -1 once the server is gone.
+static int on_readable(void) {
+    for (;;) {
+        char *room;
+        size_t cap = linebuf_space(&g_in, &room);
+        if (cap == 0) { print_lines(); continue; }
+        ssize_t n = recv(g_fd, room, cap, 0);
+        if (n == 0) { print_lines(); return -1; }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        linebuf_commit(&g_in, (size_t)n);
+    }
+    print_lines();
+    if (!g_bot) fflush(stdout);
+    return 0;
+}
 
-    SOCKET s=socket(AF_INET,SOCK_STREAM,0); if(s==INVALID_SOCKET){ fputs("socket failed\n",stderr); return 1; }
+// Read what is typed; whole lines go out. Only polled while connected.
+static void on_stdin(void) {
+    char *room;
+    size_t cap = linebuf_space(&g_keys, &room);
+    ssize_t n = cap ? read(STDIN_FILENO, room, cap) : 0;
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return;
+    if (n <= 0 && cap) { g_stdin = 0; return; }   // EOF: keep listening
+    if (n > 0) linebuf_commit(&g_keys, (size_t)n);
+    char line[MAXMSG + 1];
+    int k;
+    while ((k = linebuf_getline(&g_keys, line, sizeof line)) != LB_NOLINE) {
+        if (k == LB_TOOLONG) { puts("[line too long, not sent]"); continue; }
+        if (k == 0) continue;
+        if (strcmp(line, "/quit") == 0) { g_stop = 1; return; }
+        queue_line(line);
+    }
+    fflush(stdout);
+}
 
-    // enable TCP keepalive
-    BOOL ka=TRUE; setsockopt(s,SOL_SOCKET,SO_KEEPALIVE,(char*)&ka,sizeof(ka));
+// Whether the bot has lines left to say.
+static int talking(void) {
+    return g_every && (!g_count || g_said < g_count);
+}
 
-    struct sockaddr_in srv; srv.sin_family=AF_INET; srv.sin_port=htons((u_short)port); srv.sin_addr.s_addr=inet_addr(host);
-    if(connect(s,(struct sockaddr*)&srv,sizeof(srv))==SOCKET_ERROR){ fputs("connect failed (IP/port/firewall?)\n",stderr); closesocket(s); WSACleanup(); return 1; }
+// --bot: say the next line if it is time.
+static void bot_tick(int64_t now) {
+    if (g_state != ST_UP || !talking() || now < g_next_say) return;
+    char line[128];
+    snprintf(line, sizeof line, "%s line %ld", g_name, ++g_said);
+    queue_line(line);
+    g_next_say = now + jitter(g_every, 2);
+}
 
-    // send name first (as server expects)
-    send(s,name,(int)strlen(name),0); send(s,"\n",1,0);
-    puts("[connected] Type messages. Use /quit to exit.");
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s <server-ip> <port> <name> [--join ROOM] [--bot [--every MS] [--count N]]\n", argv[0]);
+        return 1;
+    }
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons((uint16_t)atoi(argv[2]));
+    if (inet_pton(AF_INET, argv[1], &g_addr.sin_addr) != 1) die("bad server address");
+    g_name = argv[3];
+    for (int i = 4; i < argc; ++i) {
+        if (strcmp(argv[i], "--bot") == 0) g_bot = 1;
+        else if (strcmp(argv[i], "--join") == 0 && i + 1 < argc) g_room = argv[++i];
+        else if (strcmp(argv[i], "--every") == 0 && i + 1 < argc) g_every = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) g_count = atol(argv[++i]);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 1; }
+    }
+    if (!*g_name || strlen(g_name) > 63) die("name must be 1-63 bytes");
+    if (g_room && strlen(g_room) > 31) die("room names are at most 31 bytes");
+    if (g_every < 0 || g_count < 0) die("bad --every or --count");
+    if (!g_bot) g_every = 0;
+    srand((unsigned)(getpid() ^ now_ms()));
 
-    ctx_t ctx; ctx.sock=s; ctx.running=1;
-    uintptr_t th=_beginthreadex(NULL,0,recv_thread,&ctx,0,NULL); if(!th){ fputs("thread create failed\n",stderr); closesocket(s); WSACleanup(); return 1; }
+    struct sigaction sa = { .sa_handler = on_signal };   // no SA_RESTART: poll returns
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    if (linebuf_init(&g_in, 4 * MAXLINE) != 0 || linebuf_init(&g_keys, 2 * MAXMSG) != 0) die("out of memory");
+    if (g_bot) g_stdin = 0;   // otherwise left blocking: poll says when a read will not wait
 
-    // main loop: try to read stdin; if EOF, just sleep & keep connection alive
-    char line[MAXMSG];
-    while(ctx.running){
-        if(fgets(line,sizeof(line),stdin)){
-            if(strncmp(line,"/quit",5)==0) break;
-            int len=(int)strlen(line);
-            if(len>0 && send(s,line,len,0)<=0){ puts("[send failed]"); break; }
-        }else{
-            // stdin closed (e.g., launched without console): keep connection alive
-            Sleep(200);
+    start_connect();
+    while (!g_stop) {
+        int64_t now = now_ms();
+        if (g_state == ST_WAIT && now >= g_deadline) { start_connect(); continue; }
+        if (g_state == ST_CONNECTING && now >= g_deadline) { lost("connect timed out"); continue; }
+        if (g_bot) bot_tick(now);
+        if (g_state == ST_UP && flush_out() != 0) { lost("disconnected from server"); continue; }
+        if (g_bot && g_every && !talking() && !outbuf_pending(&g_out)) break;   // --count said
+
+        struct pollfd pfd[2];
+        int n = 0, sock = -1, keys = -1;
+        if (g_state != ST_WAIT) {
+            short ev = g_state == ST_CONNECTING ? POLLOUT : POLLIN | (outbuf_pending(&g_out) ? POLLOUT : 0);
+            sock = n;
+            pfd[n++] = (struct pollfd){ g_fd, ev, 0 };
+        }
+        if (g_stdin && g_state == ST_UP) { keys = n; pfd[n++] = (struct pollfd){ STDIN_FILENO, POLLIN, 0 }; }
+        int64_t wake = g_state != ST_UP ? g_deadline : talking() ? g_next_say : -1;
+        int timeout = wake < 0 ? -1 : wake > now ? (int)(wake - now) : 0;
+        if (poll(pfd, (nfds_t)n, timeout) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
         }
+        if (keys >= 0 && pfd[keys].revents) on_stdin();
+        if (sock < 0 || !pfd[sock].revents) continue;
+        if (g_state == ST_CONNECTING) { finish_connect(); continue; }
+        if ((pfd[sock].revents & (POLLIN | POLLHUP | POLLERR)) && on_readable() != 0) lost("disconnected from server");
     }
 
-    ctx.running=0; shutdown(s,SD_BOTH); closesocket(s);
-    WaitForSingleObject((HANDLE)th,INFINITE); CloseHandle((HANDLE)th);
-    WSACleanup(); return 0;
+    if (g_state == ST_UP) {
+        flush_out();
+        shutdown(g_fd, SHUT_WR);
+    }
+    if (g_fd >= 0) close(g_fd);
+    if (g_bot) fprintf(stderr, "%s: said %ld lines, heard %ld, connection lost or refused %ld times\n", g_name, g_said, g_heard, g_retries);
+    linebuf_free(&g_in); linebuf_free(&g_keys); outbuf_free(&g_out);
+    return 0;
 }
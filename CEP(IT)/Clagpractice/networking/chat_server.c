@@ -1,156 +1,1081 @@
-// chat_server.c (fixed)
-// Build:  gcc chat_server.c -lws2_32 -o chat_server.exe
-// Run:    chat_server.exe 0.0.0.0 5555
+// chat_server.c — multi-room chat over TCP (POSIX, epoll, room worker threads)
+// Build:  gcc -std=c17 -O2 -Wall -Wextra -pthread -I../../common chat_server.c ../../common/netbuf.c ../../common/workq.c ../../common/mpscring.c -o chat_server
+// Run:    ./chat_server 0.0.0.0 5555 [--workers N] [--max-clients N] [--sendq-max BYTES]
+//                        [--policy disconnect|drop-oldest|coalesce] [--history N] [--history-bytes B]
+//
+// Protocol: lines ending in '\n'. A client's first non-empty line is its
+// name. Everyone starts in room "lobby"; a plain line goes to the other
+// members of the room joined last, as "#room name: line". Commands:
+//   /join ROOM     join ROOM (up to 31 of A-Z a-z 0-9 _ -) and talk there;
+//                  a client is in at most MAX_JOINED rooms
+//   /leave [ROOM]  leave ROOM (default: the current one); talk goes back to
+//                  the room joined before it
+//   /since N       the current room's kept lines from number N on (0: all)
+//   /stats         the sender's send-queue counters and the server's totals
+// Members see "[server] NAME joined #room" / "... left #room"; sending a
+// name counts as joining the lobby. A client that never sends one stays in
+// the lobby and receives everything said there without being announced.
+// A named client joining a room (the lobby: sending its name) first gets
+// the room's recent lines.
+//
+// Fan-out: a message is formatted once into a Msg, an immutable buffer with
+// a reference count, and each recipient's send queue takes a reference to
+// it rather than a copy. One edge-triggered epoll loop reads and parses;
+// every client that got something during a wakeup is then flushed once,
+// with writev over its queued messages (IOV_BATCH at a time, the first one
+// from where a short write left off), and what the socket does not take
+// waits for EPOLLOUT. A client drops its reference once the last byte of
+// the message is written to it, and the last reference frees the Msg. A
+// slow reader thus only holds on to references and delays nobody else.
+// chatbench.c measures the fan-out rate.
+//
+// Rooms: the I/O thread owns the sockets and send queues, and --workers N
+// threads (default 2) own the rooms. Room R lives on worker hash(R) % N,
+// in that worker's hash table, its members a dense array of client handles
+// (slot and generation): a join appends, a leave swaps the last member
+// into the gap. The loop hands joins, leaves and lines to the room's worker
+// through the worker's MpscQueue (workq.h), in RoomOps from an ObjPool
+// (mpscring.h); the worker answers with Deliveries, a Msg plus the handles
+// to queue it for, through a DoneRing whose eventfd is in the epoll set.
+// Neither direction takes a lock. What the loop answers itself (/leave,
+// /stats, errors) also goes as an op, to the worker that has the client's
+// latest one, so it arrives behind that op's answer; only answers from two
+// different workers can still cross. Ops a full worker queue refuses wait,
+// in order, on a backlog the loop retries every millisecond; a worker whose
+// answer does not fit waits for the loop. Client slots come off a free
+// list, and since a handle whose slot has been reused no longer resolves, a
+// slot is free again the moment its client is closed.
+//
+// Slow consumers: a send queue holds at most --sendq-max bytes (default
+// 256 KiB). A message that would take it past that mark is handled by
+// --policy:
+//   disconnect    close the client (the default)
+//   drop-oldest   drop the oldest queued messages until the new one fits
+//   coalesce      drop everything still queued and send one line saying
+//                 how many messages were skipped, then the new one
+// A message already partly written is never dropped, so the stream stays
+// line-aligned. Each client counts its queued bytes, their peak and its
+// dropped messages; /stats shows them.
+//
+// History: each room keeps its last --history lines (default 64) in one
+// block allocated with the room, so a room's memory never grows: the text
+// back to back in a byte ring of --history-bytes (default 16 KiB; the
+// oldest lines go when a new one does not fit) and the lengths in a ring
+// indexed by line number. Lines are numbered per room from 1. A replay is
+// copied out of the ring into one Msg, header included, which then goes
+// out in the client's next writev like any other message. The history
+// goes with the room when its last member leaves. /stats shows the sizes
+// and what all rooms' history blocks take.
 
-#define _WINSOCK_DEPRECATED_NO_WARNINGS
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#define _GNU_SOURCE   // accept4
+#include <arpa/inet.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
-#pragma comment(lib, "ws2_32.lib")
+#include "mpscring.h"
+#include "netbuf.h"
+#include "workq.h"
 
-#define MAXMSG 1024
-#define MAX_CLIENTS 128
+#define MAXMSG      1024
+#define MAX_EVENTS  256
+#define IOV_BATCH   64     // messages per writev
+#define SENDQ_MIN   16
+#define SENDQ_FLOOR (8 * (MAXMSG + 128))   // smallest --sendq-max
+#define ROOM_MAX    32     // room name bytes, NUL included
+#define MAX_JOINED  16     // rooms per client
+#define MAX_WORKERS 64
+#define WORKER_QUEUE 4096  // RoomOps waiting for one worker
+#define INBOX       8192   // Deliveries waiting for the loop
+#define OP_POOL     4096
+#define HAND_BATCH  256    // Deliveries a worker holds at most before handing them back
+
+enum { OP_JOIN, OP_LEAVE, OP_SAY, OP_SINCE, OP_REPLY, OP_STATS };
+
+enum { POLICY_DISCONNECT, POLICY_DROP_OLDEST, POLICY_COALESCE, POLICIES };
+static const char *const POLICY[POLICIES] = { "disconnect", "drop-oldest", "coalesce" };
+
+typedef struct {
+    int    refs;   // send queues holding it
+    size_t len;
+    char   data[];
+} Msg;
+
+// The loop's request to a room's worker.
+typedef struct {
+    WorkItem link;     // first, for the queues; next links the backlog
+    int      kind;     // OP_*
+    int      quiet;    // join or leave without an announcement; a line not
+                       // kept in history; a /since without "nothing" reply
+    int      last;     // the loop's last op for this worker in its wakeup
+    uint64_t who;      // the client's handle
+    uint64_t seq;      // OP_SINCE: the first line wanted
+    Msg     *msg;      // OP_SAY, OP_REPLY; OP_STATS: the loop's half
+    char     room[ROOM_MAX];
+    char     name[64];
+} RoomOp;
+
+// A room's members: a dense array of handles. Deliveries share it rather
+// than copy it, so a room changes a shared Roster by replacing it.
+typedef struct {
+    int      refs;     // the room's and in-flight Deliveries' (atomic)
+    uint32_t n, cap;
+    uint64_t h[];
+} Roster;
+
+// A worker's answer: queue msg for everyone in to but except, or for one.
+typedef struct {
+    WorkItem link;
+    Msg     *msg;
+    int      log;      // an announcement: echo it to stdout
+    Roster  *to;       // NULL: just for one
+    uint64_t except, one;
+} Delivery;
+
+// A room's last lines: the text in a byte ring, the lengths in a ring of
+// --history entries. Both live in the room's own allocation.
+typedef struct {
+    uint64_t  next;         // the next line's number; the oldest kept is next - n
+    uint32_t  n;            // lines kept
+    size_t    head, used;   // the oldest line's offset in text, bytes kept
+    uint16_t *len;          // [number % --history]
+    char     *text;         // --history-bytes
+} History;
+
+typedef struct Room {
+    struct Room *next;      // hash chain
+    char         name[ROOM_MAX];
+    Roster      *members;
+    History      hist;
+} Room;
 
 typedef struct {
-    SOCKET sock;
-    char   name[64];  // empty until first message sets it
+    pthread_t tid;
+    MpscQueue in;
+    WorkItem *backlog, *backlog_tail;   // loop only: ops the queue refused
+    RoomOp   *held;                     // loop only: the wakeup's latest op
+    Room    **buckets;                  // worker only
+    size_t    nbuckets;
+    WorkItem *done, **done_tail;        // worker only: Deliveries not handed back yet
+    int       ndone;
+    size_t    rooms, members;           // for /stats (atomic)
+} Worker;
+
+typedef struct {
+    Msg  **q;       // ring of cap entries, cap a power of two
+    size_t head, count, cap;
+    size_t off;     // bytes of q[head] already written
+    size_t bytes;   // queued and not yet written
+    size_t peak;    // highest bytes so far
+    unsigned long dropped, dropped_bytes;
+} SendQ;
+
+typedef struct Client {
+    int            fd;
+    uint32_t       slot, gen;  // its handle
+    int            dirty;      // on g_dirty
+    int            dead;       // on g_dead
+    SendQ          out;
+    struct Client *next_dirty, *next_dead;
+    LineBuf        in;
+    char           name[64];   // empty until the first line sets it
+    int            nrooms;
+    char           rooms[MAX_JOINED][ROOM_MAX];   // joined; talk goes to the last
+    Worker        *tail;       // has its latest op; replies go in behind it
 } Client;
 
+static Client  **g_slots;        // [slot]: its client, or NULL
+static uint32_t *g_gens;         // [slot]: generation, bumped when it is freed
+static uint32_t *g_free;         // free slots, a stack
+static int       g_nfree, g_nclients, g_max_clients = 16384;
+static Worker    g_workers[MAX_WORKERS];
+static int       g_nworkers = 2, g_backlogged;
+static DoneRing  g_inbox;        // Deliveries from the workers
+static ObjPool   g_ops;          // RoomOps: the loop takes, workers give back
+static Client  *g_dirty;         // queued something since the last flush
+static Client  *g_dead;          // to be closed once the wakeup is done
+static size_t   g_sendq_max = 256 * 1024;
+static int      g_policy = POLICY_DISCONNECT;
+static int      g_hist_lines = 64;
+static size_t   g_hist_bytes = 16 * 1024;
+static size_t   g_queued;        // over all send queues
+static unsigned long g_dropped, g_slow_closed;
+
 static void die(const char* m) { fprintf(stderr, "%s\n", m); exit(1); }
 
-static void broadcast(Client clients[], int n, SOCKET except, const char* msg) {
-    for (int i = 0; i < n; ++i) {
-        if (clients[i].sock != INVALID_SOCKET && clients[i].sock != except) {
-            send(clients[i].sock, msg, (int)strlen(msg), 0);
+// Format once; the text is cut at MAXMSG+127 bytes but always ends in '\n'.
+static Msg *msg_new(const char *fmt, ...) {
+    char tmp[MAXMSG + 128];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof tmp, fmt, ap);
+    va_end(ap);
+    if (n <= 0) return NULL;
+    if ((size_t)n >= sizeof tmp) { n = sizeof tmp - 1; tmp[n - 1] = '\n'; }
+    Msg *m = malloc(sizeof *m + (size_t)n);
+    if (!m) return NULL;
+    m->refs = 0;
+    m->len = (size_t)n;
+    memcpy(m->data, tmp, (size_t)n);
+    return m;
+}
+
+static void msg_unref(Msg *m) {
+    if (--m->refs == 0) free(m);
+}
+
+static void kill_client(Client *c) {
+    if (c->dead) return;
+    c->dead = 1;
+    c->next_dead = g_dead;
+    g_dead = c;
+}
+
+static void mark_dirty(Client *c) {
+    if (c->dirty) return;
+    c->dirty = 1;
+    c->next_dirty = g_dirty;
+    g_dirty = c;
+}
+
+static int sendq_grow(SendQ *q) {
+    size_t cap = q->cap ? q->cap * 2 : SENDQ_MIN;
+    Msg **nq = malloc(cap * sizeof *nq);
+    if (!nq) return -1;
+    for (size_t i = 0; i < q->count; ++i) nq[i] = q->q[(q->head + i) & (q->cap - 1)];
+    free(q->q);
+    q->q = nq;
+    q->cap = cap;
+    q->head = 0;
+    return 0;
+}
+
+static int sendq_push(SendQ *q, Msg *m) {
+    if (q->count == q->cap && sendq_grow(q) != 0) return -1;
+    q->q[(q->head + q->count++) & (q->cap - 1)] = m;
+    q->bytes += m->len;
+    if (q->bytes > q->peak) q->peak = q->bytes;
+    g_queued += m->len;
+    m->refs++;
+    return 0;
+}
+
+// Drop the oldest message nothing of which is written yet. 0 if there is none.
+static size_t sendq_drop_oldest(SendQ *q) {
+    size_t first = q->off ? 1 : 0;   // a started message stays at the head
+    if (q->count <= first) return 0;
+    size_t at = (q->head + first) & (q->cap - 1);
+    Msg *m = q->q[at];
+    if (first) q->q[at] = q->q[q->head];
+    q->head = (q->head + 1) & (q->cap - 1);
+    q->count--;
+    size_t len = m->len;
+    q->bytes -= len;
+    g_queued -= len;
+    q->dropped++;
+    q->dropped_bytes += len;
+    g_dropped++;
+    msg_unref(m);
+    return len;
+}
+
+// Taking need more bytes would put c's queue over --sendq-max: apply the
+// policy. -1 if c is being closed instead.
+static int make_room(Client *c, size_t need) {
+    SendQ *q = &c->out;
+    if (g_policy == POLICY_DISCONNECT) {
+        printf("[server] %s: over %zu queued bytes, disconnecting\n", c->name[0] ? c->name : "(unnamed)", g_sendq_max);
+        g_slow_closed++;
+        kill_client(c);
+        return -1;
+    }
+    if (g_policy == POLICY_DROP_OLDEST) {
+        while (q->bytes + need > g_sendq_max && sendq_drop_oldest(q)) {}
+        return 0;
+    }
+    unsigned long skipped = q->dropped;
+    while (sendq_drop_oldest(q)) {}
+    skipped = q->dropped - skipped;
+    if (skipped) {
+        Msg *note = msg_new("[server] %lu messages skipped (you are behind)\n", skipped);
+        if (!note) return 0;
+        note->refs++;
+        if (sendq_push(q, note) != 0) { msg_unref(note); kill_client(c); return -1; }
+        msg_unref(note);
+    }
+    return 0;
+}
+
+// Queue a reference to m for c, within --sendq-max. A client whose queue
+// cannot grow is closed.
+static void enqueue(Client *c, Msg *m) {
+    SendQ *q = &c->out;
+    if (q->bytes + m->len > g_sendq_max && make_room(c, m->len) != 0) return;
+    if (sendq_push(q, m) != 0) { kill_client(c); return; }
+    mark_dirty(c);
+}
+
+// n more bytes are written: drop the messages they finish.
+static void sendq_consume(SendQ *q, size_t n) {
+    q->bytes -= n;
+    g_queued -= n;
+    while (n) {
+        Msg *m = q->q[q->head];
+        size_t left = m->len - q->off;
+        if (n < left) { q->off += n; return; }
+        n -= left;
+        q->off = 0;
+        q->head = (q->head + 1) & (q->cap - 1);
+        q->count--;
+        msg_unref(m);
+    }
+}
+
+static void sendq_free(SendQ *q) {
+    g_queued -= q->bytes;
+    while (q->count) {
+        msg_unref(q->q[q->head]);
+        q->head = (q->head + 1) & (q->cap - 1);
+        q->count--;
+    }
+    free(q->q);
+}
+
+// Write until the queue is empty or the socket is full; EPOLLOUT resumes.
+static int flush_client(Client *c) {
+    SendQ *q = &c->out;
+    while (q->count) {
+        struct iovec iov[IOV_BATCH];
+        int n = 0;
+        for (size_t i = 0; i < q->count && n < IOV_BATCH; ++i) {
+            Msg *m = q->q[(q->head + i) & (q->cap - 1)];
+            size_t skip = i == 0 ? q->off : 0;
+            iov[n++] = (struct iovec){ m->data + skip, m->len - skip };
+        }
+        ssize_t w = writev(c->fd, iov, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
         }
+        sendq_consume(q, (size_t)w);
+    }
+    return 0;
+}
+
+// Generations start at 1, so no handle is 0.
+static uint64_t handle_of(const Client *c) {
+    return (uint64_t)c->gen << 32 | c->slot;
+}
+
+// The client a handle names, or NULL once it is gone.
+static Client *client_of(uint64_t h) {
+    uint32_t slot = (uint32_t)h;
+    Client *c = slot < (uint32_t)g_max_clients ? g_slots[slot] : NULL;
+    return c && c->gen == (uint32_t)(h >> 32) && !c->dead ? c : NULL;
+}
+
+static uint32_t room_hash(const char *s) {   // FNV-1a
+    uint32_t h = 2166136261u;
+    while (*s) { h ^= (uint8_t)*s++; h *= 16777619u; }
+    return h;
+}
+
+static Worker *room_worker(const char *room) {
+    return &g_workers[room_hash(room) % (uint32_t)g_nworkers];
+}
+
+static void roster_unref(Roster *r) {
+    if (__atomic_sub_fetch(&r->refs, 1, __ATOMIC_ACQ_REL) == 0) free(r);
+}
+
+// ---- room workers ----
+
+// r's roster with room for one more member, unshared. NULL if out of memory.
+static Roster *roster_for_change(Room *r) {
+    Roster *o = r->members;
+    int shared = o && __atomic_load_n(&o->refs, __ATOMIC_ACQUIRE) > 1;
+    if (o && !shared && o->n < o->cap) return o;
+    uint32_t cap = !o ? 8 : o->n < o->cap ? o->cap : o->cap * 2;
+    Roster *nr;
+    if (o && !shared) {
+        if (!(nr = realloc(o, sizeof *nr + cap * sizeof *nr->h))) return NULL;
+    } else {
+        if (!(nr = malloc(sizeof *nr + cap * sizeof *nr->h))) return NULL;
+        nr->refs = 1;
+        nr->n = o ? o->n : 0;
+        if (o) { memcpy(nr->h, o->h, o->n * sizeof *o->h); roster_unref(o); }
     }
+    nr->cap = cap;
+    r->members = nr;
+    return nr;
 }
 
-int main(int argc, char** argv) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <bind-ip> <port>\nExample: %s 0.0.0.0 5555\n", argv[0], argv[0]);
-        return 1;
+static size_t room_bucket(const Worker *w, const char *name) {
+    return (room_hash(name) / (uint32_t)g_nworkers) & (w->nbuckets - 1);
+}
+
+// The link that points at room name, or the end of its chain.
+static Room **room_find(Worker *w, const char *name) {
+    Room **p = &w->buckets[room_bucket(w, name)];
+    while (*p && strcmp((*p)->name, name) != 0) p = &(*p)->next;
+    return p;
+}
+
+static void rooms_grow(Worker *w) {
+    size_t nb = w->nbuckets * 2;
+    Room **b = calloc(nb, sizeof *b);
+    if (!b) return;   // longer chains, nothing worse
+    Room **old = w->buckets;
+    size_t nold = w->nbuckets;
+    w->buckets = b;
+    w->nbuckets = nb;
+    for (size_t i = 0; i < nold; ++i) {
+        for (Room *r = old[i], *next; r; r = next) {
+            next = r->next;
+            Room **head = &b[room_bucket(w, r->name)];
+            r->next = *head;
+            *head = r;
+        }
     }
-    const char* bind_ip = argv[1];
-    int port = atoi(argv[2]);
+    free(old);
+}
 
-    WSADATA wsa;
-    if (WSAStartup(MAKEWORD(2,2), &wsa) != 0) die("WSAStartup failed");
+// Bytes of one room's history block.
+static size_t history_size(void) {
+    return g_hist_lines ? (size_t)g_hist_lines * sizeof(uint16_t) + g_hist_bytes : 0;
+}
 
-    SOCKET listen_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_sock == INVALID_SOCKET) die("socket failed");
+// A room with its history block, or NULL if out of memory.
+static Room *room_new(const char *name) {
+    Room *r = malloc(sizeof *r + history_size());
+    if (!r) return NULL;
+    memset(r, 0, sizeof *r);
+    memcpy(r->name, name, sizeof r->name);
+    r->hist.next = 1;
+    r->hist.len = (uint16_t *)(r + 1);
+    r->hist.text = (char *)(r->hist.len + g_hist_lines);
+    return r;
+}
 
-    int opt = 1;
-    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
+// len bytes at at in the text ring, wrapping at its end.
+static void ring_put(char *text, size_t at, const char *src, size_t len) {
+    size_t first = g_hist_bytes - at < len ? g_hist_bytes - at : len;
+    memcpy(text + at, src, first);
+    memcpy(text, src + first, len - first);
+}
 
-    struct sockaddr_in addr;
-    addr.sin_family = AF_INET;
-    addr.sin_port   = htons((u_short)port);
-    addr.sin_addr.s_addr = inet_addr(bind_ip);
+static void ring_get(char *dst, const char *text, size_t at, size_t len) {
+    size_t first = g_hist_bytes - at < len ? g_hist_bytes - at : len;
+    memcpy(dst, text + at, first);
+    memcpy(dst + first, text, len - first);
+}
 
-    if (bind(listen_sock, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) die("bind failed");
-    if (listen(listen_sock, SOMAXCONN) == SOCKET_ERROR) die("listen failed");
+// Keep line m, dropping the oldest lines until it fits. A line is at most
+// MAXMSG+127 bytes (msg_new) and --history-bytes no less than MAXMSG+128.
+static void history_add(History *h, const Msg *m) {
+    if (!g_hist_lines) return;
+    while (h->n && (h->n == (uint32_t)g_hist_lines || h->used + m->len > g_hist_bytes)) {
+        size_t old = h->len[(h->next - h->n) % (uint64_t)g_hist_lines];
+        h->head = (h->head + old) % g_hist_bytes;
+        h->used -= old;
+        h->n--;
+    }
+    ring_put(h->text, (h->head + h->used) % g_hist_bytes, m->data, m->len);
+    h->len[h->next % (uint64_t)g_hist_lines] = (uint16_t)m->len;
+    h->used += m->len;
+    h->n++;
+    h->next++;
+}
 
-    printf("Chat server listening on %s:%d ...\n", bind_ip, port);
+// r's lines from number from on, under a header line, as one Msg. NULL if
+// there are none (or no memory).
+static Msg *history_since(const Room *r, uint64_t from) {
+    const History *h = &r->hist;
+    uint64_t first = h->next - h->n;
+    if (from < first) from = first;
+    if (from >= h->next) return NULL;
+    size_t at = h->head, len = 0;
+    for (uint64_t i = first; i < h->next; ++i) {
+        size_t l = h->len[i % (uint64_t)g_hist_lines];
+        if (i < from) at = (at + l) % g_hist_bytes;
+        else len += l;
+    }
+    char head[96];
+    int hn = snprintf(head, sizeof head, "[server] #%s lines %" PRIu64 "-%" PRIu64 ":\n", r->name, from, h->next - 1);
+    Msg *m = malloc(sizeof *m + (size_t)hn + len);
+    if (!m) return NULL;
+    m->refs = 0;
+    m->len = (size_t)hn + len;
+    memcpy(m->data, head, (size_t)hn);
+    ring_get(m->data + hn, h->text, at, len);
+    return m;
+}
 
-    Client clients[MAX_CLIENTS];
-    for (int i=0;i<MAX_CLIENTS;++i){ clients[i].sock = INVALID_SOCKET; clients[i].name[0]=0; }
+// Deliveries go back in batches, one per wakeup of the loop that sent the
+// ops: one wakeup of the loop for all of them, and one writev per client.
+static void hand_back(Worker *w, Delivery *d) {
+    d->link.next = NULL;
+    *w->done_tail = &d->link;
+    w->done_tail = &d->link.next;
+    w->ndone++;
+}
 
-    fd_set readfds;
-    while (1) {
-        // build fd set
-        FD_ZERO(&readfds);
-        FD_SET(listen_sock, &readfds);
-        SOCKET maxsock = listen_sock;
-        for (int i=0;i<MAX_CLIENTS;++i) {
-            if (clients[i].sock != INVALID_SOCKET) {
-                FD_SET(clients[i].sock, &readfds);
-                if (clients[i].sock > maxsock) maxsock = clients[i].sock;
-            }
+static void hand_back_all(Worker *w) {
+    if (!w->done) return;
+    while (donering_push(&g_inbox, w->done) != 0) sched_yield();   // the loop is behind
+    w->done = NULL;
+    w->done_tail = &w->done;
+    w->ndone = 0;
+}
+
+static void deliver_one(Worker *w, Msg *m, uint64_t to) {
+    if (!m) return;
+    Delivery *d = malloc(sizeof *d);
+    if (!d) { free(m); return; }
+    d->msg = m; d->log = 0; d->to = NULL; d->except = 0; d->one = to;
+    hand_back(w, d);
+}
+
+// m for every member of r but except; a log line goes to the loop even
+// when nobody else is there.
+static void deliver_room(Worker *w, const Room *r, Msg *m, uint64_t except, int log) {
+    if (!m) return;
+    Roster *to = r->members;
+    if (!log && to->n == (to->n && to->h[0] == except ? 1u : 0u)) { free(m); return; }
+    Delivery *d = malloc(sizeof *d);
+    if (!d) { free(m); return; }
+    __atomic_fetch_add(&to->refs, 1, __ATOMIC_RELAXED);
+    d->msg = m; d->log = log; d->to = to; d->except = except; d->one = 0;
+    hand_back(w, d);
+}
+
+static void room_join(Worker *w, const RoomOp *op) {
+    Room **p = room_find(w, op->room), *r = *p;
+    if (!r) {
+        if (!(r = room_new(op->room))) { deliver_one(w, msg_new("[server] could not join #%s\n", op->room), op->who); return; }
+        *p = r;
+        if (__atomic_add_fetch(&w->rooms, 1, __ATOMIC_RELAXED) > w->nbuckets) rooms_grow(w);
+    }
+    Roster *m = roster_for_change(r);
+    if (!m) { deliver_one(w, msg_new("[server] could not join #%s\n", op->room), op->who); return; }
+    m->h[m->n++] = op->who;   // the loop never sends a second join
+    __atomic_fetch_add(&w->members, 1, __ATOMIC_RELAXED);
+    if (op->quiet) return;
+    deliver_one(w, msg_new("[server] you joined #%s, %u here\n", r->name, m->n), op->who);
+    deliver_one(w, history_since(r, 0), op->who);
+    deliver_room(w, r, msg_new("[server] %s joined #%s\n", op->name, r->name), op->who, 1);
+}
+
+static void room_leave(Worker *w, const RoomOp *op) {
+    Room **p = room_find(w, op->room), *r = *p;
+    if (!r) return;
+    const Roster *o = r->members;
+    uint32_t i = 0;   // a scan, but leaves are rare next to lines
+    while (i < o->n && o->h[i] != op->who) ++i;
+    if (i == o->n) return;
+    Roster *m = roster_for_change(r);
+    if (!m) return;   // stays listed; its handle no longer resolves
+    m->h[i] = m->h[--m->n];
+    __atomic_fetch_sub(&w->members, 1, __ATOMIC_RELAXED);
+    if (!op->quiet) deliver_room(w, r, msg_new("[server] %s left #%s\n", op->name, r->name), op->who, 1);
+    if (m->n == 0) {
+        *p = r->next;
+        roster_unref(m);
+        free(r);
+        __atomic_fetch_sub(&w->rooms, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void room_since(Worker *w, const RoomOp *op) {
+    Room *r = *room_find(w, op->room);
+    if (!r) return;
+    Msg *m = history_since(r, op->seq);
+    if (!m && !op->quiet)
+        m = msg_new("[server] nothing in #%s since line %" PRIu64 ", the next is %" PRIu64 "\n", r->name, op->seq, r->hist.next);
+    deliver_one(w, m, op->who);
+}
+
+// /stats: the loop's figures for the client, then the rooms as of now.
+static void room_stats(Worker *w, const RoomOp *op) {
+    size_t rooms = 0, members = 0;
+    for (int i = 0; i < g_nworkers; ++i) {
+        rooms += __atomic_load_n(&g_workers[i].rooms, __ATOMIC_RELAXED);
+        members += __atomic_load_n(&g_workers[i].members, __ATOMIC_RELAXED);
+    }
+    deliver_one(w, msg_new("%.*srooms=%zu members=%zu workers=%d history=%d lines/%zu bytes per room history-mem=%zu\n",
+                           (int)op->msg->len, op->msg->data,
+                           rooms, members, g_nworkers, g_hist_lines, g_hist_bytes, rooms * history_size()), op->who);
+    free(op->msg);
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    WorkItem *it;
+    w->done_tail = &w->done;
+    while ((it = mpscq_pop(&w->in, NULL))) {
+        RoomOp *op = (RoomOp *)it;
+        int op_last = op->last;
+        switch (op->kind) {
+        case OP_JOIN:  room_join(w, op); break;
+        case OP_LEAVE: room_leave(w, op); break;
+        case OP_SAY: {
+            Room *r = *room_find(w, op->room);
+            if (!r) { free(op->msg); break; }
+            if (!op->quiet) history_add(&r->hist, op->msg);
+            deliver_room(w, r, op->msg, op->who, 0);
+            break;
+        }
+        case OP_SINCE: room_since(w, op); break;
+        case OP_REPLY: deliver_one(w, op->msg, op->who); break;
+        case OP_STATS: room_stats(w, op); break;
         }
+        if (objpool_owns(&g_ops, op)) objpool_put(&g_ops, op);
+        else free(op);
+        if (op_last || w->ndone >= HAND_BATCH) hand_back_all(w);
+    }
+    return NULL;
+}
 
-        int ready = select(0, &readfds, NULL, NULL, NULL);
-        if (ready == SOCKET_ERROR) { fprintf(stderr, "select error\n"); break; }
-
-        // new connection?
-        if (FD_ISSET(listen_sock, &readfds)) {
-            struct sockaddr_in cli;
-            int clen = sizeof(cli);
-            SOCKET cs = accept(listen_sock, (struct sockaddr*)&cli, &clen);
-            if (cs != INVALID_SOCKET) {
-                // find a slot
-                int slot = -1;
-                for (int i=0;i<MAX_CLIENTS;++i) { if (clients[i].sock == INVALID_SOCKET) { slot = i; break; } }
-                if (slot < 0) {
-                    const char* full = "[server] room full, try later\n";
-                    send(cs, full, (int)strlen(full), 0);
-                    closesocket(cs);
-                } else {
-                    clients[slot].sock = cs;
-                    clients[slot].name[0] = 0;
-                    char rip[32]; strncpy(rip, inet_ntoa(cli.sin_addr), sizeof(rip)-1); rip[sizeof(rip)-1]=0;
-                    printf("New client %s:%d (slot %d)\n", rip, ntohs(cli.sin_port), slot);
-                    const char* ask = "[server] send your name (first message)\n";
-                    send(cs, ask, (int)strlen(ask), 0);
-                }
-            }
-            if (--ready <= 0) continue;
+// ---- the loop's side ----
+
+// Past OP_POOL in flight, ops come from the heap.
+static RoomOp *op_new(int kind, const Client *c, const char *room) {
+    RoomOp *op = objpool_get(&g_ops);
+    if (!op && !(op = malloc(sizeof *op))) return NULL;
+    op->kind = kind;
+    op->quiet = !c->name[0];
+    op->who = handle_of(c);
+    op->seq = 0;
+    op->msg = NULL;
+    snprintf(op->room, sizeof op->room, "%s", room);
+    memcpy(op->name, c->name, sizeof op->name);
+    return op;
+}
+
+// To w, behind whatever already waits for it.
+static void queue_op(Worker *w, RoomOp *op) {
+    if (!w->backlog && mpscq_push(&w->in, &op->link) == 0) return;
+    op->link.next = NULL;
+    if (w->backlog_tail) w->backlog_tail->next = &op->link;
+    else { w->backlog = &op->link; g_backlogged++; }
+    w->backlog_tail = &op->link;
+}
+
+// To w, for c. Each worker's latest op of the wakeup is held back until
+// release_held() marks it last, so the worker answers the whole wakeup at
+// once even when it runs ahead of the loop.
+static void submit_to(Worker *w, Client *c, RoomOp *op) {
+    c->tail = w;
+    op->last = 0;
+    if (w->held) queue_op(w, w->held);
+    w->held = op;
+}
+
+// To the room's worker.
+static void submit(Client *c, RoomOp *op) {
+    submit_to(room_worker(op->room), c, op);
+}
+
+static void release_held(void) {
+    for (int i = 0; i < g_nworkers; ++i) {
+        Worker *w = &g_workers[i];
+        if (!w->held) continue;
+        w->held->last = 1;
+        queue_op(w, w->held);
+        w->held = NULL;
+    }
+}
+
+static void retry_backlogs(void) {
+    for (int i = 0; i < g_nworkers && g_backlogged; ++i) {
+        Worker *w = &g_workers[i];
+        if (!w->backlog) continue;
+        while (w->backlog) {
+            WorkItem *it = w->backlog, *next = it->next;   // the worker may free it once pushed
+            if (mpscq_push(&w->in, it) != 0) break;
+            w->backlog = next;
         }
+        if (!w->backlog) { w->backlog_tail = NULL; g_backlogged--; }
+    }
+}
 
-        // handle each client
-        for (int i=0;i<MAX_CLIENTS && ready>0; ++i) {
-            SOCKET s = clients[i].sock;
-            if (s == INVALID_SOCKET) continue;
-            if (!FD_ISSET(s, &readfds)) continue;
-            ready--;
-
-            char buf[MAXMSG+1];
-            int n = recv(s, buf, MAXMSG, 0);
-            if (n <= 0) {
-                if (clients[i].name[0]) {
-                    char bye[128];
-                    snprintf(bye, sizeof(bye), "[server] %s left the chat\n", clients[i].name);
-                    printf("%s", bye);
-                    broadcast(clients, MAX_CLIENTS, s, bye);
-                }
-                closesocket(s);
-                clients[i].sock = INVALID_SOCKET;
-                clients[i].name[0] = 0;
-                continue;
-            }
-            buf[n] = 0;
-
-            if (clients[i].name[0] == 0) {
-                // first message = name
-                // trim leading/trailing newlines
-                char* p = buf; while (*p && (*p=='\r' || *p=='\n')) p++;
-                strncpy(clients[i].name, p, sizeof(clients[i].name)-1);
-                clients[i].name[sizeof(clients[i].name)-1] = 0;
-                for (int k=(int)strlen(clients[i].name)-1; k>=0 && (clients[i].name[k]=='\r' || clients[i].name[k]=='\n'); --k)
-                    clients[i].name[k]=0;
-
-                char joined[128];
-                snprintf(joined, sizeof(joined), "[server] %s joined the chat\n", clients[i].name);
-                printf("%s", joined);
-                broadcast(clients, MAX_CLIENTS, s, joined);
-                continue;
+static void send_op(Client *c, int kind, const char *room, Msg *m) {
+    RoomOp *op = op_new(kind, c, room);
+    if (!op) { free(m); kill_client(c); return; }
+    op->msg = m;
+    submit(c, op);
+}
+
+// A worker answers in the order it gets ops, so a reply the loop makes
+// itself goes through the worker with the client's latest op and arrives
+// after that op's answer. Only the greeting, before any op, goes straight
+// to the send queue.
+static void reply(Client *c, const char *text) {
+    Msg *m = msg_new("%s", text);
+    if (!m) { kill_client(c); return; }
+    if (c->tail) {
+        RoomOp *op = op_new(OP_REPLY, c, "");
+        if (!op) { free(m); kill_client(c); return; }
+        op->msg = m;
+        submit_to(c->tail, c, op);
+        return;
+    }
+    m->refs++;
+    enqueue(c, m);
+    msg_unref(m);
+}
+
+// Queue every Delivery the workers have handed back.
+static void on_deliveries(void) {
+    for (WorkItem *it = donering_take(&g_inbox); it; ) {
+        Delivery *d = (Delivery *)it;
+        it = it->next;
+        Msg *m = d->msg;
+        if (d->log) fwrite(m->data, 1, m->len, stdout);
+        m->refs++;   // held while queueing, so a failing client cannot free it
+        if (d->to) {
+            const Roster *r = d->to;
+            for (uint32_t i = 0; i < r->n; ++i) {
+                Client *c = r->h[i] != d->except ? client_of(r->h[i]) : NULL;
+                if (c) enqueue(c, m);
             }
+            roster_unref(d->to);
+        } else {
+            Client *c = client_of(d->one);
+            if (c) enqueue(c, m);
+        }
+        msg_unref(m);
+        free(d);
+    }
+}
+
+static int joined_at(const Client *c, const char *room) {
+    for (int i = 0; i < c->nrooms; ++i) if (strcmp(c->rooms[i], room) == 0) return i;
+    return -1;
+}
+
+static void unlist_room(Client *c, int i) {
+    memmove(c->rooms[i], c->rooms[i + 1], (size_t)(c->nrooms - i - 1) * sizeof c->rooms[0]);
+    c->nrooms--;
+}
+
+static int valid_room(const char *s) {
+    size_t n = strlen(s);
+    if (n == 0 || n >= ROOM_MAX) return 0;
+    for (; *s; ++s)
+        if (!((*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z') || (*s >= '0' && *s <= '9') || *s == '_' || *s == '-'))
+            return 0;
+    return 1;
+}
+
+static void say(Client *c, const char *text) {
+    if (!c->nrooms) { reply(c, "[server] you are in no room, /join one\n"); return; }
+    const char *room = c->rooms[c->nrooms - 1];
+    Msg *m = msg_new("#%s %s: %s\n", room, c->name, text);
+    if (!m) { kill_client(c); return; }
+    fwrite(m->data, 1, m->len, stdout);
+    send_op(c, OP_SAY, room, m);
+}
+
+static void cmd_join(Client *c, const char *room) {
+    char line[128];
+    if (!valid_room(room)) { reply(c, "[server] room names are 1-31 of A-Z a-z 0-9 _ -\n"); return; }
+    int i = joined_at(c, room);
+    if (i >= 0) {   // already in: talk there
+        unlist_room(c, i);
+        snprintf(c->rooms[c->nrooms++], ROOM_MAX, "%s", room);
+        snprintf(line, sizeof line, "[server] talking in #%s\n", room);
+        reply(c, line);
+        return;
+    }
+    if (c->nrooms == MAX_JOINED) {
+        snprintf(line, sizeof line, "[server] you are in %d rooms, /leave one first\n", MAX_JOINED);
+        reply(c, line);
+        return;
+    }
+    snprintf(c->rooms[c->nrooms++], ROOM_MAX, "%s", room);
+    send_op(c, OP_JOIN, room, NULL);
+}
+
+static void cmd_leave(Client *c, const char *arg) {
+    char room[ROOM_MAX], line[160];
+    const char *want = *arg ? arg : c->nrooms ? c->rooms[c->nrooms - 1] : "";
+    int i = valid_room(want) ? joined_at(c, want) : -1;
+    if (i < 0) { reply(c, "[server] you are not in that room\n"); return; }
+    memcpy(room, c->rooms[i], sizeof room);
+    unlist_room(c, i);
+    send_op(c, OP_LEAVE, room, NULL);
+    if (c->nrooms) snprintf(line, sizeof line, "[server] you left #%s, talking in #%s\n", room, c->rooms[c->nrooms - 1]);
+    else snprintf(line, sizeof line, "[server] you left #%s\n", room);
+    reply(c, line);
+}
+
+static void cmd_since(Client *c, const char *arg) {
+    char *end;
+    uint64_t from = strtoull(arg, &end, 10);
+    if (*arg < '0' || *arg > '9' || *end) { reply(c, "[server] usage: /since LINE (0: all kept)\n"); return; }
+    if (!c->nrooms) { reply(c, "[server] you are in no room, /join one\n"); return; }
+    RoomOp *op = op_new(OP_SINCE, c, c->rooms[c->nrooms - 1]);
+    if (!op) { kill_client(c); return; }
+    op->seq = from;
+    submit(c, op);
+}
 
-            // normal message → broadcast
-            char line[MAXMSG+128];
-            snprintf(line, sizeof(line), "%s: %s", clients[i].name, buf);
-            printf("%s", line);
-            broadcast(clients, MAX_CLIENTS, s, line);
+// The name line: the client gets the lobby's recent lines and is announced
+// in the lobby it is already in.
+static void set_name(Client *c, const char *line) {
+    strncpy(c->name, line, sizeof c->name - 1);
+    c->name[sizeof c->name - 1] = 0;
+    if (joined_at(c, "lobby") < 0) return;
+    RoomOp *since = op_new(OP_SINCE, c, "lobby");
+    if (!since) { kill_client(c); return; }
+    since->quiet = 1;
+    submit(c, since);
+    Msg *m = msg_new("[server] %s joined #lobby\n", c->name);
+    if (!m) { kill_client(c); return; }
+    fwrite(m->data, 1, m->len, stdout);
+    RoomOp *op = op_new(OP_SAY, c, "lobby");
+    if (!op) { free(m); kill_client(c); return; }
+    op->msg = m;
+    op->quiet = 1;   // not a line of the room's history
+    submit(c, op);
+}
+
+// The worker with the client's latest op adds the rooms and answers, so
+// the counts include the client's own joins and leaves before it.
+static void send_stats(Client *c) {
+    const SendQ *q = &c->out;
+    Msg *m = msg_new("[server] you: queued=%zu peak=%zu dropped=%lu (%lu bytes); "
+                     "all: clients=%d queued=%zu dropped=%lu slow-closed=%lu policy=%s sendq-max=%zu ",
+                     q->bytes, q->peak, q->dropped, q->dropped_bytes,
+                     g_nclients, g_queued, g_dropped, g_slow_closed, POLICY[g_policy], g_sendq_max);
+    RoomOp *op = m ? op_new(OP_STATS, c, "") : NULL;
+    if (!op) { free(m); kill_client(c); return; }
+    op->msg = m;
+    submit_to(c->tail ? c->tail : &g_workers[0], c, op);
+}
+
+static void process_lines(Client *c) {
+    char line[MAXMSG + 1];
+    int n;
+    while (!c->dead && (n = linebuf_getline(&c->in, line, sizeof line)) != LB_NOLINE) {
+        if (n == LB_TOOLONG) { reply(c, "[server] line too long, dropped\n"); continue; }
+        if (n == 0) continue;
+        if (!c->name[0]) { set_name(c, line); continue; }
+        if (strcmp(line, "/stats") == 0) send_stats(c);
+        else if (strncmp(line, "/join ", 6) == 0) cmd_join(c, line + 6);
+        else if (strcmp(line, "/since") == 0 || strncmp(line, "/since ", 7) == 0) cmd_since(c, line[6] ? line + 7 : "");
+        else if (strcmp(line, "/leave") == 0 || strncmp(line, "/leave ", 7) == 0) cmd_leave(c, line[6] ? line + 7 : "");
+        else say(c, line);
+    }
+}
+
+// Drain the socket (edge-triggered). -1 once the peer is gone.
+static int on_readable(Client *c) {
+    for (;;) {
+        char *room;
+        size_t cap = linebuf_space(&c->in, &room);
+        if (cap == 0) {
+            process_lines(c);
+            if (c->dead) return -1;
+            continue;
+        }
+        ssize_t n = recv(c->fd, room, cap, 0);
+        if (n == 0) { process_lines(c); return -1; }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        linebuf_commit(&c->in, (size_t)n);
+    }
+    process_lines(c);
+    return 0;
+}
+
+static void accept_all(int ls, int ep) {
+    for (;;) {
+        struct sockaddr_in cli;
+        socklen_t clen = sizeof cli;
+        int cs = accept4(ls, (struct sockaddr *)&cli, &clen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cs < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+        if (!g_nfree) {
+            const char *full = "[server] server full, try later\n";
+            send(cs, full, strlen(full), MSG_NOSIGNAL);
+            close(cs);
+            continue;
+        }
+        Client *c = calloc(1, sizeof *c);
+        if (!c || linebuf_init(&c->in, 2 * MAXMSG) != 0) { free(c); close(cs); continue; }
+        c->fd = cs;
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = c };
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, cs, &ev) < 0) {
+            perror("epoll_ctl");
+            linebuf_free(&c->in); free(c); close(cs);
+            continue;
+        }
+        c->slot = g_free[--g_nfree];
+        c->gen = g_gens[c->slot];
+        g_slots[c->slot] = c;
+        g_nclients++;
+        char rip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &cli.sin_addr, rip, sizeof rip);
+        printf("New client %s:%d (%d connected)\n", rip, ntohs(cli.sin_port), g_nclients);
+        reply(c, "[server] send your name (first message)\n");
+        strcpy(c->rooms[c->nrooms++], "lobby");
+        send_op(c, OP_JOIN, "lobby", NULL);
+    }
+}
+
+static void flush_dirty(void) {
+    while (g_dirty) {
+        Client *c = g_dirty;
+        g_dirty = c->next_dirty;
+        c->dirty = 0;
+        if (!c->dead && flush_client(c) != 0) kill_client(c);
+    }
+}
+
+// Close the clients that died this wakeup (none of them is on the dirty
+// list by now), leave their rooms and free their slots.
+static void reap(void) {
+    while (g_dead) {
+        Client *c = g_dead;
+        g_dead = c->next_dead;
+        for (int i = 0; i < c->nrooms; ++i) send_op(c, OP_LEAVE, c->rooms[i], NULL);
+        g_slots[c->slot] = NULL;
+        if (++g_gens[c->slot] == 0) g_gens[c->slot] = 1;
+        g_free[g_nfree++] = c->slot;
+        g_nclients--;
+        close(c->fd);   // also leaves the epoll set
+        if (c->out.dropped)
+            printf("[server] %s: %lu messages (%lu bytes) dropped, peak queue %zu bytes\n",
+                   c->name[0] ? c->name : "(unnamed)", c->out.dropped, c->out.dropped_bytes, c->out.peak);
+        sendq_free(&c->out);
+        linebuf_free(&c->in);
+        free(c);
+    }
+}
+
+// Room for --max-clients descriptors, as far as the hard limit allows.
+static void raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return;
+    rlim_t want = (rlim_t)g_max_clients + 64;
+    if (rl.rlim_cur >= want) return;
+    rl.rlim_cur = want < rl.rlim_max ? want : rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <bind-ip> <port> [--workers N] [--max-clients N] [--sendq-max BYTES] "
+                "[--policy disconnect|drop-oldest|coalesce] [--history N] [--history-bytes B]\nExample: %s 0.0.0.0 5555\n", argv[0], argv[0]);
+        return 1;
+    }
+    const char* bind_ip = argv[1];
+    int port = atoi(argv[2]);
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) g_nworkers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-clients") == 0 && i + 1 < argc) g_max_clients = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--sendq-max") == 0 && i + 1 < argc) g_sendq_max = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) g_hist_lines = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--history-bytes") == 0 && i + 1 < argc) g_hist_bytes = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+            const char *p = argv[++i];
+            for (g_policy = 0; g_policy < POLICIES && strcmp(p, POLICY[g_policy]) != 0; ++g_policy) {}
+            if (g_policy == POLICIES) { fprintf(stderr, "unknown policy %s\n", p); return 1; }
+        }
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 1; }
+    }
+    if (g_nworkers < 1 || g_nworkers > MAX_WORKERS) die("--workers must be 1..64");
+    if (g_max_clients < 1) die("--max-clients must be at least 1");
+    if (g_sendq_max < SENDQ_FLOOR) { fprintf(stderr, "--sendq-max must be at least %d\n", SENDQ_FLOOR); return 1; }
+    if (g_hist_lines < 0 || g_hist_lines > 65536) die("--history must be 0..65536");
+    // a replay is one Msg, and has to fit in an empty send queue
+    if (g_hist_bytes < MAXMSG + 128 || g_hist_bytes > g_sendq_max / 2) {
+        fprintf(stderr, "--history-bytes must be %d..%zu (half of --sendq-max)\n", MAXMSG + 128, g_sendq_max / 2);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    raise_fd_limit();
+
+    g_slots = calloc((size_t)g_max_clients, sizeof *g_slots);
+    g_gens = malloc((size_t)g_max_clients * sizeof *g_gens);
+    g_free = malloc((size_t)g_max_clients * sizeof *g_free);
+    if (!g_slots || !g_gens || !g_free) die("out of memory");
+    for (int i = 0; i < g_max_clients; ++i) { g_gens[i] = 1; g_free[i] = (uint32_t)(g_max_clients - 1 - i); }
+    g_nfree = g_max_clients;
+    if (donering_init(&g_inbox, INBOX) != 0 || objpool_init(&g_ops, OP_POOL, sizeof(RoomOp)) != 0) die("out of memory");
+    for (int i = 0; i < g_nworkers; ++i) {
+        Worker *w = &g_workers[i];
+        w->nbuckets = 64;
+        if (!(w->buckets = calloc(w->nbuckets, sizeof *w->buckets)) || mpscq_init(&w->in, WORKER_QUEUE) != 0) die("out of memory");
+        if (pthread_create(&w->tid, NULL, worker_main, w) != 0) die("worker thread failed");
+    }
+
+    int ls = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ls < 0) die("socket failed");
+    int opt = 1;
+    setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons((uint16_t)port);
+    if (inet_pton(AF_INET, bind_ip, &addr.sin_addr) != 1) die("bad bind address");
+
+    if (bind(ls, (struct sockaddr*)&addr, sizeof(addr)) < 0) die("bind failed");
+    if (listen(ls, SOMAXCONN) < 0) die("listen failed");
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) die("epoll_create1 failed");
+    struct epoll_event lev = { .events = EPOLLIN | EPOLLET, .data.ptr = NULL };
+    struct epoll_event iev = { .events = EPOLLIN, .data.ptr = &g_inbox };
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, ls, &lev) < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, g_inbox.efd, &iev) < 0) die("epoll_ctl failed");
+
+    printf("Chat server listening on %s:%d ...\n", bind_ip, port);
+    fflush(stdout);
+
+    struct epoll_event evs[MAX_EVENTS];
+    while (1) {
+        retry_backlogs();
+        int n = epoll_wait(ep, evs, MAX_EVENTS, g_backlogged ? 1 : -1);
+        if (n < 0) { if (errno == EINTR) continue; perror("epoll_wait"); break; }
+        for (int i = 0; i < n; ++i) {
+            Client *c = evs[i].data.ptr;
+            if (!c) { accept_all(ls, ep); continue; }
+            if (evs[i].data.ptr == &g_inbox) { on_deliveries(); continue; }
+            if (c->dead) continue;
+            uint32_t e = evs[i].events;
+            int gone = (e & EPOLLERR) != 0;
+            if (!gone && (e & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) gone = on_readable(c) != 0;
+            if (!gone && (e & EPOLLOUT) && c->out.count) gone = flush_client(c) != 0;
+            if (gone) kill_client(c);
         }
+        while (g_dirty || g_dead) { flush_dirty(); reap(); }
+        release_held();
+        fflush(stdout);
     }
 
-    // cleanup
-    for (int i=0;i<MAX_CLIENTS;++i)
-        if (clients[i].sock != INVALID_SOCKET) closesocket(clients[i].sock);
-    closesocket(listen_sock);
-    WSACleanup();
+    close(ep);
+    close(ls);
     return 0;
 }
@@ -0,0 +1,251 @@
+// chatbench.c — broadcast fan-out rate of chat_server
+// Build: gcc -std=c17 -O2 -Wall -Wextra chatbench.c -o chatbench
+// Run:   ./chatbench <server-ip> <port> [--subs N[,N]...] [--msgs M] [--size B] [--window W]
+//                   [--stuck K]
+//
+// For each subscriber count (default 1000,10000) opens N connections that
+// never send a name, so they only listen and no joins are announced to
+// them, then one publisher named "pub" that sends M messages (default
+// 5000), each B bytes on the wire (default 64, the server's "#lobby pub: "
+// and '\n' included). The publisher stays at most W messages (default 64) ahead of
+// the slowest subscriber and writes whatever the window allows in one
+// send(), as a chatty client would. Start the server with --max-clients
+// above the largest N; both ends need that many descriptors (the bench
+// raises its own limit as far as the hard limit goes).
+//
+// Prints, per N, messages/s (each one delivered to every subscriber),
+// deliveries/s (messages/s times N) and the payload rate, and exits 1 if a
+// subscriber got fewer or more bytes than were sent to it.
+//
+// --stuck K adds K subscribers with a small receive buffer that never read,
+// the slow consumers the server's --sendq-max and --policy are for. They
+// are not waited for; after the run the publisher asks for /stats and the
+// server's answer is printed under the row.
+//
+//   ./chat_server 127.0.0.1 5555 --max-clients 12000 > /dev/null &
+//   ./chatbench 127.0.0.1 5555
+//   ./chatbench 127.0.0.1 5555 --subs 1000 --stuck 10
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_RUNS   16
+#define MAX_EVENTS 512
+#define PREFIX     "#lobby pub: "   // what the server puts before each line
+
+typedef struct {
+    int  fd;
+    int  lines;   // after the join line: messages received
+    long bytes;
+} Sub;
+
+static struct sockaddr_in g_addr;
+static long   g_msgs = 5000;
+static int    g_size = 64, g_window = 64, g_stuck;
+static int   *g_atleast;   // [k % ring]: subscribers with k or more messages
+static char   g_stats[1024];   // the server's /stats answer (--stuck)
+
+static void die(const char *m) { fprintf(stderr, "%s\n", m); exit(1); }
+
+static double now_s(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void raise_fd_limit(long want) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur >= (rlim_t)want) return;
+    rl.rlim_cur = (rlim_t)want < rl.rlim_max ? (rlim_t)want : rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+// Connect and read the server's greeting line, so the server has accepted
+// this one before the next connect (no SYN retries behind a full backlog).
+static int connect_one(int rcvbuf) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (rcvbuf) setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+    if (connect(fd, (struct sockaddr *)&g_addr, sizeof g_addr) != 0) { close(fd); return -1; }
+    char c;
+    ssize_t n;
+    while ((n = recv(fd, &c, 1, 0)) == 1 && c != '\n') {}
+    if (n != 1) { close(fd); return -1; }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// Message k as the publisher sends it, without PREFIX.
+static void format_msg(char *p, long k) {
+    int body = g_size - (int)strlen(PREFIX) - 1;
+    int n = snprintf(p, (size_t)body + 1, "%08ld ", k);
+    memset(p + n, 'x', (size_t)(body - n));
+    p[body] = '\n';
+}
+
+// Ask the server for /stats over the publisher, which receives nothing else
+// but, if the lobby has any, its recent lines.
+static void get_stats(int pub) {
+    size_t n;
+    g_stats[0] = 0;
+    if (send(pub, "/stats\n", 7, MSG_NOSIGNAL) != 7) return;
+    fcntl(pub, F_SETFL, fcntl(pub, F_GETFL) & ~O_NONBLOCK);
+    do {
+        n = 0;
+        while (n < sizeof g_stats - 1 && recv(pub, g_stats + n, 1, 0) == 1 && g_stats[n] != '\n') n++;
+        g_stats[n] = 0;
+    } while (n && strncmp(g_stats, "[server] you:", 13) != 0);
+}
+
+// One run with n subscribers. 0 and the elapsed seconds, or -1.
+static int run(int n, double *secs) {
+    int ring = g_window + 2;
+    Sub *subs = calloc((size_t)n, sizeof *subs);
+    g_atleast = calloc((size_t)ring, sizeof *g_atleast);
+    char *out = malloc((size_t)g_window * (size_t)g_size);
+    if (!subs || !g_atleast || !out) die("out of memory");
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) die("epoll_create1 failed");
+    for (int i = 0; i < n; ++i) {
+        subs[i].fd = connect_one(0);
+        subs[i].lines = -1;   // the publisher's join comes first
+        if (subs[i].fd < 0) { fprintf(stderr, "connect failed at subscriber %d\n", i); return -1; }
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &subs[i] };
+        epoll_ctl(ep, EPOLL_CTL_ADD, subs[i].fd, &ev);
+    }
+    int *stuck = calloc((size_t)g_stuck + 1, sizeof *stuck);
+    if (!stuck) die("out of memory");
+    for (int i = 0; i < g_stuck; ++i)
+        if ((stuck[i] = connect_one(4096)) < 0) { fprintf(stderr, "connect failed at stuck subscriber %d\n", i); return -1; }
+    int pub = connect_one(0);
+    if (pub < 0) { fprintf(stderr, "publisher connect failed\n"); return -1; }
+    if (send(pub, "pub\n", 4, MSG_NOSIGNAL) != 4) return -1;
+
+    long sent = 0, slow = -1;   // slow: every subscriber has this many (-1: not even the join)
+    int joined = 0;
+    size_t pend = 0, poff = 0;  // publisher bytes in out not yet sent
+    static char buf[1 << 16];
+    struct epoll_event evs[MAX_EVENTS];
+    double t0 = 0;
+    while (slow < g_msgs) {
+        if (slow >= 0 && !pend && sent < g_msgs && sent - slow < g_window) {
+            if (!t0) t0 = now_s();
+            while (sent < g_msgs && sent - slow < g_window) {
+                format_msg(out + pend, sent++);
+                pend += (size_t)g_size - strlen(PREFIX);
+            }
+            poff = 0;
+        }
+        while (pend) {
+            ssize_t w = send(pub, out + poff, pend, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                fprintf(stderr, "publisher send failed\n"); return -1;
+            }
+            poff += (size_t)w; pend -= (size_t)w;
+        }
+        int k = epoll_wait(ep, evs, MAX_EVENTS, pend ? 1 : 1000);
+        if (k < 0) { if (errno == EINTR) continue; die("epoll_wait failed"); }
+        if (k == 0 && !pend) { fprintf(stderr, "stalled at %ld of %ld messages\n", slow, g_msgs); return -1; }
+        for (int e = 0; e < k; ++e) {
+            Sub *s = evs[e].data.ptr;
+            for (;;) {
+                ssize_t r = recv(s->fd, buf, sizeof buf, 0);
+                if (r < 0 && errno == EINTR) continue;
+                if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                if (r <= 0) { fprintf(stderr, "subscriber disconnected\n"); return -1; }
+                s->bytes += r;
+                for (char *p = buf, *end = buf + r; (p = memchr(p, '\n', (size_t)(end - p))); ++p) {
+                    if (++s->lines == 0) { joined++; continue; }
+                    if (s->lines > g_msgs) { fprintf(stderr, "subscriber got an extra line\n"); return -1; }
+                    g_atleast[s->lines % ring]++;
+                }
+            }
+        }
+        if (slow < 0 && joined == n) slow = 0;
+        while (slow >= 0 && slow < sent && g_atleast[(slow + 1) % ring] == n) {
+            g_atleast[++slow % ring] = 0;
+        }
+    }
+    *secs = now_s() - t0;
+
+    if (g_stuck) get_stats(pub);
+    close(pub);   // first, so its "left" is not for the next run's subscribers
+    for (int i = 0; i < g_stuck; ++i) close(stuck[i]);
+    free(stuck);
+    long want = -1;
+    int bad = 0;
+    for (int i = 0; i < n; ++i) {
+        long join = subs[i].bytes - g_msgs * g_size;
+        if (want < 0) want = join;
+        if (join != want || join <= 0) bad = 1;
+        close(subs[i].fd);
+    }
+    close(ep);
+    free(subs); free(g_atleast); free(out);
+    if (bad) fprintf(stderr, "byte counts differ between subscribers\n");
+    return bad ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <server-ip> <port> [--subs N[,N]...] [--msgs M] [--size B] [--window W] [--stuck K]\n", argv[0]);
+        return 1;
+    }
+    int subs[MAX_RUNS] = { 1000, 10000 }, nruns = 2;
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons((uint16_t)atoi(argv[2]));
+    if (inet_pton(AF_INET, argv[1], &g_addr.sin_addr) != 1) die("bad server address");
+    for (int i = 3; i < argc; ++i) {
+        if (!strcmp(argv[i], "--subs") && i + 1 < argc) {
+            nruns = 0;
+            for (char *p = argv[++i]; *p && nruns < MAX_RUNS; ) {
+                subs[nruns++] = (int)strtol(p, &p, 10);
+                if (*p == ',') ++p;
+            }
+        }
+        else if (!strcmp(argv[i], "--msgs") && i + 1 < argc) g_msgs = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--size") && i + 1 < argc) g_size = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--window") && i + 1 < argc) g_window = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--stuck") && i + 1 < argc) g_stuck = atoi(argv[++i]);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 1; }
+    }
+    if (g_msgs < 1 || g_size < 24 || g_size > 1000 || g_window < 1 || g_stuck < 0)
+        die("bad --msgs, --size (24..1000), --window or --stuck");
+    int maxn = 0;
+    for (int i = 0; i < nruns; ++i) {
+        if (subs[i] < 1) die("bad --subs");
+        if (subs[i] > maxn) maxn = subs[i];
+    }
+    raise_fd_limit(maxn + g_stuck + 64L);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%-8s %12s %14s %10s\n", "subs", "msgs/s", "deliveries/s", "MB/s");
+    int failed = 0;
+    for (int i = 0; i < nruns; ++i) {
+        double secs;
+        if (run(subs[i], &secs) != 0) { printf("%-8d FAIL\n", subs[i]); failed = 1; continue; }
+        double mps = g_msgs / secs;
+        printf("%-8d %12.0f %14.0f %10.1f\n", subs[i], mps, mps * subs[i], mps * subs[i] * g_size / 1e6);
+        if (g_stuck) printf("  %s\n", g_stats);
+        fflush(stdout);
+        struct timespec ts = { 0, 200 * 1000000L };   // let the server close them
+        nanosleep(&ts, NULL);
+    }
+    return failed;
+}
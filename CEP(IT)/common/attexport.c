@@ -0,0 +1,65 @@
+// attexport.c — write an att_server database's attendance as a column file
+// Build: gcc -std=c17 -O2 -Wall -Wextra attexport.c colfile.c datetime.c -lsqlite3 -o attexport
+// Run:   ./attexport <db> <out> [--from YYYY-MM-DD] [--to YYYY-MM-DD]
+//
+// The same file att_server's EXPORT sends (colfile.h): students and courses
+// as dictionaries, then every mark (or those between --from and --to) in
+// (course, day, student) order. Reads on its own read-only connection, so
+// the server may keep running. Prints the rows, the file size and the time.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "colfile.h"
+#include "datetime.h"
+
+static double now_s(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <db> <out> [--from YYYY-MM-DD] [--to YYYY-MM-DD]\n", argv[0]);
+        return 1;
+    }
+    int64_t from = INT64_MIN, to = INT64_MAX;
+    for (int i = 3; i < argc; ++i) {
+        int64_t *d = !strcmp(argv[i], "--from") ? &from : !strcmp(argv[i], "--to") ? &to : NULL;
+        if (!d || i + 1 >= argc) { fprintf(stderr, "unknown option %s\n", argv[i]); return 1; }
+        ++i;
+        if (parse_ymd(argv[i], strlen(argv[i]), d) != 0) { fprintf(stderr, "bad date %s\n", argv[i]); return 1; }
+    }
+
+    sqlite3 *db;
+    if (sqlite3_open_v2(argv[1], &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(stderr, "open %s: %s\n", argv[1], sqlite3_errmsg(db));
+        return 1;
+    }
+    sqlite3_busy_timeout(db, 5000);
+    int fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) { perror(argv[2]); return 1; }
+
+    double t0 = now_s();
+    errno = 0;
+    int64_t rows = colfile_export(db, fd, from, to);
+    if (rows < 0) {
+        fprintf(stderr, "export failed: %s\n", errno ? strerror(errno) : sqlite3_errmsg(db));
+        unlink(argv[2]);
+        return 1;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (fsync(fd) != 0 || close(fd) != 0) { perror(argv[2]); return 1; }
+    double secs = now_s() - t0;
+    printf("%s: %lld rows, %lld bytes (%.2f per row), %.2f s\n", argv[2], (long long)rows,
+           (long long)size, rows ? (double)size / rows : 0.0, secs);
+    sqlite3_close(db);
+    return 0;
+}
@@ -0,0 +1,139 @@
+// attimport.c — bulk-load a CSV/TSV file into an att_server database
+// Build: gcc -std=c17 -O2 -Wall -Wextra -pthread attimport.c csvimport.c idmap.c datetime.c dbtune.c -lsqlite3 -o attimport
+// Run:   ./attimport <db> <file> [--txn N] [--defer|--no-defer] [--errors N] [storage flags, dbtune.h]
+//
+// The same import as att_server's IMPORT (csvimport.h), without the
+// network: the file is mmap'd and parsed in place. The database must
+// already have att_server's schema (start the server on it once), and the
+// server should not be running on it: its id caches and attendance index
+// are loaded at startup and would not see these rows.
+//
+// Prints the first --errors failed rows (default 20) as file:line: reason,
+// then the totals and rows per second. Exits 0 if every row went in, 2 if
+// some were skipped, 1 if the file could not be imported.
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "csvimport.h"
+#include "dbtune.h"
+#include "idmap.h"
+
+typedef struct {
+    const char *path;
+    long        shown, max_shown;
+} ErrorLog;
+
+static void on_error(void *ctx, long line, const char *msg) {
+    ErrorLog *log = ctx;
+    if (line == 0) { fprintf(stderr, "%s: %s\n", log->path, msg); return; }
+    if (log->shown++ < log->max_shown) fprintf(stderr, "%s:%ld: %s\n", log->path, line, msg);
+}
+
+static double now_s(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int load_ids(sqlite3 *db, const char *sql, IdMap *m, PairSet *s) {
+    sqlite3_stmt *st;
+    if (sqlite3_prepare_v2(db, sql, -1, &st, NULL) != SQLITE_OK) return -1;
+    while (sqlite3_step(st) == SQLITE_ROW) {
+        if (m) {
+            const char *key = (const char*)sqlite3_column_text(st, 1);
+            if (key && idmap_put(m, key, sqlite3_column_int(st, 0)) != 0) { sqlite3_finalize(st); return -1; }
+        } else if (pairset_add(s, sqlite3_column_int(st, 0), sqlite3_column_int(st, 1)) < 0) {
+            sqlite3_finalize(st); return -1;
+        }
+    }
+    sqlite3_finalize(st);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <db> <file> [--txn N] [--defer|--no-defer] [--errors N] " DBTUNE_USAGE "\n", argv[0]);
+        return 1;
+    }
+    const char *dbpath = argv[1], *path = argv[2];
+    ErrorLog log = { path, 0, 20 };
+    DbTune tune = DBTUNE_DEFAULTS;
+    tune.checkpoint_ms = 0;   // no checkpointer thread: SQLite's auto-checkpoint
+    CsvImport im = { .txn_rows = CSV_TXN_ROWS, .defer = CSV_DEFER_AUTO };
+    for (int i = 3; i < argc; ++i) {
+        int r;
+        if (!strcmp(argv[i], "--txn") && i + 1 < argc)         im.txn_rows = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--defer"))                  im.defer = CSV_DEFER_ON;
+        else if (!strcmp(argv[i], "--no-defer"))               im.defer = CSV_DEFER_OFF;
+        else if (!strcmp(argv[i], "--errors") && i + 1 < argc) log.max_shown = atol(argv[++i]);
+        else if ((r = dbtune_option(&tune, argc, argv, &i)) < 0) { fprintf(stderr, "bad value for %s\n", argv[i - 1]); return 1; }
+        else if (r == 0) { fprintf(stderr, "unknown option %s\n", argv[i]); return 1; }
+    }
+    if (im.txn_rows < 1) { fprintf(stderr, "--txn must be >= 1\n"); return 1; }
+
+    int fd = open(path, O_RDONLY);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) != 0) { perror(path); return 1; }
+    const char *buf = "";
+    if (sb.st_size > 0) {
+        void *m = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) { perror("mmap"); return 1; }
+        madvise(m, (size_t)sb.st_size, MADV_SEQUENTIAL);
+        buf = m;
+    }
+
+    sqlite3 *db;
+    if (sqlite3_open_v2(dbpath, &db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+        fprintf(stderr, "open %s: %s\n", dbpath, sqlite3_errmsg(db));
+        return 1;
+    }
+    sqlite3_busy_timeout(db, 5000);
+    if (dbtune_apply(db, &tune) != 0) return 1;
+    sqlite3_exec(db, "PRAGMA foreign_keys=ON", NULL, NULL, NULL);
+    sqlite3_stmt *st;
+    int version = -1;
+    if (sqlite3_prepare_v2(db, "SELECT user_version FROM pragma_user_version "
+                           "WHERE EXISTS(SELECT 1 FROM sqlite_master WHERE name='attendance')", -1, &st, NULL) == SQLITE_OK) {
+        if (sqlite3_step(st) == SQLITE_ROW) version = sqlite3_column_int(st, 0);
+        sqlite3_finalize(st);
+    }
+    if (version != 1) {
+        fprintf(stderr, "%s has no att_server schema (version 1); start att_server on it once first\n", dbpath);
+        return 1;
+    }
+
+    IdMap students, courses;
+    PairSet enrolled;
+    if (idmap_init(&students, 1024) || idmap_init(&courses, 64) || pairset_init(&enrolled, 4096) ||
+        load_ids(db, "SELECT id,roll FROM students", &students, NULL) ||
+        load_ids(db, "SELECT id,code FROM courses", &courses, NULL) ||
+        load_ids(db, "SELECT student_id,course_id FROM enrollments", NULL, &enrolled)) {
+        fprintf(stderr, "loading ids: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    im.db = db;
+    im.students = &students; im.courses = &courses; im.enrolled = &enrolled;
+    im.on_error = on_error; im.ctx = &log;
+    double t0 = now_s();
+    int rc = csv_import(&im, buf, (size_t)sb.st_size);
+    double secs = now_s() - t0;
+    if (log.shown > log.max_shown) fprintf(stderr, "%s: ... %ld more failed rows\n", path, log.shown - log.max_shown);
+    printf("%s: %s, %ld rows, %ld imported, %ld failed%s, %.2f s (%.0f rows/s)\n",
+           path, im.kind ? im.kind : "?", im.rows, im.imported, im.failed,
+           im.deferred ? ", indexes rebuilt" : "", secs, secs > 0 ? im.rows / secs : 0.0);
+
+    sqlite3_close(db);
+    if (sb.st_size > 0) munmap((void*)buf, (size_t)sb.st_size);
+    close(fd);
+    idmap_free(&students); idmap_free(&courses); pairset_free(&enrolled);
+    return rc != 0 ? 1 : im.failed ? 2 : 0;
+}
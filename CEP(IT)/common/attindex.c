@@ -0,0 +1,96 @@
+// attindex.c — see attindex.h
+
+#define _GNU_SOURCE   // pthread_rwlock_t under -std=c17
+
+#include "attindex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static size_t day_hash(int course_id, int32_t day) {
+    uint64_t k = ((uint64_t)(uint32_t)course_id << 32) | (uint32_t)day;
+    k ^= k >> 33; k *= 0xff51afd7ed558ccdULL; k ^= k >> 33;
+    return (size_t)k;
+}
+
+static AttDay **day_slot(AttDay **slots, size_t cap, int course_id, int32_t day) {
+    size_t i = day_hash(course_id, day) & (cap - 1);
+    while (slots[i] && !(slots[i]->course_id == course_id && slots[i]->day == day))
+        i = (i + 1) & (cap - 1);
+    return &slots[i];
+}
+
+int attindex_init(AttIndex *x, size_t expected) {
+    x->cap = 64;
+    while (x->cap < expected * 2) x->cap <<= 1;
+    x->count = 0;
+    x->max_student = 0;
+    if (!(x->slots = calloc(x->cap, sizeof *x->slots))) return -1;
+    if (pthread_rwlock_init(&x->lock, NULL) != 0) { free(x->slots); return -1; }
+    return 0;
+}
+
+void attindex_free(AttIndex *x) {
+    for (size_t i = 0; i < x->cap; ++i) {
+        if (!x->slots[i]) continue;
+        for (int s = 0; s < ATT_NSTATUS; ++s) bitmap_free(&x->slots[i]->st[s]);
+        free(x->slots[i]);
+    }
+    free(x->slots);
+    x->slots = NULL; x->cap = 0;
+    pthread_rwlock_destroy(&x->lock);
+}
+
+int attindex_status(char status) {
+    switch (status) {
+    case 'P': return ATT_P;
+    case 'A': return ATT_A;
+    case 'L': return ATT_L;
+    default:  return -1;
+    }
+}
+
+static int grow(AttIndex *x) {
+    size_t ncap = x->cap * 2;
+    AttDay **ns = calloc(ncap, sizeof *ns);
+    if (!ns) return -1;
+    for (size_t i = 0; i < x->cap; ++i)
+        if (x->slots[i]) *day_slot(ns, ncap, x->slots[i]->course_id, x->slots[i]->day) = x->slots[i];
+    free(x->slots);
+    x->slots = ns; x->cap = ncap;
+    return 0;
+}
+
+int attindex_mark(AttIndex *x, int course_id, int32_t day, int student_id, char status) {
+    int s = attindex_status(status);
+    if (s < 0 || student_id < 0) return -1;
+    if ((x->count + 1) * 10 > x->cap * 7 && grow(x) != 0) return -1;
+    AttDay **slot = day_slot(x->slots, x->cap, course_id, day);
+    if (!*slot) {
+        AttDay *d = calloc(1, sizeof *d);
+        if (!d) return -1;
+        d->course_id = course_id;
+        d->day = day;
+        *slot = d;
+        x->count++;
+    }
+    // a student has one status per course and day
+    for (int o = 0; o < ATT_NSTATUS; ++o) if (o != s) bitmap_remove(&(*slot)->st[o], (uint32_t)student_id);
+    if (bitmap_add(&(*slot)->st[s], (uint32_t)student_id) < 0) return -1;
+    if ((uint32_t)student_id > x->max_student) x->max_student = (uint32_t)student_id;
+    return 0;
+}
+
+const AttDay *attindex_get(const AttIndex *x, int course_id, int32_t day) {
+    return *day_slot(x->slots, x->cap, course_id, day);
+}
+
+size_t attindex_bytes(const AttIndex *x) {
+    size_t n = x->cap * sizeof *x->slots;
+    for (size_t i = 0; i < x->cap; ++i) {
+        if (!x->slots[i]) continue;
+        n += sizeof *x->slots[i];
+        for (int s = 0; s < ATT_NSTATUS; ++s) n += bitmap_bytes(&x->slots[i]->st[s]);
+    }
+    return n;
+}
@@ -0,0 +1,50 @@
+// attindex.h — in-memory attendance bitmaps per (course, day)
+//
+// For every (course id, day) that has marks, one bitmap (bitmap.h) per
+// status of the student ids marked P, A and L. Student ids are INTEGER
+// PRIMARY KEYs, so they are dense and a day of a course costs about a bit
+// per enrolled student. Set queries across days and courses then become
+// AND / OR / ANDNOT over a handful of bitmaps instead of joins over the
+// attendance table.
+//
+// The table is open addressing over (course, day), like idmap.h. One thread
+// writes, under the write lock; query threads hold the read lock for as long
+// as they use the bitmaps they got from it.
+
+#ifndef ATTINDEX_H
+#define ATTINDEX_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+
+enum { ATT_P, ATT_A, ATT_L, ATT_NSTATUS };
+
+typedef struct {
+    int     course_id;
+    int32_t day;                  // days since 1970-01-01 (datetime.h)
+    Bitmap  st[ATT_NSTATUS];
+} AttDay;
+
+typedef struct {
+    pthread_rwlock_t lock;
+    AttDay         **slots;       // NULL = empty
+    size_t           cap;         // power of two
+    size_t           count;
+    uint32_t         max_student; // highest student id ever marked
+} AttIndex;
+
+int  attindex_init(AttIndex *x, size_t expected);
+void attindex_free(AttIndex *x);
+// 'P', 'A' or 'L' -> ATT_*, or -1.
+int  attindex_status(char status);
+// Record one mark (write lock held). 0, or -1 on OOM / bad status.
+int  attindex_mark(AttIndex *x, int course_id, int32_t day, int student_id, char status);
+// The entry for (course, day), or NULL (read lock held).
+const AttDay *attindex_get(const AttIndex *x, int course_id, int32_t day);
+// Heap bytes held by the table and its bitmaps.
+size_t attindex_bytes(const AttIndex *x);
+
+#endif
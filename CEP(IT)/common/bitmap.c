@@ -0,0 +1,313 @@
+// bitmap.c — see bitmap.h
+
+#include "bitmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define WORDS 1024   // 65536 bits per bitset chunk
+
+enum { OP_AND, OP_OR, OP_ANDNOT };
+
+static int is_bits(const BitmapChunk *c) { return c->card > BITMAP_ARRAY_MAX; }
+
+static uint32_t lower_bound(const uint16_t *a, uint32_t n, uint16_t v) {
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (a[mid] < v) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+// Index of the chunk for key, or where it would go; *found says which.
+static uint32_t find_chunk(const Bitmap *b, uint16_t key, int *found) {
+    uint32_t lo = 0, hi = b->n;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (b->c[mid].key < key) lo = mid + 1; else hi = mid;
+    }
+    *found = lo < b->n && b->c[lo].key == key;
+    return lo;
+}
+
+static int insert_chunk(Bitmap *b, uint32_t at, BitmapChunk c) {
+    if (b->n == b->cap) {
+        uint32_t ncap = b->cap ? b->cap * 2 : 4;
+        BitmapChunk *nc = realloc(b->c, ncap * sizeof *nc);
+        if (!nc) return -1;
+        b->c = nc; b->cap = ncap;
+    }
+    memmove(b->c + at + 1, b->c + at, (b->n - at) * sizeof *b->c);
+    b->c[at] = c;
+    b->n++;
+    return 0;
+}
+
+static void to_words(const BitmapChunk *c, uint64_t *w) {
+    if (is_bits(c)) { memcpy(w, c->data, WORDS * sizeof *w); return; }
+    memset(w, 0, WORDS * sizeof *w);
+    const uint16_t *a = c->data;
+    for (uint32_t i = 0; i < c->card; ++i) w[a[i] >> 6] |= 1ull << (a[i] & 63);
+}
+
+// A chunk holding the card set bits of w, as an array if they fit one.
+static int from_words(BitmapChunk *c, uint16_t key, const uint64_t *w, uint32_t card) {
+    c->key = key; c->card = card; c->cap = 0;
+    if (card > BITMAP_ARRAY_MAX) {
+        if (!(c->data = malloc(WORDS * sizeof *w))) return -1;
+        memcpy(c->data, w, WORDS * sizeof *w);
+        return 0;
+    }
+    uint16_t *a = malloc(card * sizeof *a);
+    if (!(c->data = a)) return -1;
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < WORDS; ++i)
+        for (uint64_t x = w[i]; x; x &= x - 1) a[k++] = (uint16_t)(i * 64 + __builtin_ctzll(x));
+    c->cap = card;
+    return 0;
+}
+
+// A chunk holding the n sorted values of a, as a bitset if they need one.
+static int from_array(BitmapChunk *c, uint16_t key, const uint16_t *a, uint32_t n) {
+    if (n > BITMAP_ARRAY_MAX) {
+        uint64_t w[WORDS];
+        memset(w, 0, sizeof w);
+        for (uint32_t i = 0; i < n; ++i) w[a[i] >> 6] |= 1ull << (a[i] & 63);
+        return from_words(c, key, w, n);
+    }
+    c->key = key; c->card = n; c->cap = n;
+    if (!(c->data = malloc(n * sizeof *a))) return -1;
+    memcpy(c->data, a, n * sizeof *a);
+    return 0;
+}
+
+static int copy_chunk(BitmapChunk *out, const BitmapChunk *x) {
+    return is_bits(x) ? from_words(out, x->key, x->data, x->card)
+                      : from_array(out, x->key, x->data, x->card);
+}
+
+void bitmap_free(Bitmap *b) {
+    for (uint32_t i = 0; i < b->n; ++i) free(b->c[i].data);
+    free(b->c);
+    b->c = NULL; b->n = b->cap = 0;
+}
+
+int bitmap_add(Bitmap *b, uint32_t v) {
+    uint16_t key = (uint16_t)(v >> 16), lo = (uint16_t)v;
+    int found;
+    uint32_t i = find_chunk(b, key, &found);
+    if (!found) {
+        uint16_t *a = malloc(4 * sizeof *a);
+        if (!a) return -1;
+        a[0] = lo;
+        if (insert_chunk(b, i, (BitmapChunk){ key, 1, 4, a }) != 0) { free(a); return -1; }
+        return 1;
+    }
+    BitmapChunk *c = &b->c[i];
+    if (is_bits(c)) {
+        uint64_t *w = c->data, m = 1ull << (lo & 63);
+        if (w[lo >> 6] & m) return 0;
+        w[lo >> 6] |= m;
+        c->card++;
+        return 1;
+    }
+    uint16_t *a = c->data;
+    uint32_t at = lower_bound(a, c->card, lo);
+    if (at < c->card && a[at] == lo) return 0;
+    if (c->card == BITMAP_ARRAY_MAX) {   // the array is full: switch to a bitset
+        uint64_t *w = malloc(WORDS * sizeof *w);
+        if (!w) return -1;
+        to_words(c, w);
+        w[lo >> 6] |= 1ull << (lo & 63);
+        free(c->data);
+        c->data = w; c->cap = 0; c->card++;
+        return 1;
+    }
+    if (c->card == c->cap) {
+        uint32_t ncap = c->cap * 2 < BITMAP_ARRAY_MAX ? c->cap * 2 : BITMAP_ARRAY_MAX;
+        if (!(a = realloc(a, ncap * sizeof *a))) return -1;
+        c->data = a; c->cap = ncap;
+    }
+    memmove(a + at + 1, a + at, (c->card - at) * sizeof *a);
+    a[at] = lo;
+    c->card++;
+    return 1;
+}
+
+int bitmap_remove(Bitmap *b, uint32_t v) {
+    uint16_t key = (uint16_t)(v >> 16), lo = (uint16_t)v;
+    int found;
+    uint32_t i = find_chunk(b, key, &found);
+    if (!found) return 0;
+    BitmapChunk *c = &b->c[i];
+    if (is_bits(c)) {
+        uint64_t *w = c->data, m = 1ull << (lo & 63);
+        if (!(w[lo >> 6] & m)) return 0;
+        w[lo >> 6] &= ~m;
+        if (--c->card == BITMAP_ARRAY_MAX) {   // back to an array
+            BitmapChunk a;
+            if (from_words(&a, key, w, c->card) != 0) { w[lo >> 6] |= m; c->card++; return -1; }
+            free(c->data);
+            *c = a;
+        }
+        return 1;
+    }
+    uint16_t *a = c->data;
+    uint32_t at = lower_bound(a, c->card, lo);
+    if (at == c->card || a[at] != lo) return 0;
+    memmove(a + at, a + at + 1, (c->card - at - 1) * sizeof *a);
+    if (--c->card == 0) {
+        free(c->data);
+        memmove(b->c + i, b->c + i + 1, (b->n - i - 1) * sizeof *b->c);
+        b->n--;
+    }
+    return 1;
+}
+
+int bitmap_contains(const Bitmap *b, uint32_t v) {
+    uint16_t key = (uint16_t)(v >> 16), lo = (uint16_t)v;
+    int found;
+    uint32_t i = find_chunk(b, key, &found);
+    if (!found) return 0;
+    const BitmapChunk *c = &b->c[i];
+    if (is_bits(c)) return (((const uint64_t*)c->data)[lo >> 6] >> (lo & 63)) & 1;
+    uint32_t at = lower_bound(c->data, c->card, lo);
+    return at < c->card && ((const uint16_t*)c->data)[at] == lo;
+}
+
+uint64_t bitmap_card(const Bitmap *b) {
+    uint64_t n = 0;
+    for (uint32_t i = 0; i < b->n; ++i) n += b->c[i].card;
+    return n;
+}
+
+size_t bitmap_bytes(const Bitmap *b) {
+    size_t n = b->cap * sizeof *b->c;
+    for (uint32_t i = 0; i < b->n; ++i)
+        n += is_bits(&b->c[i]) ? WORDS * sizeof(uint64_t) : b->c[i].cap * sizeof(uint16_t);
+    return n;
+}
+
+// Two sorted arrays; out holds x->card + y->card values.
+static uint32_t merge(const BitmapChunk *x, const BitmapChunk *y, int op, uint16_t *out) {
+    const uint16_t *a = x->data, *b = y->data;
+    uint32_t i = 0, j = 0, n = 0;
+    while (i < x->card && j < y->card) {
+        if (a[i] < b[j])      { if (op != OP_AND) out[n++] = a[i]; i++; }
+        else if (b[j] < a[i]) { if (op == OP_OR) out[n++] = b[j]; j++; }
+        else                  { if (op != OP_ANDNOT) out[n++] = a[i]; i++; j++; }
+    }
+    if (op != OP_AND) while (i < x->card) out[n++] = a[i++];
+    if (op == OP_OR)  while (j < y->card) out[n++] = b[j++];
+    return n;
+}
+
+// out = x op y for one key; a missing side is NULL. out->card is 0 if the
+// result is empty (nothing allocated).
+static int chunk_op(BitmapChunk *out, uint16_t key, const BitmapChunk *x, const BitmapChunk *y,
+                    int op, uint64_t *wx, uint64_t *wy) {
+    memset(out, 0, sizeof *out);
+    if (!y) return copy_chunk(out, x);
+    if (!x) return copy_chunk(out, y);
+    if (!is_bits(x) && !is_bits(y)) {
+        uint16_t tmp[2 * BITMAP_ARRAY_MAX];
+        uint32_t n = merge(x, y, op, tmp);
+        return n ? from_array(out, key, tmp, n) : 0;
+    }
+    if (op == OP_AND && (!is_bits(x) || !is_bits(y))) {   // probe the array in the bitset
+        const BitmapChunk *arr = is_bits(x) ? y : x, *bits = is_bits(x) ? x : y;
+        const uint16_t *a = arr->data;
+        const uint64_t *w = bits->data;
+        uint16_t tmp[BITMAP_ARRAY_MAX];
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < arr->card; ++i)
+            if ((w[a[i] >> 6] >> (a[i] & 63)) & 1) tmp[n++] = a[i];
+        return n ? from_array(out, key, tmp, n) : 0;
+    }
+    to_words(x, wx);
+    to_words(y, wy);
+    uint32_t card = 0;
+    for (uint32_t i = 0; i < WORDS; ++i) {
+        wx[i] = op == OP_AND ? wx[i] & wy[i] : op == OP_OR ? wx[i] | wy[i] : wx[i] & ~wy[i];
+        card += (uint32_t)__builtin_popcountll(wx[i]);
+    }
+    return card ? from_words(out, key, wx, card) : 0;
+}
+
+static int bitmap_op(Bitmap *out, const Bitmap *a, const Bitmap *b, int op) {
+    uint64_t wx[WORDS], wy[WORDS];
+    bitmap_free(out);
+    uint32_t i = 0, j = 0;
+    while (i < a->n || j < b->n) {
+        const BitmapChunk *x = NULL, *y = NULL;
+        if (j == b->n || (i < a->n && a->c[i].key < b->c[j].key)) x = &a->c[i++];
+        else if (i == a->n || b->c[j].key < a->c[i].key)          y = &b->c[j++];
+        else { x = &a->c[i++]; y = &b->c[j++]; }
+        if (op == OP_AND && (!x || !y)) continue;
+        if (op == OP_ANDNOT && !x) continue;
+        BitmapChunk c;
+        if (chunk_op(&c, x ? x->key : y->key, x, y, op, wx, wy) != 0 ||
+            (c.card && insert_chunk(out, out->n, c) != 0)) {
+            free(c.data);
+            bitmap_free(out);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int bitmap_copy(Bitmap *out, const Bitmap *a) {
+    static const Bitmap empty = BITMAP_INIT;
+    return bitmap_op(out, a, &empty, OP_OR);
+}
+
+int bitmap_and(Bitmap *out, const Bitmap *a, const Bitmap *b)    { return bitmap_op(out, a, b, OP_AND); }
+int bitmap_or(Bitmap *out, const Bitmap *a, const Bitmap *b)     { return bitmap_op(out, a, b, OP_OR); }
+int bitmap_andnot(Bitmap *out, const Bitmap *a, const Bitmap *b) { return bitmap_op(out, a, b, OP_ANDNOT); }
+
+uint64_t bitmap_and_card(const Bitmap *a, const Bitmap *b) {
+    uint64_t n = 0;
+    uint32_t i = 0, j = 0;
+    while (i < a->n && j < b->n) {
+        const BitmapChunk *x = &a->c[i], *y = &b->c[j];
+        if (x->key < y->key) { i++; continue; }
+        if (y->key < x->key) { j++; continue; }
+        i++; j++;
+        if (is_bits(x) && is_bits(y)) {
+            const uint64_t *wx = x->data, *wy = y->data;
+            for (uint32_t k = 0; k < WORDS; ++k) n += (uint64_t)__builtin_popcountll(wx[k] & wy[k]);
+        } else if (is_bits(x) || is_bits(y)) {
+            const BitmapChunk *arr = is_bits(x) ? y : x, *bits = is_bits(x) ? x : y;
+            const uint16_t *v = arr->data;
+            const uint64_t *w = bits->data;
+            for (uint32_t k = 0; k < arr->card; ++k) n += (w[v[k] >> 6] >> (v[k] & 63)) & 1;
+        } else {
+            const uint16_t *va = x->data, *vb = y->data;
+            uint32_t p = 0, q = 0;
+            while (p < x->card && q < y->card) {
+                if (va[p] < vb[q]) p++;
+                else if (vb[q] < va[p]) q++;
+                else { n++; p++; q++; }
+            }
+        }
+    }
+    return n;
+}
+
+size_t bitmap_to_array(const Bitmap *b, uint32_t *out) {
+    size_t n = 0;
+    for (uint32_t i = 0; i < b->n; ++i) {
+        const BitmapChunk *c = &b->c[i];
+        uint32_t hi = (uint32_t)c->key << 16;
+        if (is_bits(c)) {
+            const uint64_t *w = c->data;
+            for (uint32_t k = 0; k < WORDS; ++k)
+                for (uint64_t x = w[k]; x; x &= x - 1) out[n++] = hi | (k * 64 + (uint32_t)__builtin_ctzll(x));
+        } else {
+            const uint16_t *a = c->data;
+            for (uint32_t k = 0; k < c->card; ++k) out[n++] = hi | a[k];
+        }
+    }
+    return n;
+}
@@ -0,0 +1,57 @@
+// bitmap.h — compressed bitmaps over 32-bit ids (roaring layout)
+//
+// An id is split into a 16-bit chunk key and a 16-bit low part. Every chunk
+// that has members is one container: a sorted uint16 array while it holds
+// at most BITMAP_ARRAY_MAX members, a 65536-bit bitset (1024 words) beyond
+// that, so a dense run of ids costs a bit each and a sparse one two bytes.
+//
+// AND / OR / ANDNOT walk the two chunk lists by key. Two arrays are merged;
+// anything involving a bitset works on 64-bit words and takes the result's
+// cardinality with popcount. bitmap_and_card() counts an intersection
+// without building it. Not thread-safe.
+
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BITMAP_ARRAY_MAX 4096   // members above which a chunk is a bitset
+
+typedef struct {
+    uint16_t  key;     // high 16 bits of every member
+    uint32_t  card;    // members; > BITMAP_ARRAY_MAX means data is a bitset
+    uint32_t  cap;     // uint16 slots allocated (arrays only)
+    void     *data;    // uint16_t[cap] sorted, or uint64_t[1024]
+} BitmapChunk;
+
+typedef struct {
+    BitmapChunk *c;    // sorted by key
+    uint32_t     n, cap;
+} Bitmap;
+
+#define BITMAP_INIT { NULL, 0, 0 }
+
+void     bitmap_free(Bitmap *b);
+// 1 if v was added, 0 if it was there, -1 on OOM.
+int      bitmap_add(Bitmap *b, uint32_t v);
+// 1 if v was removed, 0 if it was not there.
+int      bitmap_remove(Bitmap *b, uint32_t v);
+int      bitmap_contains(const Bitmap *b, uint32_t v);
+uint64_t bitmap_card(const Bitmap *b);
+// Heap bytes held by the containers.
+size_t   bitmap_bytes(const Bitmap *b);
+
+// out = a op b. out must not be a or b; whatever it held is freed first.
+// 0, or -1 on OOM (out is left empty).
+int      bitmap_copy(Bitmap *out, const Bitmap *a);
+int      bitmap_and(Bitmap *out, const Bitmap *a, const Bitmap *b);
+int      bitmap_or(Bitmap *out, const Bitmap *a, const Bitmap *b);
+int      bitmap_andnot(Bitmap *out, const Bitmap *a, const Bitmap *b);
+// |a AND b|, without building it.
+uint64_t bitmap_and_card(const Bitmap *a, const Bitmap *b);
+
+// The members in ascending order; out must hold bitmap_card(b) ids.
+size_t   bitmap_to_array(const Bitmap *b, uint32_t *out);
+
+#endif
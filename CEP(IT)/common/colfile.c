@@ -0,0 +1,357 @@
+// colfile.c — see colfile.h
+
+#define _GNU_SOURCE   // madvise, O_CLOEXEC under -std=c17
+
+#include "colfile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char MAGIC[8] = "ATTCOL1\n", END[8] = "ATTCEND\n";
+
+#define GROUP_HDR 28    // rows, day_min, day_max, bytes[4]
+#define INDEX_ENT 20    // offset, rows, day_min, day_max
+#define TRAILER   28    // index_offset, groups, rows, END
+
+// ---- writer ----
+
+static int buf_reserve(ColBuf *b, size_t n) {
+    if (b->n + n <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->n + n) cap *= 2;
+    uint8_t *p = realloc(b->p, cap);
+    if (!p) return -1;
+    b->p = p; b->cap = cap;
+    return 0;
+}
+
+static void put_le(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static int buf_le(ColBuf *b, uint64_t v, int bytes) {
+    if (buf_reserve(b, (size_t)bytes) != 0) return -1;
+    put_le(b->p + b->n, v, bytes);
+    b->n += (size_t)bytes;
+    return 0;
+}
+
+static int write_all(ColWriter *w, const void *p, size_t n) {
+    if (w->failed) return -1;
+    for (const char *s = p; n; ) {
+        ssize_t k = write(w->fd, s, n);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) { w->failed = 1; return -1; }
+        s += k; n -= (size_t)k; w->off += (uint64_t)k;
+    }
+    return 0;
+}
+
+static int bits_for(uint32_t count) {
+    int b = 1;
+    while (b < 32 && count > (1u << b)) ++b;
+    return b;
+}
+
+int colw_init(ColWriter *w, int fd) {
+    memset(w, 0, sizeof *w);
+    w->fd = fd;
+    return write_all(w, MAGIC, sizeof MAGIC);
+}
+
+int colw_dict(ColWriter *w, int which, uint32_t id, const char *s, size_t n) {
+    if (w->started || n > UINT16_MAX || w->count[which] == UINT32_MAX - 1) return -1;
+    if (id >= w->maxid[which]) {
+        uint32_t cap = w->maxid[which] ? w->maxid[which] : 1024;
+        while (cap <= id && cap < UINT32_MAX / 2) cap *= 2;
+        if (cap <= id) return -1;
+        uint32_t *ix = realloc(w->index[which], (size_t)cap * sizeof *ix);
+        if (!ix) return -1;
+        memset(ix + w->maxid[which], 0, (size_t)(cap - w->maxid[which]) * sizeof *ix);
+        w->index[which] = ix; w->maxid[which] = cap;
+    }
+    ColBuf *b = &w->dict[which];
+    if (buf_reserve(b, 6 + n) != 0) return -1;
+    put_le(b->p + b->n, id, 4);
+    put_le(b->p + b->n + 4, n, 2);
+    memcpy(b->p + b->n + 6, s, n);
+    b->n += 6 + n;
+    w->index[which][id] = ++w->count[which];
+    return 0;
+}
+
+static int start(ColWriter *w) {
+    for (int d = 0; d < 2; ++d) {
+        uint8_t n[4];
+        put_le(n, w->count[d], 4);
+        if (write_all(w, n, 4) != 0 || write_all(w, w->dict[d].p, w->dict[d].n) != 0) return -1;
+        free(w->dict[d].p);
+        w->dict[d] = (ColBuf){0};
+        w->width[d] = bits_for(w->count[d]);
+    }
+    w->started = 1;
+    return 0;
+}
+
+static int pack(ColWriter *w, int c, uint32_t v, int width) {
+    w->acc[c] |= (uint64_t)v << w->accbits[c];
+    w->accbits[c] += width;
+    if (buf_reserve(&w->col[c], 5) != 0) return -1;
+    for (; w->accbits[c] >= 8; w->accbits[c] -= 8, w->acc[c] >>= 8)
+        w->col[c].p[w->col[c].n++] = (uint8_t)w->acc[c];
+    return 0;
+}
+
+static int flush_group(ColWriter *w) {
+    for (int c = 0; c < 4; ++c)
+        if (w->accbits[c] && pack(w, c, 0, 8 - w->accbits[c]) != 0) return -1;
+    uint8_t h[GROUP_HDR];
+    put_le(h, w->rows, 4);
+    put_le(h + 4, (uint32_t)w->day_min, 4);
+    put_le(h + 8, (uint32_t)w->day_max, 4);
+    for (int c = 0; c < 4; ++c) put_le(h + 12 + 4 * c, w->col[c].n, 4);
+    uint64_t at = w->off;
+    if (write_all(w, h, sizeof h) != 0) return -1;
+    for (int c = 0; c < 4; ++c) {
+        if (write_all(w, w->col[c].p, w->col[c].n) != 0) return -1;
+        w->col[c].n = 0;
+    }
+    if (buf_le(&w->groups, at, 8) || buf_le(&w->groups, w->rows, 4) ||
+        buf_le(&w->groups, (uint32_t)w->day_min, 4) || buf_le(&w->groups, (uint32_t)w->day_max, 4)) return -1;
+    w->ngroups++;
+    w->rows = 0;
+    return 0;
+}
+
+int colw_row(ColWriter *w, uint32_t course_id, int32_t day, uint32_t student_id, char status) {
+    if (!w->started && start(w) != 0) return -1;
+    const char *m = status ? strchr(COL_MARKS, status) : NULL;
+    uint32_t ci = course_id < w->maxid[COL_COURSES] ? w->index[COL_COURSES][course_id] : 0;
+    uint32_t si = student_id < w->maxid[COL_STUDENTS] ? w->index[COL_STUDENTS][student_id] : 0;
+    if (!m || !ci || !si || w->failed) return -1;
+    if (w->rows == COL_GROUP_ROWS && flush_group(w) != 0) return -1;
+    if (w->rows == 0) { w->day_min = w->day_max = day; w->last_day = 0; }
+    if (day < w->day_min) w->day_min = day;
+    if (day > w->day_max) w->day_max = day;
+
+    int64_t d = (int64_t)day - w->last_day;
+    uint64_t z = ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+    w->last_day = day;
+    ColBuf *b = &w->col[2];
+    if (pack(w, 0, ci - 1, w->width[COL_COURSES]) != 0 ||
+        pack(w, 1, si - 1, w->width[COL_STUDENTS]) != 0 ||
+        pack(w, 3, (uint32_t)(m - COL_MARKS), 2) != 0 ||
+        buf_reserve(b, 10) != 0) return -1;
+    for (; z >= 0x80; z >>= 7) b->p[b->n++] = (uint8_t)(z | 0x80);
+    b->p[b->n++] = (uint8_t)z;
+    w->rows++;
+    w->total++;
+    return 0;
+}
+
+int64_t colw_finish(ColWriter *w) {
+    if (!w->started && start(w) != 0) return -1;
+    if (w->rows && flush_group(w) != 0) return -1;
+    uint8_t t[TRAILER];
+    put_le(t, w->off, 8);
+    put_le(t + 8, w->ngroups, 4);
+    put_le(t + 12, w->total, 8);
+    memcpy(t + 20, END, 8);
+    if (write_all(w, w->groups.p, w->groups.n) != 0 || write_all(w, t, sizeof t) != 0) return -1;
+    return (int64_t)w->off;
+}
+
+void colw_free(ColWriter *w) {
+    for (int d = 0; d < 2; ++d) { free(w->dict[d].p); free(w->index[d]); }
+    for (int c = 0; c < 4; ++c) free(w->col[c].p);
+    free(w->groups.p);
+    memset(w, 0, sizeof *w);
+}
+
+static int export_dict(sqlite3 *db, ColWriter *w, int which, const char *sql) {
+    sqlite3_stmt *st;
+    if (sqlite3_prepare_v2(db, sql, -1, &st, NULL) != SQLITE_OK) return -1;
+    int rc;
+    while ((rc = sqlite3_step(st)) == SQLITE_ROW) {
+        if (colw_dict(w, which, (uint32_t)sqlite3_column_int64(st, 0),
+                      (const char*)sqlite3_column_text(st, 1), (size_t)sqlite3_column_bytes(st, 1)) != 0) break;
+    }
+    sqlite3_finalize(st);
+    return rc == SQLITE_DONE ? 0 : -1;
+}
+
+int64_t colfile_export(sqlite3 *db, int fd, int64_t from, int64_t to) {
+    ColWriter w;
+    int64_t rows = -1;
+    sqlite3_stmt *st = NULL;
+    if (colw_init(&w, fd) != 0) { colw_free(&w); return -1; }
+    if (sqlite3_exec(db, "BEGIN", NULL, NULL, NULL) != SQLITE_OK) { colw_free(&w); return -1; }
+    // (course_id, date, student_id, status) is idx_att_course_day: no sort step
+    if (export_dict(db, &w, COL_STUDENTS, "SELECT id,roll FROM students ORDER BY id") == 0 &&
+        export_dict(db, &w, COL_COURSES, "SELECT id,code FROM courses ORDER BY id") == 0 &&
+        sqlite3_prepare_v2(db, "SELECT course_id,date,student_id,status FROM attendance "
+                               "WHERE date BETWEEN ?1 AND ?2 ORDER BY course_id,date,student_id",
+                           -1, &st, NULL) == SQLITE_OK) {
+        sqlite3_bind_int64(st, 1, from);
+        sqlite3_bind_int64(st, 2, to);
+        int rc;
+        while ((rc = sqlite3_step(st)) == SQLITE_ROW) {
+            const unsigned char *s = sqlite3_column_text(st, 3);
+            if (colw_row(&w, (uint32_t)sqlite3_column_int64(st, 0), (int32_t)sqlite3_column_int64(st, 1),
+                         (uint32_t)sqlite3_column_int64(st, 2), s ? (char)s[0] : 0) != 0) break;
+        }
+        if (rc == SQLITE_DONE && colw_finish(&w) >= 0) rows = (int64_t)w.total;
+    }
+    sqlite3_finalize(st);
+    sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    colw_free(&w);
+    return rows;
+}
+
+// ---- reader ----
+
+static uint64_t get_le(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+// Dictionary at *off; advances it past the entries.
+static int read_dict(ColFile *f, int d, size_t *off, size_t end) {
+    if (end - *off < 4) return -1;
+    uint32_t n = (uint32_t)get_le(f->map + *off, 4);
+    *off += 4;
+    if (n > (end - *off) / 6) return -1;
+    f->count[d] = n;
+    f->id[d] = malloc((n ? n : 1) * sizeof *f->id[d]);
+    f->str[d] = malloc((n ? n : 1) * sizeof *f->str[d]);
+    if (!f->id[d] || !f->str[d]) return -1;
+    for (uint32_t i = 0; i < n; ++i) {
+        if (end - *off < 6) return -1;
+        f->id[d][i] = (uint32_t)get_le(f->map + *off, 4);
+        uint16_t len = (uint16_t)get_le(f->map + *off + 4, 2);
+        if (end - *off - 6 < len) return -1;
+        f->str[d][i] = (ColStr){ (const char*)f->map + *off + 6, len };
+        *off += 6u + len;
+    }
+    f->width[d] = bits_for(n);
+    return 0;
+}
+
+int colfile_open(ColFile *f, const char *path) {
+    memset(f, 0, sizeof *f);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) { close(fd); return -1; }
+    if ((size_t)sb.st_size < sizeof MAGIC + 8 + TRAILER) { close(fd); errno = EINVAL; return -1; }
+    void *m = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return -1;
+    f->map = m; f->len = (size_t)sb.st_size;
+    madvise(m, f->len, MADV_SEQUENTIAL);
+
+    const uint8_t *t = f->map + f->len - TRAILER;
+    uint64_t ix = get_le(t, 8);
+    f->ngroups = (uint32_t)get_le(t + 8, 4);
+    f->rows = get_le(t + 12, 8);
+    size_t off = sizeof MAGIC;
+    if (memcmp(f->map, MAGIC, sizeof MAGIC) || memcmp(t + 20, END, sizeof END) ||
+        ix > f->len - TRAILER || (f->len - TRAILER - ix) != (uint64_t)f->ngroups * INDEX_ENT ||
+        read_dict(f, COL_STUDENTS, &off, ix) || read_dict(f, COL_COURSES, &off, ix) ||
+        !(f->groups = malloc((f->ngroups ? f->ngroups : 1) * sizeof *f->groups))) goto bad;
+    uint64_t rows = 0;
+    for (uint32_t g = 0; g < f->ngroups; ++g) {
+        const uint8_t *e = f->map + ix + (size_t)g * INDEX_ENT;
+        ColGroupInfo *gi = &f->groups[g];
+        gi->offset = get_le(e, 8);
+        gi->rows = (uint32_t)get_le(e + 8, 4);
+        gi->day_min = (int32_t)get_le(e + 12, 4);
+        gi->day_max = (int32_t)get_le(e + 16, 4);
+        if (gi->offset < off || gi->offset + GROUP_HDR > ix || gi->rows == 0 || gi->rows > COL_GROUP_ROWS) goto bad;
+        rows += gi->rows;
+    }
+    if (rows != f->rows) goto bad;
+    return 0;
+bad:
+    colfile_close(f);
+    errno = EINVAL;
+    return -1;
+}
+
+void colfile_close(ColFile *f) {
+    if (f->map) munmap((void*)f->map, f->len);
+    for (int d = 0; d < 2; ++d) { free(f->id[d]); free(f->str[d]); }
+    free(f->groups);
+    memset(f, 0, sizeof *f);
+}
+
+// rows values of width bits from p[0..n); each must be below limit.
+static int unpack(const uint8_t *p, size_t n, int width, uint32_t rows, uint32_t limit, uint32_t *out) {
+    if (((uint64_t)rows * (uint64_t)width + 7) / 8 > n) return -1;
+    uint64_t acc = 0, mask = (1ull << width) - 1;
+    int have = 0;
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < rows; ++i) {
+        while (have < width) { acc |= (uint64_t)*p++ << have; have += 8; }
+        uint32_t v = (uint32_t)(acc & mask);
+        acc >>= width; have -= width;
+        bad |= v >= limit;
+        out[i] = v;
+    }
+    return bad ? -1 : 0;
+}
+
+int colfile_read(const ColFile *f, uint32_t g, ColGroup *out, int cols) {
+    if (g >= f->ngroups) return -1;
+    const ColGroupInfo *gi = &f->groups[g];
+    const uint8_t *h = f->map + gi->offset;
+    size_t at = (size_t)gi->offset + GROUP_HDR, bytes[4];
+    if (get_le(h, 4) != gi->rows) return -1;
+    for (int c = 0; c < 4; ++c) {
+        bytes[c] = (size_t)get_le(h + 12 + 4 * c, 4);
+        if (bytes[c] > f->len - at) return -1;
+        at += bytes[c];
+    }
+    const uint8_t *p = h + GROUP_HDR;
+    uint32_t rows = gi->rows;
+    out->rows = rows;
+    if ((cols & COL_COURSE) &&
+        unpack(p, bytes[0], f->width[COL_COURSES], rows, f->count[COL_COURSES], out->course) != 0) return -1;
+    p += bytes[0];
+    if ((cols & COL_STUDENT) &&
+        unpack(p, bytes[1], f->width[COL_STUDENTS], rows, f->count[COL_STUDENTS], out->student) != 0) return -1;
+    p += bytes[1];
+    if (cols & COL_DAY) {
+        const uint8_t *q = p, *end = p + bytes[2];
+        int64_t day = 0;
+        for (uint32_t i = 0; i < rows; ++i) {
+            uint64_t z = 0;
+            for (int s = 0; ; s += 7) {
+                if (q == end || s > 63) return -1;
+                uint8_t b = *q++;
+                z |= (uint64_t)(b & 0x7f) << s;
+                if (!(b & 0x80)) break;
+            }
+            day += (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+            out->day[i] = (int32_t)day;
+        }
+    }
+    p += bytes[2];
+    if (cols & COL_STATUS) {
+        if (((size_t)rows * 2 + 7) / 8 > bytes[3]) return -1;
+        uint8_t bad = 0;
+        for (uint32_t i = 0; i < rows; ++i) {
+            uint8_t v = (p[i >> 2] >> ((i & 3) * 2)) & 3;
+            bad |= v == 3;
+            out->status[i] = v;
+        }
+        if (bad) return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+// colfile.h — columnar attendance export: file format, writer, reader
+//
+// One file holds the students and courses as two dictionaries and the
+// attendance rows in groups of up to COL_GROUP_ROWS, sorted by (course,
+// day, student). All integers are little-endian.
+//
+//   file    = "ATTCOL1\n"  dict(students)  dict(courses)  group...  index  trailer
+//   dict    = count:u32  { id:u32  len:u16  bytes[len] }...     (id ascending)
+//   group   = rows:u32  day_min:i32  day_max:i32  bytes:u32[4]  course  student  day  status
+//   index   = { offset:u64  rows:u32  day_min:i32  day_max:i32 }...  (one per group)
+//   trailer = index_offset:u64  groups:u32  rows:u64  "ATTCEND\n"
+//
+// Inside a group each column is packed on its own, so a scan decodes only
+// the columns it asks for and skips a group whose day range it does not need:
+//
+//   course, student  dictionary index, bit-packed at the width the
+//                    dictionary's size needs (LSB first)
+//   day              zigzag LEB128 delta from the previous row's day number
+//                    (datetime.h); the first row's delta is from 0
+//   status           2 bits per row: 0 = P, 1 = A, 2 = L
+//
+// Sorted this way most day deltas are 0, so a mark costs about a byte of
+// day, two bits of status and the two index widths: a few bytes where the
+// REPORT_* text spends 30-40.
+//
+// ColWriter streams: the dictionaries are held until the first row, and
+// after that only the group being filled (a few bytes per row) is kept in
+// memory. colfile_export() runs it over an att_server database. ColFile
+// maps a file read-only and decodes one group at a time into a ColGroup.
+
+#ifndef COLFILE_H
+#define COLFILE_H
+
+#include <sqlite3.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COL_GROUP_ROWS 65536
+#define COL_MARKS      "PAL"    // status column value -> mark
+
+enum { COL_STUDENTS, COL_COURSES };   // dictionaries
+// columns, as colfile_read()'s mask
+enum { COL_COURSE = 1, COL_STUDENT = 2, COL_DAY = 4, COL_STATUS = 8, COL_ALL = 15 };
+
+typedef struct { uint8_t *p; size_t n, cap; } ColBuf;
+
+typedef struct {
+    int       fd;
+    int       failed;          // a write failed; the rest are no-ops
+    uint64_t  off;             // bytes written so far
+    ColBuf    dict[2];         // entries of each dictionary, until the first row
+    uint32_t  count[2];
+    uint32_t *index[2];        // database id -> dictionary index + 1
+    uint32_t  maxid[2];
+    int       width[2];        // bits per student / course index
+    int       started;         // dictionaries written
+    // the group being filled
+    uint32_t  rows;
+    int32_t   day_min, day_max, last_day;
+    ColBuf    col[4];
+    uint64_t  acc[4];          // bit-packing accumulators (course, student, -, status)
+    int       accbits[4];
+    // one index entry per finished group
+    ColBuf    groups;
+    uint32_t  ngroups;
+    uint64_t  total;
+} ColWriter;
+
+int  colw_init(ColWriter *w, int fd);   // writes the magic
+// Dictionary entries, ids ascending, all of them before the first row.
+int  colw_dict(ColWriter *w, int which, uint32_t id, const char *s, size_t n);
+// Rows in (course, day, student) order. -1 on an id missing from its
+// dictionary, a status other than P/A/L, or a failed write.
+int  colw_row(ColWriter *w, uint32_t course_id, int32_t day, uint32_t student_id, char status);
+// Last group, index and trailer. Returns the file size, or -1.
+int64_t colw_finish(ColWriter *w);
+void colw_free(ColWriter *w);
+
+// Write students, courses and the attendance with from <= date <= to to fd,
+// in one read transaction on db (which must not have one open). Returns the
+// rows written, or -1 (database error or failed write; errno or
+// sqlite3_errmsg() says which).
+int64_t colfile_export(sqlite3 *db, int fd, int64_t from, int64_t to);
+
+typedef struct { const char *s; uint16_t n; } ColStr;
+
+typedef struct {
+    uint64_t offset;
+    uint32_t rows;
+    int32_t  day_min, day_max;
+} ColGroupInfo;
+
+typedef struct {
+    const uint8_t *map;
+    size_t         len;
+    uint32_t       count[2];
+    uint32_t      *id[2];      // dictionary index -> database id
+    ColStr        *str[2];     // dictionary index -> roll / code (into map)
+    int            width[2];
+    uint32_t       ngroups;
+    uint64_t       rows;
+    ColGroupInfo  *groups;
+} ColFile;
+
+typedef struct {
+    uint32_t rows;
+    uint32_t course[COL_GROUP_ROWS];    // dictionary indexes
+    uint32_t student[COL_GROUP_ROWS];
+    int32_t  day[COL_GROUP_ROWS];
+    uint8_t  status[COL_GROUP_ROWS];    // index into COL_MARKS
+} ColGroup;
+
+// mmap and check path; -1 with errno set (EINVAL: not a valid file).
+int  colfile_open(ColFile *f, const char *path);
+void colfile_close(ColFile *f);
+// Decode the columns in cols (COL_COURSE | ...) of group g. -1 if corrupt.
+int  colfile_read(const ColFile *f, uint32_t g, ColGroup *out, int cols);
+
+#endif
@@ -0,0 +1,308 @@
+// csvimport.c — see csvimport.h
+
+#define _GNU_SOURCE   // strdup under -std=c17
+
+#include "csvimport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "datetime.h"
+
+void csv_reader_init(CsvReader *r, const char *buf, size_t len) {
+    if (len >= 3 && memcmp(buf, "\xEF\xBB\xBF", 3) == 0) { buf += 3; len -= 3; }   // UTF-8 BOM
+    r->p = buf;
+    r->end = buf + len;
+    r->line = 0;
+    r->next_line = 1;
+    r->esc_used = 0;
+    const char *eol = memchr(buf, '\n', len);
+    r->sep = memchr(buf, '\t', eol ? (size_t)(eol - buf) : len) ? '\t' : ',';
+}
+
+static const char *line_end(const char *p, const char *end) {
+    const char *e = memchr(p, '\n', (size_t)(end - p));
+    return e ? e : end;
+}
+
+// Give up on the record and resume after the line p is on.
+static int bad_record(CsvReader *r, const char *p) {
+    const char *eol = line_end(p, r->end);
+    if (eol < r->end) { r->p = eol + 1; r->next_line++; }
+    else r->p = eol;
+    return CSV_BAD;
+}
+
+int csv_next(CsvReader *r, CsvField *f, int max) {
+    const char *p = r->p, *end = r->end;
+    while (p < end && (*p == '\n' || *p == '\r')) { if (*p == '\n') r->next_line++; p++; }
+    r->p = p;
+    if (p == end) return 0;
+    r->line = r->next_line;
+    r->esc_used = 0;
+    const char *eol = line_end(p, end);
+    int n = 0;
+    for (;;) {
+        const char *s, *e;   // the field is [s, e)
+        if (p < end && *p == '"') {
+            const char *q = p + 1;
+            int escaped = 0;
+            for (;;) {
+                const char *c = memchr(q, '"', (size_t)(end - q));
+                if (!c) { r->p = end; return CSV_BAD; }
+                if (c + 1 < end && c[1] == '"') { escaped = 1; q = c + 2; continue; }
+                s = p + 1; e = c; p = c + 1;
+                break;
+            }
+            for (const char *c = s; (c = memchr(c, '\n', (size_t)(e - c))) != NULL; ++c) r->next_line++;
+            eol = line_end(p, end);
+            if (p < eol && *p != r->sep && !(*p == '\r' && p + 1 == eol)) return bad_record(r, p);
+            if (escaped) {
+                if ((size_t)(e - s) > sizeof r->esc - r->esc_used) return bad_record(r, p);
+                char *o0 = r->esc + r->esc_used, *o = o0;
+                for (const char *c = s; c < e; ++c) { *o++ = *c; if (*c == '"') ++c; }
+                s = o0; e = o;
+                r->esc_used += (size_t)(o - o0);
+            }
+        } else {
+            s = p;
+            e = memchr(p, r->sep, (size_t)(eol - p));
+            if (!e) e = eol;
+            p = e;
+            if (e == eol && e > s && e[-1] == '\r') e--;
+        }
+        if (n < max) { f[n].s = s; f[n].n = (size_t)(e - s); }
+        n++;
+        if (p < eol && *p == r->sep) { p++; continue; }
+        break;
+    }
+    if (eol < end) { r->p = eol + 1; r->next_line++; }
+    else r->p = end;
+    return n;
+}
+
+// ---- import ----
+
+enum { K_STUDENTS, K_COURSES, K_ENROLLMENTS, K_ATTENDANCE, K_COUNT };
+
+static const struct {
+    const char *name;
+    int         nf;
+    const char *cols[4];
+    const char *sql;
+} KINDS[K_COUNT] = {
+    [K_STUDENTS]    = { "students",    2, { "roll", "name" },
+                        "INSERT INTO students(roll,name) VALUES(?,?)" },
+    [K_COURSES]     = { "courses",     2, { "code", "title" },
+                        "INSERT INTO courses(code,title) VALUES(?,?)" },
+    [K_ENROLLMENTS] = { "enrollments", 2, { "roll", "code" },
+                        "INSERT OR IGNORE INTO enrollments(student_id,course_id) VALUES(?,?)" },
+    [K_ATTENDANCE]  = { "attendance",  4, { "roll", "code", "date", "status" },
+                        "INSERT INTO attendance(student_id,course_id,date,status) VALUES(?,?,?,?)" },
+};
+
+#define MAX_DEFERRED 8
+
+typedef struct {
+    CsvImport    *im;
+    int           kind;
+    sqlite3_stmt *ins, *enroll;
+    char         *index_sql[MAX_DEFERRED];
+    int           nindex;
+} Run;
+
+static void report(CsvImport *im, long line, const char *msg) {
+    if (im->on_error) im->on_error(im->ctx, line, msg);
+}
+
+static int exec(CsvImport *im, const char *sql) {
+    if (sqlite3_exec(im->db, sql, NULL, NULL, NULL) == SQLITE_OK) return 0;
+    report(im, 0, sqlite3_errmsg(im->db));
+    return -1;
+}
+
+static int header_kind(const CsvField *f, int n) {
+    for (int k = 0; k < K_COUNT; ++k) {
+        if (n != KINDS[k].nf) continue;
+        int i = 0;
+        while (i < n && strlen(KINDS[k].cols[i]) == f[i].n && strncasecmp(KINDS[k].cols[i], f[i].s, f[i].n) == 0) i++;
+        if (i == n) return k;
+    }
+    return -1;
+}
+
+static int enroll(Run *run, int sid, int cid) {
+    if (pairset_has(run->im->enrolled, sid, cid)) return 0;
+    sqlite3_bind_int(run->enroll, 1, sid);
+    sqlite3_bind_int(run->enroll, 2, cid);
+    int rc = sqlite3_step(run->enroll);
+    sqlite3_reset(run->enroll);
+    if (rc != SQLITE_DONE) return -1;
+    pairset_add(run->im->enrolled, sid, cid);
+    return 0;
+}
+
+// Insert one record; NULL, or why it was skipped.
+static const char *import_row(Run *run, const CsvField *f) {
+    CsvImport *im = run->im;
+    sqlite3_stmt *st = run->ins;
+    for (int i = 0; i < KINDS[run->kind].nf; ++i) {
+        if (f[i].n == 0) return "empty field";
+        if (f[i].n > CSV_FIELD_MAX) return "field too long";
+    }
+    if (run->kind == K_STUDENTS || run->kind == K_COURSES) {
+        IdMap *m = run->kind == K_STUDENTS ? im->students : im->courses;
+        if (idmap_get_n(m, f[0].s, f[0].n) >= 0) return run->kind == K_STUDENTS ? "student exists" : "course exists";
+        sqlite3_bind_text(st, 1, f[0].s, (int)f[0].n, SQLITE_STATIC);
+        sqlite3_bind_text(st, 2, f[1].s, (int)f[1].n, SQLITE_STATIC);
+        int rc = sqlite3_step(st);
+        sqlite3_reset(st);
+        if (rc != SQLITE_DONE) return sqlite3_errmsg(im->db);
+        if (idmap_put_n(m, f[0].s, f[0].n, (int)sqlite3_last_insert_rowid(im->db)) != 0) return "out of memory";
+        return NULL;
+    }
+    int sid = idmap_get_n(im->students, f[0].s, f[0].n);
+    int cid = idmap_get_n(im->courses, f[1].s, f[1].n);
+    if (sid < 0) return "no such student";
+    if (cid < 0) return "no such course";
+    if (run->kind == K_ENROLLMENTS) return enroll(run, sid, cid) == 0 ? NULL : sqlite3_errmsg(im->db);
+
+    int64_t day;
+    if (parse_ymd(f[2].s, f[2].n, &day) != 0) return "bad date";
+    if (!(f[3].n == 1 && (f[3].s[0] == 'P' || f[3].s[0] == 'A' || f[3].s[0] == 'L'))) return "bad status";
+    enroll(run, sid, cid);
+    sqlite3_bind_int(st, 1, sid);
+    sqlite3_bind_int(st, 2, cid);
+    sqlite3_bind_int64(st, 3, day);
+    sqlite3_bind_text(st, 4, f[3].s, 1, SQLITE_STATIC);
+    int rc = sqlite3_step(st);
+    sqlite3_reset(st);
+    if (rc != SQLITE_DONE)
+        return sqlite3_extended_errcode(im->db) == SQLITE_CONSTRAINT_UNIQUE ? "duplicate mark" : sqlite3_errmsg(im->db);
+    if (im->on_mark) im->on_mark(im->ctx, sid, cid, (int32_t)day, f[3].s[0]);
+    return NULL;
+}
+
+static long long query_ll(sqlite3 *db, const char *sql) {
+    sqlite3_stmt *st;
+    long long v = 0;
+    if (sqlite3_prepare_v2(db, sql, -1, &st, NULL) != SQLITE_OK) return 0;
+    if (sqlite3_step(st) == SQLITE_ROW) v = sqlite3_column_int64(st, 0);
+    sqlite3_finalize(st);
+    return v;
+}
+
+// Worth rebuilding attendance's indexes rather than maintaining them? When
+// the file adds a quarter of the table or more (about break-even measured:
+// 1M rows into 1M took 20 s deferred vs 30 s, 100k into 1M 3.1 vs 2.9 s).
+static int want_defer(CsvImport *im, const char *p, const char *end) {
+    if (im->defer != CSV_DEFER_AUTO) return im->defer == CSV_DEFER_ON;
+    long long lines = 0;
+    while ((p = memchr(p, '\n', (size_t)(end - p))) != NULL) { lines++; p++; }
+    return lines >= 10000 && lines * 4 >= query_ll(im->db, "SELECT coalesce(max(id),0) FROM attendance");
+}
+
+// Inside the first transaction: remember and drop the non-unique indexes
+// (after the schema scan is done: a DROP beside it is "table is locked").
+static int drop_indexes(Run *run) {
+    sqlite3_stmt *st;
+    if (sqlite3_prepare_v2(run->im->db,
+            "SELECT sql FROM sqlite_master WHERE type='index' AND tbl_name='attendance' "
+            "AND sql LIKE 'CREATE INDEX %'", -1, &st, NULL) != SQLITE_OK) {
+        report(run->im, 0, sqlite3_errmsg(run->im->db));
+        return -1;
+    }
+    int rc = 0;
+    while (run->nindex < MAX_DEFERRED && sqlite3_step(st) == SQLITE_ROW)
+        if (!(run->index_sql[run->nindex++] = strdup((const char*)sqlite3_column_text(st, 0)))) rc = -1;
+    sqlite3_finalize(st);
+    for (int i = 0; rc == 0 && i < run->nindex; ++i) {
+        // "CREATE INDEX name ON ..." -> "DROP INDEX name"
+        const char *name = run->index_sql[i] + 13, *sp = strchr(name, ' ');
+        char *q = sp ? sqlite3_mprintf("DROP INDEX %.*s", (int)(sp - name), name) : NULL;
+        rc = q ? exec(run->im, q) : -1;
+        sqlite3_free(q);
+    }
+    return rc;
+}
+
+// IF NOT EXISTS: a failed first COMMIT has already brought them back.
+static int rebuild_indexes(Run *run) {
+    if (exec(run->im, "BEGIN IMMEDIATE") != 0) return -1;
+    for (int i = 0; i < run->nindex; ++i) {
+        char *q = sqlite3_mprintf("CREATE INDEX IF NOT EXISTS %s", run->index_sql[i] + 13);
+        int rc = q ? exec(run->im, q) : -1;
+        sqlite3_free(q);
+        if (rc != 0) { exec(run->im, "ROLLBACK"); return -1; }
+    }
+    return exec(run->im, "COMMIT");
+}
+
+static int commit(Run *run) {
+    CsvImport *im = run->im;
+    if (sqlite3_exec(im->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        report(im, 0, sqlite3_errmsg(im->db));
+        sqlite3_exec(im->db, "ROLLBACK", NULL, NULL, NULL);
+        if (im->on_commit) im->on_commit(im->ctx, 0);
+        return -1;
+    }
+    if (im->on_commit) im->on_commit(im->ctx, 1);
+    return 0;
+}
+
+int csv_import(CsvImport *im, const char *buf, size_t len) {
+    im->kind = NULL;
+    im->rows = im->imported = im->failed = 0;
+    im->deferred = 0;
+    int txn_rows = im->txn_rows > 0 ? im->txn_rows : CSV_TXN_ROWS;
+
+    CsvReader rd;
+    csv_reader_init(&rd, buf, len);
+    CsvField f[4];
+    int n = csv_next(&rd, f, 4);
+    Run run = { .im = im, .kind = n > 0 ? header_kind(f, n) : -1 };
+    if (run.kind < 0) {
+        report(im, 1, "header must be roll,name / code,title / roll,code / roll,code,date,status");
+        return -1;
+    }
+    im->kind = KINDS[run.kind].name;
+    if (sqlite3_prepare_v2(im->db, KINDS[run.kind].sql, -1, &run.ins, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(im->db, KINDS[K_ENROLLMENTS].sql, -1, &run.enroll, NULL) != SQLITE_OK) {
+        report(im, 0, sqlite3_errmsg(im->db));
+        sqlite3_finalize(run.ins);
+        return -1;
+    }
+
+    int rc = exec(im, "BEGIN IMMEDIATE");
+    if (rc == 0 && run.kind == K_ATTENDANCE && want_defer(im, rd.p, rd.end)) {
+        rc = drop_indexes(&run);
+        im->deferred = run.nindex > 0;
+        if (rc != 0) {
+            exec(im, "ROLLBACK");   // the drops too
+            while (run.nindex) free(run.index_sql[--run.nindex]);
+        }
+    }
+    long in_txn = 0;
+    while (rc == 0 && (n = csv_next(&rd, f, 4)) != 0) {
+        const char *err;
+        if (n == CSV_BAD) err = "unbalanced quotes";
+        else if (n != KINDS[run.kind].nf) err = n < KINDS[run.kind].nf ? "too few fields" : "too many fields";
+        else err = import_row(&run, f);
+        im->rows++;
+        if (err) { im->failed++; report(im, rd.line, err); }
+        else im->imported++;
+        if (++in_txn == txn_rows) {
+            in_txn = 0;
+            if ((rc = commit(&run)) == 0) rc = exec(im, "BEGIN IMMEDIATE");
+        }
+    }
+    if (rc == 0) rc = commit(&run);
+    sqlite3_finalize(run.ins);
+    sqlite3_finalize(run.enroll);
+    // indexes come back even if the import stopped early
+    if (run.nindex && rebuild_indexes(&run) != 0) rc = -1;
+    for (int i = 0; i < run.nindex; ++i) free(run.index_sql[i]);
+    return rc;
+}
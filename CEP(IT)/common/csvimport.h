@@ -0,0 +1,85 @@
+// csvimport.h — bulk CSV/TSV import into the att_server schema
+//
+// The input is a whole file in memory: mmap'd by the attimport tool, or the
+// body of an IMPORT request in att_server. Its first line names the columns,
+// and so what the rows are:
+//
+//   roll,name                  students
+//   code,title                 courses
+//   roll,code                  enrollments
+//   roll,code,date,status      attendance (YYYY-MM-DD, P/A/L; enrolls too)
+//
+// The separator is a tab if the header has one, a comma otherwise. Fields
+// may be quoted, with "" for a quote inside; CRLF line ends are fine.
+//
+// CsvReader does not copy: fields point into the buffer, and only a quoted
+// field with "" in it is unescaped, into the reader's scratch space. Rolls
+// and codes resolve through the caller's IdMap/PairSet (idmap.h), which the
+// import keeps current. Rows go in txn_rows per transaction; a row that
+// fails (unknown roll, bad date, duplicate mark, ...) is reported through
+// on_error and skipped without disturbing the rest of its transaction.
+//
+// An attendance import of a quarter of the table or more drops attendance's
+// non-unique indexes first and builds them again at the end, one sorted
+// pass each instead of a B-tree insert per row. The unique index stays, so
+// duplicates are still rejected row by row.
+
+#ifndef CSVIMPORT_H
+#define CSVIMPORT_H
+
+#include <sqlite3.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "idmap.h"
+
+#define CSV_FIELD_MAX 1024      // bytes per field
+#define CSV_TXN_ROWS  100000    // default rows per transaction
+#define CSV_BAD       (-1)      // csv_next: malformed record, skipped
+
+typedef struct {
+    const char *s;
+    size_t      n;
+} CsvField;
+
+typedef struct {
+    const char *p, *end;
+    char        sep;
+    long        line;       // line the last record started on (1-based)
+    long        next_line;
+    size_t      esc_used;
+    char        esc[4 * CSV_FIELD_MAX];   // unescaped fields of the record
+} CsvReader;
+
+void csv_reader_init(CsvReader *r, const char *buf, size_t len);
+// Next non-empty record into f[0..max). Returns its field count (which may
+// exceed max; the rest are not stored), 0 at the end, or CSV_BAD.
+int  csv_next(CsvReader *r, CsvField *f, int max);
+
+enum { CSV_DEFER_AUTO = -1, CSV_DEFER_OFF, CSV_DEFER_ON };
+
+typedef struct {
+    // set by the caller
+    sqlite3 *db;                  // in autocommit mode
+    IdMap   *students, *courses;  // roll / code -> id, warm
+    PairSet *enrolled;
+    int      txn_rows;            // 0 = CSV_TXN_ROWS
+    int      defer;               // CSV_DEFER_*
+    void   (*on_error)(void *ctx, long line, const char *msg);
+    // attendance rows as they are inserted, then each COMMIT (ok = 0: it
+    // failed and the import stops)
+    void   (*on_mark)(void *ctx, int sid, int cid, int32_t day, char status);
+    void   (*on_commit)(void *ctx, int ok);
+    void    *ctx;
+    // results
+    const char *kind;             // "students", ... once the header is read
+    long     rows, imported, failed;
+    int      deferred;            // indexes were dropped and rebuilt
+} CsvImport;
+
+// Import buf[0..len). 0 when the file was read to the end (rows may have
+// failed), -1 when it could not be (bad header, database error), with the
+// reason passed to on_error as line 0 or 1. Whatever was committed stays.
+int csv_import(CsvImport *im, const char *buf, size_t len);
+
+#endif
@@ -0,0 +1,90 @@
+// datetime.c — see datetime.h (H. Hinnant's days_from_civil algorithm)
+
+#include "datetime.h"
+
+int64_t days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153u * (unsigned)(m + (m > 2 ? -3 : 9)) + 2) / 5 + (unsigned)d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+void civil_from_days(int64_t z, int *y, int *m, int *d) {
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    *d = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *m = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *y = (int)(yoe + era * 400) + (*m <= 2);
+}
+
+// n ASCII digits at s, or -1
+static int digits(const char *s, int n) {
+    int v = 0;
+    for (int i = 0; i < n; ++i) {
+        unsigned c = (unsigned char)s[i] - '0';
+        if (c > 9) return -1;
+        v = v * 10 + (int)c;
+    }
+    return v;
+}
+
+static int days_in_month(int y, int m) {
+    static const unsigned char dim[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
+    int leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    return dim[m - 1] + (m == 2 && leap);
+}
+
+int parse_ymd(const char *s, size_t len, int64_t *day) {
+    if (len != 10 || s[4] != '-' || s[7] != '-') return -1;
+    int y = digits(s, 4), m = digits(s + 5, 2), d = digits(s + 8, 2);
+    if (y < 0 || m < 1 || m > 12 || d < 1 || d > days_in_month(y, m)) return -1;
+    *day = days_from_civil(y, m, d);
+    return 0;
+}
+
+int parse_iso8601(const char *s, size_t len, int64_t *epoch) {
+    int64_t day;
+    if (len != 20 || s[10] != 'T' || s[13] != ':' || s[16] != ':' || s[19] != 'Z') return -1;
+    if (parse_ymd(s, 10, &day) != 0) return -1;
+    int hh = digits(s + 11, 2), mm = digits(s + 14, 2), ss = digits(s + 17, 2);
+    if (hh < 0 || hh > 23 || mm < 0 || mm > 59 || ss < 0 || ss > 60) return -1;
+    *epoch = day * 86400 + hh * 3600 + mm * 60 + ss;
+    return 0;
+}
+
+static char *put_digits(char *p, unsigned v, int n) {
+    for (int i = n - 1; i >= 0; --i) { p[i] = (char)('0' + v % 10); v /= 10; }
+    return p + n;
+}
+
+// Years outside 0..9999 are clamped; the protocols never carry them.
+static char *put_ymd(char *p, int64_t day) {
+    int y, m, d;
+    civil_from_days(day, &y, &m, &d);
+    if (y < 0) y = 0;
+    if (y > 9999) y = 9999;
+    p = put_digits(p, (unsigned)y, 4); *p++ = '-';
+    p = put_digits(p, (unsigned)m, 2); *p++ = '-';
+    return put_digits(p, (unsigned)d, 2);
+}
+
+void format_ymd(int64_t day, char *out) {
+    *put_ymd(out, day) = 0;
+}
+
+void format_iso8601(int64_t epoch, char *out) {
+    int64_t day = epoch >= 0 ? epoch / 86400 : -((-epoch + 86399) / 86400);
+    unsigned sod = (unsigned)(epoch - day * 86400);
+    char *p = put_ymd(out, day);
+    *p++ = 'T';
+    p = put_digits(p, sod / 3600, 2); *p++ = ':';
+    p = put_digits(p, sod / 60 % 60, 2); *p++ = ':';
+    p = put_digits(p, sod % 60, 2);
+    *p++ = 'Z'; *p = 0;
+}
@@ -0,0 +1,24 @@
+// datetime.h — civil date <-> day number / epoch conversion (UTC only)
+//
+// Validating parsers for the two text forms the protocols carry,
+// "YYYY-MM-DD" and "YYYY-MM-DDTHH:MM:SSZ", and the matching formatters.
+// Day numbers count from 1970-01-01 (day 0).
+
+#ifndef DATETIME_H
+#define DATETIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+int64_t days_from_civil(int y, int m, int d);
+void    civil_from_days(int64_t z, int *y, int *m, int *d);
+
+// Parse exactly "YYYY-MM-DD" (len bytes). Returns 0 and *day, or -1.
+int  parse_ymd(const char *s, size_t len, int64_t *day);
+// Parse exactly "YYYY-MM-DDTHH:MM:SSZ". Returns 0 and *epoch, or -1.
+int  parse_iso8601(const char *s, size_t len, int64_t *epoch);
+// out must hold 11 / 21 bytes; both NUL-terminate.
+void format_ymd(int64_t day, char *out);
+void format_iso8601(int64_t epoch, char *out);
+
+#endif
@@ -0,0 +1,181 @@
+// dbtune.c — see dbtune.h
+
+#define _GNU_SOURCE   // pthread_condattr_setclock under -std=c17
+
+#include "dbtune.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+static int parse_mb(const char *s, long long *bytes) {
+    char *end;
+    long long v = strtoll(s, &end, 10);
+    if (end == s || *end || v < 0) return -1;
+    *bytes = v << 20;
+    return 0;
+}
+
+int dbtune_option(DbTune *t, int argc, char **argv, int *i) {
+    const char *opt = argv[*i];
+    if (strncmp(opt, "--", 2) != 0) return 0;
+    opt += 2;
+    if (strcmp(opt, "sync") && strcmp(opt, "mmap-mb") && strcmp(opt, "cache-mb") &&
+        strcmp(opt, "ckpt-ms") && strcmp(opt, "wal-max-mb"))
+        return 0;
+    if (*i + 1 >= argc) return -1;
+    const char *v = argv[++*i];
+    long long n;
+    if (!strcmp(opt, "sync")) {
+        if      (!strcmp(v, "off"))    t->synchronous = 0;
+        else if (!strcmp(v, "normal")) t->synchronous = 1;
+        else if (!strcmp(v, "full"))   t->synchronous = 2;
+        else return -1;
+    } else if (!strcmp(opt, "ckpt-ms")) {
+        int ms = atoi(v);
+        if (ms < 0) return -1;
+        t->checkpoint_ms = ms;
+    } else {
+        if (parse_mb(v, &n) != 0) return -1;
+        if      (!strcmp(opt, "mmap-mb"))  t->mmap_bytes = n;
+        else if (!strcmp(opt, "cache-mb")) t->cache_kib = n >> 10;
+        else                               t->wal_max_bytes = n;
+    }
+    return 1;
+}
+
+static int pragma(sqlite3 *db, const char *fmt, long long v) {
+    char sql[96], *err = NULL;
+    snprintf(sql, sizeof sql, fmt, v);
+    if (sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", sql, err ? err : "(unknown)");
+        sqlite3_free(err);
+        return -1;
+    }
+    return 0;
+}
+
+int dbtune_apply_reader(sqlite3 *db, const DbTune *t) {
+    if (pragma(db, "PRAGMA mmap_size=%lld;", t->mmap_bytes) != 0) return -1;
+    return pragma(db, "PRAGMA cache_size=-%lld;", t->cache_kib);
+}
+
+int dbtune_apply(sqlite3 *db, const DbTune *t) {
+    sqlite3_stmt *st;
+    if (sqlite3_prepare_v2(db, "PRAGMA journal_mode=WAL", -1, &st, NULL) != SQLITE_OK) return -1;
+    int wal = sqlite3_step(st) == SQLITE_ROW &&
+              !sqlite3_stricmp((const char*)sqlite3_column_text(st, 0), "wal");
+    sqlite3_finalize(st);
+    if (!wal) { fprintf(stderr, "journal_mode=WAL refused: %s\n", sqlite3_errmsg(db)); return -1; }
+    if (pragma(db, "PRAGMA synchronous=%lld;", t->synchronous) != 0) return -1;
+    // checkpoints belong to the Checkpointer thread, not to whoever commits
+    if (t->checkpoint_ms > 0 && pragma(db, "PRAGMA wal_autocheckpoint=%lld;", 0) != 0) return -1;
+    return dbtune_apply_reader(db, t);
+}
+
+static double now_ms(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static long long file_size(const char *path) {
+    struct stat sb;
+    return stat(path, &sb) == 0 ? (long long)sb.st_size : 0;
+}
+
+static void report(const char *why, const CheckpointStats *s) {
+    unsigned long n = s->passive + s->truncate;
+    fprintf(stderr, "checkpoint %s: wal %.1f MB (peak %.1f), %lu passive / %lu truncate / %lu busy, "
+            "last %.1f ms, avg %.1f ms, max %.1f ms\n", why,
+            s->wal_bytes / 1048576.0, s->wal_peak / 1048576.0, s->passive, s->truncate, s->busy,
+            s->last_ms, n ? s->total_ms / n : 0.0, s->max_ms);
+}
+
+static void *checkpointer_main(void *arg) {
+    Checkpointer *ck = arg;
+    double next_report = now_ms() + ck->cfg.report_s * 1e3;
+    pthread_mutex_lock(&ck->mu);
+    while (!ck->stop) {
+        struct timespec dl;
+        clock_gettime(CLOCK_MONOTONIC, &dl);
+        dl.tv_sec += ck->cfg.checkpoint_ms / 1000;
+        dl.tv_nsec += (long)(ck->cfg.checkpoint_ms % 1000) * 1000000L;
+        if (dl.tv_nsec >= 1000000000L) { dl.tv_sec++; dl.tv_nsec -= 1000000000L; }
+        while (!ck->stop && pthread_cond_timedwait(&ck->cv, &ck->mu, &dl) == 0) {}
+        if (ck->stop) break;
+        pthread_mutex_unlock(&ck->mu);
+
+        long long wal = file_size(ck->wal_path);
+        int mode = wal > ck->cfg.wal_max_bytes ? SQLITE_CHECKPOINT_TRUNCATE : SQLITE_CHECKPOINT_PASSIVE;
+        double t0 = now_ms();
+        int rc = sqlite3_wal_checkpoint_v2(ck->db, NULL, mode, NULL, NULL);
+        double ms = now_ms() - t0;
+        long long after = file_size(ck->wal_path);
+
+        pthread_mutex_lock(&ck->mu);
+        CheckpointStats *s = &ck->st;
+        s->wal_bytes = after;
+        if (wal > s->wal_peak) s->wal_peak = wal;
+        if (rc == SQLITE_BUSY) s->busy++;
+        else if (mode == SQLITE_CHECKPOINT_TRUNCATE) s->truncate++;
+        else s->passive++;
+        s->last_ms = ms; s->total_ms += ms;
+        if (ms > s->max_ms) s->max_ms = ms;
+        if (rc != SQLITE_OK && rc != SQLITE_BUSY)
+            fprintf(stderr, "checkpoint: %s\n", sqlite3_errmsg(ck->db));
+        if (mode == SQLITE_CHECKPOINT_TRUNCATE) report("truncate", s);
+        else if (ck->cfg.report_s > 0 && now_ms() >= next_report) {
+            report("stats", s);
+            next_report = now_ms() + ck->cfg.report_s * 1e3;
+        }
+    }
+    pthread_mutex_unlock(&ck->mu);
+    return NULL;
+}
+
+int checkpointer_start(Checkpointer *ck, const char *path, const DbTune *t) {
+    memset(ck, 0, sizeof *ck);
+    ck->cfg = *t;
+    if (t->checkpoint_ms <= 0) return 0;
+    size_t n = strlen(path);
+    ck->wal_path = malloc(n + 5);
+    if (!ck->wal_path) return -1;
+    memcpy(ck->wal_path, path, n);
+    memcpy(ck->wal_path + n, "-wal", 5);
+    if (sqlite3_open_v2(path, &ck->db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL) != SQLITE_OK) {
+        fprintf(stderr, "checkpointer open: %s\n", sqlite3_errmsg(ck->db));
+        sqlite3_close(ck->db); free(ck->wal_path);
+        return -1;
+    }
+    sqlite3_busy_timeout(ck->db, 1000);
+    // a checkpoint on a connection that has not read the file yet is a no-op
+    sqlite3_exec(ck->db, "SELECT count(*) FROM sqlite_master", NULL, NULL, NULL);
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&ck->cv, &ca);
+    pthread_condattr_destroy(&ca);
+    pthread_mutex_init(&ck->mu, NULL);
+    if (pthread_create(&ck->tid, NULL, checkpointer_main, ck) != 0) {
+        pthread_cond_destroy(&ck->cv); pthread_mutex_destroy(&ck->mu);
+        sqlite3_close(ck->db); free(ck->wal_path);
+        ck->db = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void checkpointer_stop(Checkpointer *ck) {
+    if (!ck->db) return;
+    pthread_mutex_lock(&ck->mu);
+    ck->stop = 1;
+    pthread_cond_signal(&ck->cv);
+    pthread_mutex_unlock(&ck->mu);
+    pthread_join(ck->tid, NULL);
+    report("final", &ck->st);
+    pthread_cond_destroy(&ck->cv); pthread_mutex_destroy(&ck->mu);
+    sqlite3_close(ck->db); free(ck->wal_path);
+    ck->db = NULL;
+}
@@ -0,0 +1,65 @@
+// dbtune.h — SQLite storage settings and a background WAL checkpointer
+//
+// dbtune_apply() puts a database in WAL mode with the configured
+// synchronous level, mmap_size and cache_size. With a checkpoint period set
+// it also turns off SQLite's commit-time auto-checkpoint, and a Checkpointer
+// thread takes over on its own connection: a PASSIVE checkpoint every
+// period, escalated to TRUNCATE once the -wal file is larger than the limit.
+// So the thread that commits never pays for copying the WAL back.
+//
+// The checkpointer logs the WAL size and checkpoint times to stderr every
+// report period, at once for every TRUNCATE, and when it is stopped.
+
+#ifndef DBTUNE_H
+#define DBTUNE_H
+
+#include <pthread.h>
+#include <sqlite3.h>
+
+typedef struct {
+    int       synchronous;     // 0 OFF, 1 NORMAL, 2 FULL
+    long long mmap_bytes;      // PRAGMA mmap_size
+    long long cache_kib;       // PRAGMA cache_size = -cache_kib
+    int       checkpoint_ms;   // PASSIVE period; 0 keeps SQLite's auto-checkpoint
+    long long wal_max_bytes;   // TRUNCATE once the -wal file is larger
+    int       report_s;        // stats line period; 0 = only TRUNCATEs
+} DbTune;
+
+#define DBTUNE_DEFAULTS { 1, 256LL << 20, 64LL << 10, 1000, 64LL << 20, 60 }
+
+// Storage flags for a server's command line; see DBTUNE_USAGE.
+#define DBTUNE_USAGE "[--sync off|normal|full] [--mmap-mb N] [--cache-mb N] [--ckpt-ms N] [--wal-max-mb N]"
+// If argv[*i] is one of them, consume it (and its value) and return 1;
+// return 0 if it is not, -1 if the value is bad.
+int dbtune_option(DbTune *t, int argc, char **argv, int *i);
+
+// Write connection: WAL plus everything above. Returns 0 or -1 (reported).
+int dbtune_apply(sqlite3 *db, const DbTune *t);
+// Extra (read-only) connections: mmap_size and cache_size only.
+int dbtune_apply_reader(sqlite3 *db, const DbTune *t);
+
+typedef struct {
+    long long     wal_bytes;      // -wal file size at the last check
+    long long     wal_peak;
+    unsigned long passive, truncate, busy;
+    double        last_ms, max_ms, total_ms;
+} CheckpointStats;
+
+typedef struct {
+    pthread_t       tid;
+    pthread_mutex_t mu;
+    pthread_cond_t  cv;
+    int             stop;
+    sqlite3        *db;
+    char           *wal_path;
+    DbTune          cfg;
+    CheckpointStats st;      // under mu
+} Checkpointer;
+
+// Open a connection to path and start the thread. Does nothing (returns 0)
+// if t->checkpoint_ms is 0.
+int  checkpointer_start(Checkpointer *ck, const char *path, const DbTune *t);
+// Stop the thread and log the final stats.
+void checkpointer_stop(Checkpointer *ck);
+
+#endif
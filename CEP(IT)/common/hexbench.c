@@ -0,0 +1,136 @@
+// hexbench.c — equivalence check and microbenchmark for hexcodec
+// Build: gcc -std=c17 -O2 -Wall -Wextra hexbench.c hexcodec.c -o hexbench
+// Run:   ./hexbench [MB]
+//
+// First compares every kernel against the decoder the servers used before
+// (isxdigit + sscanf("%2x")), exhaustively over all 2-digit inputs, every
+// single-character corruption of a SIMD-sized block, and odd-length and
+// capacity errors; exits non-zero on any mismatch. Then times each kernel
+// on <MB> megabytes of digits (default 64).
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hexcodec.h"
+
+// The pre-hexcodec ClagCode/server.c implementation, kept as the reference.
+static int legacy_hex_to_bytes(const char *hex, unsigned char *out, size_t outcap) {
+    size_t len = strlen(hex);
+    if (len % 2) return -1;
+    size_t n = len / 2;
+    if (n > outcap) return -2;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned int v;
+        if (!isxdigit((unsigned char)hex[2*i]) || !isxdigit((unsigned char)hex[2*i+1]))
+            return -3;
+        if (sscanf(&hex[2*i], "%2x", &v) != 1) return -4;
+        out[i] = (unsigned char)v;
+    }
+    return (int)n;
+}
+
+typedef struct { const char *name; int (*fn)(const char *, size_t, unsigned char *); } Kernel;
+
+static Kernel kernels[4];
+static int nkernels;
+
+// Run one input through every kernel and the legacy decoder.
+static int check(const char *hex, size_t outcap) {
+    unsigned char want[256], got[256];
+    int rw = legacy_hex_to_bytes(hex, want, outcap);
+    size_t len = strlen(hex);
+    int rc = hex_decode(hex, len, got, outcap);
+    if (rc != rw || (rc > 0 && memcmp(got, want, (size_t)rc))) {
+        fprintf(stderr, "hex_decode(\"%s\", cap %zu) = %d, legacy %d\n", hex, outcap, rc, rw);
+        return 1;
+    }
+    if (len % 2 || len / 2 > outcap) return 0;
+    for (int k = 0; k < nkernels; ++k) {
+        int r = kernels[k].fn(hex, len / 2, got);
+        int expect = rw < 0 ? rw : 0;
+        if (r != expect || (r == 0 && memcmp(got, want, len / 2))) {
+            fprintf(stderr, "%s(\"%s\") = %d, legacy %d\n", kernels[k].name, hex, r, rw);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int run_checks(void) {
+    char buf[80];
+    int fails = 0;
+    for (int a = 1; a < 256; ++a)            // every 2-character input
+        for (int b = 1; b < 256; ++b) {
+            buf[0] = (char)a; buf[1] = (char)b; buf[2] = 0;
+            fails += check(buf, 8);
+        }
+    const char *digits = "0123456789abcdefABCDEF";
+    for (int len = 0; len <= 72; ++len) {    // covers 32/16-digit blocks and tails
+        for (int i = 0; i < len; ++i) buf[i] = digits[(i * 7 + len) % 22];
+        buf[len] = 0;
+        fails += check(buf, 64);
+        fails += check(buf, (size_t)len / 2 ? (size_t)len / 2 - 1 : 0);  // capacity
+        for (int pos = 0; pos < len; ++pos)  // each bad character at each position
+            for (int c = 1; c < 256; c += 3) {
+                char save = buf[pos];
+                buf[pos] = (char)c;
+                fails += check(buf, 64);
+                buf[pos] = save;
+            }
+    }
+    return fails;
+}
+
+static double now_s(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 64;
+    kernels[nkernels++] = (Kernel){ "scalar", hex_decode_scalar };
+#ifdef HEXCODEC_X86
+    kernels[nkernels++] = (Kernel){ "sse2", hex_decode_sse2 };
+    if (hex_cpu_has_avx2()) kernels[nkernels++] = (Kernel){ "avx2", hex_decode_avx2 };
+#endif
+    printf("dispatch: %s\n", hex_impl_name());
+
+    int fails = run_checks();
+    if (fails) { fprintf(stderr, "%d mismatches\n", fails); return 1; }
+    printf("equivalence: ok\n");
+
+    // short fields are what the servers decode (roll, course, timestamp)
+    size_t sizes[] = { 8, 40, 4096 };
+    size_t total = mb << 20;
+    char *hex = malloc(total + 1);
+    unsigned char *out = malloc(total / 2);
+    if (!hex || !out) { perror("malloc"); return 1; }
+    for (size_t i = 0; i < total; ++i) hex[i] = "0123456789ABCDEF"[(i * 31) & 15];
+    hex[total] = 0;
+
+    for (size_t s = 0; s < sizeof sizes / sizeof *sizes; ++s) {
+        size_t field = sizes[s];
+        printf("field %5zu digits:", field);
+        double t = now_s();
+        for (size_t off = 0; off + field <= total && off < (16u << 20); off += field) {
+            char save = hex[off + field]; hex[off + field] = 0;
+            legacy_hex_to_bytes(hex + off, out, total / 2);
+            hex[off + field] = save;
+        }
+        double leg = now_s() - t;
+        printf("  legacy %7.1f MB/s", (total < (16u << 20) ? total : (16u << 20)) / leg / 1e6);
+        for (int k = 0; k < nkernels; ++k) {
+            t = now_s();
+            for (size_t off = 0; off + field <= total; off += field)
+                kernels[k].fn(hex + off, field / 2, out + off / 2);
+            printf("  %s %7.1f MB/s", kernels[k].name, total / (now_s() - t) / 1e6);
+        }
+        printf("\n");
+    }
+    free(hex); free(out);
+    return 0;
+}
@@ -0,0 +1,142 @@
+// hexcodec.c — see hexcodec.h
+
+#include "hexcodec.h"
+
+#include <stdint.h>
+
+#ifdef HEXCODEC_X86
+#include <immintrin.h>
+#endif
+
+// nibble value + 1, so every other (zero-initialised) entry reads as -1
+static const int8_t NIB[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+int hex_decode_scalar(const char *hex, size_t n, unsigned char *out) {
+    int bad = 0;
+    for (size_t i = 0; i < n; ++i) {
+        int hi = NIB[(unsigned char)hex[2*i]] - 1;
+        int lo = NIB[(unsigned char)hex[2*i+1]] - 1;
+        bad |= hi | lo;
+        out[i] = (unsigned char)(((unsigned)hi << 4) | ((unsigned)lo & 0xF));
+    }
+    return bad < 0 ? HEX_ERR_DIGIT : 0;
+}
+
+#ifdef HEXCODEC_X86
+// 16 digits -> 8 bytes. Returns 0 when every digit was valid.
+static inline int sse2_block(const char *hex, unsigned char *out) {
+    __m128i v     = _mm_loadu_si128((const __m128i*)hex);
+    __m128i isdig = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i low   = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i isalp = _mm_and_si128(_mm_cmpgt_epi8(low, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(low, _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(isdig, isalp)) != 0xFFFF) return -1;
+    __m128i nib = _mm_or_si128(
+        _mm_and_si128(isdig, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+        _mm_and_si128(isalp, _mm_sub_epi8(low, _mm_set1_epi8('a' - 10))));
+    // each 16-bit lane holds (hi nibble, lo nibble) in (low, high) byte
+    __m128i b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nib, _mm_set1_epi16(0x00FF)), 4),
+                             _mm_srli_epi16(nib, 8));
+    _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(b, _mm_setzero_si128()));
+    return 0;
+}
+
+int hex_decode_sse2(const char *hex, size_t n, unsigned char *out) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        if (sse2_block(hex + 2*i, out + i)) return HEX_ERR_DIGIT;
+    return hex_decode_scalar(hex + 2*i, n - i, out + i);
+}
+
+__attribute__((target("avx2")))
+int hex_decode_avx2(const char *hex, size_t n, unsigned char *out) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v     = _mm256_loadu_si256((const __m256i*)(hex + 2*i));
+        __m256i isdig = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+        __m256i low   = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i isalp = _mm256_and_si256(_mm256_cmpgt_epi8(low, _mm256_set1_epi8('a' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), low));
+        if ((uint32_t)_mm256_movemask_epi8(_mm256_or_si256(isdig, isalp)) != 0xFFFFFFFFu)
+            return HEX_ERR_DIGIT;
+        __m256i nib = _mm256_or_si256(
+            _mm256_and_si256(isdig, _mm256_sub_epi8(v, _mm256_set1_epi8('0'))),
+            _mm256_and_si256(isalp, _mm256_sub_epi8(low, _mm256_set1_epi8('a' - 10))));
+        __m256i b = _mm256_or_si256(
+            _mm256_slli_epi16(_mm256_and_si256(nib, _mm256_set1_epi16(0x00FF)), 4),
+            _mm256_srli_epi16(nib, 8));
+        // packus works per 128-bit lane: qwords [A,0,B,0] -> [A,B,..]
+        __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi16(b, _mm256_setzero_si256()),
+                                             0xD8);
+        _mm_storeu_si128((__m128i*)(out + i), _mm256_castsi256_si128(p));
+    }
+    for (; i + 8 <= n; i += 8)
+        if (sse2_block(hex + 2*i, out + i)) return HEX_ERR_DIGIT;
+    return hex_decode_scalar(hex + 2*i, n - i, out + i);
+}
+
+int hex_cpu_has_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+typedef struct {
+    const char *name;
+    int (*decode)(const char *, size_t, unsigned char *);
+} HexImpl;
+
+#ifdef HEXCODEC_X86
+static const HexImpl IMPL_AVX2 = { "avx2", hex_decode_avx2 };
+static const HexImpl IMPL_SSE2 = { "sse2", hex_decode_sse2 };   // baseline on x86-64
+#else
+static const HexImpl IMPL_SCALAR = { "scalar", hex_decode_scalar };
+#endif
+
+// Chosen on first use, from whichever threads get there first: they all pick
+// the same entry, and the acquire load sees the whole entry it points to.
+static const HexImpl *g_impl;
+
+static const HexImpl *impl(void) {
+    const HexImpl *im = __atomic_load_n(&g_impl, __ATOMIC_ACQUIRE);
+    if (im) return im;
+#ifdef HEXCODEC_X86
+    im = hex_cpu_has_avx2() ? &IMPL_AVX2 : &IMPL_SSE2;
+#else
+    im = &IMPL_SCALAR;
+#endif
+    __atomic_store_n(&g_impl, im, __ATOMIC_RELEASE);
+    return im;
+}
+
+const char *hex_impl_name(void) {
+    return impl()->name;
+}
+
+int hex_decode(const char *hex, size_t len, unsigned char *out, size_t outcap) {
+    if (len % 2) return HEX_ERR_ODD;
+    size_t n = len / 2;
+    if (n > outcap) return HEX_ERR_SPACE;
+    int rc = impl()->decode(hex, n, out);
+    return rc ? rc : (int)n;
+}
+
+size_t hex_encode(const void *in, size_t len, char *out, size_t outcap, int upper) {
+    static const char HU[] = "0123456789ABCDEF", HL[] = "0123456789abcdef";
+    const char *H = upper ? HU : HL;
+    const unsigned char *p = in;
+    if (outcap < len * 2 + 1) { if (outcap) out[0] = 0; return 0; }
+    for (size_t i = 0; i < len; ++i) {
+        out[2*i]   = H[p[i] >> 4];
+        out[2*i+1] = H[p[i] & 0xF];
+    }
+    out[len*2] = 0;
+    return len * 2;
+}
@@ -0,0 +1,37 @@
+// hexcodec.h — hex encode/decode shared by the servers and clients
+//
+// Decoding uses a 256-entry lookup table; on x86 an SSE2 or AVX2 kernel is
+// picked once at runtime and handles 16/32 hex digits per step, with the
+// table finishing the tail. All paths return the same results.
+
+#ifndef HEXCODEC_H
+#define HEXCODEC_H
+
+#include <stddef.h>
+
+#define HEX_ERR_ODD   (-1)   // odd number of digits
+#define HEX_ERR_SPACE (-2)   // decoded bytes would not fit in outcap
+#define HEX_ERR_DIGIT (-3)   // a character outside [0-9A-Fa-f]
+
+// Decode len hex digits into out. Returns the byte count or a HEX_ERR_*
+// code (checked in that order). Empty input decodes to 0 bytes.
+int hex_decode(const char *hex, size_t len, unsigned char *out, size_t outcap);
+
+// Encode len bytes as 2*len digits plus a NUL. Returns the digit count, or
+// 0 with out[0] = 0 when outcap is too small.
+size_t hex_encode(const void *in, size_t len, char *out, size_t outcap, int upper);
+
+// Name of the decode kernel in use ("scalar", "sse2", "avx2").
+const char *hex_impl_name(void);
+
+// Individual kernels, exposed for hexbench. n is the number of output
+// bytes (2*n digits are read); return 0, or HEX_ERR_DIGIT.
+int hex_decode_scalar(const char *hex, size_t n, unsigned char *out);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HEXCODEC_X86 1
+int hex_decode_sse2(const char *hex, size_t n, unsigned char *out);
+int hex_decode_avx2(const char *hex, size_t n, unsigned char *out);
+int hex_cpu_has_avx2(void);
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+// histo.c — see histo.h
+
+#include "histo.h"
+
+#include <string.h>
+
+static int msb(uint64_t v) { return 63 - __builtin_clzll(v); }
+
+static int bucket_of(uint64_t v) {
+    if (v < 2 * HISTO_SUB) return (int)v;
+    int shift = msb(v) - 6;   // 6 = log2(HISTO_SUB)
+    int i = shift * HISTO_SUB + (int)(v >> shift);
+    return i < HISTO_BUCKETS ? i : HISTO_BUCKETS - 1;
+}
+
+// Largest value that lands in bucket i.
+static uint64_t bucket_top(int i) {
+    if (i < 2 * HISTO_SUB) return (uint64_t)i;
+    int shift = i / HISTO_SUB - 1;
+    return (((uint64_t)(i - shift * HISTO_SUB) + 1) << shift) - 1;
+}
+
+void histo_init(Histo *h) {
+    memset(h, 0, sizeof *h);
+    h->min = UINT64_MAX;
+}
+
+void histo_add(Histo *h, uint64_t v) {
+    h->b[bucket_of(v)]++;
+    h->count++;
+    h->sum += (double)v;
+    if (v < h->min) h->min = v;
+    if (v > h->max) h->max = v;
+}
+
+void histo_merge(Histo *dst, const Histo *src) {
+    for (int i = 0; i < HISTO_BUCKETS; ++i) dst->b[i] += src->b[i];
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t histo_quantile(const Histo *h, double q) {
+    if (!h->count) return 0;
+    uint64_t want = (uint64_t)(q * (double)h->count + 0.5);
+    if (want < 1) want = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTO_BUCKETS; ++i) {
+        seen += h->b[i];
+        if (seen >= want) {
+            uint64_t top = bucket_top(i);
+            return top < h->max ? top : h->max;
+        }
+    }
+    return h->max;
+}
+
+void histo_print(const Histo *h, FILE *f, double scale) {
+    if (!h->count) { fprintf(f, "(no samples)"); return; }
+    fprintf(f, "avg %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f",
+            h->sum / (double)h->count / scale,
+            histo_quantile(h, 0.50) / scale, histo_quantile(h, 0.90) / scale,
+            histo_quantile(h, 0.99) / scale, histo_quantile(h, 0.999) / scale,
+            h->max / scale);
+}
+
+void histo_dump(const Histo *h, FILE *f, double scale) {
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTO_BUCKETS; ++i) {
+        if (!h->b[i]) continue;
+        seen += h->b[i];
+        fprintf(f, "%12.1f %10llu %.6f\n", bucket_top(i) / scale,
+                (unsigned long long)h->b[i], (double)seen / (double)h->count);
+    }
+}
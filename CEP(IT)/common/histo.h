@@ -0,0 +1,34 @@
+// histo.h — HDR-style latency histogram
+//
+// Log-linear buckets: values below 2*HISTO_SUB are exact, above that every
+// power-of-two range is split into HISTO_SUB buckets, so any recorded value
+// is reported within 1/HISTO_SUB (~1.6%) of itself, from nanoseconds to
+// hours, in a fixed 21 KB table. Adding is a few instructions and
+// histograms from different threads merge by summing.
+
+#ifndef HISTO_H
+#define HISTO_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HISTO_SUB     64
+#define HISTO_BUCKETS (HISTO_SUB * 42)   // up to 2^47
+
+typedef struct {
+    uint64_t count, min, max;
+    double   sum;
+    uint64_t b[HISTO_BUCKETS];
+} Histo;
+
+void     histo_init(Histo *h);
+void     histo_add(Histo *h, uint64_t v);
+void     histo_merge(Histo *dst, const Histo *src);
+// Smallest bucket upper bound with at least q (0..1) of the values below it.
+uint64_t histo_quantile(const Histo *h, double q);
+// "p50 .. p90 .. p99 .. p99.9 .. max .." with values divided by scale.
+void     histo_print(const Histo *h, FILE *f, double scale);
+// Non-empty buckets as "upper_bound count cumulative_fraction" lines.
+void     histo_dump(const Histo *h, FILE *f, double scale);
+
+#endif
@@ -0,0 +1,137 @@
+// idmap.c — see idmap.h
+
+#include "idmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t fnv1a(const char *s, size_t n) {
+    uint32_t h = 2166136261u;
+    while (n--) { h ^= (unsigned char)*s++; h *= 16777619u; }
+    return h;
+}
+
+static size_t pow2_for(size_t expected) {
+    size_t c = 64;
+    while (c < expected * 2) c <<= 1;   // keep load under 1/2 at the start
+    return c;
+}
+
+int idmap_init(IdMap *m, size_t expected) {
+    m->cap = pow2_for(expected);
+    m->count = 0;
+    m->slots = calloc(m->cap, sizeof *m->slots);
+    return m->slots ? 0 : -1;
+}
+
+void idmap_clear(IdMap *m) {
+    for (size_t i = 0; i < m->cap; ++i) free(m->slots[i].key);
+    memset(m->slots, 0, m->cap * sizeof *m->slots);
+    m->count = 0;
+}
+
+void idmap_free(IdMap *m) {
+    if (m->slots) idmap_clear(m);
+    free(m->slots);
+    m->slots = NULL; m->cap = 0;
+}
+
+static IdSlot *find_slot(IdSlot *slots, size_t cap, const char *key, size_t n, uint32_t h) {
+    size_t i = h & (cap - 1);
+    for (;;) {
+        IdSlot *s = &slots[i];
+        if (!s->key || (s->hash == h && strncmp(s->key, key, n) == 0 && s->key[n] == 0)) return s;
+        i = (i + 1) & (cap - 1);
+    }
+}
+
+int idmap_get(const IdMap *m, const char *key) {
+    return idmap_get_n(m, key, strlen(key));
+}
+
+int idmap_get_n(const IdMap *m, const char *key, size_t n) {
+    const IdSlot *s = find_slot(m->slots, m->cap, key, n, fnv1a(key, n));
+    return s->key ? s->id : -1;
+}
+
+static int idmap_grow(IdMap *m) {
+    size_t ncap = m->cap * 2;
+    IdSlot *ns = calloc(ncap, sizeof *ns);
+    if (!ns) return -1;
+    for (size_t i = 0; i < m->cap; ++i)
+        if (m->slots[i].key) *find_slot(ns, ncap, m->slots[i].key, strlen(m->slots[i].key), m->slots[i].hash) = m->slots[i];
+    free(m->slots);
+    m->slots = ns; m->cap = ncap;
+    return 0;
+}
+
+int idmap_put(IdMap *m, const char *key, int id) {
+    return idmap_put_n(m, key, strlen(key), id);
+}
+
+int idmap_put_n(IdMap *m, const char *key, size_t n, int id) {
+    if ((m->count + 1) * 10 > m->cap * 7 && idmap_grow(m) != 0) return -1;
+    uint32_t h = fnv1a(key, n);
+    IdSlot *s = find_slot(m->slots, m->cap, key, n, h);
+    if (!s->key) {
+        if (!(s->key = malloc(n + 1))) return -1;
+        memcpy(s->key, key, n);
+        s->key[n] = 0;
+        s->hash = h;
+        m->count++;
+    }
+    s->id = id;
+    return 0;
+}
+
+static uint64_t pair_key(int a, int b) {
+    return (((uint64_t)(uint32_t)a << 32) | (uint32_t)b) + 1;
+}
+
+static size_t pair_hash(uint64_t k) {
+    k ^= k >> 33; k *= 0xff51afd7ed558ccdULL; k ^= k >> 33;
+    return (size_t)k;
+}
+
+int pairset_init(PairSet *s, size_t expected) {
+    s->cap = pow2_for(expected);
+    s->count = 0;
+    s->keys = calloc(s->cap, sizeof *s->keys);
+    return s->keys ? 0 : -1;
+}
+
+void pairset_clear(PairSet *s) {
+    memset(s->keys, 0, s->cap * sizeof *s->keys);
+    s->count = 0;
+}
+
+void pairset_free(PairSet *s) {
+    free(s->keys);
+    s->keys = NULL; s->cap = 0;
+}
+
+static uint64_t *pair_slot(uint64_t *keys, size_t cap, uint64_t k) {
+    size_t i = pair_hash(k) & (cap - 1);
+    while (keys[i] && keys[i] != k) i = (i + 1) & (cap - 1);
+    return &keys[i];
+}
+
+int pairset_has(const PairSet *s, int a, int b) {
+    uint64_t k = pair_key(a, b);
+    return *pair_slot(s->keys, s->cap, k) == k;
+}
+
+int pairset_add(PairSet *s, int a, int b) {
+    if ((s->count + 1) * 10 > s->cap * 7) {
+        size_t ncap = s->cap * 2;
+        uint64_t *nk = calloc(ncap, sizeof *nk);
+        if (!nk) return -1;
+        for (size_t i = 0; i < s->cap; ++i)
+            if (s->keys[i]) *pair_slot(nk, ncap, s->keys[i]) = s->keys[i];
+        free(s->keys);
+        s->keys = nk; s->cap = ncap;
+    }
+    uint64_t *slot = pair_slot(s->keys, s->cap, pair_key(a, b));
+    if (!*slot) { *slot = pair_key(a, b); s->count++; }
+    return 0;
+}
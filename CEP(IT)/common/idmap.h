@@ -0,0 +1,50 @@
+// idmap.h — in-memory identity caches in front of students/courses/enrollments
+//
+// IdMap maps a key string (roll number, course code) to its row id with open
+// addressing and linear probing; PairSet remembers known (student, course)
+// enrollment pairs. Both are warmed from the DB at startup and updated by
+// the server whenever it creates a row, so the per-mark lookups stay in
+// memory. Not thread-safe: owned by the thread that writes the DB.
+
+#ifndef IDMAP_H
+#define IDMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    char    *key;    // NULL = empty slot
+    uint32_t hash;
+    int      id;
+} IdSlot;
+
+typedef struct {
+    IdSlot *slots;
+    size_t  cap;     // power of two
+    size_t  count;
+} IdMap;
+
+int  idmap_init(IdMap *m, size_t expected);
+void idmap_free(IdMap *m);
+void idmap_clear(IdMap *m);
+// Returns the id for key, or -1 when absent.
+int  idmap_get(const IdMap *m, const char *key);
+// Insert or overwrite. Returns -1 on OOM.
+int  idmap_put(IdMap *m, const char *key, int id);
+// The same for a key of n bytes that need not be NUL-terminated.
+int  idmap_get_n(const IdMap *m, const char *key, size_t n);
+int  idmap_put_n(IdMap *m, const char *key, size_t n, int id);
+
+typedef struct {
+    uint64_t *keys;  // 0 = empty slot; stored as key+1
+    size_t    cap;
+    size_t    count;
+} PairSet;
+
+int  pairset_init(PairSet *s, size_t expected);
+void pairset_free(PairSet *s);
+void pairset_clear(PairSet *s);
+int  pairset_has(const PairSet *s, int a, int b);
+int  pairset_add(PairSet *s, int a, int b);
+
+#endif
@@ -0,0 +1,341 @@
+// ingestlog.c — see ingestlog.h
+
+#define _GNU_SOURCE   // O_CLOEXEC, fdatasync, openat under -std=c17
+
+#include "ingestlog.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CURSOR_BUF (256 * 1024)
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = c & 1 ? (c >> 1) ^ 0x82F63B78u : c >> 1;   // Castagnoli, reflected
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32c(uint32_t crc, const uint8_t *p, size_t n) {
+    crc = ~crc;
+    while (n--) crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_le(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+// CRC of a record whose header is at h and payload at p.
+static uint32_t record_crc(const uint8_t *h, const uint8_t *p, size_t n) {
+    uint32_t crc = crc32c(0, h, 4);
+    crc = crc32c(crc, h + 8, 8);
+    return crc32c(crc, p, n);
+}
+
+// The record at p[0..avail): 1 and its seq and size if it is whole and
+// valid, 0 if more bytes are needed, -1 if it is not a record.
+static int parse_record(const uint8_t *p, size_t avail, uint64_t *seq, size_t *size) {
+    if (avail < ILOG_HDR) return 0;
+    size_t n = (size_t)get_le(p, 4);
+    if (n > ILOG_REC_MAX) return -1;
+    if (avail - ILOG_HDR < n) return 0;
+    if (record_crc(p, p + ILOG_HDR, n) != (uint32_t)get_le(p + 4, 4)) return -1;
+    *seq = get_le(p + 8, 8);
+    *size = ILOG_HDR + n;
+    return 1;
+}
+
+static void seg_name(char *out, size_t cap, uint64_t first) {
+    snprintf(out, cap, "%016llx.ilog", (unsigned long long)first);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int add_seg(IngestLog *l, uint64_t first) {
+    if (l->nsegs == l->capsegs) {
+        size_t cap = l->capsegs ? l->capsegs * 2 : 16;
+        uint64_t *s = realloc(l->segs, cap * sizeof *s);
+        if (!s) return -1;
+        l->segs = s; l->capsegs = cap;
+    }
+    l->segs[l->nsegs++] = first;
+    return 0;
+}
+
+static int open_seg(IngestLog *l, uint64_t first, int flags) {
+    char name[32];
+    seg_name(name, sizeof name, first);
+    return openat(l->dirfd, name, flags | O_CLOEXEC, 0644);
+}
+
+// Start a new segment whose first record will be first.
+static int new_segment(IngestLog *l, uint64_t first) {
+    int fd = open_seg(l, first, O_WRONLY | O_APPEND | O_CREAT | O_TRUNC);
+    if (fd < 0) return -1;
+    if (fsync(l->dirfd) != 0) { close(fd); return -1; }   // the new name is durable too
+    pthread_mutex_lock(&l->mu);
+    int rc = add_seg(l, first);
+    pthread_mutex_unlock(&l->mu);
+    if (rc != 0) { close(fd); return -1; }
+    if (l->fd >= 0) { close(l->fd); l->rotations++; }
+    l->fd = fd;
+    l->seg_bytes = 0;
+    return 0;
+}
+
+// Scan the last segment: find its last good record and cut off anything
+// after it (a batch that was being written when the process died).
+static int recover_tail(IngestLog *l, uint64_t *last) {
+    uint64_t first = l->segs[l->nsegs - 1];
+    int fd = open_seg(l, first, O_RDWR);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) != 0) { perror("ingest log: open segment"); if (fd >= 0) close(fd); return -1; }
+    uint8_t *buf = malloc(CURSOR_BUF);
+    if (!buf) { close(fd); return -1; }
+    size_t have = 0, good = 0;
+    *last = first - 1;
+    for (int more = 1; more; ) {
+        ssize_t r = read(fd, buf + have, CURSOR_BUF - have);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) { perror("ingest log: read"); free(buf); close(fd); return -1; }
+        have += (size_t)r;
+        size_t pos = 0, sz;
+        uint64_t seq;
+        int ok;
+        while ((ok = parse_record(buf + pos, have - pos, &seq, &sz)) == 1 && seq == *last + 1) {
+            pos += sz; good += sz; *last = seq;
+        }
+        more = r > 0 && ok == 0;   // stop at the end of the file or a bad record
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
+    }
+    free(buf);
+    if ((uint64_t)sb.st_size > good) {
+        char name[32];
+        seg_name(name, sizeof name, first);
+        fprintf(stderr, "ingest log: %s: dropping %llu bytes after record %llu (torn write)\n",
+                name, (unsigned long long)(sb.st_size - good), (unsigned long long)*last);
+        if (ftruncate(fd, (off_t)good) != 0 || fdatasync(fd) != 0) { perror("ingest log: truncate"); close(fd); return -1; }
+    }
+    close(fd);
+    return 0;
+}
+
+int ilog_open(IngestLog *l, const char *dir, uint64_t seg_max, uint64_t min_seq) {
+    memset(l, 0, sizeof *l);
+    pthread_once(&crc_once, crc_init);
+    l->fd = -1;
+    l->seg_max = seg_max;
+    pthread_mutex_init(&l->mu, NULL);
+    if (!(l->dir = strdup(dir))) return -1;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) { perror(dir); return -1; }
+    if ((l->dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) { perror(dir); return -1; }
+
+    DIR *d = fdopendir(dup(l->dirfd));
+    if (!d) { perror(dir); return -1; }
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        unsigned long long first;
+        char tail[8];
+        if (sscanf(e->d_name, "%16llx.%7s", &first, tail) == 2 && strlen(e->d_name) == 21 &&
+            !strcmp(tail, "ilog") && first > 0 && add_seg(l, first) != 0) { closedir(d); return -1; }
+    }
+    closedir(d);
+    qsort(l->segs, l->nsegs, sizeof *l->segs, cmp_u64);
+
+    uint64_t last = 0;
+    if (l->nsegs && recover_tail(l, &last) != 0) return -1;
+    l->next_seq = (last > min_seq ? last : min_seq) + 1;
+    l->durable = l->next_seq - 1;
+    if (l->nsegs && last + 1 == l->next_seq) {
+        // keep appending to the last segment
+        if ((l->fd = open_seg(l, l->segs[l->nsegs - 1], O_WRONLY | O_APPEND)) < 0) { perror("ingest log"); return -1; }
+        struct stat sb;
+        if (fstat(l->fd, &sb) != 0) return -1;
+        l->seg_bytes = (uint64_t)sb.st_size;
+    } else if (new_segment(l, l->next_seq) != 0) {
+        perror("ingest log: new segment");
+        return -1;
+    }
+    return 0;
+}
+
+void ilog_close(IngestLog *l) {
+    if (l->fd >= 0) close(l->fd);
+    if (l->dirfd > 0) close(l->dirfd);
+    free(l->dir); free(l->buf); free(l->segs);
+    pthread_mutex_destroy(&l->mu);
+    memset(l, 0, sizeof *l);
+    l->fd = -1;
+}
+
+uint64_t ilog_append(IngestLog *l, const void *p, size_t n) {
+    if (n > ILOG_REC_MAX) return 0;
+    if (l->len + ILOG_HDR + n > l->cap) {
+        size_t cap = l->cap ? l->cap : 64 * 1024;
+        while (cap < l->len + ILOG_HDR + n) cap *= 2;
+        uint8_t *b = realloc(l->buf, cap);
+        if (!b) return 0;
+        l->buf = b; l->cap = cap;
+    }
+    uint8_t *h = l->buf + l->len;
+    uint64_t seq = l->next_seq++;
+    put_le(h, n, 4);
+    put_le(h + 8, seq, 8);
+    memcpy(h + ILOG_HDR, p, n);
+    put_le(h + 4, record_crc(h, h + ILOG_HDR, n), 4);
+    l->len += ILOG_HDR + n;
+    return seq;
+}
+
+static double now_ms(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+uint64_t ilog_sync(IngestLog *l) {
+    if (!l->len) return l->durable;
+    uint64_t first = get_le(l->buf + 8, 8);
+    if (l->seg_bytes >= l->seg_max && new_segment(l, first) != 0) perror("ingest log: rotate");
+    double t0 = now_ms();
+    size_t off = 0;
+    while (off < l->len) {
+        ssize_t w = write(l->fd, l->buf + off, l->len - off);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) break;
+        off += (size_t)w;
+    }
+    if (off < l->len || fdatasync(l->fd) != 0) {
+        perror("ingest log: write");
+        // cut the batch off again: nothing after durable may stay in the file
+        if (ftruncate(l->fd, (off_t)l->seg_bytes) != 0) perror("ingest log: truncate");
+        l->next_seq = first;
+        l->len = 0;
+        return 0;
+    }
+    double ms = now_ms() - t0;
+    l->syncs++;
+    l->sync_ms_total += ms;
+    if (ms > l->sync_ms_max) l->sync_ms_max = ms;
+    l->seg_bytes += l->len;
+    l->len = 0;
+    return l->durable = l->next_seq - 1;
+}
+
+void ilog_report(const IngestLog *l, const char *why) {
+    fprintf(stderr, "ingest log %s: durable seq %llu, %lu syncs, avg %.1f ms, max %.1f ms, %lu rotations\n",
+            why, (unsigned long long)l->durable, l->syncs,
+            l->syncs ? l->sync_ms_total / l->syncs : 0.0, l->sync_ms_max, l->rotations);
+}
+
+void ilog_release(IngestLog *l, uint64_t seq) {
+    pthread_mutex_lock(&l->mu);
+    size_t drop = 0;
+    // segment i holds [segs[i], segs[i+1]); never drop the one being appended to
+    while (drop + 1 < l->nsegs && l->segs[drop + 1] <= seq + 1) {
+        char name[32];
+        seg_name(name, sizeof name, l->segs[drop]);
+        if (unlinkat(l->dirfd, name, 0) != 0 && errno != ENOENT) { perror("ingest log: unlink"); break; }
+        drop++;
+    }
+    if (drop) {
+        memmove(l->segs, l->segs + drop, (l->nsegs - drop) * sizeof *l->segs);
+        l->nsegs -= drop;
+    }
+    pthread_mutex_unlock(&l->mu);
+}
+
+int ilog_cursor_open(IlogCursor *c, IngestLog *l, uint64_t seq) {
+    memset(c, 0, sizeof *c);
+    c->log = l;
+    c->fd = -1;
+    c->next = seq;
+    c->cap = CURSOR_BUF;
+    return (c->buf = malloc(c->cap)) ? 0 : -1;
+}
+
+void ilog_cursor_close(IlogCursor *c) {
+    if (c->fd >= 0) close(c->fd);
+    free(c->buf);
+    memset(c, 0, sizeof *c);
+    c->fd = -1;
+}
+
+// Open the segment that holds c->next (or the oldest one, if c->next is
+// older than anything kept).
+static int cursor_seek(IlogCursor *c) {
+    IngestLog *l = c->log;
+    pthread_mutex_lock(&l->mu);
+    uint64_t first = 0;
+    for (size_t i = 0; i < l->nsegs && (first == 0 || l->segs[i] <= c->next); ++i) first = l->segs[i];
+    pthread_mutex_unlock(&l->mu);
+    if (!first || first == c->seg) return -1;   // nothing (else) holds it
+    c->seg = first;
+    if (first > c->next) {
+        fprintf(stderr, "ingest log: records %llu..%llu are gone, resuming at %llu\n",
+                (unsigned long long)c->next, (unsigned long long)first - 1, (unsigned long long)first);
+        c->next = first;
+    }
+    if (c->fd >= 0) close(c->fd);
+    c->have = c->pos = 0;
+    if ((c->fd = open_seg(l, first, O_RDONLY)) < 0) return -1;
+    posix_fadvise(c->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
+int ilog_next(IlogCursor *c, uint64_t upto, uint64_t *seq, const uint8_t **p, size_t *n) {
+    if (c->fd < 0 && cursor_seek(c) != 0) return -1;
+    for (;;) {
+        if (c->next > upto) {
+            // bytes past upto may belong to a batch that fails and is cut
+            // off again: read them afresh next time
+            if (c->have > c->pos && lseek(c->fd, -(off_t)(c->have - c->pos), SEEK_CUR) < 0) return -1;
+            c->have = c->pos = 0;
+            return 0;
+        }
+        uint64_t s;
+        size_t sz;
+        int ok = parse_record(c->buf + c->pos, c->have - c->pos, &s, &sz);
+        if (ok < 0) return -1;
+        if (ok) {
+            if (s > c->next) return -1;   // a gap: something is missing
+            c->pos += sz;
+            if (s < c->next) continue;    // before where we were asked to start
+            c->next++;
+            *seq = s;
+            *p = c->buf + c->pos - sz + ILOG_HDR;
+            *n = sz - ILOG_HDR;
+            return 1;
+        }
+        // need more of this segment (or the next one)
+        memmove(c->buf, c->buf + c->pos, c->have - c->pos);
+        c->have -= c->pos; c->pos = 0;
+        ssize_t r = read(c->fd, c->buf + c->have, c->cap - c->have);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) return -1;
+        if (r > 0) { c->have += (size_t)r; continue; }
+        // end of this segment: whatever is left is not a whole record
+        if (c->have != 0 || cursor_seek(c) != 0) return -1;
+    }
+}
@@ -0,0 +1,91 @@
+// ingestlog.h — append-only, checksummed, segment-rotated record log
+//
+// A server writes each accepted request here before it acknowledges it, and
+// a separate thread applies the log to the database at its own pace. The
+// log lives in a directory of segment files named after the sequence number
+// of their first record (%016llx.ilog); records are numbered 1, 2, ... with
+// no gaps across segments.
+//
+//   record = len:u32  crc:u32  seq:u64  payload[len]     (little-endian)
+//   crc    = CRC-32C of len, seq and payload
+//
+// One thread appends: ilog_append() only buffers, and ilog_sync() writes the
+// whole batch with one write() on an O_APPEND descriptor and one fdatasync(),
+// so the cost of making a batch durable is paid once for all its records.
+// A batch that cannot be written is cut off the file again and fails as a
+// whole. Once the current segment reaches seg_max bytes the next batch
+// starts a new one (and the directory is fsync'ed).
+//
+// ilog_open() recovers after a crash: a torn or corrupt record at the end
+// of the last segment (a batch whose write or fdatasync never finished, so
+// never acknowledged) is truncated away. The applier reads with an
+// IlogCursor, which checks every checksum and sequence number, and reports
+// how far it has got with ilog_release(); segments whose records are all
+// applied are deleted. Keeping the applied sequence number in the same
+// transaction as the applied rows makes replay after a restart idempotent.
+
+#ifndef INGESTLOG_H
+#define INGESTLOG_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ILOG_REC_MAX  (64 * 1024)   // payload bytes per record
+#define ILOG_HDR      16
+
+typedef struct {
+    char           *dir;
+    int             dirfd;
+    int             fd;           // current segment, O_APPEND
+    uint64_t        seg_bytes;    // its size
+    uint64_t        seg_max;
+    uint64_t        next_seq;     // seq of the next ilog_append
+    uint64_t        durable;      // last seq known to be on disk (appender thread)
+    // the batch being built
+    uint8_t        *buf;
+    size_t          len, cap;
+    // first seq of each segment, ascending; the last one is being appended to
+    pthread_mutex_t mu;
+    uint64_t       *segs;
+    size_t          nsegs, capsegs;
+    // stats (appender thread)
+    unsigned long   syncs, rotations;
+    double          sync_ms_max, sync_ms_total;
+} IngestLog;
+
+// Open or create dir and recover its tail. Numbering continues after the
+// last record on disk, or after min_seq if that is higher (a log that was
+// removed after everything in it was applied). -1 with a message on stderr.
+int      ilog_open(IngestLog *l, const char *dir, uint64_t seg_max, uint64_t min_seq);
+void     ilog_close(IngestLog *l);
+// Add a record to the batch; returns its seq, or 0 if n > ILOG_REC_MAX or
+// out of memory.
+uint64_t ilog_append(IngestLog *l, const void *p, size_t n);
+// Write and fdatasync the batch. Returns the last durable seq, or 0 if the
+// write failed (every record of the batch is dropped; their seqs are reused).
+uint64_t ilog_sync(IngestLog *l);
+// Everything up to seq is applied: delete segments that hold nothing newer.
+void     ilog_release(IngestLog *l, uint64_t seq);
+// One stats line on stderr, next to the checkpointer's (dbtune.h). Appender
+// thread, or once it is done.
+void     ilog_report(const IngestLog *l, const char *why);
+
+typedef struct {
+    IngestLog *log;
+    int        fd;             // segment being read, -1 if none yet
+    uint64_t   seg;            // its first seq
+    uint64_t   next;           // seq of the next record to return
+    uint8_t   *buf;
+    size_t     have, pos, cap;
+} IlogCursor;
+
+// Start reading at record seq (or the oldest one kept, if that is later).
+int  ilog_cursor_open(IlogCursor *c, IngestLog *l, uint64_t seq);
+void ilog_cursor_close(IlogCursor *c);
+// Next record if its seq is <= upto (records up to the durable seq are
+// complete on disk). 1 and *seq / *p / *n (valid until the next call), 0 if
+// the next record is past upto, -1 if the log is corrupt or unreadable.
+int  ilog_next(IlogCursor *c, uint64_t upto, uint64_t *seq, const uint8_t **p, size_t *n);
+
+#endif
@@ -0,0 +1,468 @@
+// loadgen.c — headless load generator for the attendance servers
+// Build: gcc -std=c17 -O2 -Wall -Wextra -pthread loadgen.c histo.c hexcodec.c netbuf.c wire.c datetime.c -o loadgen
+// Run:   ./loadgen <ip> <port> [options]
+//
+//   --proto att|op     att: ClagCode/server.c "ATT|..." rows
+//                      op:  final project/att_server.c "OPCODE HEX" (default)
+//   --bin              negotiate wire.h frames ("BIN") instead of text
+//   --threads T        client threads, each with its own poll loop (1)
+//   --conns C          connections in total, spread over the threads (16)
+//   --pipeline P       requests in flight per connection (4)
+//   --duration S       measured seconds (10), after --warmup S (1)
+//   --mix SPEC         op weights, e.g. mark:90,add:2,roll:5,code:3
+//                      (mark, add, roll, code, list); att only sends marks
+//   --students N --courses N   roster size (1000 / 20)
+//   --seed X           RNG seed (1)
+//   --hist FILE        write the full latency histogram of all requests
+//
+// Every run names its rows with a fresh tag (rolls "<tag>S000042", or
+// "<tag>000042" for --proto att; codes "<tag>C007"), so runs against the same
+// database never collide. For --proto op that roster (courses, students,
+// enrollments) is created first over one pipelined connection. Every MARK is
+// for a new (student, course, day), so the unique index never rejects one;
+// ADD_STUDENT uses new rolls.
+//
+// Prints throughput, error counts and per-op latency (avg/p50/p90/p99/
+// p99.9/max in microseconds, HDR-style buckets, see histo.h).
+//
+// Typical regression check against a local server:
+//   ./att_server 127.0.0.1 5555 /dev/shm/lg.db &
+//   ./loadgen 127.0.0.1 5555 --conns 64 --pipeline 8 --duration 20
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "datetime.h"
+#include "hexcodec.h"
+#include "histo.h"
+#include "netbuf.h"
+#include "wire.h"
+
+#define MAX_PIPE  256
+#define MAX_LINE  4096
+
+enum { OP_MARK, OP_ADD, OP_ROLL, OP_CODE, OP_LIST, OP_N };
+static const char *const OP_NAME[OP_N] = { "MARK", "ADD_STUDENT", "REPORT_BY_ROLL", "REPORT_BY_CODE", "LIST_COURSES" };
+
+static struct {
+    const char *ip;
+    int    port, att, bin, threads, conns, pipeline, students, courses;
+    double duration, warmup;
+    int    weight[OP_N], wsum;
+    unsigned seed;
+    const char *hist;
+} cfg = { .port = 0, .threads = 1, .conns = 16, .pipeline = 4, .students = 1000,
+          .courses = 20, .duration = 10, .warmup = 1,
+          .weight = { 90, 2, 5, 3, 0 }, .seed = 1 };
+
+static uint64_t g_mark_seq;     // atomic: k -> unique (student, course, day)
+static char g_tag[8];           // per-run prefix of every roll and code
+static volatile int g_phase;    // 0 warmup, 1 measuring, 2 stop
+
+typedef struct { int op; uint64_t t0; } Sent;
+
+typedef struct {
+    int     fd;
+    LineBuf in;
+    OutBuf  out;
+    Sent    q[MAX_PIPE];   // in flight, replies come back in this order
+    int     qh, qn;
+    int     rows;          // rows seen for the report at q[qh]
+    int     negotiating;   // waiting for the reply to "BIN"
+} LConn;
+
+typedef struct {
+    pthread_t tid;
+    int       id, nconns;
+    LConn    *c;
+    uint64_t  rng, adds;
+    uint64_t  done[OP_N], errs[OP_N], rows;
+    Histo     lat[OP_N];
+} Worker;
+
+static uint64_t now_ns(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t xorshift(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    return *s = x;
+}
+
+static int connect_tcp(void) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    struct sockaddr_in a = {0};
+    a.sin_family = AF_INET; a.sin_port = htons((uint16_t)cfg.port);
+    if (inet_pton(AF_INET, cfg.ip, &a.sin_addr) != 1 ||
+        connect(s, (struct sockaddr*)&a, sizeof a) < 0) { close(s); return -1; }
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    return s;
+}
+
+// Text request "OPCODE HEX(fields joined by '|')" or its wire.h frame.
+static void put_op(OutBuf *o, int wop, const char *name, const char **f, int n) {
+    if (cfg.bin) {
+        uint8_t payload[512], frame[512 + WIRE_MAX_HDR];
+        WireWriter w = { payload, payload + sizeof payload, 0 };
+        for (int i = 0; i < n; ++i) wire_put_str(&w, f[i], strlen(f[i]));
+        size_t len = wire_frame(frame, sizeof frame, (uint8_t)wop, payload, (size_t)(w.p - payload));
+        outbuf_append(o, frame, len);
+        return;
+    }
+    char plain[512], line[1100];
+    size_t len = 0;
+    for (int i = 0; i < n; ++i)
+        len += (size_t)snprintf(plain + len, sizeof plain - len, "%s%s", i ? "|" : "", f[i]);
+    int m = snprintf(line, sizeof line, "%s", name);
+    if (len) {
+        line[m++] = ' ';
+        m += (int)hex_encode(plain, len, line + m, sizeof line - (size_t)m - 1, 0);
+    }
+    line[m++] = '\n';
+    outbuf_append(o, line, (size_t)m);
+}
+
+static void put_mark(OutBuf *o, uint64_t k) {
+    uint64_t per_day = (uint64_t)cfg.students * (uint64_t)cfg.courses;
+    char roll[24], code[24], date[11];
+    // ClagCode keys students on CAST(roll AS INTEGER) too: keep them numeric there
+    snprintf(roll, sizeof roll, cfg.att ? "%s%06d" : "%sS%06d", g_tag, (int)(k % (uint64_t)cfg.students));
+    snprintf(code, sizeof code, "%sC%03d", g_tag, (int)(k / (uint64_t)cfg.students % (uint64_t)cfg.courses));
+    int64_t day = days_from_civil(2020, 1, 1) + (int64_t)(k / per_day);
+    if (cfg.att) {   // ClagCode: roll, course, ISO timestamp, status
+        char ts[21];
+        format_iso8601(day * 86400 + 8 * 3600, ts);
+        if (cfg.bin) {
+            uint8_t payload[96], frame[96 + WIRE_MAX_HDR];
+            WireWriter w = { payload, payload + sizeof payload, 0 };
+            wire_put_str(&w, roll, strlen(roll));
+            wire_put_str(&w, code, strlen(code));
+            wire_put_u32(&w, (uint32_t)(day * 86400 + 8 * 3600));
+            wire_put_u8(&w, 1);
+            outbuf_append(o, frame, wire_frame(frame, sizeof frame, WIRE_ATT, payload, (size_t)(w.p - payload)));
+            return;
+        }
+        char hr[64], hc[64], ht[64], line[256];
+        hex_encode(roll, strlen(roll), hr, sizeof hr, 1);
+        hex_encode(code, strlen(code), hc, sizeof hc, 1);
+        hex_encode(ts, strlen(ts), ht, sizeof ht, 1);
+        int n = snprintf(line, sizeof line, "ATT|%s|%s|%s|31\n", hr, hc, ht);
+        outbuf_append(o, line, (size_t)n);
+        return;
+    }
+    format_ymd(day, date);
+    if (cfg.bin) {
+        uint8_t payload[96], frame[96 + WIRE_MAX_HDR];
+        WireWriter w = { payload, payload + sizeof payload, 0 };
+        wire_put_str(&w, roll, strlen(roll));
+        wire_put_str(&w, code, strlen(code));
+        wire_put_u32(&w, (uint32_t)(day * 86400));
+        wire_put_u8(&w, 'P');
+        outbuf_append(o, frame, wire_frame(frame, sizeof frame, WOP_MARK, payload, (size_t)(w.p - payload)));
+        return;
+    }
+    const char *f[4] = { roll, code, date, "P" };
+    put_op(o, WOP_MARK, "MARK", f, 4);
+}
+
+static int pick_op(Worker *w) {
+    if (cfg.att) return OP_MARK;
+    int r = (int)(xorshift(&w->rng) % (uint64_t)cfg.wsum);
+    for (int i = 0; i < OP_N; ++i) { if (r < cfg.weight[i]) return i; r -= cfg.weight[i]; }
+    return OP_MARK;
+}
+
+static void issue(Worker *w, LConn *c) {
+    int op = pick_op(w);
+    char a[40], b[24];
+    const char *f[2] = { a, b };
+    switch (op) {
+    case OP_MARK: put_mark(&c->out, __atomic_fetch_add(&g_mark_seq, 1, __ATOMIC_RELAXED)); break;
+    case OP_ADD:
+        snprintf(a, sizeof a, "%sN%d_%llu", g_tag, w->id, (unsigned long long)w->adds++);
+        snprintf(b, sizeof b, "Load %d", w->id);
+        put_op(&c->out, WOP_ADD_STUDENT, "ADD_STUDENT", f, 2);
+        break;
+    case OP_ROLL:
+        snprintf(a, sizeof a, "%sS%06d", g_tag, (int)(xorshift(&w->rng) % (uint64_t)cfg.students));
+        put_op(&c->out, WOP_REPORT_BY_ROLL, "REPORT_BY_ROLL", f, 1);
+        break;
+    case OP_CODE:
+        snprintf(a, sizeof a, "%sC%03d", g_tag, (int)(xorshift(&w->rng) % (uint64_t)cfg.courses));
+        put_op(&c->out, WOP_REPORT_BY_CODE, "REPORT_BY_CODE", f, 1);
+        break;
+    default:
+        put_op(&c->out, WOP_LIST_COURSES, "LIST_COURSES", f, 0);
+    }
+    Sent *s = &c->q[(c->qh + c->qn++) % MAX_PIPE];
+    s->op = op;
+    s->t0 = now_ns();
+}
+
+static int is_report(int op) { return op == OP_ROLL || op == OP_CODE || op == OP_LIST; }
+
+// One reply line for the oldest request. Returns 1 when that request is done.
+static int on_line(Worker *w, LConn *c, const char *line) {
+    Sent *s = &c->q[c->qh];
+    int err = cfg.att ? strncmp(line, "OK|", 3) != 0 : strncmp(line, "ERR", 3) == 0;
+    if (is_report(s->op) && !err && strcmp(line, ".") != 0) { c->rows++; return 0; }
+    if (g_phase == 1) {
+        w->done[s->op]++;
+        if (err) w->errs[s->op]++;
+        w->rows += (uint64_t)c->rows;
+        histo_add(&w->lat[s->op], now_ns() - s->t0);
+    }
+    c->rows = 0;
+    c->qh = (c->qh + 1) % MAX_PIPE;
+    c->qn--;
+    return 1;
+}
+
+static int flush_out(LConn *c) {
+    while (outbuf_pending(&c->out)) {
+        ssize_t n = send(c->fd, outbuf_data(&c->out), outbuf_pending(&c->out), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) { outbuf_consume(&c->out, (size_t)n); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        return -1;
+    }
+    return 0;
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    struct pollfd *pfd = calloc((size_t)w->nconns, sizeof *pfd);
+    if (!pfd) { perror("calloc"); exit(1); }
+    for (int i = 0; i < w->nconns; ++i) {
+        LConn *c = &w->c[i];
+        if (cfg.bin) { outbuf_puts(&c->out, "BIN\n"); c->negotiating = 1; }
+        else while (c->qn < cfg.pipeline) issue(w, c);
+        flush_out(c);
+    }
+    char line[MAX_LINE];
+    while (g_phase < 2) {
+        for (int i = 0; i < w->nconns; ++i) {
+            pfd[i].fd = w->c[i].fd;
+            pfd[i].events = POLLIN | (outbuf_pending(&w->c[i].out) ? POLLOUT : 0);
+        }
+        int n = poll(pfd, (nfds_t)w->nconns, 100);
+        if (n < 0) { if (errno == EINTR) continue; perror("poll"); exit(1); }
+        for (int i = 0; i < w->nconns && n > 0; ++i) {
+            if (!pfd[i].revents) continue;
+            n--;
+            LConn *c = &w->c[i];
+            if (pfd[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                char *room;
+                size_t cap = linebuf_space(&c->in, &room);
+                ssize_t r = recv(c->fd, room, cap, MSG_DONTWAIT);
+                if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR)) {
+                    fprintf(stderr, "connection closed by server\n"); exit(1);
+                }
+                if (r > 0) linebuf_commit(&c->in, (size_t)r);
+                int len;
+                while ((len = linebuf_getline(&c->in, line, sizeof line)) != LB_NOLINE) {
+                    if (len == LB_TOOLONG) continue;
+                    if (c->negotiating) {
+                        if (strncmp(line, "OK", 2) != 0) { fprintf(stderr, "server refused BIN\n"); exit(1); }
+                        c->negotiating = 0;
+                        while (c->qn < cfg.pipeline) issue(w, c);
+                        continue;
+                    }
+                    if (c->qn && on_line(w, c, line) && g_phase < 2) issue(w, c);
+                }
+            }
+            if (flush_out(c) != 0) { fprintf(stderr, "send failed\n"); exit(1); }
+        }
+    }
+    free(pfd);
+    return NULL;
+}
+
+// Create courses, students and enrollments over one pipelined connection.
+static void seed_roster(void) {
+    int fd = connect_tcp();
+    if (fd < 0) { perror("connect"); exit(1); }
+    OutBuf o = {0};
+    char a[24], b[32];
+    const char *f[2] = { a, b };
+    long n = 0;
+    int bin = cfg.bin;
+    cfg.bin = 0;   // plain text on this connection, even under --bin
+    for (int i = 0; i < cfg.courses; ++i, ++n) {
+        snprintf(a, sizeof a, "%sC%03d", g_tag, i); snprintf(b, sizeof b, "Load course %d", i);
+        put_op(&o, WOP_ADD_COURSE, "ADD_COURSE", f, 2);
+    }
+    for (int i = 0; i < cfg.students; ++i, ++n) {
+        snprintf(a, sizeof a, "%sS%06d", g_tag, i); snprintf(b, sizeof b, "Student %d", i);
+        put_op(&o, WOP_ADD_STUDENT, "ADD_STUDENT", f, 2);
+    }
+    for (int i = 0; i < cfg.students; ++i)
+        for (int j = 0; j < cfg.courses; ++j, ++n) {
+            snprintf(a, sizeof a, "%sS%06d", g_tag, i); snprintf(b, sizeof b, "%sC%03d", g_tag, j);
+            put_op(&o, WOP_ENROLL, "ENROLL", f, 2);
+        }
+    cfg.bin = bin;
+    LineBuf in;
+    linebuf_init(&in, 1 << 16);
+    char line[MAX_LINE];
+    long got = 0;
+    uint64_t t0 = now_ns();
+    while (got < n) {
+        if (outbuf_pending(&o)) {
+            ssize_t s = send(fd, outbuf_data(&o), outbuf_pending(&o) > 65536 ? 65536 : outbuf_pending(&o), MSG_NOSIGNAL);
+            if (s < 0) { perror("send"); exit(1); }
+            outbuf_consume(&o, (size_t)s);
+        }
+        char *room;
+        size_t cap = linebuf_space(&in, &room);
+        ssize_t r = recv(fd, room, cap, outbuf_pending(&o) ? MSG_DONTWAIT : 0);
+        if (r == 0) { fprintf(stderr, "server closed during roster\n"); exit(1); }
+        if (r > 0) linebuf_commit(&in, (size_t)r);
+        while (linebuf_getline(&in, line, sizeof line) != LB_NOLINE) got++;
+    }
+    printf("roster: %d courses, %d students, %ld requests in %.2f s\n",
+           cfg.courses, cfg.students, n, (now_ns() - t0) / 1e9);
+    linebuf_free(&in); outbuf_free(&o); close(fd);
+}
+
+static int parse_mix(const char *spec) {
+    memset(cfg.weight, 0, sizeof cfg.weight);
+    char buf[256];
+    snprintf(buf, sizeof buf, "%s", spec);
+    char *save = NULL;
+    for (char *t = strtok_r(buf, ",", &save); t; t = strtok_r(NULL, ",", &save)) {
+        char *colon = strchr(t, ':');
+        if (!colon) return -1;
+        *colon = 0;
+        static const char *const key[OP_N] = { "mark", "add", "roll", "code", "list" };
+        int k = 0;
+        while (k < OP_N && strcmp(key[k], t)) k++;
+        if (k == OP_N || atoi(colon + 1) < 0) return -1;
+        cfg.weight[k] = atoi(colon + 1);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <ip> <port> [--proto att|op] [--bin] [--threads T] [--conns C] "
+                "[--pipeline P] [--duration S] [--warmup S] [--mix SPEC] [--students N] "
+                "[--courses N] [--seed X] [--hist FILE]\n", argv[0]);
+        return 1;
+    }
+    cfg.ip = argv[1]; cfg.port = atoi(argv[2]);
+    for (int i = 3; i < argc; ++i) {
+        const char *o = argv[i], *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(o, "--bin")) { cfg.bin = 1; continue; }
+        if (!v) { fprintf(stderr, "%s needs a value\n", o); return 1; }
+        i++;
+        if      (!strcmp(o, "--proto"))    cfg.att = !strcmp(v, "att");
+        else if (!strcmp(o, "--threads"))  cfg.threads = atoi(v);
+        else if (!strcmp(o, "--conns"))    cfg.conns = atoi(v);
+        else if (!strcmp(o, "--pipeline")) cfg.pipeline = atoi(v);
+        else if (!strcmp(o, "--duration")) cfg.duration = atof(v);
+        else if (!strcmp(o, "--warmup"))   cfg.warmup = atof(v);
+        else if (!strcmp(o, "--students")) cfg.students = atoi(v);
+        else if (!strcmp(o, "--courses"))  cfg.courses = atoi(v);
+        else if (!strcmp(o, "--seed"))     cfg.seed = (unsigned)strtoul(v, NULL, 10);
+        else if (!strcmp(o, "--hist"))     cfg.hist = v;
+        else if (!strcmp(o, "--mix"))      { if (parse_mix(v) != 0) { fprintf(stderr, "bad --mix\n"); return 1; } }
+        else { fprintf(stderr, "unknown option %s\n", o); return 1; }
+    }
+    for (int i = 0; i < OP_N; ++i) cfg.wsum += cfg.weight[i];
+    if (cfg.threads < 1 || cfg.conns < cfg.threads || cfg.pipeline < 1 || cfg.pipeline > MAX_PIPE ||
+        cfg.students < 1 || cfg.courses < 1 || cfg.duration <= 0 || cfg.wsum <= 0) {
+        fprintf(stderr, "bad settings\n"); return 1;
+    }
+    snprintf(g_tag, sizeof g_tag, "%06u", ((unsigned)time(NULL) ^ (unsigned)getpid() << 12) % 900000 + 100000);
+    printf("run tag %s\n", g_tag);
+    if (!cfg.att) seed_roster();
+
+    Worker *w = calloc((size_t)cfg.threads, sizeof *w);
+    if (!w) { perror("calloc"); return 1; }
+    for (int t = 0; t < cfg.threads; ++t) {
+        w[t].id = t;
+        w[t].rng = ((uint64_t)cfg.seed << 32 | (uint64_t)t) * 0x9E3779B97F4A7C15ull | 1;
+        w[t].nconns = cfg.conns / cfg.threads + (t < cfg.conns % cfg.threads);
+        w[t].c = calloc((size_t)w[t].nconns, sizeof(LConn));
+        if (!w[t].c) { perror("calloc"); return 1; }
+        for (int i = 0; i < OP_N; ++i) histo_init(&w[t].lat[i]);
+        for (int i = 0; i < w[t].nconns; ++i) {
+            LConn *c = &w[t].c[i];
+            if ((c->fd = connect_tcp()) < 0) { perror("connect"); return 1; }
+            linebuf_init(&c->in, 1 << 16);
+        }
+    }
+    for (int t = 0; t < cfg.threads; ++t)
+        if (pthread_create(&w[t].tid, NULL, worker_main, &w[t]) != 0) { perror("pthread_create"); return 1; }
+
+    struct timespec ws = { (time_t)cfg.warmup, (long)((cfg.warmup - (time_t)cfg.warmup) * 1e9) };
+    nanosleep(&ws, NULL);
+    uint64_t t0 = now_ns();
+    g_phase = 1;
+    struct timespec ds = { (time_t)cfg.duration, (long)((cfg.duration - (time_t)cfg.duration) * 1e9) };
+    nanosleep(&ds, NULL);
+    g_phase = 2;
+    double secs = (now_ns() - t0) / 1e9;
+    for (int t = 0; t < cfg.threads; ++t) pthread_join(w[t].tid, NULL);
+
+    Histo *all = malloc(sizeof *all), *per = malloc(OP_N * sizeof *per);
+    if (!all || !per) { perror("malloc"); return 1; }
+    histo_init(all);
+    uint64_t done[OP_N] = {0}, errs[OP_N] = {0}, rows = 0, total = 0;
+    for (int i = 0; i < OP_N; ++i) histo_init(&per[i]);
+    for (int t = 0; t < cfg.threads; ++t) {
+        for (int i = 0; i < OP_N; ++i) {
+            histo_merge(&per[i], &w[t].lat[i]);
+            histo_merge(all, &w[t].lat[i]);
+            done[i] += w[t].done[i]; errs[i] += w[t].errs[i];
+        }
+        rows += w[t].rows;
+    }
+    for (int i = 0; i < OP_N; ++i) total += done[i];
+
+    printf("proto=%s%s threads=%d conns=%d pipeline=%d  %.1f s\n", cfg.att ? "att" : "op",
+           cfg.bin ? "+bin" : "", cfg.threads, cfg.conns, cfg.pipeline, secs);
+    printf("%-15s %10s %8s %10s   latency us\n", "op", "requests", "errors", "req/s");
+    for (int i = 0; i < OP_N; ++i) {
+        if (!done[i]) continue;
+        printf("%-15s %10llu %8llu %10.0f   ", OP_NAME[i], (unsigned long long)done[i],
+               (unsigned long long)errs[i], done[i] / secs);
+        histo_print(&per[i], stdout, 1e3);
+        printf("\n");
+    }
+    printf("%-15s %10llu %8s %10.0f   ", "all", (unsigned long long)total, "", total / secs);
+    histo_print(all, stdout, 1e3);
+    printf("\n");
+    if (rows) printf("report rows received: %llu\n", (unsigned long long)rows);
+    if (cfg.hist) {
+        FILE *f = fopen(cfg.hist, "w");
+        if (!f) perror(cfg.hist);
+        else { fprintf(f, "# latency_us count cumulative\n"); histo_dump(all, f, 1e3); fclose(f); }
+    }
+
+    for (int t = 0; t < cfg.threads; ++t) {
+        for (int i = 0; i < w[t].nconns; ++i) {
+            close(w[t].c[i].fd); linebuf_free(&w[t].c[i].in); outbuf_free(&w[t].c[i].out);
+        }
+        free(w[t].c);
+    }
+    free(w); free(all); free(per);
+    return 0;
+}
@@ -0,0 +1,96 @@
+// mpscring.c — see mpscring.h
+
+#include "mpscring.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+int mpscring_init(MpscRing *r, size_t cap) {
+    size_t n = 2;
+    while (n < cap) n <<= 1;
+    r->slots = malloc(n * sizeof *r->slots);
+    if (!r->slots) return -1;
+    for (size_t i = 0; i < n; ++i) { r->slots[i].seq = i; r->slots[i].p = NULL; }
+    r->mask = n - 1;
+    r->tail = r->head = 0;
+    return 0;
+}
+
+void mpscring_free(MpscRing *r) {
+    free(r->slots);
+    r->slots = NULL;
+}
+
+int mpscring_push(MpscRing *r, void *p) {
+    size_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        RingSlot *s = &r->slots[pos & r->mask];
+        size_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        intptr_t d = (intptr_t)(seq - pos);
+        if (d == 0) {
+            // our turn for this slot if no other producer claims pos first
+            if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                s->p = p;
+                __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        } else if (d < 0) {
+            return -1;   // the slot still holds the item from a lap ago
+        } else {
+            pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void *mpscring_pop(MpscRing *r) {
+    size_t pos = r->head;
+    RingSlot *s = &r->slots[pos & r->mask];
+    if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != pos + 1) return NULL;
+    void *p = s->p;
+    __atomic_store_n(&s->seq, pos + r->mask + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->head, pos + 1, __ATOMIC_RELAXED);
+    return p;
+}
+
+size_t mpscring_cap(const MpscRing *r) {
+    return r->mask + 1;
+}
+
+size_t mpscring_count(const MpscRing *r) {
+    size_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    size_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    return tail - head <= r->mask ? tail - head : r->mask + 1;   // head is read first
+}
+
+int objpool_init(ObjPool *p, size_t count, size_t size) {
+    p->size = (size + 63) & ~(size_t)63;
+    p->count = count;
+    if (mpscring_init(&p->free, count) != 0) return -1;
+    size_t bytes = count * p->size;
+    if (!(p->mem = aligned_alloc(64, bytes ? bytes : 64))) {
+        mpscring_free(&p->free);
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) mpscring_push(&p->free, p->mem + i * p->size);
+    return 0;
+}
+
+void objpool_free(ObjPool *p) {
+    mpscring_free(&p->free);
+    free(p->mem);
+    p->mem = NULL;
+}
+
+void *objpool_get(ObjPool *p) {
+    return mpscring_pop(&p->free);
+}
+
+void objpool_put(ObjPool *p, void *obj) {
+    mpscring_push(&p->free, obj);   // never full: it has a slot per object
+}
+
+int objpool_owns(const ObjPool *p, const void *obj) {
+    uintptr_t a = (uintptr_t)obj, lo = (uintptr_t)p->mem;
+    return a >= lo && a < lo + p->count * p->size;
+}
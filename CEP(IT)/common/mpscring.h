@@ -0,0 +1,63 @@
+// mpscring.h — bounded lock-free MPSC ring, and a fixed-size object pool on it
+//
+// MpscRing is Vyukov's bounded queue cut down to one consumer: a power-of-
+// two array of slots, each with a sequence number that says whose turn the
+// slot is. A producer claims a position with one compare-and-swap on tail,
+// stores the pointer and publishes it by bumping the slot's sequence; the
+// consumer reads head's slot and hands it back to the producers one lap
+// later. Nothing is allocated after init and no thread ever waits on a lock.
+// A push into a full ring fails instead of waiting.
+//
+// A claimed slot may be published a little later than slots claimed after
+// it, so pop can return NULL while the ring is not empty; callers that know
+// something was pushed (a count, as MpscQueue in workq.h keeps) try again.
+//
+// ObjPool hands out fixed-size objects from one block: the free list is an
+// MpscRing of them, so the owner thread takes an object without a malloc
+// and any thread may give one back. Objects are cache-line aligned.
+
+#ifndef MPSCRING_H
+#define MPSCRING_H
+
+#include <stddef.h>
+
+typedef struct {
+    size_t seq;   // == position: free for it; == position + 1: holds it
+    void  *p;
+} RingSlot;
+
+typedef struct {
+    RingSlot *slots;
+    size_t    mask;
+    _Alignas(64) size_t tail;   // next position to claim (producers)
+    _Alignas(64) size_t head;   // next position to read (consumer)
+} MpscRing;
+
+// cap is rounded up to a power of two (at least 2). -1 if out of memory.
+int    mpscring_init(MpscRing *r, size_t cap);
+void   mpscring_free(MpscRing *r);
+// Any thread. 0, or -1 if the ring is full.
+int    mpscring_push(MpscRing *r, void *p);
+// Consumer thread only. Oldest published pointer, or NULL.
+void  *mpscring_pop(MpscRing *r);
+size_t mpscring_cap(const MpscRing *r);
+// Claimed and not yet popped; exact only when no push is under way.
+size_t mpscring_count(const MpscRing *r);
+
+typedef struct {
+    MpscRing free;
+    char    *mem;
+    size_t   size, count;
+} ObjPool;
+
+// count objects of size bytes each. -1 if out of memory.
+int   objpool_init(ObjPool *p, size_t count, size_t size);
+void  objpool_free(ObjPool *p);
+// Owner thread only: an object (not zeroed), or NULL when all are out.
+void *objpool_get(ObjPool *p);
+// Any thread: give back an object from objpool_get.
+void  objpool_put(ObjPool *p, void *obj);
+// Whether obj came from this pool (and not from, say, a malloc fallback).
+int   objpool_owns(const ObjPool *p, const void *obj);
+
+#endif
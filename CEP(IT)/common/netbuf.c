@@ -0,0 +1,140 @@
+// netbuf.c — see netbuf.h
+
+#include "netbuf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int linebuf_init(LineBuf *lb, size_t cap) {
+    size_t c = 64;
+    while (c < cap) c <<= 1;
+    memset(lb, 0, sizeof *lb);
+    lb->buf = malloc(c);
+    if (!lb->buf) return -1;
+    lb->cap = c;
+    return 0;
+}
+
+void linebuf_free(LineBuf *lb) {
+    free(lb->buf);
+    memset(lb, 0, sizeof *lb);
+}
+
+size_t linebuf_space(LineBuf *lb, char **p) {
+    size_t used = lb->tail - lb->head;
+    size_t ti = lb->tail & (lb->cap - 1);
+    size_t run = lb->cap - ti;
+    size_t free_ = lb->cap - used;
+    *p = lb->buf + ti;
+    return run < free_ ? run : free_;
+}
+
+void linebuf_commit(LineBuf *lb, size_t n) {
+    lb->tail += n;
+}
+
+// Offset of the first '\n' at or after head+from, or (size_t)-1.
+static size_t find_nl(const LineBuf *lb, size_t from) {
+    size_t used = lb->tail - lb->head;
+    while (from < used) {
+        size_t i = (lb->head + from) & (lb->cap - 1);
+        size_t run = lb->cap - i;
+        if (run > used - from) run = used - from;
+        const char *hit = memchr(lb->buf + i, '\n', run);
+        if (hit) return from + (size_t)(hit - (lb->buf + i));
+        from += run;
+    }
+    return (size_t)-1;
+}
+
+static void copy_out(const LineBuf *lb, char *dst, size_t n) {
+    size_t i = lb->head & (lb->cap - 1);
+    size_t run = lb->cap - i;
+    if (run >= n) { memcpy(dst, lb->buf + i, n); return; }
+    memcpy(dst, lb->buf + i, run);
+    memcpy(dst + run, lb->buf, n - run);
+}
+
+int linebuf_getline(LineBuf *lb, char *line, size_t cap) {
+    for (;;) {
+        size_t used = lb->tail - lb->head;
+        size_t nl = find_nl(lb, lb->scanned);
+        if (nl == (size_t)-1) {
+            lb->scanned = used;
+            if (used < lb->cap) return LB_NOLINE;
+            // ring full and still no newline: drop it, keep dropping to '\n'
+            lb->head = lb->tail;
+            lb->scanned = 0;
+            if (lb->skipping) return LB_NOLINE;
+            lb->skipping = 1;
+            return LB_TOOLONG;
+        }
+        size_t n = nl;
+        lb->scanned = 0;
+        if (lb->skipping) {               // end of an already reported line
+            lb->head += n + 1;
+            lb->skipping = 0;
+            continue;
+        }
+        if (n >= cap) { lb->head += n + 1; return LB_TOOLONG; }
+        copy_out(lb, line, n);
+        lb->head += n + 1;
+        if (n && line[n-1] == '\r') n--;
+        line[n] = 0;
+        return (int)n;
+    }
+}
+
+size_t linebuf_used(const LineBuf *lb) {
+    return lb->tail - lb->head;
+}
+
+size_t linebuf_peek(const LineBuf *lb, void *dst, size_t n) {
+    size_t used = lb->tail - lb->head;
+    if (n > used) n = used;
+    copy_out(lb, dst, n);
+    return n;
+}
+
+void linebuf_drop(LineBuf *lb, size_t n) {
+    size_t used = lb->tail - lb->head;
+    lb->head += n < used ? n : used;
+    lb->scanned = 0;
+}
+
+static int outbuf_reserve(OutBuf *ob, size_t n) {
+    if (ob->off && ob->off == ob->len) ob->off = ob->len = 0;
+    if (ob->len + n <= ob->cap) return 0;
+    if (ob->off) {                       // compact before growing
+        memmove(ob->data, ob->data + ob->off, ob->len - ob->off);
+        ob->len -= ob->off; ob->off = 0;
+        if (ob->len + n <= ob->cap) return 0;
+    }
+    size_t ncap = ob->cap ? ob->cap : 256;
+    while (ncap < ob->len + n) ncap *= 2;
+    char *p = realloc(ob->data, ncap);
+    if (!p) return -1;
+    ob->data = p; ob->cap = ncap;
+    return 0;
+}
+
+int outbuf_append(OutBuf *ob, const void *p, size_t n) {
+    if (outbuf_reserve(ob, n) != 0) return -1;
+    memcpy(ob->data + ob->len, p, n);
+    ob->len += n;
+    return 0;
+}
+
+int outbuf_puts(OutBuf *ob, const char *s) {
+    return outbuf_append(ob, s, strlen(s));
+}
+
+void outbuf_consume(OutBuf *ob, size_t n) {
+    ob->off += n;
+    if (ob->off >= ob->len) ob->off = ob->len = 0;
+}
+
+void outbuf_free(OutBuf *ob) {
+    free(ob->data);
+    memset(ob, 0, sizeof *ob);
+}
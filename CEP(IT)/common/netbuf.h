@@ -0,0 +1,54 @@
+// netbuf.h — per-connection input framing and output coalescing
+//
+// LineBuf is a power-of-two ring that accumulates partial reads and hands
+// back complete '\n'-terminated lines in arrival order, so a client may
+// pipeline any number of requests in one segment. OutBuf collects the
+// responses for everything processed in one wakeup so they leave in a
+// single send().
+//
+// Plain C, no socket calls: shared by the POSIX and Winsock servers.
+
+#ifndef NETBUF_H
+#define NETBUF_H
+
+#include <stddef.h>
+
+#define LB_NOLINE  (-1)   // no complete line buffered yet
+#define LB_TOOLONG (-2)   // a line exceeded the caller's cap and was dropped
+
+typedef struct {
+    char  *buf;
+    size_t cap;      // power of two
+    size_t head;     // read position, monotonic
+    size_t tail;     // write position, monotonic
+    size_t scanned;  // bytes after head already searched for '\n'
+    int    skipping; // discarding the tail of an over-long line
+} LineBuf;
+
+int    linebuf_init(LineBuf *lb, size_t cap);
+void   linebuf_free(LineBuf *lb);
+// Contiguous free region for the next recv(); 0 means the ring is full.
+size_t linebuf_space(LineBuf *lb, char **p);
+void   linebuf_commit(LineBuf *lb, size_t n);
+// Copy the next complete line (without "\r\n") into line[cap] and return its
+// length, or LB_NOLINE / LB_TOOLONG. A full ring without a newline counts as
+// LB_TOOLONG so the reader can always make progress.
+int    linebuf_getline(LineBuf *lb, char *line, size_t cap);
+// Raw access for non-line framing (see wire.h).
+size_t linebuf_used(const LineBuf *lb);
+size_t linebuf_peek(const LineBuf *lb, void *dst, size_t n);
+void   linebuf_drop(LineBuf *lb, size_t n);
+
+typedef struct {
+    char  *data;
+    size_t off, len, cap;  // pending bytes are data[off..len)
+} OutBuf;
+
+int    outbuf_append(OutBuf *ob, const void *p, size_t n);
+int    outbuf_puts(OutBuf *ob, const char *s);
+void   outbuf_consume(OutBuf *ob, size_t n);
+void   outbuf_free(OutBuf *ob);
+static inline size_t outbuf_pending(const OutBuf *ob) { return ob->len - ob->off; }
+static inline const char *outbuf_data(const OutBuf *ob) { return ob->data + ob->off; }
+
+#endif
@@ -0,0 +1,152 @@
+// ringbench.c — hand-off contention: mutex WorkQueue vs MpscQueue vs bare MpscRing
+// Build: gcc -std=c17 -O2 -Wall -Wextra -pthread ringbench.c mpscring.c workq.c -o ringbench
+// Run:   ./ringbench [max_producers] [items_per_producer]
+// Races: gcc -std=c17 -O1 -g -fsanitize=thread -pthread ringbench.c mpscring.c workq.c -o ringbench_tsan
+//        ./ringbench_tsan 4 20000
+//
+// For 1..max_producers (default 4) producer threads and one consumer, moves
+// items_per_producer (default 1M) items through each queue the way the
+// servers do: a producer takes an item from its own ObjPool, numbers it and
+// pushes it (retrying while the queue is full), and the consumer pops it,
+// checks that it is the next number from that producer and puts it back in
+// the producer's pool, which is the cross-thread return the pool is for.
+// The queues hold QUEUE_CAP items and the pools POOL items each.
+//
+//   mutex   WorkQueue (workq.h): one mutex and condition variable
+//   mpscq   MpscQueue (workq.h): MpscRing plus a count and a sleep/wakeup
+//   ring    MpscRing (mpscring.h) alone, the consumer spinning on pop
+//
+// Prints items/s and the pushes that found the queue full, and exits 1 if
+// an item was lost, duplicated or overtook an earlier one from its producer.
+// Under ThreadSanitizer (see Races above) the same run is the race check for
+// the ring, the pool and MpscQueue's wakeup.
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mpscring.h"
+#include "workq.h"
+
+#define MAX_PRODUCERS 64
+#define QUEUE_CAP     4096
+#define POOL          1024
+
+enum { Q_MUTEX, Q_MPSCQ, Q_RING, Q_KINDS };
+static const char *const KIND[Q_KINDS] = { "mutex", "mpscq", "ring" };
+
+typedef struct {
+    WorkItem link;   // first, for the workq.h queues
+    int      src;
+    long     seq;
+} Item;
+
+typedef struct {
+    pthread_t tid;
+    int       id;
+    ObjPool   pool;
+    long      full;   // pushes refused
+} Producer;
+
+static int       g_kind;
+static long      g_items;
+static WorkQueue g_wq;
+static MpscQueue g_mq;
+static MpscRing  g_ring;
+static Producer  g_prod[MAX_PRODUCERS];
+
+static double now_s(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int push(Item *it) {
+    switch (g_kind) {
+    case Q_MUTEX: return workq_push(&g_wq, &it->link);
+    case Q_MPSCQ: return mpscq_push(&g_mq, &it->link);
+    default:      return mpscring_push(&g_ring, it);
+    }
+}
+
+static Item *pop(void) {
+    switch (g_kind) {
+    case Q_MUTEX: return (Item *)workq_pop(&g_wq, NULL);
+    case Q_MPSCQ: return (Item *)mpscq_pop(&g_mq, NULL);
+    default: {
+        Item *it;
+        while (!(it = mpscring_pop(&g_ring))) sched_yield();
+        return it;
+    }
+    }
+}
+
+static void *producer_main(void *arg) {
+    Producer *p = arg;
+    for (long i = 0; i < g_items; ++i) {
+        Item *it;
+        while (!(it = objpool_get(&p->pool))) sched_yield();   // all in flight
+        it->src = p->id;
+        it->seq = i;
+        while (push(it) != 0) { p->full++; sched_yield(); }
+    }
+    return NULL;
+}
+
+// One run; the consumer is this thread. 0 if every item arrived once, in order.
+static int run(int kind, int np, double *secs, long *full) {
+    g_kind = kind;
+    if (workq_init(&g_wq, QUEUE_CAP) || mpscq_init(&g_mq, QUEUE_CAP) || mpscring_init(&g_ring, QUEUE_CAP)) {
+        fprintf(stderr, "queue init failed\n"); exit(1);
+    }
+    long next[MAX_PRODUCERS];
+    for (int i = 0; i < np; ++i) {
+        g_prod[i].id = i; g_prod[i].full = 0; next[i] = 0;
+        if (objpool_init(&g_prod[i].pool, POOL, sizeof(Item))) { fprintf(stderr, "out of memory\n"); exit(1); }
+    }
+    double t0 = now_s();
+    for (int i = 0; i < np; ++i)
+        if (pthread_create(&g_prod[i].tid, NULL, producer_main, &g_prod[i]) != 0) { fprintf(stderr, "thread failed\n"); exit(1); }
+    int bad = 0;
+    for (long n = (long)np * g_items; n > 0; --n) {
+        Item *it = pop();
+        if (!it || it->src < 0 || it->src >= np) { bad = 1; break; }
+        if (it->seq != next[it->src]) bad = 1;
+        next[it->src] = it->seq + 1;
+        objpool_put(&g_prod[it->src].pool, it);
+    }
+    *secs = now_s() - t0;
+    *full = 0;
+    for (int i = 0; i < np; ++i) {
+        pthread_join(g_prod[i].tid, NULL);
+        *full += g_prod[i].full;
+        if (next[i] != g_items) bad = 1;
+        objpool_free(&g_prod[i].pool);
+    }
+    workq_free(&g_wq); mpscq_free(&g_mq); mpscring_free(&g_ring);
+    return bad ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    int maxp = argc > 1 ? atoi(argv[1]) : 4;
+    g_items = argc > 2 ? atol(argv[2]) : 1000000;
+    if (maxp < 1 || maxp > MAX_PRODUCERS || g_items < 1) {
+        fprintf(stderr, "Usage: %s [max_producers 1..%d] [items_per_producer]\n", argv[0], MAX_PRODUCERS);
+        return 1;
+    }
+    int failed = 0;
+    printf("%-9s %-6s %14s %12s\n", "producers", "queue", "items/s", "full pushes");
+    for (int np = 1; np <= maxp; ++np) {
+        for (int k = 0; k < Q_KINDS; ++k) {
+            double secs; long full;
+            int rc = run(k, np, &secs, &full);
+            printf("%-9d %-6s %14.0f %12ld%s\n", np, KIND[k], np * g_items / secs, full, rc ? "  FAIL" : "");
+            if (rc) failed = 1;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,155 @@
+// scalebench.c — server throughput from 1 to N reactors
+// Build: gcc -std=c17 -O2 -Wall -Wextra scalebench.c -o scalebench
+// Run:   ./scalebench <server> <db> [--max N] [--pin] [--port P] [--loadgen PATH]
+//                     [--server-arg X]... [loadgen options]
+//
+// For k = 1..N (default: the online CPUs) starts `<server> 127.0.0.1 <port>
+// <db> --reactors k` (plus --pin and every --server-arg), waits until it
+// accepts connections, runs loadgen against it with --threads k unless the
+// options set --threads, stops the server and moves on. Every other option
+// goes to loadgen as is, so --proto att selects ClagCode/server.c.
+//
+// Prints one row per step: throughput, its ratio to the 1-reactor run, and
+// p50/p99 latency in microseconds from loadgen's "all" line. loadgen runs
+// on the same host and needs CPUs too; on a small box keep --max below the
+// core count, or the client is what stops scaling. Put <db> on tmpfs so
+// fsync does not flatten the curve. Every loadgen run uses fresh rolls, so
+// the steps can share one database.
+//
+//   ./scalebench ./att_server /dev/shm/sb.db --max 4 --conns 64 --pipeline 8 --duration 10
+//   ./scalebench ./server /dev/shm/sbc.db --pin --proto att --conns 64 --pipeline 16
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_ARGS 128
+
+static void die(const char *m) { fprintf(stderr, "%s\n", m); exit(1); }
+
+// Poll until 127.0.0.1:port accepts, for up to 60 s (the servers warm their
+// caches before they listen). -1 if the server exited or never listened.
+static int wait_listening(pid_t pid, int port) {
+    struct sockaddr_in a = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < 6000; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        int ok = connect(fd, (struct sockaddr *)&a, sizeof a) == 0;
+        close(fd);
+        if (ok) return 0;
+        if (waitpid(pid, NULL, WNOHANG) == pid) return -1;
+        struct timespec ts = { 0, 10 * 1000000L };
+        nanosleep(&ts, NULL);
+    }
+    return -1;
+}
+
+static pid_t spawn(char **argv, int quiet) {
+    fflush(stdout);   // or the child's freopen writes our buffer again
+    pid_t pid = fork();
+    if (pid < 0) die("fork failed");
+    if (pid == 0) {
+        if (quiet && !freopen("/dev/null", "w", stdout)) _exit(127);
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    return pid;
+}
+
+typedef struct { double rps, p50, p99; } Result;
+
+// Run loadgen with argv, parse its "all" line.
+static int run_loadgen(char **argv, Result *r) {
+    int fds[2];
+    if (pipe(fds) != 0) die("pipe failed");
+    pid_t pid = fork();
+    if (pid < 0) die("fork failed");
+    if (pid == 0) {
+        dup2(fds[1], 1);
+        close(fds[0]); close(fds[1]);
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+    close(fds[1]);
+    FILE *f = fdopen(fds[0], "r");
+    char line[1024];
+    int found = 0;
+    while (f && fgets(line, sizeof line, f)) {
+        long long reqs;
+        if (sscanf(line, "all %lld %lf avg %*f p50 %lf p90 %*f p99 %lf", &reqs, &r->rps, &r->p50, &r->p99) == 4)
+            found = 1;
+    }
+    if (f) fclose(f);
+    int st;
+    waitpid(pid, &st, 0);
+    return found && WIFEXITED(st) && WEXITSTATUS(st) == 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <server> <db> [--max N] [--pin] [--port P] [--loadgen PATH] "
+                "[--server-arg X]... [loadgen options]\n", argv[0]);
+        return 1;
+    }
+    const char *server = argv[1], *db = argv[2], *loadgen = "./loadgen";
+    int max = (int)sysconf(_SC_NPROCESSORS_ONLN), pin = 0, port = 5599, threads_set = 0;
+    char *sargs[MAX_ARGS], *largs[MAX_ARGS];
+    int ns = 0, nl = 0;
+    char portstr[16], kstr[16];
+    sargs[ns++] = (char *)server; sargs[ns++] = "127.0.0.1"; sargs[ns++] = portstr;
+    sargs[ns++] = (char *)db; sargs[ns++] = "--reactors"; sargs[ns++] = kstr;
+    largs[nl++] = NULL;   // loadgen path, set below
+    largs[nl++] = "127.0.0.1"; largs[nl++] = portstr;
+    for (int i = 3; i < argc; ++i) {
+        if (ns >= MAX_ARGS - 2 || nl >= MAX_ARGS - 3) die("too many options");
+        if (!strcmp(argv[i], "--max") && i + 1 < argc) max = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--pin")) pin = 1;
+        else if (!strcmp(argv[i], "--port") && i + 1 < argc) port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--loadgen") && i + 1 < argc) loadgen = argv[++i];
+        else if (!strcmp(argv[i], "--server-arg") && i + 1 < argc) sargs[ns++] = argv[++i];
+        else {
+            if (!strcmp(argv[i], "--threads")) threads_set = 1;
+            largs[nl++] = argv[i];
+        }
+    }
+    if (max < 1 || port < 1 || port > 65535) die("bad --max or --port");
+    if (pin) sargs[ns++] = "--pin";
+    sargs[ns] = NULL;
+    largs[0] = (char *)loadgen;
+    if (!threads_set) { largs[nl++] = "--threads"; largs[nl++] = kstr; }
+    largs[nl] = NULL;
+    snprintf(portstr, sizeof portstr, "%d", port);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%-9s %12s %8s %10s %10s\n", "reactors", "req/s", "speedup", "p50 us", "p99 us");
+    double base = 0;
+    for (int k = 1; k <= max; ++k) {
+        snprintf(kstr, sizeof kstr, "%d", k);
+        pid_t pid = spawn(sargs, 1);
+        if (wait_listening(pid, port) != 0) {
+            kill(pid, SIGKILL); waitpid(pid, NULL, 0);
+            fprintf(stderr, "server did not start with --reactors %d\n", k);
+            return 1;
+        }
+        Result r;
+        int rc = run_loadgen(largs, &r);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        if (rc != 0) { fprintf(stderr, "loadgen failed at --reactors %d\n", k); return 1; }
+        if (k == 1) base = r.rps;
+        printf("%-9d %12.0f %8.2f %10.1f %10.1f\n", k, r.rps, base > 0 ? r.rps / base : 0, r.p50, r.p99);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+// setbench.c — att_server's bitmap set queries vs the same questions in SQL
+// Build: gcc -std=c17 -O2 -Wall -Wextra setbench.c histo.c hexcodec.c datetime.c -lsqlite3 -o setbench
+// Run:   ./setbench <ip> <port> <db> <code> <from> <to> [--iters N]
+//
+// For a course and a date range that has marks, asks five questions both
+// ways, --iters times each (default 50), and checks the answers agree:
+//
+//   and2     absent on <from> and on the next day       SET_COUNT ... AND ...
+//   week     absent at least once in <from>..+6          SET_COUNT range term
+//   nowhere  absent somewhere on <from>, present nowhere SET_COUNT * ANDNOT *
+//   streak3  absent 3 class days running in the range    ABSENT_STREAK
+//   below75  under 75% present across all courses        BELOW_PCT
+//
+// The server side is one request/reply over TCP to a running att_server on
+// <db>, so its times include the loopback round trip and, for the list
+// replies, the roll/name lookups and the transfer. The SQL side runs on a
+// read-only connection in this process with a warm page cache, against the
+// schema's indexes, and only counts. Prints p50/p99 per side in
+// microseconds and the p50 speedup.
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "datetime.h"
+#include "hexcodec.h"
+#include "histo.h"
+
+#define MAX_LINE 4096
+
+typedef struct {
+    const char *name;
+    const char *op;
+    char        payload[256];
+    const char *sql;      // ?1 code, ?2 from, ?3 to, ?4 from+1, ?5 from+6
+} Query;
+
+static int  g_fd;
+static char g_in[1 << 16];
+static size_t g_have, g_off;
+
+static uint64_t now_ns(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int connect_tcp(const char *ip, int port) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    struct sockaddr_in a = {0};
+    a.sin_family = AF_INET; a.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, ip, &a.sin_addr) != 1 ||
+        connect(s, (struct sockaddr*)&a, sizeof a) < 0) { close(s); return -1; }
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    return s;
+}
+
+static int read_line(char *line, size_t cap) {
+    size_t n = 0;
+    for (;;) {
+        if (g_off == g_have) {
+            ssize_t r = recv(g_fd, g_in, sizeof g_in, 0);
+            if (r <= 0) return -1;
+            g_have = (size_t)r; g_off = 0;
+        }
+        char ch = g_in[g_off++];
+        if (ch == '\n') { line[n] = 0; return 0; }
+        if (n + 1 < cap) line[n++] = ch;
+    }
+}
+
+// One request; the answer is count=N, or the number of rows before ".".
+static long long ask(const Query *q) {
+    char req[MAX_LINE];
+    int n = snprintf(req, sizeof req, "%s ", q->op);
+    n += (int)hex_encode(q->payload, strlen(q->payload), req + n, sizeof req - (size_t)n - 1, 0);
+    req[n++] = '\n';
+    if (send(g_fd, req, (size_t)n, 0) != n) return -1;
+    char line[MAX_LINE];
+    if (read_line(line, sizeof line) != 0) return -1;
+    if (!strncmp(line, "OK count=", 9)) return atoll(line + 9);
+    if (!strncmp(line, "ERR", 3)) { fprintf(stderr, "%s: %s\n", q->name, line); return -1; }
+    long long rows = 0;
+    while (strcmp(line, ".") != 0) {
+        rows++;
+        if (read_line(line, sizeof line) != 0) return -1;
+    }
+    return rows;
+}
+
+static long long count_sql(sqlite3_stmt *st) {
+    long long n = -1;
+    if (sqlite3_step(st) == SQLITE_ROW) n = sqlite3_column_int64(st, 0);
+    sqlite3_reset(st);
+    return n;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 7) {
+        fprintf(stderr, "Usage: %s <ip> <port> <db> <code> <from> <to> [--iters N]\n", argv[0]);
+        return 1;
+    }
+    const char *code = argv[4], *from = argv[5], *to = argv[6];
+    int iters = 50;
+    for (int i = 7; i < argc; ++i) {
+        if (!strcmp(argv[i], "--iters") && i + 1 < argc) iters = atoi(argv[++i]);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 1; }
+    }
+    int64_t d0, d1;
+    if (parse_ymd(from, strlen(from), &d0) != 0 || parse_ymd(to, strlen(to), &d1) != 0 || d1 < d0 + 6 || iters < 1) {
+        fprintf(stderr, "need dates YYYY-MM-DD at least a week apart and --iters >= 1\n");
+        return 1;
+    }
+    char next[11], week[11];
+    format_ymd(d0 + 1, next);
+    format_ymd(d0 + 6, week);
+
+    Query qs[] = {
+        { "and2", "SET_COUNT", "",
+          "SELECT count(*) FROM attendance a JOIN attendance b ON b.student_id=a.student_id "
+          "WHERE a.course_id=(SELECT id FROM courses WHERE code=?1) AND a.date=?2 AND a.status='A' "
+          "AND b.course_id=a.course_id AND b.date=?4 AND b.status='A'" },
+        { "week", "SET_COUNT", "",
+          "SELECT count(DISTINCT student_id) FROM attendance "
+          "WHERE course_id=(SELECT id FROM courses WHERE code=?1) AND date BETWEEN ?2 AND ?5 AND status='A'" },
+        { "nowhere", "SET_COUNT", "",
+          "SELECT count(*) FROM (SELECT student_id FROM attendance WHERE date=?2 "
+          "GROUP BY student_id HAVING sum(status='A')>0 AND sum(status='P')=0)" },
+        { "streak3", "ABSENT_STREAK", "",
+          "WITH d AS (SELECT date, row_number() OVER (ORDER BY date) AS k FROM (SELECT DISTINCT date FROM attendance "
+          "  WHERE course_id=(SELECT id FROM courses WHERE code=?1) AND date BETWEEN ?2 AND ?3)), "
+          "ab AS (SELECT a.student_id, d.k - row_number() OVER (PARTITION BY a.student_id ORDER BY d.k) AS grp "
+          "  FROM attendance a JOIN d USING(date) "
+          "  WHERE a.course_id=(SELECT id FROM courses WHERE code=?1) AND a.status='A') "
+          "SELECT count(DISTINCT student_id) FROM (SELECT student_id FROM ab GROUP BY student_id, grp HAVING count(*)>=3)" },
+        { "below75", "BELOW_PCT", "75",
+          "SELECT count(*) FROM (SELECT student_id FROM attendance GROUP BY student_id "
+          "HAVING 100.0*sum(status='P')/count(*) < 75)" },
+    };
+    snprintf(qs[0].payload, sizeof qs[0].payload, "%s@%s:A AND %s@%s:A", code, from, code, next);
+    snprintf(qs[1].payload, sizeof qs[1].payload, "%s@%s..%s:A", code, from, week);
+    snprintf(qs[2].payload, sizeof qs[2].payload, "*@%s:A ANDNOT *@%s:P", from, from);
+    snprintf(qs[3].payload, sizeof qs[3].payload, "%s|%s|%s|3", code, from, to);
+    int nq = (int)(sizeof qs / sizeof qs[0]);
+
+    if ((g_fd = connect_tcp(argv[1], atoi(argv[2]))) < 0) { perror("connect"); return 1; }
+    sqlite3 *db;
+    if (sqlite3_open_v2(argv[3], &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(stderr, "open %s: %s\n", argv[3], sqlite3_errmsg(db));
+        return 1;
+    }
+    sqlite3_exec(db, "PRAGMA cache_size=-262144", NULL, NULL, NULL);
+
+    printf("%-8s %10s %12s %12s %12s %12s %9s\n", "query", "answer", "bitmap p50", "bitmap p99", "sql p50", "sql p99", "speedup");
+    int bad = 0;
+    for (int i = 0; i < nq; ++i) {
+        sqlite3_stmt *st;
+        if (sqlite3_prepare_v2(db, qs[i].sql, -1, &st, NULL) != SQLITE_OK) {
+            fprintf(stderr, "%s: %s\n", qs[i].name, sqlite3_errmsg(db));
+            return 1;
+        }
+        sqlite3_bind_text(st, 1, code, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(st, 2, d0);        // attendance.date is a day number
+        sqlite3_bind_int64(st, 3, d1);
+        sqlite3_bind_int64(st, 4, d0 + 1);
+        sqlite3_bind_int64(st, 5, d0 + 6);
+
+        Histo hb, hs;
+        histo_init(&hb); histo_init(&hs);
+        long long a = ask(&qs[i]), b = count_sql(st);   // also warms both sides
+        for (int k = 0; k < iters; ++k) {
+            uint64_t t0 = now_ns();
+            if (ask(&qs[i]) != a) a = -2;
+            uint64_t t1 = now_ns();
+            if (count_sql(st) != b) b = -2;
+            uint64_t t2 = now_ns();
+            histo_add(&hb, t1 - t0);
+            histo_add(&hs, t2 - t1);
+        }
+        sqlite3_finalize(st);
+        double pb = histo_quantile(&hb, 0.5) / 1e3, ps = histo_quantile(&hs, 0.5) / 1e3;
+        printf("%-8s %10lld %12.1f %12.1f %12.1f %12.1f %8.1fx%s\n", qs[i].name, a,
+               pb, histo_quantile(&hb, 0.99) / 1e3, ps, histo_quantile(&hs, 0.99) / 1e3,
+               pb > 0 ? ps / pb : 0.0, a == b && a >= 0 ? "" : "  MISMATCH");
+        if (a != b || a < 0) { bad = 1; fprintf(stderr, "%s: bitmap %lld, sql %lld\n", qs[i].name, a, b); }
+    }
+    sqlite3_close(db);
+    close(g_fd);
+    return bad;
+}
@@ -0,0 +1,48 @@
+// stmtcache.c — see stmtcache.h
+
+#include "stmtcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int stmtcache_init(StmtCache *sc, sqlite3 *db, const char *const *sql, int n) {
+    sc->db = db; sc->n = n; sc->sql = sql;
+    sc->st = calloc((size_t)n, sizeof *sc->st);
+    if (!sc->st) return -1;
+    for (int i = 0; i < n; ++i) {
+        if (sqlite3_prepare_v3(db, sql[i], -1, SQLITE_PREPARE_PERSISTENT,
+                               &sc->st[i], NULL) != SQLITE_OK) {
+            fprintf(stderr, "prepare [%d] %s: %s\n", i, sql[i], sqlite3_errmsg(db));
+            stmtcache_free(sc);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void stmtcache_free(StmtCache *sc) {
+    if (sc->st)
+        for (int i = 0; i < sc->n; ++i) sqlite3_finalize(sc->st[i]);
+    free(sc->st);
+    sc->st = NULL; sc->n = 0;
+}
+
+sqlite3_stmt *stmtcache_get(StmtCache *sc, int id) {
+    return (id >= 0 && id < sc->n) ? sc->st[id] : NULL;
+}
+
+void stmtcache_put(sqlite3_stmt *st) {
+    if (!st) return;
+    sqlite3_reset(st);
+    sqlite3_clear_bindings(st);
+}
+
+sqlite3_stmt *stmtcache_detach(StmtCache *sc, int id) {
+    sqlite3_stmt *fresh;
+    if (id < 0 || id >= sc->n ||
+        sqlite3_prepare_v3(sc->db, sc->sql[id], -1, SQLITE_PREPARE_PERSISTENT, &fresh, NULL) != SQLITE_OK)
+        return NULL;
+    sqlite3_stmt *st = sc->st[id];
+    sc->st[id] = fresh;
+    return st;
+}
@@ -0,0 +1,32 @@
+// stmtcache.h — prepared-statement cache for the request hot path
+//
+// Each server lists its SQL in a table indexed by an enum. All statements
+// are compiled once (SQLITE_PREPARE_PERSISTENT) right after the schema is
+// created; handlers borrow a statement by id, bind, step, and hand it back,
+// which resets it and clears its bindings instead of finalizing.
+
+#ifndef STMTCACHE_H
+#define STMTCACHE_H
+
+#include <sqlite3.h>
+
+typedef struct {
+    sqlite3            *db;
+    int                 n;
+    const char *const  *sql;   // caller-owned, indexed by statement id
+    sqlite3_stmt      **st;
+} StmtCache;
+
+// Prepare every entry of sql[0..n). Returns 0, or -1 after reporting the
+// failing statement on stderr (nothing is left allocated).
+int           stmtcache_init(StmtCache *sc, sqlite3 *db, const char *const *sql, int n);
+void          stmtcache_free(StmtCache *sc);
+sqlite3_stmt *stmtcache_get(StmtCache *sc, int id);
+void          stmtcache_put(sqlite3_stmt *st);
+// Give statement id (with its bindings and step position) to the caller for
+// good, who finalizes it, and prepare a fresh copy in its place. Lets a
+// cursor outlive the request that opened it. NULL (cache unchanged) if the
+// copy cannot be prepared.
+sqlite3_stmt *stmtcache_detach(StmtCache *sc, int id);
+
+#endif
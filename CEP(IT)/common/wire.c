@@ -0,0 +1,103 @@
+// wire.c — see wire.h
+
+#include "wire.h"
+
+#include <string.h>
+
+size_t varint_put(uint8_t *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) { p[n++] = (uint8_t)(v | 0x80); v >>= 7; }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+int varint_get(const uint8_t *p, size_t len, uint64_t *v) {
+    uint64_t x = 0;
+    for (size_t i = 0; i < 10; ++i) {
+        if (i == len) return 0;
+        x |= (uint64_t)(p[i] & 0x7F) << (7 * i);
+        if (!(p[i] & 0x80)) { *v = x; return (int)i + 1; }
+    }
+    return -1;
+}
+
+int wire_header(const uint8_t *p, size_t len, uint8_t *op, uint64_t *plen) {
+    if (len < 2) return 0;
+    int n = varint_get(p + 1, len - 1, plen);
+    if (n <= 0) return n;
+    *op = p[0];
+    return n + 1;
+}
+
+size_t wire_frame(uint8_t *out, size_t cap, uint8_t op, const void *payload, size_t n) {
+    uint8_t hdr[WIRE_MAX_HDR];
+    hdr[0] = op;
+    size_t h = 1 + varint_put(hdr + 1, n);
+    if (h + n > cap) return 0;
+    memcpy(out, hdr, h);
+    memcpy(out + h, payload, n);
+    return h + n;
+}
+
+int wire_next_frame(LineBuf *lb, uint8_t *op, uint8_t *payload, size_t cap,
+                    uint8_t *raw, size_t *rawlen) {
+    uint8_t hdr[WIRE_MAX_HDR];
+    uint64_t plen;
+    size_t got = linebuf_peek(lb, hdr, sizeof hdr);
+    int h = wire_header(hdr, got, op, &plen);
+    if (h < 0 || (h > 0 && plen > cap)) return WIRE_BAD;
+    if (h == 0 || linebuf_used(lb) < (size_t)h + plen) return LB_NOLINE;
+    if (raw) {
+        linebuf_peek(lb, raw, (size_t)h + (size_t)plen);
+        memcpy(payload, raw + h, (size_t)plen);
+        *rawlen = (size_t)h + (size_t)plen;
+    } else {
+        linebuf_drop(lb, (size_t)h);
+        linebuf_peek(lb, payload, (size_t)plen);
+        linebuf_drop(lb, (size_t)plen);
+        return (int)plen;
+    }
+    linebuf_drop(lb, (size_t)h + (size_t)plen);
+    return (int)plen;
+}
+
+const char *wire_get_str(WireReader *r, size_t *n) {
+    uint64_t len;
+    int k = r->bad ? -1 : varint_get(r->p, (size_t)(r->end - r->p), &len);
+    if (k <= 0 || len > (uint64_t)(r->end - r->p - k)) { r->bad = 1; *n = 0; return ""; }
+    const char *s = (const char*)r->p + k;
+    r->p += k + len;
+    *n = (size_t)len;
+    return s;
+}
+
+uint32_t wire_get_u32(WireReader *r) {
+    if (r->bad || r->end - r->p < 4) { r->bad = 1; return 0; }
+    uint32_t v = (uint32_t)r->p[0] | (uint32_t)r->p[1] << 8 |
+                 (uint32_t)r->p[2] << 16 | (uint32_t)r->p[3] << 24;
+    r->p += 4;
+    return v;
+}
+
+uint8_t wire_get_u8(WireReader *r) {
+    if (r->bad || r->p == r->end) { r->bad = 1; return 0; }
+    return *r->p++;
+}
+
+void wire_put_str(WireWriter *w, const char *s, size_t n) {
+    uint8_t tmp[10];
+    size_t k = varint_put(tmp, n);
+    if (w->bad || (size_t)(w->end - w->p) < k + n) { w->bad = 1; return; }
+    memcpy(w->p, tmp, k); memcpy(w->p + k, s, n);
+    w->p += k + n;
+}
+
+void wire_put_u32(WireWriter *w, uint32_t v) {
+    if (w->bad || w->end - w->p < 4) { w->bad = 1; return; }
+    for (int i = 0; i < 4; ++i) *w->p++ = (uint8_t)(v >> (8 * i));
+}
+
+void wire_put_u8(WireWriter *w, uint8_t v) {
+    if (w->bad || w->p == w->end) { w->bad = 1; return; }
+    *w->p++ = v;
+}
@@ -0,0 +1,67 @@
+// wire.h — compact binary framing, negotiated per connection
+//
+// A client that sends the text line "BIN" (and gets an OK back) switches its
+// connection to frames; everyone else keeps the hex text protocol.
+//
+//   frame   = opcode:u8  len:varint  payload[len]
+//   varint  = unsigned LEB128, at most 10 bytes
+//   str     = len:varint bytes[len]
+//   u32/u8  = little-endian fixed width
+//
+// Replies stay text lines in both modes.
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "netbuf.h"
+
+#define WIRE_MAX_HDR 11   // opcode + longest varint
+#define WIRE_BAD     (-3) // framing lost: bad header or oversized payload
+
+// ClagCode/server.c: payload = str roll, str course, u32 epoch, u8 status
+#define WIRE_ATT 0x01
+
+// final project/att_server.c: payloads are the text fields as strs, except
+// MARK = str roll, str code, u32 epoch (date = its UTC day), u8 status char.
+// IMPORT's file follows its frame as raw bytes, and EXPORT's its reply line.
+enum {
+    WOP_ADD_STUDENT = 1, WOP_ADD_COURSE, WOP_ENROLL, WOP_MARK,
+    WOP_LIST_STUDENTS, WOP_LIST_COURSES, WOP_REPORT_BY_ROLL, WOP_REPORT_BY_CODE,
+    WOP_PAGE_STUDENTS, WOP_PAGE_BY_ROLL, WOP_PAGE_BY_CODE,
+    WOP_SUMMARY, WOP_REBUILD_COUNTS,
+    WOP_SET_QUERY, WOP_SET_COUNT, WOP_ABSENT_STREAK, WOP_BELOW_PCT,
+    WOP_IMPORT, WOP_EXPORT,
+    WOP_COUNT
+};
+
+size_t varint_put(uint8_t *p, uint64_t v);
+// Bytes consumed; 0 if more input is needed; -1 if malformed.
+int    varint_get(const uint8_t *p, size_t len, uint64_t *v);
+
+// Parse a frame header from the first len bytes. Returns the header size
+// and fills *op/*plen; 0 if incomplete; -1 if malformed.
+int    wire_header(const uint8_t *p, size_t len, uint8_t *op, uint64_t *plen);
+// Write header + payload; returns the frame size, or 0 if cap is too small.
+size_t wire_frame(uint8_t *out, size_t cap, uint8_t op, const void *payload, size_t n);
+// Take the next whole frame out of an input ring: copies the payload into
+// payload[cap] and returns its length, LB_NOLINE if incomplete, or WIRE_BAD.
+// If raw is non-NULL the whole frame (header too) is copied there as well;
+// it must hold WIRE_MAX_HDR + cap bytes.
+int    wire_next_frame(LineBuf *lb, uint8_t *op, uint8_t *payload, size_t cap,
+                       uint8_t *raw, size_t *rawlen);
+
+typedef struct { const uint8_t *p, *end; int bad; } WireReader;
+typedef struct { uint8_t *p, *end; int bad; } WireWriter;
+
+// Readers set r->bad on short input and return zeroes / empty strings.
+const char *wire_get_str(WireReader *r, size_t *n);
+uint32_t    wire_get_u32(WireReader *r);
+uint8_t     wire_get_u8(WireReader *r);
+void        wire_put_str(WireWriter *w, const char *s, size_t n);
+void        wire_put_u32(WireWriter *w, uint32_t v);
+void        wire_put_u8(WireWriter *w, uint8_t v);
+
+#endif
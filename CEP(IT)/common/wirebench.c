@@ -0,0 +1,186 @@
+// wirebench.c — bytes and CPU per request, hex text lines vs wire.h frames
+// Build: gcc -std=c17 -O2 -Wall -Wextra wirebench.c wire.c netbuf.c hexcodec.c datetime.c -o wirebench
+// Run:   ./wirebench [requests]
+//
+// For the ClagCode ATT request and the att_server MARK request, encodes
+// <requests> (default 2M) rows both ways, then pushes them through a LineBuf
+// in 64 KiB reads and times the server-side work up to a decoded row:
+// framing, field split, hex decode / varint strings, timestamp formatting.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "datetime.h"
+#include "hexcodec.h"
+#include "netbuf.h"
+#include "wire.h"
+
+#define MAX_MSG 600
+#define CHUNK   65536
+#define SLOT    128     // stream bytes reserved per message (longest is 74)
+
+static volatile unsigned g_sink;   // keeps the decode results live
+
+typedef struct { char roll[129], course[129], ts[129]; int status; } Row;
+
+static double now_s(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sample(int i, char *roll, char *course, uint32_t *epoch) {
+    sprintf(roll, "%d", 2300000 + i % 5000);
+    sprintf(course, "CS%03d", i % 40);
+    *epoch = 1735718400u + (uint32_t)(i % 90) * 86400u + (uint32_t)(i % 7) * 3600u;
+}
+
+static size_t text_msg(char *out, int mark, int i) {
+    char roll[16], course[16], ts[21], hr[40], hc[40], ht[48], hs[4];
+    uint32_t epoch;
+    sample(i, roll, course, &epoch);
+    if (mark) format_ymd(epoch / 86400, ts); else format_iso8601(epoch, ts);
+    hex_encode(roll, strlen(roll), hr, sizeof hr, 1);
+    hex_encode(course, strlen(course), hc, sizeof hc, 1);
+    hex_encode(ts, strlen(ts), ht, sizeof ht, 1);
+    if (mark) {
+        // att_server: "MARK <hex of roll|code|date|status>"
+        char plain[80], hex[160];
+        int n = sprintf(plain, "%s|%s|%s|P", roll, course, ts);
+        hex_encode(plain, (size_t)n, hex, sizeof hex, 0);
+        return (size_t)sprintf(out, "MARK %s\n", hex);
+    }
+    hex_encode("1", 1, hs, sizeof hs, 1);
+    return (size_t)sprintf(out, "ATT|%s|%s|%s|%s\n", hr, hc, ht, hs);
+}
+
+static size_t bin_msg(uint8_t *out, int mark, int i) {
+    char roll[16], course[16];
+    uint32_t epoch;
+    uint8_t payload[64];
+    sample(i, roll, course, &epoch);
+    WireWriter w = { payload, payload + sizeof payload, 0 };
+    wire_put_str(&w, roll, strlen(roll));
+    wire_put_str(&w, course, strlen(course));
+    wire_put_u32(&w, mark ? epoch / 86400 * 86400 : epoch);
+    wire_put_u8(&w, mark ? 'P' : 1);
+    return wire_frame(out, MAX_MSG, mark ? WOP_MARK : WIRE_ATT, payload, (size_t)(w.p - payload));
+}
+
+// Server-side decode of one text line, as in ClagCode/server.c parse_line
+// and att_server.c process_command.
+static int text_decode(char *line, int mark, Row *r) {
+    unsigned char b[4][128];
+    int n[4];
+    char *save = NULL;
+    if (mark) {
+        char *hex = strchr(line, ' ');
+        if (!hex) return -1;
+        unsigned char plain[256];
+        int m = hex_decode(hex + 1, strlen(hex + 1), plain, sizeof plain - 1);
+        if (m < 0) return -1;
+        plain[m] = 0;
+        char *f[4];
+        f[0] = strtok_r((char*)plain, "|", &save);
+        for (int k = 1; k < 4; ++k) f[k] = strtok_r(NULL, "|", &save);
+        if (!f[3]) return -1;
+        snprintf(r->roll, sizeof r->roll, "%s", f[0]);
+        snprintf(r->course, sizeof r->course, "%s", f[1]);
+        snprintf(r->ts, sizeof r->ts, "%s", f[2]);
+        r->status = f[3][0];
+        return 0;
+    }
+    char *verb = strtok_r(line, "|", &save);
+    char *f[4];
+    for (int k = 0; k < 4; ++k) f[k] = strtok_r(NULL, k == 3 ? "\r\n" : "|", &save);
+    if (!verb || !f[3]) return -1;
+    for (int k = 0; k < 4; ++k)
+        if ((n[k] = hex_decode(f[k], strlen(f[k]), b[k], sizeof b[k] - 1)) < 0) return -1;
+    memcpy(r->roll, b[0], (size_t)n[0]); r->roll[n[0]] = 0;
+    memcpy(r->course, b[1], (size_t)n[1]); r->course[n[1]] = 0;
+    memcpy(r->ts, b[2], (size_t)n[2]); r->ts[n[2]] = 0;
+    r->status = b[3][0] == '1';
+    return 0;
+}
+
+static int bin_decode(const uint8_t *p, size_t len, int mark, Row *r) {
+    WireReader rd = { p, p + len, 0 };
+    size_t nr, nc;
+    const char *roll = wire_get_str(&rd, &nr);
+    const char *course = wire_get_str(&rd, &nc);
+    uint32_t epoch = wire_get_u32(&rd);
+    uint8_t st = wire_get_u8(&rd);
+    if (rd.bad || nr >= sizeof r->roll || nc >= sizeof r->course) return -1;
+    memcpy(r->roll, roll, nr); r->roll[nr] = 0;
+    memcpy(r->course, course, nc); r->course[nc] = 0;
+    if (mark) format_ymd(epoch / 86400, r->ts); else format_iso8601(epoch, r->ts);
+    r->status = st;
+    return 0;
+}
+
+// Feed stream[0..len) through a LineBuf in CHUNK reads and decode every
+// message. Returns the rows decoded.
+static long run(const char *stream, size_t len, int bin, int mark, unsigned *sink) {
+    LineBuf lb;
+    if (linebuf_init(&lb, 2 * CHUNK) != 0) return -1;
+    char line[MAX_MSG];
+    uint8_t payload[MAX_MSG];
+    Row r;
+    long rows = 0;
+    size_t off = 0;
+    while (off < len) {
+        char *room;
+        size_t cap = linebuf_space(&lb, &room);
+        size_t n = len - off < cap ? len - off : cap;
+        if (n > CHUNK) n = CHUNK;
+        memcpy(room, stream + off, n);
+        linebuf_commit(&lb, n);
+        off += n;
+        int m;
+        uint8_t op;
+        if (bin) {
+            while ((m = wire_next_frame(&lb, &op, payload, sizeof payload, NULL, NULL)) >= 0)
+                if (bin_decode(payload, (size_t)m, mark, &r) == 0) { rows++; *sink += (unsigned)r.ts[9]; }
+        } else {
+            while ((m = linebuf_getline(&lb, line, sizeof line)) >= 0)
+                if (text_decode(line, mark, &r) == 0) { rows++; *sink += (unsigned)r.ts[9]; }
+        }
+    }
+    linebuf_free(&lb);
+    return rows;
+}
+
+int main(int argc, char **argv) {
+    int reqs = argc > 1 ? atoi(argv[1]) : 2000000;
+    if (reqs <= 0) { fprintf(stderr, "bad count\n"); return 1; }
+    char *text = malloc((size_t)reqs * SLOT);
+    uint8_t *bin = malloc((size_t)reqs * SLOT);
+    if (!text || !bin) { perror("malloc"); return 1; }
+    unsigned sink = 0;
+
+    for (int mark = 0; mark < 2; ++mark) {
+        size_t tlen = 0, blen = 0;
+        for (int i = 0; i < reqs; ++i) {
+            tlen += text_msg(text + tlen, mark, i);
+            blen += bin_msg(bin + blen, mark, i);
+        }
+        double t = now_s();
+        long tr = run(text, tlen, 0, mark, &sink);
+        double tt = now_s() - t;
+        t = now_s();
+        long br = run((const char*)bin, blen, 1, mark, &sink);
+        double bt = now_s() - t;
+        if (tr != reqs || br != reqs) {
+            fprintf(stderr, "%s: decoded %ld text / %ld binary of %d\n", mark ? "MARK" : "ATT", tr, br, reqs);
+            return 1;
+        }
+        printf("%-4s text %5.1f B/req %6.1f ns/req   binary %5.1f B/req %6.1f ns/req\n",
+               mark ? "MARK" : "ATT", (double)tlen / reqs, tt * 1e9 / reqs,
+               (double)blen / reqs, bt * 1e9 / reqs);
+    }
+    free(text); free(bin);
+    g_sink = sink;
+    return 0;
+}
@@ -0,0 +1,231 @@
+// workq.c — see workq.h
+
+#define _GNU_SOURCE   // pthread_condattr_setclock under -std=c17
+
+#include "workq.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define MPSCQ_SPINS 16   // yields an empty mpscq_pop tries before it sleeps
+
+// Mutex and a condition variable whose timed waits use CLOCK_MONOTONIC.
+static int lock_init(pthread_mutex_t *mu, pthread_cond_t *cv) {
+    pthread_condattr_t ca;
+    if (pthread_mutex_init(mu, NULL) != 0) return -1;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    int rc = pthread_cond_init(cv, &ca);
+    pthread_condattr_destroy(&ca);
+    if (rc != 0) { pthread_mutex_destroy(mu); return -1; }
+    return 0;
+}
+
+int workq_init(WorkQueue *q, size_t cap) {
+    q->head = q->tail = NULL;
+    q->n = 0; q->cap = cap; q->closed = 0;
+    return lock_init(&q->mu, &q->cv);
+}
+
+void workq_free(WorkQueue *q) {
+    pthread_cond_destroy(&q->cv);
+    pthread_mutex_destroy(&q->mu);
+}
+
+int workq_push(WorkQueue *q, WorkItem *it) {
+    pthread_mutex_lock(&q->mu);
+    if (q->closed || q->n >= q->cap) { pthread_mutex_unlock(&q->mu); return -1; }
+    it->next = NULL;
+    if (q->tail) q->tail->next = it; else q->head = it;
+    q->tail = it;
+    q->n++;
+    pthread_cond_signal(&q->cv);
+    pthread_mutex_unlock(&q->mu);
+    return 0;
+}
+
+int workq_full(WorkQueue *q) {
+    pthread_mutex_lock(&q->mu);
+    int full = q->n >= q->cap;
+    pthread_mutex_unlock(&q->mu);
+    return full;
+}
+
+WorkItem *workq_pop(WorkQueue *q, const struct timespec *deadline) {
+    pthread_mutex_lock(&q->mu);
+    while (!q->head && !q->closed) {
+        if (!deadline) pthread_cond_wait(&q->cv, &q->mu);
+        else if (pthread_cond_timedwait(&q->cv, &q->mu, deadline) == ETIMEDOUT) break;
+    }
+    WorkItem *it = q->head;
+    if (it) {
+        q->head = it->next;
+        if (!q->head) q->tail = NULL;
+        q->n--;
+    }
+    pthread_mutex_unlock(&q->mu);
+    return it;
+}
+
+void workq_close(WorkQueue *q) {
+    pthread_mutex_lock(&q->mu);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->cv);
+    pthread_mutex_unlock(&q->mu);
+}
+
+int mpscq_init(MpscQueue *q, size_t cap) {
+    q->n = 0;
+    q->sleeping = q->closed = 0;
+    if (mpscring_init(&q->ring, cap) != 0) return -1;
+    if (lock_init(&q->mu, &q->cv) != 0) { mpscring_free(&q->ring); return -1; }
+    return 0;
+}
+
+void mpscq_free(MpscQueue *q) {
+    pthread_cond_destroy(&q->cv);
+    pthread_mutex_destroy(&q->mu);
+    mpscring_free(&q->ring);
+}
+
+int mpscq_push(MpscQueue *q, WorkItem *it) {
+    if (__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE)) return -1;
+    // counted first, so n never drops below what the ring holds
+    __atomic_fetch_add(&q->n, 1, __ATOMIC_SEQ_CST);
+    if (mpscring_push(&q->ring, it) != 0) { __atomic_fetch_sub(&q->n, 1, __ATOMIC_RELAXED); return -1; }
+    // pairs with the consumer's store of sleeping and load of n: one of
+    // the two sides sees the other's write
+    if (__atomic_load_n(&q->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&q->mu);
+        pthread_cond_signal(&q->cv);
+        pthread_mutex_unlock(&q->mu);
+    }
+    return 0;
+}
+
+int mpscq_full(MpscQueue *q) {
+    return mpscring_count(&q->ring) >= mpscring_cap(&q->ring);
+}
+
+WorkItem *mpscq_pop(MpscQueue *q, const struct timespec *deadline) {
+    for (;;) {
+        WorkItem *it = mpscring_pop(&q->ring);
+        if (it) { __atomic_fetch_sub(&q->n, 1, __ATOMIC_RELAXED); return it; }
+        // counted but not readable yet: a push is under way
+        if (__atomic_load_n(&q->n, __ATOMIC_SEQ_CST)) { sched_yield(); continue; }
+        // a few yields first: under load the next push is usually close
+        int spins = 0;
+        while (spins < MPSCQ_SPINS && !__atomic_load_n(&q->n, __ATOMIC_SEQ_CST)) { sched_yield(); spins++; }
+        if (spins < MPSCQ_SPINS) continue;
+        pthread_mutex_lock(&q->mu);
+        __atomic_store_n(&q->sleeping, 1, __ATOMIC_SEQ_CST);
+        int timeout = 0;
+        while (!timeout && !__atomic_load_n(&q->n, __ATOMIC_SEQ_CST) &&
+               !__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE)) {
+            if (!deadline) pthread_cond_wait(&q->cv, &q->mu);
+            else timeout = pthread_cond_timedwait(&q->cv, &q->mu, deadline) == ETIMEDOUT;
+        }
+        __atomic_store_n(&q->sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&q->mu);
+        if (!__atomic_load_n(&q->n, __ATOMIC_SEQ_CST)) return NULL;
+    }
+}
+
+void mpscq_close(MpscQueue *q) {
+    __atomic_store_n(&q->closed, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&q->mu);
+    pthread_cond_broadcast(&q->cv);
+    pthread_mutex_unlock(&q->mu);
+}
+
+static void wake(int efd) {
+    uint64_t one = 1;
+    ssize_t rc = write(efd, &one, sizeof one);
+    (void)rc;
+}
+
+int doneq_init(DoneQueue *d) {
+    d->head = d->tail = NULL;
+    d->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (d->efd < 0) return -1;
+    if (pthread_mutex_init(&d->mu, NULL) != 0) { close(d->efd); return -1; }
+    return 0;
+}
+
+void doneq_free(DoneQueue *d) {
+    close(d->efd);
+    pthread_mutex_destroy(&d->mu);
+}
+
+void doneq_push(DoneQueue *d, WorkItem *it) {
+    it->next = NULL;
+    pthread_mutex_lock(&d->mu);
+    int was_empty = d->head == NULL;
+    if (d->tail) d->tail->next = it; else d->head = it;
+    d->tail = it;
+    pthread_mutex_unlock(&d->mu);
+    if (was_empty) wake(d->efd);   // one wakeup per batch the loop has not taken yet
+}
+
+WorkItem *doneq_take(DoneQueue *d) {
+    uint64_t v;
+    ssize_t rc = read(d->efd, &v, sizeof v);
+    (void)rc;
+    pthread_mutex_lock(&d->mu);
+    WorkItem *it = d->head;
+    d->head = d->tail = NULL;
+    pthread_mutex_unlock(&d->mu);
+    return it;
+}
+
+int donering_init(DoneRing *d, size_t cap) {
+    d->n = 0;
+    if (mpscring_init(&d->ring, cap) != 0) return -1;
+    d->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (d->efd < 0) { mpscring_free(&d->ring); return -1; }
+    return 0;
+}
+
+void donering_free(DoneRing *d) {
+    close(d->efd);
+    mpscring_free(&d->ring);
+}
+
+int donering_push(DoneRing *d, WorkItem *first) {
+    if (mpscring_push(&d->ring, first) != 0) return -1;
+    // counted once it is in the ring, so every counted item can be popped
+    if (__atomic_fetch_add(&d->n, 1, __ATOMIC_ACQ_REL) == 0) wake(d->efd);
+    return 0;
+}
+
+WorkItem *donering_take(DoneRing *d) {
+    uint64_t v;
+    ssize_t rc = read(d->efd, &v, sizeof v);
+    (void)rc;
+    size_t k = __atomic_load_n(&d->n, __ATOMIC_ACQUIRE);
+    WorkItem *head = NULL, **tail = &head;
+    for (size_t i = 0; i < k; ) {
+        WorkItem *it = mpscring_pop(&d->ring);
+        if (!it) { sched_yield(); continue; }   // an earlier slot is still being filled
+        *tail = it;
+        while (it->next) it = it->next;
+        tail = &it->next;
+        ++i;
+    }
+    *tail = NULL;
+    // pushes after the load above saw a non-zero count and did not wake us
+    if (k && __atomic_sub_fetch(&d->n, k, __ATOMIC_ACQ_REL) != 0) wake(d->efd);
+    return head;
+}
+
+struct timespec workq_deadline(int ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+    return ts;
+}
@@ -0,0 +1,110 @@
+// workq.h — hand-off queues between the I/O loop and database threads
+//
+// WorkQueue is a bounded FIFO of intrusive items. Producers never block: a
+// push into a full queue fails, and the I/O loop stops reading from that
+// connection until replies drain. Consumers (writer / reader threads) block
+// in workq_pop, optionally until a deadline.
+//
+// DoneQueue carries finished items back. It is unbounded, so a worker never
+// waits on the I/O loop, and it owns an eventfd that becomes readable when
+// the queue goes from empty to non-empty; register it with epoll and call
+// doneq_take when it fires.
+//
+// MpscQueue is WorkQueue's contract for many producer threads and one
+// consumer, e.g. several I/O loops feeding one database writer. Items go
+// through an MpscRing (mpscring.h): a push is one compare-and-swap and an
+// atomic increment of the count, so producers never wait on a lock or on
+// each other; only the consumer takes its mutex, to sleep while the queue
+// is empty, and a producer touches it only to wake a sleeping consumer.
+// The capacity is cap rounded up to a power of two.
+//
+// DoneRing is DoneQueue on an MpscRing, for workers that hand back at a
+// rate where the mutex would be the bottleneck. It is bounded: a push into
+// a full ring fails and the worker tries again once the loop has caught
+// up. The eventfd is written only when the count of waiting items goes
+// from zero to one, and donering_take writes it again itself if it leaves
+// items behind, so no batch goes without a wakeup. A push may be a whole
+// chain of items, which then costs one slot and at most one wakeup.
+//
+// Embed a WorkItem as the first member of the request struct and cast.
+
+#ifndef WORKQ_H
+#define WORKQ_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "mpscring.h"
+
+typedef struct WorkItem { struct WorkItem *next; } WorkItem;
+
+typedef struct {
+    pthread_mutex_t mu;
+    pthread_cond_t  cv;       // signalled on push and close
+    WorkItem       *head, *tail;
+    size_t          n, cap;
+    int             closed;
+} WorkQueue;
+
+int       workq_init(WorkQueue *q, size_t cap);
+void      workq_free(WorkQueue *q);
+// 0, or -1 if the queue is full or closed.
+int       workq_push(WorkQueue *q, WorkItem *it);
+int       workq_full(WorkQueue *q);
+// Oldest item. Waits until `deadline` (CLOCK_MONOTONIC, NULL = forever);
+// NULL on timeout, or once the queue is closed and empty.
+WorkItem *workq_pop(WorkQueue *q, const struct timespec *deadline);
+// Wake every consumer; pops return the remaining items, then NULL.
+void      workq_close(WorkQueue *q);
+
+typedef struct {
+    pthread_mutex_t mu;
+    WorkItem       *head, *tail;
+    int             efd;      // eventfd, readable while items are waiting
+} DoneQueue;
+
+typedef struct {
+    MpscRing        ring;
+    _Alignas(64) size_t n;    // pushed and not yet popped
+    _Alignas(64) int sleeping;   // consumer waits on cv
+    int             closed;
+    pthread_mutex_t mu;
+    pthread_cond_t  cv;
+} MpscQueue;
+
+int       mpscq_init(MpscQueue *q, size_t cap);
+void      mpscq_free(MpscQueue *q);
+// Any thread: 0, or -1 if the queue is full or closed.
+int       mpscq_push(MpscQueue *q, WorkItem *it);
+int       mpscq_full(MpscQueue *q);
+// Consumer thread only; as workq_pop.
+WorkItem *mpscq_pop(MpscQueue *q, const struct timespec *deadline);
+void      mpscq_close(MpscQueue *q);
+
+typedef struct {
+    MpscRing        ring;
+    _Alignas(64) size_t n;   // pushed and not yet taken
+    int             efd;     // eventfd, readable while items are waiting
+} DoneRing;
+
+int       doneq_init(DoneQueue *d);
+void      doneq_free(DoneQueue *d);
+void      doneq_push(DoneQueue *d, WorkItem *it);
+// Every waiting item in push order (NULL if none); rearms the eventfd.
+WorkItem *doneq_take(DoneQueue *d);
+
+// cap is rounded up to a power of two. -1 if out of memory or no eventfd.
+int       donering_init(DoneRing *d, size_t cap);
+void      donering_free(DoneRing *d);
+// Any thread: the chain from first (linked through next, NULL-terminated)
+// as one entry. 0, or -1 if the ring is full.
+int       donering_push(DoneRing *d, WorkItem *first);
+// Consumer thread only: the items waiting when it was called, in push
+// order and linked through next (NULL if none).
+WorkItem *donering_take(DoneRing *d);
+
+// now + ms on CLOCK_MONOTONIC, for workq_pop deadlines.
+struct timespec workq_deadline(int ms);
+
+#endif
@@ -1,7 +1,14 @@
 // att_client.c — Menu Client (hex-encodes payloads, talks to server)
-// Build:  gcc att_client.c -lws2_32 -o att_client.exe
-// Run:    att_client.exe <server-ip> <port>
+// Build:  gcc -I../common att_client.c ../common/hexcodec.c ../common/wire.c ../common/netbuf.c ../common/datetime.c -lws2_32 -o att_client.exe
+// Run:    att_client.exe <server-ip> <port> [--bin]
 // Example: att_client.exe 192.168.100.6 5555
+// --bin sends "BIN" first and, once the server answers "OK", wire.h frames
+// instead of hex lines; it exits if the server refuses.
+// Options 9-11 page through a list or report a screen at a time (PAGE_*).
+// Options 12-13 show a day's or a student's P/A/L totals (SUMMARY).
+// Options 14-16 are the set queries (SET_QUERY, ABSENT_STREAK, BELOW_PCT).
+// Option 17 uploads a CSV/TSV file for the server to bulk-load (IMPORT);
+// option 18 saves the attendance as a column file (EXPORT, colfile.h).
 
 #define _WINSOCK_DEPRECATED_NO_WARNINGS
 #include <winsock2.h>
@@ -9,6 +16,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "datetime.h"
+#include "hexcodec.h"
+#include "wire.h"
 
 #pragma comment(lib, "ws2_32.lib")
 
@@ -25,20 +35,48 @@ static void get_line(const char* p, char* buf, size_t sz){
     trim(buf);
 }
 
-static void bytes_to_hex(const unsigned char* in, int n, char* out, int outcap){
-    static const char* H="0123456789abcdef";
-    int j=0;
-    for(int i=0;i<n && j+2<outcap;i++){
-        unsigned char b=in[i];
-        out[j++]=H[b>>4];
-        out[j++]=H[b&0xF];
+static int g_binary;
+
+static const char* const WOP_NAMES[WOP_COUNT]={
+    [WOP_ADD_STUDENT]="ADD_STUDENT", [WOP_ADD_COURSE]="ADD_COURSE", [WOP_ENROLL]="ENROLL",
+    [WOP_MARK]="MARK", [WOP_LIST_STUDENTS]="LIST_STUDENTS", [WOP_LIST_COURSES]="LIST_COURSES",
+    [WOP_REPORT_BY_ROLL]="REPORT_BY_ROLL", [WOP_REPORT_BY_CODE]="REPORT_BY_CODE",
+    [WOP_PAGE_STUDENTS]="PAGE_STUDENTS", [WOP_PAGE_BY_ROLL]="PAGE_BY_ROLL", [WOP_PAGE_BY_CODE]="PAGE_BY_CODE",
+    [WOP_SUMMARY]="SUMMARY", [WOP_REBUILD_COUNTS]="REBUILD_COUNTS",
+    [WOP_SET_QUERY]="SET_QUERY", [WOP_SET_COUNT]="SET_COUNT",
+    [WOP_ABSENT_STREAK]="ABSENT_STREAK", [WOP_BELOW_PCT]="BELOW_PCT",
+    [WOP_IMPORT]="IMPORT", [WOP_EXPORT]="EXPORT",
+};
+
+// Same request as a wire.h frame: '|'-separated fields become length-prefixed
+// strings; MARK sends its date as a u32 epoch and the status as one byte.
+static void send_frame(SOCKET s, const char* op, const char* ascii_payload){
+    int wop=0;
+    for(int i=1;i<WOP_COUNT;i++) if(strcmp(WOP_NAMES[i],op)==0) wop=i;
+    uint8_t payload[MAXLINE]; WireWriter w={payload,payload+sizeof(payload),0};
+    char tmp[MAXLINE]; snprintf(tmp,sizeof(tmp),"%s",ascii_payload);
+    char* fields[4]; int fcnt=0; char* save=NULL;
+    for(char* t=strtok_s(tmp,"|",&save); t && fcnt<4; t=strtok_s(NULL,"|",&save)) fields[fcnt++]=t;
+    if(wop==WOP_MARK){
+        int64_t day;
+        if(fcnt!=4 || parse_ymd(fields[2],strlen(fields[2]),&day)!=0 || day<0 || day>UINT32_MAX/86400){ puts("Invalid date."); return; }
+        wire_put_str(&w,fields[0],strlen(fields[0]));
+        wire_put_str(&w,fields[1],strlen(fields[1]));
+        wire_put_u32(&w,(uint32_t)day*86400u);
+        wire_put_u8(&w,(uint8_t)fields[3][0]);
+    }else{
+        for(int i=0;i<fcnt;i++) wire_put_str(&w,fields[i],strlen(fields[i]));
     }
-    out[j]=0;
+    uint8_t frame[WIRE_MAX_HDR+MAXLINE];
+    size_t n=wire_frame(frame,sizeof(frame),(uint8_t)wop,payload,(size_t)(w.p-payload));
+    if(w.bad || n==0){ puts("Request too long."); return; }
+    send(s,(const char*)frame,(int)n,0);
 }
 
 static void send_cmd(SOCKET s, const char* op, const char* ascii_payload){
+    if(g_binary){ send_frame(s,op,ascii_payload); return; }
     char hex[MAXLINE*2+4];
-    bytes_to_hex((const unsigned char*)ascii_payload, (int)strlen(ascii_payload), hex, (int)sizeof(hex));
+    hex_encode(ascii_payload, strlen(ascii_payload), hex, sizeof(hex), 0);
     char line[MAXLINE*2+64];
     if(ascii_payload[0]) snprintf(line,sizeof(line),"%s %s\n", op, hex);
     else snprintf(line,sizeof(line),"%s\n", op);
@@ -67,6 +105,110 @@ static void read_until_dot(SOCKET s){
     }
 }
 
+// Received bytes not yet returned by recv_line/recv_bytes.
+static char g_rbuf[4096]; static int g_rhave, g_rpos;
+
+// One reply line, without the newline; -1 once the server is gone.
+static int recv_line(SOCKET s, char* line, size_t cap){
+    size_t n=0;
+    for(;;){
+        if(g_rpos==g_rhave){
+            g_rhave=recv(s,g_rbuf,sizeof(g_rbuf),0); g_rpos=0;
+            if(g_rhave<=0){ g_rhave=0; return -1; }
+        }
+        char ch=g_rbuf[g_rpos++];
+        if(ch=='\n'){ if(n && line[n-1]=='\r') n--; line[n]=0; return (int)n; }
+        if(n+1<cap) line[n++]=ch;
+    }
+}
+
+// Print one PAGE_* reply. Returns 1 and fills cursor if another page follows.
+static int read_page(SOCKET s, char* cursor, size_t cap){
+    char line[MAXLINE];
+    for(;;){
+        if(recv_line(s,line,sizeof(line))<0){ puts("[disconnected]"); exit(0); }
+        if(strncmp(line,"ERR",3)==0){ puts(line); return 0; }
+        if(strcmp(line,".")==0) return 0;
+        if(strncmp(line,". ",2)==0){ snprintf(cursor,cap,"%s",line+2); return 1; }
+        puts(line);
+    }
+}
+
+// Fetch op a screen at a time; key is "" for PAGE_STUDENTS.
+static void paged(SOCKET s, const char* op, const char* key){
+    char size[16], more[8], cursor[MAXLINE/2]="", payload[MAXLINE];
+    get_line("Page size [20]: ", size, sizeof(size));
+    int n=atoi(size);
+    if(n<1) n=20;
+    for(;;){
+        snprintf(payload,sizeof(payload),"%s%s%d%s%s", key, key[0]?"|":"", n, cursor[0]?"|":"", cursor);
+        send_cmd(s,op,payload);
+        if(!read_page(s,cursor,sizeof(cursor))) return;
+        get_line("-- Enter for the next page, q to stop: ", more, sizeof(more));
+        if(more[0]=='q' || more[0]=='Q') return;
+    }
+}
+
+// Send a whole file as an IMPORT body and print the summary and failed rows.
+static void import_file(SOCKET s){
+    char path[512]; get_line("CSV/TSV file: ", path, sizeof(path));
+    FILE* f=fopen(path,"rb");
+    if(!f){ puts("Cannot open file."); return; }
+    fseek(f,0,SEEK_END); long len=ftell(f); fseek(f,0,SEEK_SET);
+    char* data=len>0?(char*)malloc((size_t)len):NULL;
+    if(len<=0 || !data || fread(data,1,(size_t)len,f)!=(size_t)len){ puts("Cannot read file."); fclose(f); free(data); return; }
+    fclose(f);
+    char size[32]; snprintf(size,sizeof(size),"%ld",len);
+    send_cmd(s,"IMPORT",size);
+    for(long off=0; off<len; ){
+        int n=send(s,data+off,(int)(len-off>65536?65536:len-off),0);
+        if(n<=0){ puts("[disconnected]"); exit(0); }
+        off+=n;
+    }
+    free(data);
+    char line[MAXLINE];
+    for(;;){
+        if(recv_line(s,line,sizeof(line))<0){ puts("[disconnected]"); exit(0); }
+        if(strcmp(line,".")==0) return;
+        puts(line);
+        if(strncmp(line,"ERR",3)==0) return;
+    }
+}
+
+// Exactly n bytes after a reply line into f; -1 once the server is gone.
+static int recv_bytes(SOCKET s, FILE* f, long long n){
+    while(n>0){
+        if(g_rpos==g_rhave){
+            g_rhave=recv(s,g_rbuf,sizeof(g_rbuf),0); g_rpos=0;
+            if(g_rhave<=0){ g_rhave=0; return -1; }
+        }
+        int k=g_rhave-g_rpos;
+        if(k>n) k=(int)n;
+        fwrite(g_rbuf+g_rpos,1,(size_t)k,f);
+        g_rpos+=k; n-=k;
+    }
+    return 0;
+}
+
+// EXPORT: save the column file the server sends after its reply line.
+static void export_file(SOCKET s){
+    char from[32], to[32], path[512];
+    get_line("From (YYYY-MM-DD, Enter for everything): ", from, sizeof(from));
+    if(from[0]) get_line("To (YYYY-MM-DD): ", to, sizeof(to));
+    get_line("Save as: ", path, sizeof(path));
+    FILE* f=fopen(path,"wb");
+    if(!f){ puts("Cannot create file."); return; }
+    char payload[MAXLINE]="";
+    if(from[0]) snprintf(payload,sizeof(payload),"%s|%s", from, to);
+    send_cmd(s,"EXPORT",payload);
+    char line[MAXLINE]; const char* b;
+    if(recv_line(s,line,sizeof(line))<0){ puts("[disconnected]"); exit(0); }
+    if(strncmp(line,"OK",2)!=0 || !(b=strstr(line,"bytes="))){ puts(line); fclose(f); remove(path); return; }
+    if(recv_bytes(s,f,atoll(b+6))!=0){ puts("[disconnected]"); exit(0); }
+    fclose(f);
+    printf("%s -> %s\n", line, path);
+}
+
 static void read_simple_reply(SOCKET s){
     char buf[1024]; int n=recv(s,buf,sizeof(buf)-1,0);
     if(n<=0){ puts("[disconnected]"); exit(0); }
@@ -83,12 +225,22 @@ static void menu(){
     puts("6) List courses");
     puts("7) Report by student (roll)");
     puts("8) Report by course (code)");
+    puts("9) List students, paged");
+    puts("10) Report by student, paged");
+    puts("11) Report by course, paged");
+    puts("12) Course summary for a day");
+    puts("13) Student summary for a course");
+    puts("14) Set query (e.g. CS101@2025-05-05:A AND CS101@2025-05-06:A)");
+    puts("15) Absent several class days running");
+    puts("16) Students below an attendance %");
+    puts("17) Bulk import (CSV/TSV file)");
+    puts("18) Export attendance (column file)");
     puts("0) Quit");
 }
 
 int main(int argc, char** argv){
-    if(argc!=3){
-        fprintf(stderr,"Usage: %s <server-ip> <port>\n", argv[0]);
+    if(argc!=3 && !(argc==4 && strcmp(argv[3],"--bin")==0)){
+        fprintf(stderr,"Usage: %s <server-ip> <port> [--bin]\n", argv[0]);
         return 1;
     }
     const char* host=argv[1]; int port=atoi(argv[2]);
@@ -97,31 +249,39 @@ int main(int argc, char** argv){
     SOCKET s=socket(AF_INET,SOCK_STREAM,0); if(s==INVALID_SOCKET){ fputs("socket failed\n",stderr); return 1; }
     struct sockaddr_in srv; srv.sin_family=AF_INET; srv.sin_port=htons((u_short)port); srv.sin_addr.s_addr=inet_addr(host);
     if(connect(s,(struct sockaddr*)&srv,sizeof(srv))==SOCKET_ERROR){ fputs("connect failed (IP/port/firewall?)\n",stderr); closesocket(s); WSACleanup(); return 1; }
+    if(argc==4){
+        char ack[64];
+        if(send(s,"BIN\n",4,0)!=4 || recv_line(s,ack,sizeof(ack))<0 || strcmp(ack,"OK")!=0){
+            fputs("server does not support binary mode\n",stderr); closesocket(s); WSACleanup(); return 1;
+        }
+        g_binary=1;
+    }
 
     char choice[16];
     for(;;){
         menu();
         get_line("Select: ", choice, sizeof(choice));
-        if(choice[0]=='0') break;
-        if(choice[0]=='1'){
+        int ch = choice[0] && strspn(choice,"0123456789")==strlen(choice) ? atoi(choice) : -1;
+        if(ch==0) break;
+        if(ch==1){
             char roll[128], name[256];
             get_line("Roll: ", roll, sizeof(roll));
             get_line("Name: ", name, sizeof(name));
             char payload[MAXLINE]; snprintf(payload,sizeof(payload),"%s|%s", roll, name);
             send_cmd(s,"ADD_STUDENT",payload); read_simple_reply(s);
-        }else if(choice[0]=='2'){
+        }else if(ch==2){
             char code[64], title[256];
             get_line("Course code: ", code, sizeof(code));
             get_line("Course title: ", title, sizeof(title));
             char payload[MAXLINE]; snprintf(payload,sizeof(payload),"%s|%s", code, title);
             send_cmd(s,"ADD_COURSE",payload); read_simple_reply(s);
-        }else if(choice[0]=='3'){
+        }else if(ch==3){
             char roll[128], code[64];
             get_line("Roll: ", roll, sizeof(roll));
             get_line("Course code: ", code, sizeof(code));
             char payload[MAXLINE]; snprintf(payload,sizeof(payload),"%s|%s", roll, code);
             send_cmd(s,"ENROLL",payload); read_simple_reply(s);
-        }else if(choice[0]=='4'){
+        }else if(ch==4){
             char roll[128], code[64], date[32], status[8];
             get_line("Roll: ", roll, sizeof(roll));
             get_line("Course code: ", code, sizeof(code));
@@ -129,16 +289,57 @@ int main(int argc, char** argv){
             get_line("Status [P/A/L]: ", status, sizeof(status));
             char payload[MAXLINE]; snprintf(payload,sizeof(payload),"%s|%s|%s|%s", roll, code, date, status);
             send_cmd(s,"MARK",payload); read_simple_reply(s);
-        }else if(choice[0]=='5'){
+        }else if(ch==5){
             send_cmd(s,"LIST_STUDENTS",""); read_until_dot(s);
-        }else if(choice[0]=='6'){
+        }else if(ch==6){
             send_cmd(s,"LIST_COURSES",""); read_until_dot(s);
-        }else if(choice[0]=='7'){
+        }else if(ch==7){
             char roll[128]; get_line("Roll: ", roll, sizeof(roll));
             send_cmd(s,"REPORT_BY_ROLL",roll); read_until_dot(s);
-        }else if(choice[0]=='8'){
+        }else if(ch==8){
             char code[64]; get_line("Course code: ", code, sizeof(code));
             send_cmd(s,"REPORT_BY_CODE",code); read_until_dot(s);
+        }else if(ch==9){
+            paged(s,"PAGE_STUDENTS","");
+        }else if(ch==10){
+            char roll[128]; get_line("Roll: ", roll, sizeof(roll));
+            paged(s,"PAGE_BY_ROLL",roll);
+        }else if(ch==11){
+            char code[64]; get_line("Course code: ", code, sizeof(code));
+            paged(s,"PAGE_BY_CODE",code);
+        }else if(ch==12){
+            char code[64], date[32];
+            get_line("Course code: ", code, sizeof(code));
+            get_line("Date (YYYY-MM-DD): ", date, sizeof(date));
+            char payload[MAXLINE]; snprintf(payload,sizeof(payload),"DAY|%s|%s", code, date);
+            send_cmd(s,"SUMMARY",payload); read_simple_reply(s);
+        }else if(ch==13){
+            char roll[128], code[64];
+            get_line("Roll: ", roll, sizeof(roll));
+            get_line("Course code: ", code, sizeof(code));
+            char payload[MAXLINE]; snprintf(payload,sizeof(payload),"STUDENT|%s|%s", roll, code);
+            send_cmd(s,"SUMMARY",payload); read_simple_reply(s);
+        }else if(ch==14){
+            char expr[512]; get_line("Terms CODE@DATE[..DATE]:P|A|L|M joined by AND/OR/ANDNOT: ", expr, sizeof(expr));
+            send_cmd(s,"SET_QUERY",expr); read_until_dot(s);
+        }else if(ch==15){
+            char code[64], from[32], to[32], n[16];
+            get_line("Course code: ", code, sizeof(code));
+            get_line("From (YYYY-MM-DD): ", from, sizeof(from));
+            get_line("To (YYYY-MM-DD): ", to, sizeof(to));
+            get_line("Days running: ", n, sizeof(n));
+            char payload[MAXLINE]; snprintf(payload,sizeof(payload),"%s|%s|%s|%s", code, from, to, n);
+            send_cmd(s,"ABSENT_STREAK",payload); read_until_dot(s);
+        }else if(ch==16){
+            char pct[16], code[64];
+            get_line("Below %: ", pct, sizeof(pct));
+            get_line("Course code (Enter for all): ", code, sizeof(code));
+            char payload[MAXLINE]; snprintf(payload,sizeof(payload),code[0]?"%s|%s":"%s", pct, code);
+            send_cmd(s,"BELOW_PCT",payload); read_until_dot(s);
+        }else if(ch==17){
+            import_file(s);
+        }else if(ch==18){
+            export_file(s);
         }else{
             puts("Invalid option.");
         }
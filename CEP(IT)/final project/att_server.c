@@ -1,6 +1,6 @@
-// att_server.c  — Networked Attendance Server (SQLite + Winsock, hex protocol)
-// Build:  gcc att_server.c -lsqlite3 -lws2_32 -o att_server.exe
-// Run:    att_server.exe 0.0.0.0 5555 attendance.db
+// att_server.c  — Networked Attendance Server (SQLite + epoll, hex protocol)
+// Build:  gcc -pthread -I../common att_server.c ../common/attindex.c ../common/bitmap.c ../common/colfile.c ../common/csvimport.c ../common/netbuf.c ../common/stmtcache.c ../common/idmap.c ../common/hexcodec.c ../common/wire.c ../common/datetime.c ../common/workq.c ../common/mpscring.c ../common/dbtune.c -lsqlite3 -o att_server
+// Run:    ./att_server 0.0.0.0 5555 attendance.db [--readers N] [--reactors N] [--pin] [--migrate-dates] [storage flags, dbtune.h]
 //
 // Protocol (client -> server, one command per line):
 //   OPCODE <space> HEX_PAYLOAD \n
@@ -14,52 +14,240 @@
 //     REPORT_BY_CODE:  "CODE"                          (server returns lines)
 //     LIST_STUDENTS:   ""                              (no payload)
 //     LIST_COURSES:    ""
+//     PAGE_STUDENTS:   "LIMIT[|CURSOR]"                (paged LIST_STUDENTS)
+//     PAGE_BY_ROLL:    "ROLL|LIMIT[|CURSOR]"           (paged REPORT_BY_ROLL)
+//     PAGE_BY_CODE:    "CODE|LIMIT[|CURSOR]"           (paged REPORT_BY_CODE)
+//     SUMMARY:         "DAY|CODE|YYYY-MM-DD" or "STUDENT|ROLL|CODE"
+//     REBUILD_COUNTS:  ""                              (recount SUMMARY's counters)
+//     SET_QUERY:       "TERM [AND|OR|ANDNOT TERM]..."  (students in the set)
+//     SET_COUNT:       same as SET_QUERY               (how many)
+//     ABSENT_STREAK:   "CODE|FROM|TO|N"                (absent N class days running)
+//     BELOW_PCT:       "PCT[|CODE]"                    (present < PCT% of marks)
+//     IMPORT:          "BYTES", then BYTES of CSV/TSV  (bulk load, csvimport.h)
+//     EXPORT:          "[FROM|TO]"                     (column file, colfile.h)
+//   TERM is CODE@DATE[..DATE]:S, S one of P/A/L or M (any mark); CODE * is
+//   every course, and a range or * is the union of the days it covers.
+//   Operators apply left to right: "CS101@2025-05-05:A ANDNOT CS101@2025-05-06:M".
+// A line "BIN" (answered "OK") switches the connection to the binary frames
+// of wire.h (WOP_* opcodes, raw fields, MARK date as a u32 epoch); replies
+// keep the text format above.
+//
+// Requests are framed on '\n' per connection, so a client may pipeline many
+// commands in one write; they run in order and the replies are sent together.
 // Server replies (text):
 //   OK\n                            on success without rows
 //   ERR:<message>\n                 on failure
 //   For listing/report: rows (one per line) then ".\n" sentinel
+//   For PAGE_*: at most LIMIT (1..1000) rows, then ". CURSOR\n" if more
+//   follow (send CURSOR back for the next page) or ".\n" after the last.
+//   CURSOR is opaque to the client: the hex of the last row's sort key.
+//   For SUMMARY: "OK present=N absent=N late=N total=N pct=X.X" (pct = present/total)
+//   For SET_QUERY/ABSENT_STREAK: "ROLL | NAME" rows in student id order, then ".";
+//   BELOW_PCT adds " | PRESENT | MARKED | PCT"; SET_COUNT: "OK count=N".
+//   For IMPORT: "OK kind=K rows=N imported=N failed=N", then "LINE | REASON"
+//   for the first IMPORT_ERRORS failed rows, then ".". A size over
+//   IMPORT_MAX is answered with ERR and the connection is closed.
+//   For EXPORT: "OK rows=N bytes=N", then BYTES of column file (no ".").
+//
+// Threads: an I/O thread runs an edge-triggered epoll loop that only moves
+// bytes and parses requests. Writes (ADD_*, ENROLL, MARK, REBUILD_COUNTS) go
+// over a bounded queue (workq.h) to one writer thread, which owns the
+// read-write connection and applies whatever is queued in one transaction.
+// LIST_*/REPORT_*/PAGE_*/SUMMARY go to a pool of --readers threads (default
+// 4), each with its own read-only connection; the database is in WAL mode
+// (dbtune.h), so a long report neither blocks the writer nor other readers,
+// and a checkpointer thread keeps the WAL short outside of the writer's
+// COMMITs. Finished requests come back through an
+// eventfd and each connection gets its replies in request order. Per
+// connection a read never runs beside an earlier write (or a write beside an
+// earlier read), so pipelined requests see each other's effects. A full
+// queue parks the connection until replies drain; with several reactors
+// the writer's queue may drain through another reactor's replies, so a
+// reactor with parked clients also retries them every STALL_RETRY_MS.
+//
+// --reactors N runs N such loops (0: one per online CPU), each a thread
+// with its own SO_REUSEPORT listener on the address, so the kernel spreads
+// new connections over them, its own epoll set, clients, done queue and
+// pool of --readers reader threads. A client lives on one reactor for
+// good; reactors share nothing but the writer, whose queue is an MpscQueue
+// (workq.h): several loops push into it without taking a lock. --pin binds
+// reactor i to the i-th CPU the process may run on. common/scalebench.c
+// measures throughput from 1 to N reactors.
+//
+// The request path allocates nothing: a Job comes from its reactor's
+// ObjPool (mpscring.h) of JOB_POOL, with only its header cleared, and goes
+// back there when its reply is out (past JOB_POOL in flight, jobs come
+// from the heap). The writer's and the readers' queues are MpscQueues, so
+// handing a job to a worker is a compare-and-swap on a ring, not a lock.
+//
+// LIST_*/REPORT_* are streamed: a reader steps at most REPORT_CHUNK bytes of
+// rows at a time, and a report that does not fit keeps its own statement
+// (and read snapshot) and goes back to the same reader for the next chunk
+// only once the last one has been written to the socket. Chunks go out with
+// writev straight from the job, behind whatever replies precede them, so a
+// report costs a few large syscalls instead of one per row, and a client
+// that reads slowly holds one chunk in memory, not the whole result.
+//
+// Roll/code -> id and known enrollments are kept in memory (idmap.h) by the
+// writer: warmed at startup, updated on ADD_STUDENT/ADD_COURSE/ENROLL/MARK
+// and IMPORT, reloaded after a failed COMMIT. The writer is the only one
+// that adds rows, so a roll or code the map does not know does not exist,
+// and resolving one never touches SQLite.
+//
+// IMPORT's file is read straight into its job (not through the line
+// buffer) and runs on the writer on its own, between batches: csv_import()
+// commits every CSV_TXN_ROWS rows, and the attendance index takes each
+// chunk's marks once it has committed.
+//
+// P/A/L counters per (course, date) and per (student, course) are kept by
+// triggers on attendance, so they change in the same statement as the row
+// and SUMMARY is a primary-key lookup however big the table gets. They are
+// backfilled when the triggers are first installed; REBUILD_COUNTS recounts
+// them from attendance.
+//
+// Dates are stored as INTEGER day numbers (datetime.h): MARK's date is
+// parsed and validated on ingest, compared and indexed as an integer, and
+// formatted back to YYYY-MM-DD only when a row is sent. A database from
+// before this (dates as text, PRAGMA user_version 0) is refused until the
+// server is started once with --migrate-dates, which rewrites attendance
+// in one transaction.
+//
+// EXPORT runs on a reader: colfile_export() streams the marks from one
+// read snapshot into an unlinked temporary file (in $TMPDIR, else /tmp), a
+// group of rows in memory at a time, and the I/O thread sends that file
+// with sendfile() once the reply line is out, so the bytes never pass
+// through user space or an OutBuf.
+//
+// The set queries run on an in-memory index (attindex.h): per (course, day)
+// one compressed bitmap of student ids for each of P, A and L. It is loaded
+// from attendance at startup and the writer adds each batch's MARKs once
+// the batch has committed; readers evaluate under its read lock and only
+// touch SQLite afterwards, to turn ids into rolls and names.
 
-#define _WINSOCK_DEPRECATED_NO_WARNINGS
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include <sqlite3.h>
-
-#pragma comment(lib, "ws2_32.lib")
+#include "attindex.h"
+#include "colfile.h"
+#include "csvimport.h"
+#include "datetime.h"
+#include "dbtune.h"
+#include "hexcodec.h"
+#include "idmap.h"
+#include "mpscring.h"
+#include "netbuf.h"
+#include "stmtcache.h"
+#include "wire.h"
+#include "workq.h"
 
 #define MAXLINE 2048
-#define MAX_CLIENTS 128
+#define MAXREQ (MAXLINE*2+64)   // "OPCODE " + hex payload
+#define MAX_EVENTS 256
+#define MAX_INFLIGHT 256        // per connection, before it is parked
+#define STALL_RETRY_MS 1        // epoll_wait timeout while clients are parked
+#define QUEUE_CAP 4096          // per worker queue
+#define JOB_POOL 1024           // pooled jobs per reactor
+#define WRITE_BATCH 64          // writes per transaction
+#define MAX_READERS 64           // per reactor
+#define MAX_REACTORS 64
+#define REPORT_CHUNK (64*1024)  // report bytes per reader step
+#define COPY_MAX 4096           // larger replies are written from the job, not copied
+#define PAGE_MAX 1000           // rows per PAGE_* reply
+#define SET_TERMS 32            // terms per SET_* expression
+#define RANGE_MAX 3660          // days per SET_* range or ABSENT_STREAK
+#define IMPORT_MAX (256u<<20)   // bytes per IMPORT file
+#define IMPORT_ERRORS 100       // failed rows listed per IMPORT reply
 
-typedef struct {
-    SOCKET sock;
-    char   ibuf[MAXLINE];
+typedef struct Job Job;
+typedef struct Reader Reader;
+typedef struct Reactor Reactor;
+
+typedef struct Client {
+    int     fd;
+    Reactor* rx;   // the loop that owns it
+    LineBuf in;    // bytes received but not yet a full line
+    OutBuf  out;   // replies not yet accepted by the kernel
+    int     binary; // sent "BIN": input is wire.h frames from here on
+    Job    *head, *tail;   // requests in flight, in arrival order
+    Job    *held;          // first job not yet handed to a worker (a suffix of the list)
+    int     inflight;
+    int     reads, writes; // jobs handed to readers / the writer, not back yet
+    int     dead;   // socket closed; freed when nothing refers to it
+    int     eof;    // peer half-closed; close after the last reply
+    int     stalled, flushing;
+    struct Client *next_stalled, *next_flush;
+    Job    *sending;       // head job whose reply is being written in place
+    Job    *resume;        // report to send back to its reader once there is room
+    Job    *body;          // IMPORT whose file is still arriving
+    size_t  body_have;
 } Client;
 
-static void die(const char* m) { fprintf(stderr, "%s\n", m); exit(1); }
+// One request. The I/O thread fills fields[] (pointing into buf); a worker
+// runs it into reply; the I/O thread copies reply out in order. buf is
+// last: job_new() clears everything before it.
+struct Job {
+    WorkItem link;      // first: queue linkage
+    Job*     next;      // client's in-flight list
+    Client*  c;
+    int      op;        // WOP_*, 0 for a reply decided up front
+    int      done;
+    int      fcnt;
+    char*    fields[8];
+    OutBuf   reply;
+    Reader*  owner;     // reads: the reader (and connection) that runs it
+    sqlite3_stmt* cur;  // report still open on owner's connection
+    int      more;      // reply is one chunk, more rows follow
+    int      cancel;    // client gone: owner just closes cur
+    char*    data;      // IMPORT: the file
+    size_t   dlen;
+    int      file;      // EXPORT: the file, sent after reply (when flen > 0)
+    off_t    foff, flen;
+    char     buf[MAXLINE+32];
+};
 
-static int hex_to_bytes(const char* hex, unsigned char* out, int outcap){
-    // returns number of bytes written, or -1 on bad hex
-    int n = (int)strlen(hex);
-    if(n==0) return 0;
-    if(n%2) return -1;
-    int w=0;
-    for(int i=0;i<n;i+=2){
-        if(w>=outcap) return -1;
-        char a=hex[i], b=hex[i+1];
-        int v=0;
-        #define H(x) ((x>='0'&&x<='9')?(x-'0'): (x>='a'&&x<='f')?(x-'a'+10): (x>='A'&&x<='F')?(x-'A'+10):-1)
-        int hi=H(a), lo=H(b);
-        if(hi<0||lo<0) return -1;
-        v=(hi<<4)|lo;
-        out[w++]=(unsigned char)v;
-    }
-    return w;
-}
+// A reader thread with its own read-only connection and queue; a report
+// that spans chunks always comes back to the reader that holds its cursor.
+struct Reader {
+    pthread_t  tid;
+    sqlite3*   db;
+    StmtCache  sc;
+    MpscQueue  q;
+    int        load;    // jobs pushed and not back yet (I/O thread only)
+};
+
+// One I/O loop and what only it touches.
+struct Reactor {
+    pthread_t  tid;
+    int        ep, ls;
+    int        cpu;       // pinned to, -1 if not
+    DoneQueue  done;      // workers -> this loop
+    Client*    stalled;   // parked on a full queue or MAX_INFLIGHT
+    Reader*    readers;
+    int        nreaders;
+    ObjPool    jobs;
+};
 
-static void send_line(SOCKET s, const char* line){
-    send(s, line, (int)strlen(line), 0);
+static MpscQueue g_writeq;            // reactors -> writer
+
+static void die(const char* m) { fprintf(stderr, "%s\n", m); exit(1); }
+
+static void send_line(OutBuf* out, const char* line){
+    outbuf_puts(out, line);
 }
 
 static void exec_ddl(sqlite3* db, const char* sql){
@@ -73,8 +261,149 @@ static void exec_ddl(sqlite3* db, const char* sql){
     }
 }
 
-static void init_schema(sqlite3* db){
+// Counters behind SUMMARY, kept by triggers in the statement that changes
+// attendance (inserts, deletes incl. cascades, and updates).
+static const char* const COUNTS_DDL=
+    "CREATE TABLE IF NOT EXISTS course_day_counts ("
+    "  course_id INTEGER NOT NULL, date INTEGER NOT NULL,"
+    "  present INTEGER NOT NULL, absent INTEGER NOT NULL, late INTEGER NOT NULL,"
+    "  PRIMARY KEY(course_id, date)"
+    ") WITHOUT ROWID;"
+    "CREATE TABLE IF NOT EXISTS student_course_counts ("
+    "  student_id INTEGER NOT NULL, course_id INTEGER NOT NULL,"
+    "  present INTEGER NOT NULL, absent INTEGER NOT NULL, late INTEGER NOT NULL,"
+    "  PRIMARY KEY(student_id, course_id)"
+    ") WITHOUT ROWID;"
+    "CREATE TRIGGER IF NOT EXISTS att_count_ins AFTER INSERT ON attendance BEGIN"
+    "  INSERT INTO course_day_counts VALUES(NEW.course_id,NEW.date,NEW.status='P',NEW.status='A',NEW.status='L')"
+    "  ON CONFLICT(course_id,date) DO UPDATE SET"
+    "    present=present+excluded.present, absent=absent+excluded.absent, late=late+excluded.late;"
+    "  INSERT INTO student_course_counts VALUES(NEW.student_id,NEW.course_id,NEW.status='P',NEW.status='A',NEW.status='L')"
+    "  ON CONFLICT(student_id,course_id) DO UPDATE SET"
+    "    present=present+excluded.present, absent=absent+excluded.absent, late=late+excluded.late;"
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS att_count_del AFTER DELETE ON attendance BEGIN"
+    "  UPDATE course_day_counts SET present=present-(OLD.status='P'), absent=absent-(OLD.status='A'),"
+    "    late=late-(OLD.status='L') WHERE course_id=OLD.course_id AND date=OLD.date;"
+    "  UPDATE student_course_counts SET present=present-(OLD.status='P'), absent=absent-(OLD.status='A'),"
+    "    late=late-(OLD.status='L') WHERE student_id=OLD.student_id AND course_id=OLD.course_id;"
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS att_count_upd AFTER UPDATE OF student_id,course_id,date,status ON attendance BEGIN"
+    "  UPDATE course_day_counts SET present=present-(OLD.status='P'), absent=absent-(OLD.status='A'),"
+    "    late=late-(OLD.status='L') WHERE course_id=OLD.course_id AND date=OLD.date;"
+    "  UPDATE student_course_counts SET present=present-(OLD.status='P'), absent=absent-(OLD.status='A'),"
+    "    late=late-(OLD.status='L') WHERE student_id=OLD.student_id AND course_id=OLD.course_id;"
+    "  INSERT INTO course_day_counts VALUES(NEW.course_id,NEW.date,NEW.status='P',NEW.status='A',NEW.status='L')"
+    "  ON CONFLICT(course_id,date) DO UPDATE SET"
+    "    present=present+excluded.present, absent=absent+excluded.absent, late=late+excluded.late;"
+    "  INSERT INTO student_course_counts VALUES(NEW.student_id,NEW.course_id,NEW.status='P',NEW.status='A',NEW.status='L')"
+    "  ON CONFLICT(student_id,course_id) DO UPDATE SET"
+    "    present=present+excluded.present, absent=absent+excluded.absent, late=late+excluded.late;"
+    "END;";
+
+// Recount both tables from attendance. A savepoint makes it one
+// transaction whether or not the writer has a batch open.
+static const char* const COUNTS_REBUILD=
+    "SAVEPOINT rebuild_counts;"
+    "DELETE FROM course_day_counts;"
+    "DELETE FROM student_course_counts;"
+    "INSERT INTO course_day_counts SELECT course_id,date,sum(status='P'),sum(status='A'),sum(status='L')"
+    "  FROM attendance GROUP BY course_id,date;"
+    "INSERT INTO student_course_counts SELECT student_id,course_id,sum(status='P'),sum(status='A'),sum(status='L')"
+    "  FROM attendance GROUP BY student_id,course_id;"
+    "RELEASE rebuild_counts;";
+
+static int has_trigger(sqlite3* db, const char* name){
+    sqlite3_stmt* st;
+    if(sqlite3_prepare_v2(db,"SELECT 1 FROM sqlite_master WHERE type='trigger' AND name=?",-1,&st,NULL)!=SQLITE_OK) return 0;
+    sqlite3_bind_text(st,1,name,-1,SQLITE_STATIC);
+    int found=sqlite3_step(st)==SQLITE_ROW;
+    sqlite3_finalize(st);
+    return found;
+}
+
+// attendance.date is an INTEGER day number (days since 1970-01-01,
+// datetime.h) from schema version 1 on (PRAGMA user_version); version 0
+// stored 'YYYY-MM-DD' text. Dates are parsed once on the way in and
+// formatted once on the way out.
+#define SCHEMA_VERSION 1
+
+#define ATTENDANCE_DDL(name) \
+    "CREATE TABLE IF NOT EXISTS " name " (" \
+    "  id INTEGER PRIMARY KEY AUTOINCREMENT," \
+    "  student_id INTEGER NOT NULL," \
+    "  course_id  INTEGER NOT NULL," \
+    "  date INTEGER NOT NULL," \
+    "  status TEXT NOT NULL CHECK(status IN('P','A','L'))," \
+    "  FOREIGN KEY(student_id) REFERENCES students(id) ON DELETE CASCADE," \
+    "  FOREIGN KEY(course_id)  REFERENCES courses(id) ON DELETE CASCADE" \
+    ");"
+
+static int query_int(sqlite3* db, const char* sql){
+    sqlite3_stmt* st;
+    int v=-1;
+    if(sqlite3_prepare_v2(db,sql,-1,&st,NULL)!=SQLITE_OK) return -1;
+    if(sqlite3_step(st)==SQLITE_ROW) v=sqlite3_column_int(st,0);
+    sqlite3_finalize(st);
+    return v;
+}
+
+// ymd_day('YYYY-MM-DD') -> day number, NULL if it is not a valid date.
+static void sql_ymd_day(sqlite3_context* ctx, int argc, sqlite3_value** argv){
+    (void)argc;
+    const char* s=(const char*)sqlite3_value_text(argv[0]);
+    int64_t day;
+    if(s && parse_ymd(s,(size_t)sqlite3_value_bytes(argv[0]),&day)==0) sqlite3_result_int64(ctx,day);
+    else sqlite3_result_null(ctx);
+}
+
+// Version 0 -> 1: rewrite attendance with day numbers in one transaction.
+// Refuses (and changes nothing) if any stored date does not parse. The
+// counters are dropped here and rebuilt by init_schema.
+static void migrate_dates(sqlite3* db){
+    sqlite3_create_function(db,"ymd_day",1,SQLITE_UTF8|SQLITE_DETERMINISTIC,NULL,sql_ymd_day,NULL,NULL);
+    int bad=query_int(db,"SELECT count(*) FROM attendance WHERE ymd_day(date) IS NULL");
+    if(bad!=0){
+        fprintf(stderr,"migrate: %d attendance rows have no valid YYYY-MM-DD date; fix them first\n", bad);
+        sqlite3_close(db);
+        exit(1);
+    }
+    exec_ddl(db,
+        "BEGIN IMMEDIATE;"
+        "DROP TRIGGER IF EXISTS att_count_ins;"
+        "DROP TRIGGER IF EXISTS att_count_del;"
+        "DROP TRIGGER IF EXISTS att_count_upd;"
+        "DROP TABLE IF EXISTS course_day_counts;"
+        ATTENDANCE_DDL("attendance_v1")
+        "INSERT INTO attendance_v1 SELECT id,student_id,course_id,ymd_day(date),status FROM attendance ORDER BY id;"
+        "DROP TABLE attendance;"
+        "ALTER TABLE attendance_v1 RENAME TO attendance;"
+        "PRAGMA user_version=1;"
+        "COMMIT;"
+    );
+    printf("Migrated %d attendance rows to day numbers\n", query_int(db,"SELECT count(*) FROM attendance"));
+}
+
+static void init_schema(sqlite3* db, int migrate){
     exec_ddl(db, "PRAGMA foreign_keys=ON;");
+    int version=query_int(db,"PRAGMA user_version");
+    if(query_int(db,"SELECT count(*) FROM sqlite_master WHERE type='table' AND name='attendance'")==0){
+        char sql[40];
+        snprintf(sql,sizeof sql,"PRAGMA user_version=%d;",SCHEMA_VERSION);
+        exec_ddl(db, sql);
+    }else if(version<SCHEMA_VERSION){
+        if(!migrate){
+            fprintf(stderr,"%s stores attendance dates as text (schema %d); "
+                    "run once with --migrate-dates to convert it\n", sqlite3_db_filename(db,"main"), version);
+            sqlite3_close(db);
+            exit(1);
+        }
+        migrate_dates(db);
+    }else if(version>SCHEMA_VERSION){
+        fprintf(stderr,"schema version %d is newer than this server (%d)\n", version, SCHEMA_VERSION);
+        sqlite3_close(db);
+        exit(1);
+    }
     exec_ddl(db,
         "CREATE TABLE IF NOT EXISTS students ("
         "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
@@ -98,189 +427,985 @@ static void init_schema(sqlite3* db){
         "  FOREIGN KEY(course_id) REFERENCES courses(id) ON DELETE CASCADE"
         ");"
     );
-    exec_ddl(db,
-        "CREATE TABLE IF NOT EXISTS attendance ("
-        "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  student_id INTEGER NOT NULL,"
-        "  course_id  INTEGER NOT NULL,"
-        "  date TEXT NOT NULL,"
-        "  status TEXT NOT NULL CHECK(status IN('P','A','L')),"
-        "  FOREIGN KEY(student_id) REFERENCES students(id) ON DELETE CASCADE,"
-        "  FOREIGN KEY(course_id)  REFERENCES courses(id) ON DELETE CASCADE"
-        ");"
-    );
+    exec_ddl(db, ATTENDANCE_DDL("attendance"));
     exec_ddl(db,
         "CREATE UNIQUE INDEX IF NOT EXISTS idx_att_unique "
         "ON attendance(student_id, course_id, date);"
     );
+    // covering indexes for date ranges per course (REPORT/PAGE_BY_CODE) and
+    // per student (REPORT/PAGE_BY_ROLL): a range never touches the table
+    exec_ddl(db,
+        "DROP INDEX IF EXISTS idx_att_course_date;"
+        "CREATE INDEX IF NOT EXISTS idx_att_course_day ON attendance(course_id, date, student_id, status);"
+        "CREATE INDEX IF NOT EXISTS idx_att_student_day ON attendance(student_id, date, course_id, status);"
+    );
+    int fresh=!has_trigger(db,"att_count_ins");
+    exec_ddl(db, COUNTS_DDL);
+    if(fresh) exec_ddl(db, COUNTS_REBUILD);
 }
 
-static int get_id(sqlite3* db, const char* sql, const char* key){
-    int id=-1; sqlite3_stmt* st=NULL;
-    if(sqlite3_prepare_v2(db, sql, -1, &st, NULL)!=SQLITE_OK) return -1;
-    sqlite3_bind_text(st,1,key,-1,SQLITE_TRANSIENT);
-    if(sqlite3_step(st)==SQLITE_ROW) id = sqlite3_column_int(st,0);
-    sqlite3_finalize(st);
-    return id;
-}
+// Every statement the handlers run, compiled once after init_schema().
+enum {
+    Q_COURSE_ID,
+    Q_ADD_STUDENT, Q_ADD_COURSE, Q_ENROLL, Q_MARK,
+    Q_LIST_STUDENTS, Q_LIST_COURSES, Q_REPORT_BY_ROLL, Q_REPORT_BY_CODE,
+    Q_PAGE_STUDENTS, Q_PAGE_BY_ROLL, Q_PAGE_BY_CODE,
+    Q_SUM_DAY, Q_SUM_STUDENT, Q_STUDENT_BY_ID,
+    Q_ALL_STUDENTS, Q_ALL_COURSES, Q_ALL_ENROLLMENTS,
+    Q_COUNT
+};
+
+static const char* const SQL[Q_COUNT]={
+    [Q_COURSE_ID]     ="SELECT id FROM courses WHERE code=?",
+    [Q_ADD_STUDENT]   ="INSERT INTO students(roll,name) VALUES(?,?)",
+    [Q_ADD_COURSE]    ="INSERT INTO courses(code,title) VALUES(?,?)",
+    [Q_ENROLL]        ="INSERT OR IGNORE INTO enrollments(student_id,course_id) VALUES(?,?)",
+    [Q_MARK]          ="INSERT INTO attendance(student_id,course_id,date,status) VALUES(?,?,?,?)",
+    [Q_LIST_STUDENTS] ="SELECT roll,name FROM students ORDER BY roll",
+    [Q_LIST_COURSES]  ="SELECT code,title FROM courses ORDER BY code",
+    [Q_REPORT_BY_ROLL]=
+      "SELECT a.date,c.code,c.title,a.status "
+      "FROM attendance a JOIN courses c ON c.id=a.course_id "
+      "JOIN students s ON s.id=a.student_id "
+      "WHERE s.roll=? ORDER BY a.date,c.code",
+    [Q_REPORT_BY_CODE]=
+      "SELECT a.date,s.roll,s.name,a.status "
+      "FROM attendance a JOIN students s ON s.id=a.student_id "
+      "JOIN courses c ON c.id=a.course_id "
+      "WHERE c.code=? ORDER BY a.date,s.roll",
+    // the same orders, resumed after the cursor (?2 = '' / INT64_MIN on the first page)
+    [Q_PAGE_STUDENTS] ="SELECT roll,name FROM students WHERE roll>?1 ORDER BY roll LIMIT ?2",
+    [Q_PAGE_BY_ROLL]  =
+      "SELECT a.date,c.code,c.title,a.status "
+      "FROM attendance a JOIN courses c ON c.id=a.course_id "
+      "WHERE a.student_id=(SELECT id FROM students WHERE roll=?1) "
+      "AND a.date>=?2 AND (a.date>?2 OR c.code>?3) ORDER BY a.date,c.code LIMIT ?4",
+    [Q_PAGE_BY_CODE]  =
+      "SELECT a.date,s.roll,s.name,a.status "
+      "FROM attendance a JOIN students s ON s.id=a.student_id "
+      "WHERE a.course_id=(SELECT id FROM courses WHERE code=?1) "
+      "AND a.date>=?2 AND (a.date>?2 OR s.roll>?3) ORDER BY a.date,s.roll LIMIT ?4",
+    [Q_SUM_DAY]       =
+      "SELECT present,absent,late FROM course_day_counts "
+      "WHERE course_id=(SELECT id FROM courses WHERE code=?1) AND date=?2",
+    [Q_SUM_STUDENT]   =
+      "SELECT present,absent,late FROM student_course_counts "
+      "WHERE student_id=(SELECT id FROM students WHERE roll=?1) "
+      "AND course_id=(SELECT id FROM courses WHERE code=?2)",
+    [Q_STUDENT_BY_ID] ="SELECT roll,name FROM students WHERE id=?",
+    [Q_ALL_STUDENTS]  ="SELECT id,roll FROM students",
+    [Q_ALL_COURSES]   ="SELECT id,code FROM courses",
+    [Q_ALL_ENROLLMENTS]="SELECT student_id,course_id FROM enrollments",
+};
+
+static IdMap   g_students, g_courses;   // roll / code -> id (writer thread only)
+static PairSet g_enrolled;              // (student id, course id) (writer thread only)
+static AttIndex g_index;                // (course, day) -> P/A/L bitmaps (writer writes)
 
-static void handle_add_student(sqlite3* db, SOCKET s, const char* roll, const char* name){
-    sqlite3_stmt* st=NULL;
-    if(sqlite3_prepare_v2(db,"INSERT INTO students(roll,name) VALUES(?,?)",-1,&st,NULL)!=SQLITE_OK){
-        send_line(s,"ERR:prepare add student\n"); return;
+// This batch's MARKs, put into g_index once the batch has committed.
+static struct { int sid, cid; int32_t day; char status; } g_marked[WRITE_BATCH];
+static int g_nmarked;
+
+static void load_ids(StmtCache* sc, int q, IdMap* m){
+    sqlite3_stmt* st=stmtcache_get(sc,q);
+    while(sqlite3_step(st)==SQLITE_ROW){
+        const unsigned char* k=sqlite3_column_text(st,1);
+        if(k) idmap_put(m,(const char*)k,sqlite3_column_int(st,0));
     }
-    sqlite3_bind_text(st,1,roll,-1,SQLITE_TRANSIENT);
-    sqlite3_bind_text(st,2,name,-1,SQLITE_TRANSIENT);
-    int rc=sqlite3_step(st);
-    sqlite3_finalize(st);
-    if(rc!=SQLITE_DONE) send_line(s,"ERR:insert student (roll may exist)\n");
-    else send_line(s,"OK\n");
+    stmtcache_put(st);
 }
 
-static void handle_add_course(sqlite3* db, SOCKET s, const char* code, const char* title){
-    sqlite3_stmt* st=NULL;
-    if(sqlite3_prepare_v2(db,"INSERT INTO courses(code,title) VALUES(?,?)",-1,&st,NULL)!=SQLITE_OK){
-        send_line(s,"ERR:prepare add course\n"); return;
-    }
-    sqlite3_bind_text(st,1,code,-1,SQLITE_TRANSIENT);
-    sqlite3_bind_text(st,2,title,-1,SQLITE_TRANSIENT);
+static void warm_caches(StmtCache* sc){
+    idmap_clear(&g_students); idmap_clear(&g_courses); pairset_clear(&g_enrolled);
+    load_ids(sc,Q_ALL_STUDENTS,&g_students);
+    load_ids(sc,Q_ALL_COURSES,&g_courses);
+    sqlite3_stmt* st=stmtcache_get(sc,Q_ALL_ENROLLMENTS);
+    while(sqlite3_step(st)==SQLITE_ROW) pairset_add(&g_enrolled,sqlite3_column_int(st,0),sqlite3_column_int(st,1));
+    stmtcache_put(st);
+}
+
+// Run a 2-text-parameter write statement; returns the sqlite3_step code.
+static int exec_write2(StmtCache* sc, int q, const char* a, const char* b){
+    sqlite3_stmt* st=stmtcache_get(sc,q);
+    sqlite3_bind_text(st,1,a,-1,SQLITE_STATIC);
+    sqlite3_bind_text(st,2,b,-1,SQLITE_STATIC);
     int rc=sqlite3_step(st);
-    sqlite3_finalize(st);
-    if(rc!=SQLITE_DONE) send_line(s,"ERR:insert course (code may exist)\n");
-    else send_line(s,"OK\n");
+    stmtcache_put(st);
+    return rc;
 }
 
-static void handle_enroll(sqlite3* db, SOCKET s, const char* roll, const char* code){
-    int sid=get_id(db,"SELECT id FROM students WHERE roll=?", roll);
-    int cid=get_id(db,"SELECT id FROM courses WHERE code=?", code);
-    if(sid<0){ send_line(s,"ERR:no such student\n"); return; }
-    if(cid<0){ send_line(s,"ERR:no such course\n"); return; }
-    sqlite3_stmt* st=NULL;
-    if(sqlite3_prepare_v2(db,"INSERT OR IGNORE INTO enrollments(student_id,course_id) VALUES(?,?)",-1,&st,NULL)!=SQLITE_OK){
-        send_line(s,"ERR:prepare enroll\n"); return;
-    }
+static int enroll_ids(StmtCache* sc, int sid, int cid){
+    if(pairset_has(&g_enrolled,sid,cid)) return SQLITE_DONE;
+    sqlite3_stmt* st=stmtcache_get(sc,Q_ENROLL);
     sqlite3_bind_int(st,1,sid); sqlite3_bind_int(st,2,cid);
     int rc=sqlite3_step(st);
-    sqlite3_finalize(st);
-    if(rc!=SQLITE_DONE) send_line(s,"ERR:enroll failed\n");
-    else send_line(s,"OK\n");
+    stmtcache_put(st);
+    if(rc==SQLITE_DONE) pairset_add(&g_enrolled,sid,cid);
+    return rc;
+}
+
+static void handle_add_student(StmtCache* sc, OutBuf* out, const char* roll, const char* name){
+    if(exec_write2(sc,Q_ADD_STUDENT,roll,name)!=SQLITE_DONE){ send_line(out,"ERR:insert student (roll may exist)\n"); return; }
+    idmap_put(&g_students,roll,(int)sqlite3_last_insert_rowid(sc->db));
+    send_line(out,"OK\n");
+}
+
+static void handle_add_course(StmtCache* sc, OutBuf* out, const char* code, const char* title){
+    if(exec_write2(sc,Q_ADD_COURSE,code,title)!=SQLITE_DONE){ send_line(out,"ERR:insert course (code may exist)\n"); return; }
+    idmap_put(&g_courses,code,(int)sqlite3_last_insert_rowid(sc->db));
+    send_line(out,"OK\n");
 }
 
-static void handle_mark(sqlite3* db, SOCKET s, const char* roll, const char* code, const char* date, const char* status){
+static void handle_enroll(StmtCache* sc, OutBuf* out, const char* roll, const char* code){
+    int sid=idmap_get(&g_students,roll);
+    int cid=idmap_get(&g_courses,code);
+    if(sid<0){ send_line(out,"ERR:no such student\n"); return; }
+    if(cid<0){ send_line(out,"ERR:no such course\n"); return; }
+    if(enroll_ids(sc,sid,cid)!=SQLITE_DONE) send_line(out,"ERR:enroll failed\n");
+    else send_line(out,"OK\n");
+}
+
+static void handle_mark(StmtCache* sc, OutBuf* out, const char* roll, const char* code, const char* date, const char* status){
     if(!(status && (status[0]=='P'||status[0]=='A'||status[0]=='L') && status[1]=='\0')){
-        send_line(s,"ERR:bad status\n"); return;
+        send_line(out,"ERR:bad status\n"); return;
     }
-    int sid=get_id(db,"SELECT id FROM students WHERE roll=?", roll);
-    int cid=get_id(db,"SELECT id FROM courses WHERE code=?", code);
-    if(sid<0){ send_line(s,"ERR:no such student\n"); return; }
-    if(cid<0){ send_line(s,"ERR:no such course\n"); return; }
+    int64_t day;
+    if(!date || parse_ymd(date,strlen(date),&day)!=0){ send_line(out,"ERR:bad date\n"); return; }
+    int sid=idmap_get(&g_students,roll);
+    int cid=idmap_get(&g_courses,code);
+    if(sid<0){ send_line(out,"ERR:no such student\n"); return; }
+    if(cid<0){ send_line(out,"ERR:no such course\n"); return; }
 
     // ensure enrollment
-    sqlite3_stmt* chk=NULL;
-    sqlite3_prepare_v2(db,"INSERT OR IGNORE INTO enrollments(student_id,course_id) VALUES(?,?)",-1,&chk,NULL);
-    sqlite3_bind_int(chk,1,sid); sqlite3_bind_int(chk,2,cid);
-    sqlite3_step(chk); sqlite3_finalize(chk);
+    enroll_ids(sc,sid,cid);
 
-    sqlite3_stmt* st=NULL;
-    if(sqlite3_prepare_v2(db,"INSERT INTO attendance(student_id,course_id,date,status) VALUES(?,?,?,?)",-1,&st,NULL)!=SQLITE_OK){
-        send_line(s,"ERR:prepare mark\n"); return;
-    }
+    sqlite3_stmt* st=stmtcache_get(sc,Q_MARK);
     sqlite3_bind_int(st,1,sid);
     sqlite3_bind_int(st,2,cid);
-    sqlite3_bind_text(st,3,date,-1,SQLITE_TRANSIENT);
-    sqlite3_bind_text(st,4,status,-1,SQLITE_TRANSIENT);
+    sqlite3_bind_int64(st,3,day);
+    sqlite3_bind_text(st,4,status,-1,SQLITE_STATIC);
     int rc=sqlite3_step(st);
-    sqlite3_finalize(st);
-    if(rc!=SQLITE_DONE) send_line(s,"ERR:insert attendance (duplicate day?)\n");
-    else send_line(s,"OK\n");
+    stmtcache_put(st);
+    if(rc!=SQLITE_DONE){ send_line(out,"ERR:insert attendance (duplicate day?)\n"); return; }
+    if(g_nmarked<WRITE_BATCH){
+        g_marked[g_nmarked].sid=sid; g_marked[g_nmarked].cid=cid;
+        g_marked[g_nmarked].day=(int32_t)day; g_marked[g_nmarked].status=status[0];
+        g_nmarked++;
+    }
+    send_line(out,"OK\n");
 }
 
-static void handle_list_students(sqlite3* db, SOCKET s){
-    sqlite3_stmt* st=NULL;
-    if(sqlite3_prepare_v2(db,"SELECT roll,name FROM students ORDER BY roll",-1,&st,NULL)!=SQLITE_OK){
-        send_line(s,"ERR:query\n"); return;
-    }
-    char line[512];
+static void index_marks(void){
+    if(!g_nmarked) return;
+    pthread_rwlock_wrlock(&g_index.lock);
+    for(int i=0;i<g_nmarked;++i)
+        if(attindex_mark(&g_index,g_marked[i].cid,g_marked[i].day,g_marked[i].sid,g_marked[i].status)!=0)
+            fprintf(stderr,"attendance index: out of memory\n");
+    pthread_rwlock_unlock(&g_index.lock);
+    g_nmarked=0;
+}
+
+static void load_index(sqlite3* db){
+    sqlite3_stmt* st;
+    if(sqlite3_prepare_v2(db,"SELECT student_id,course_id,date,status FROM attendance",-1,&st,NULL)!=SQLITE_OK) die("index load failed");
+    long n=0;
     while(sqlite3_step(st)==SQLITE_ROW){
-        const unsigned char *roll=sqlite3_column_text(st,0);
-        const unsigned char *name=sqlite3_column_text(st,1);
-        snprintf(line,sizeof(line),"%s | %s\n", roll? (const char*)roll:"", name? (const char*)name:"");
-        send_line(s,line);
+        const char* status=(const char*)sqlite3_column_text(st,3);
+        if(!status) continue;
+        if(attindex_mark(&g_index,sqlite3_column_int(st,1),sqlite3_column_int(st,2),sqlite3_column_int(st,0),status[0])!=0) die("out of memory");
+        n++;
     }
     sqlite3_finalize(st);
-    send_line(s,".\n");
+    printf("Indexed %ld marks in %zu course-days, %.1f MB\n", n, g_index.count, attindex_bytes(&g_index)/1048576.0);
+}
+
+// Columns of REPORT_*/PAGE_BY_* rows that hold day numbers (bit i = column i).
+static int day_cols(int op){
+    return op==WOP_REPORT_BY_ROLL || op==WOP_REPORT_BY_CODE ||
+           op==WOP_PAGE_BY_ROLL || op==WOP_PAGE_BY_CODE ? 1 : 0;
 }
 
-static void handle_list_courses(sqlite3* db, SOCKET s){
-    sqlite3_stmt* st=NULL;
-    if(sqlite3_prepare_v2(db,"SELECT code,title FROM courses ORDER BY code",-1,&st,NULL)!=SQLITE_OK){
-        send_line(s,"ERR:query\n"); return;
+// The current row of st as a "col | col ..." line; day-number columns in
+// the days mask go out as YYYY-MM-DD.
+static void send_row(sqlite3_stmt* st, OutBuf* out, int days){
+    int ncol=sqlite3_column_count(st);
+    char line[512], ymd[11];
+    int len=0;
+    for(int i=0;i<ncol && len<(int)sizeof(line);++i){
+        const unsigned char* v;
+        if((days>>i&1) && sqlite3_column_type(st,i)==SQLITE_INTEGER){
+            format_ymd(sqlite3_column_int64(st,i),ymd); v=(const unsigned char*)ymd;
+        }else v=sqlite3_column_text(st,i);
+        len+=snprintf(line+len,sizeof(line)-len,"%s%s", i?" | ":"", v?(const char*)v:"");
     }
-    char line[512];
-    while(sqlite3_step(st)==SQLITE_ROW){
-        const unsigned char *code=sqlite3_column_text(st,0);
-        const unsigned char *title=sqlite3_column_text(st,1);
-        snprintf(line,sizeof(line),"%s | %s\n", code? (const char*)code:"", title? (const char*)title:"");
-        send_line(s,line);
+    if(len>=(int)sizeof(line)-1) len=(int)sizeof(line)-2;
+    line[len]='\n'; line[len+1]=0;
+    send_line(out,line);
+}
+
+// Append rows of st until out holds REPORT_CHUNK bytes. Returns 1 if rows
+// remain, 0 once the last row and "." are out.
+static int send_rows(sqlite3_stmt* st, OutBuf* out, int days){
+    while(outbuf_pending(out)<REPORT_CHUNK){
+        if(sqlite3_step(st)!=SQLITE_ROW){ send_line(out,".\n"); return 0; }
+        send_row(st,out,days);
     }
-    sqlite3_finalize(st);
-    send_line(s,".\n");
+    return 1;
 }
 
-static void handle_report_by_roll(sqlite3* db, SOCKET s, const char* roll){
-    sqlite3_stmt* st=NULL;
-    const char* sql=
-      "SELECT a.date,c.code,c.title,a.status "
-      "FROM attendance a JOIN courses c ON c.id=a.course_id "
-      "JOIN students s ON s.id=a.student_id "
-      "WHERE s.roll=? ORDER BY a.date,c.code";
-    if(sqlite3_prepare_v2(db,sql,-1,&st,NULL)!=SQLITE_OK){ send_line(s,"ERR:query\n"); return; }
-    sqlite3_bind_text(st,1,roll,-1,SQLITE_TRANSIENT);
-    char line[512];
-    while(sqlite3_step(st)==SQLITE_ROW){
-        const unsigned char *date=sqlite3_column_text(st,0);
-        const unsigned char *code=sqlite3_column_text(st,1);
-        const unsigned char *title=sqlite3_column_text(st,2);
-        const unsigned char *status=sqlite3_column_text(st,3);
-        snprintf(line,sizeof(line),"%s | %s | %s | %s\n",
-            date? (const char*)date:"", code? (const char*)code:"",
-            title? (const char*)title:"", status? (const char*)status:"");
-        send_line(s,line);
+// LIST_*/REPORT_*, one chunk per call. A report that does not fit in the
+// first chunk takes its statement out of the cache (j->cur) and is called
+// again for each following chunk, or with j->cancel to close it.
+static void run_report(Reader* r, Job* j){
+    if(j->cur){
+        if(j->cancel || !send_rows(j->cur,&j->reply,day_cols(j->op))){ sqlite3_finalize(j->cur); j->cur=NULL; j->more=0; }
+        return;
     }
-    sqlite3_finalize(st);
-    send_line(s,".\n");
+    int q, nkey=1;
+    switch(j->op){
+    case WOP_LIST_STUDENTS:  q=Q_LIST_STUDENTS; nkey=0; break;
+    case WOP_LIST_COURSES:   q=Q_LIST_COURSES; nkey=0; break;
+    case WOP_REPORT_BY_ROLL: q=Q_REPORT_BY_ROLL; break;
+    default:                 q=Q_REPORT_BY_CODE; break;
+    }
+    if(nkey && j->fcnt!=1){ send_line(&j->reply, q==Q_REPORT_BY_ROLL?"ERR:need ROLL\n":"ERR:need CODE\n"); return; }
+    sqlite3_stmt* st=stmtcache_get(&r->sc,q);
+    if(nkey) sqlite3_bind_text(st,1,j->fields[0],-1,SQLITE_STATIC);   // j->buf outlives the cursor
+    int days=day_cols(j->op);
+    if(!send_rows(st,&j->reply,days)){ stmtcache_put(st); return; }
+    j->cur=stmtcache_detach(&r->sc,q);
+    if(j->cur){ j->more=1; return; }
+    while(send_rows(st,&j->reply,days)){}   // no copy to leave behind: finish in one go
+    stmtcache_put(st);
 }
 
-static void handle_report_by_code(sqlite3* db, SOCKET s, const char* code){
-    sqlite3_stmt* st=NULL;
-    const char* sql=
-      "SELECT a.date,s.roll,s.name,a.status "
-      "FROM attendance a JOIN students s ON s.id=a.student_id "
-      "JOIN courses c ON c.id=a.course_id "
-      "WHERE c.code=? ORDER BY a.date,s.roll";
-    if(sqlite3_prepare_v2(db,sql,-1,&st,NULL)!=SQLITE_OK){ send_line(s,"ERR:query\n"); return; }
-    sqlite3_bind_text(st,1,code,-1,SQLITE_TRANSIENT);
-    char line[512];
+// PAGE_*: one page in report order after the cursor. Fetches LIMIT+1 rows
+// to know whether another page follows; the cursor handed back is the last
+// row's sort key (roll, or day|code, day|roll), which the next call seeks
+// to through the (course_id, date) or (student_id, date) index, so a deep
+// page of a big course costs the same as the first.
+static void run_page(Reader* r, Job* j){
+    int k=j->op==WOP_PAGE_STUDENTS ? 0 : 1;   // fields before LIMIT
+    if(j->fcnt<k+1 || j->fcnt>k+2){ send_line(&j->reply, k?"ERR:need KEY|LIMIT[|CURSOR]\n":"ERR:need LIMIT[|CURSOR]\n"); return; }
+    int limit=atoi(j->fields[k]);
+    if(limit<1 || limit>PAGE_MAX){ send_line(&j->reply,"ERR:page size must be 1..1000\n"); return; }
+    char after[MAXLINE]=""; const char* after2="";
+    int64_t after_day=INT64_MIN;
+    if(j->fcnt==k+2){
+        const char* hex=j->fields[k+1];
+        int n=hex_decode(hex,strlen(hex),(unsigned char*)after,sizeof(after)-1);
+        char* bar;
+        if(n<0){ send_line(&j->reply,"ERR:bad cursor\n"); return; }
+        after[n]=0;
+        if(k){
+            if(!(bar=strchr(after,'|'))){ send_line(&j->reply,"ERR:bad cursor\n"); return; }
+            *bar=0; after2=bar+1;
+            char* end;
+            errno=0;
+            after_day=strtoll(after,&end,10);
+            if(errno || end==after || *end){ send_line(&j->reply,"ERR:bad cursor\n"); return; }
+        }
+    }
+    sqlite3_stmt* st;
+    if(!k){
+        st=stmtcache_get(&r->sc,Q_PAGE_STUDENTS);
+        sqlite3_bind_text(st,1,after,-1,SQLITE_STATIC);
+        sqlite3_bind_int(st,2,limit+1);
+    }else{
+        st=stmtcache_get(&r->sc,j->op==WOP_PAGE_BY_ROLL?Q_PAGE_BY_ROLL:Q_PAGE_BY_CODE);
+        sqlite3_bind_text(st,1,j->fields[0],-1,SQLITE_STATIC);
+        sqlite3_bind_int64(st,2,after_day);
+        sqlite3_bind_text(st,3,after2,-1,SQLITE_STATIC);
+        sqlite3_bind_int(st,4,limit+1);
+    }
+    char last[MAXLINE]; int n=0, more=0;
     while(sqlite3_step(st)==SQLITE_ROW){
-        const unsigned char *date=sqlite3_column_text(st,0);
-        const unsigned char *roll=sqlite3_column_text(st,1);
-        const unsigned char *name=sqlite3_column_text(st,2);
-        const unsigned char *status=sqlite3_column_text(st,3);
-        snprintf(line,sizeof(line),"%s | %s | %s | %s\n",
-            date? (const char*)date:"", roll? (const char*)roll:"",
-            name? (const char*)name:"", status? (const char*)status:"");
-        send_line(s,line);
+        if(n==limit){ more=1; break; }
+        send_row(st,&j->reply,day_cols(j->op)); n++;
+        const unsigned char* a=sqlite3_column_text(st,0);
+        const unsigned char* b=sqlite3_column_text(st,1);
+        if(k) snprintf(last,sizeof(last),"%s|%s",a?(const char*)a:"",b?(const char*)b:"");
+        else  snprintf(last,sizeof(last),"%s",a?(const char*)a:"");
+    }
+    stmtcache_put(st);
+    if(!more){ send_line(&j->reply,".\n"); return; }
+    char line[2*MAXLINE+8]=". ";
+    size_t len=2+hex_encode(last,strlen(last),line+2,sizeof(line)-4,0);
+    line[len]='\n'; line[len+1]=0;
+    send_line(&j->reply,line);
+}
+
+// SUMMARY: one row of the trigger-kept counters; no row means no marks yet.
+static void run_summary(Reader* r, Job* j){
+    int day= j->fcnt==3 && strcmp(j->fields[0],"DAY")==0;
+    if(!day && !(j->fcnt==3 && strcmp(j->fields[0],"STUDENT")==0)){
+        send_line(&j->reply,"ERR:need DAY|CODE|DATE or STUDENT|ROLL|CODE\n"); return;
+    }
+    int64_t d;
+    if(day && parse_ymd(j->fields[2],strlen(j->fields[2]),&d)!=0){ send_line(&j->reply,"ERR:bad date\n"); return; }
+    sqlite3_stmt* st=stmtcache_get(&r->sc,day?Q_SUM_DAY:Q_SUM_STUDENT);
+    sqlite3_bind_text(st,1,j->fields[1],-1,SQLITE_STATIC);
+    if(day) sqlite3_bind_int64(st,2,d);
+    else    sqlite3_bind_text(st,2,j->fields[2],-1,SQLITE_STATIC);
+    long long p=0,a=0,l=0;
+    if(sqlite3_step(st)==SQLITE_ROW){
+        p=sqlite3_column_int64(st,0); a=sqlite3_column_int64(st,1); l=sqlite3_column_int64(st,2);
+    }
+    stmtcache_put(st);
+    long long t=p+a+l;
+    char line[160];
+    snprintf(line,sizeof(line),"OK present=%lld absent=%lld late=%lld total=%lld pct=%.1f\n",
+             p,a,l,t,t?100.0*p/t:0.0);
+    send_line(&j->reply,line);
+}
+
+// ---- set queries over g_index ----
+
+enum { SET_AND, SET_OR, SET_ANDNOT };
+
+typedef struct {
+    int     cid;            // -1 = every course
+    int32_t from, to;
+    int     smask;          // 1<<ATT_P | 1<<ATT_A | 1<<ATT_L
+} SetTerm;
+
+static int course_id(Reader* r, const char* code){
+    sqlite3_stmt* st=stmtcache_get(&r->sc,Q_COURSE_ID);
+    sqlite3_bind_text(st,1,code,-1,SQLITE_STATIC);
+    int id = sqlite3_step(st)==SQLITE_ROW ? sqlite3_column_int(st,0) : -1;
+    stmtcache_put(st);
+    return id;
+}
+
+static int parse_day(const char* s, size_t n, int32_t* day){
+    int64_t d;
+    if(parse_ymd(s,n,&d)!=0) return -1;
+    *day=(int32_t)d;
+    return 0;
+}
+
+// "CODE@DATE[..DATE]:S" -> t; on error says why in out and returns -1.
+static int parse_term(Reader* r, char* tok, SetTerm* t, OutBuf* out){
+    char* at=strchr(tok,'@'); char* colon=strrchr(tok,':');
+    if(!at || !colon || colon<at){ send_line(out,"ERR:term must be CODE@DATE[..DATE]:S\n"); return -1; }
+    *at=0; *colon=0;
+    char* dots=strstr(at+1,"..");
+    const char* to=dots?dots+2:at+1;
+    if(parse_day(at+1,dots?(size_t)(dots-at-1):strlen(at+1),&t->from)!=0 || parse_day(to,strlen(to),&t->to)!=0){
+        send_line(out,"ERR:bad date\n"); return -1;
+    }
+    if(t->to<t->from || t->to-t->from>=RANGE_MAX){ send_line(out,"ERR:bad date range\n"); return -1; }
+    const char* sc=colon+1;
+    if(sc[0]=='M' && !sc[1]) t->smask=(1<<ATT_P)|(1<<ATT_A)|(1<<ATT_L);
+    else if(attindex_status(sc[0])>=0 && !sc[1]) t->smask=1<<attindex_status(sc[0]);
+    else{ send_line(out,"ERR:bad status\n"); return -1; }
+    if(strcmp(tok,"*")==0) t->cid=-1;
+    else if((t->cid=course_id(r,tok))<0){ send_line(out,"ERR:no such course\n"); return -1; }
+    return 0;
+}
+
+// acc = acc op b, keeping acc valid on failure.
+static int set_apply(Bitmap* acc, const Bitmap* b, int op){
+    Bitmap t=BITMAP_INIT;
+    int rc = op==SET_AND ? bitmap_and(&t,acc,b) : op==SET_OR ? bitmap_or(&t,acc,b) : bitmap_andnot(&t,acc,b);
+    if(rc!=0) return -1;
+    bitmap_free(acc); *acc=t;
+    return 0;
+}
+
+static int union_day(Bitmap* acc, const AttDay* d, int smask){
+    for(int s=0;s<ATT_NSTATUS;++s)
+        if((smask>>s & 1) && d->st[s].n && set_apply(acc,&d->st[s],SET_OR)!=0) return -1;
+    return 0;
+}
+
+// Union of every bitmap the term covers (read lock held).
+static int term_bitmap(const SetTerm* t, Bitmap* out){
+    bitmap_free(out);
+    if(t->cid>=0 && (size_t)(t->to-t->from) < g_index.count){
+        for(int32_t d=t->from; d<=t->to; ++d){
+            const AttDay* e=attindex_get(&g_index,t->cid,d);
+            if(e && union_day(out,e,t->smask)!=0) return -1;
+        }
+        return 0;
+    }
+    for(size_t i=0;i<g_index.cap;++i){
+        const AttDay* e=g_index.slots[i];
+        if(e && (t->cid<0 || e->course_id==t->cid) && e->day>=t->from && e->day<=t->to && union_day(out,e,t->smask)!=0) return -1;
+    }
+    return 0;
+}
+
+// "ROLL | NAME[ | ...]" rows for ids[0..n) (extra[i] appended when given), then ".".
+static void send_students(Reader* r, OutBuf* out, const uint32_t* ids, size_t n, char (*extra)[48]){
+    sqlite3_stmt* st=stmtcache_get(&r->sc,Q_STUDENT_BY_ID);
+    char line[MAXLINE];
+    for(size_t i=0;i<n;++i){
+        sqlite3_bind_int(st,1,(int)ids[i]);
+        if(sqlite3_step(st)==SQLITE_ROW){
+            const unsigned char* roll=sqlite3_column_text(st,0);
+            const unsigned char* name=sqlite3_column_text(st,1);
+            snprintf(line,sizeof(line),"%s | %s%s\n", roll?(const char*)roll:"", name?(const char*)name:"", extra?extra[i]:"");
+            send_line(out,line);
+        }
+        sqlite3_reset(st);
+    }
+    stmtcache_put(st);
+    send_line(out,".\n");
+}
+
+static void send_bitmap(Reader* r, OutBuf* out, const Bitmap* b){
+    size_t n=(size_t)bitmap_card(b);
+    uint32_t* ids=malloc((n?n:1)*sizeof *ids);
+    if(!ids){ send_line(out,"ERR:out of memory\n"); return; }
+    bitmap_to_array(b,ids);
+    send_students(r,out,ids,n,NULL);
+    free(ids);
+}
+
+// SET_QUERY / SET_COUNT. Terms are parsed (and codes resolved) before the
+// read lock is taken. SET_COUNT never builds the last result: its size comes
+// from the popcount of the intersection with the last term.
+static void run_set(Reader* r, Job* j){
+    if(j->fcnt!=1){ send_line(&j->reply,"ERR:need TERM [AND|OR|ANDNOT TERM]...\n"); return; }
+    SetTerm terms[SET_TERMS]; int ops[SET_TERMS]; int nt=0;
+    char* save=NULL;
+    for(char* tok=strtok_r(j->fields[0]," ",&save); tok; tok=strtok_r(NULL," ",&save)){
+        if(nt>0){
+            int op = strcmp(tok,"AND")==0 ? SET_AND : strcmp(tok,"OR")==0 ? SET_OR : strcmp(tok,"ANDNOT")==0 ? SET_ANDNOT : -1;
+            if(op<0){ send_line(&j->reply,"ERR:operator must be AND, OR or ANDNOT\n"); return; }
+            if(!(tok=strtok_r(NULL," ",&save))){ send_line(&j->reply,"ERR:missing term\n"); return; }
+            if(nt==SET_TERMS){ send_line(&j->reply,"ERR:too many terms\n"); return; }
+            ops[nt]=op;
+        }
+        if(parse_term(r,tok,&terms[nt],&j->reply)!=0) return;
+        nt++;
+    }
+    if(!nt){ send_line(&j->reply,"ERR:need TERM [AND|OR|ANDNOT TERM]...\n"); return; }
+
+    int count=j->op==WOP_SET_COUNT;
+    Bitmap acc=BITMAP_INIT, b=BITMAP_INIT;
+    uint64_t n=0;
+    pthread_rwlock_rdlock(&g_index.lock);
+    int rc=term_bitmap(&terms[0],&acc);
+    for(int i=1;i<nt-count && rc==0;++i)
+        if((rc=term_bitmap(&terms[i],&b))==0) rc=set_apply(&acc,&b,ops[i]);
+    if(rc==0 && count && nt>1 && (rc=term_bitmap(&terms[nt-1],&b))==0){
+        uint64_t both=bitmap_and_card(&acc,&b);
+        int op=ops[nt-1];
+        n = op==SET_AND ? both : op==SET_OR ? bitmap_card(&acc)+bitmap_card(&b)-both : bitmap_card(&acc)-both;
+    }
+    else if(rc==0 && count) n=bitmap_card(&acc);
+    pthread_rwlock_unlock(&g_index.lock);
+    bitmap_free(&b);
+    if(rc!=0) send_line(&j->reply,"ERR:out of memory\n");
+    else if(count){
+        char line[64]; snprintf(line,sizeof(line),"OK count=%llu\n",(unsigned long long)n);
+        send_line(&j->reply,line);
     }
+    else send_bitmap(r,&j->reply,&acc);
+    bitmap_free(&acc);
+}
+
+// ABSENT_STREAK: absent on N running class days of CODE (days with any mark
+// for it) between FROM and TO: the union over each window of N class days of
+// the AND of their absent bitmaps.
+static void run_streak(Reader* r, Job* j){
+    if(j->fcnt!=4){ send_line(&j->reply,"ERR:need CODE|FROM|TO|N\n"); return; }
+    int32_t from, to;
+    if(parse_day(j->fields[1],strlen(j->fields[1]),&from)!=0 || parse_day(j->fields[2],strlen(j->fields[2]),&to)!=0){
+        send_line(&j->reply,"ERR:bad date\n"); return;
+    }
+    if(to<from || to-from>=RANGE_MAX){ send_line(&j->reply,"ERR:bad date range\n"); return; }
+    int n=atoi(j->fields[3]);
+    if(n<1 || n>RANGE_MAX){ send_line(&j->reply,"ERR:bad N\n"); return; }
+    int cid=course_id(r,j->fields[0]);
+    if(cid<0){ send_line(&j->reply,"ERR:no such course\n"); return; }
+
+    const AttDay* days[RANGE_MAX]; int nd=0;
+    Bitmap acc=BITMAP_INIT, w=BITMAP_INIT;
+    int rc=0;
+    pthread_rwlock_rdlock(&g_index.lock);
+    for(int32_t d=from; d<=to; ++d){
+        const AttDay* e=attindex_get(&g_index,cid,d);
+        if(e) days[nd++]=e;
+    }
+    for(int i=0;i+n<=nd && rc==0;++i){
+        if((rc=bitmap_copy(&w,&days[i]->st[ATT_A]))!=0) break;
+        for(int k=1;k<n && w.n && rc==0;++k) rc=set_apply(&w,&days[i+k]->st[ATT_A],SET_AND);
+        if(rc==0 && w.n) rc=set_apply(&acc,&w,SET_OR);
+    }
+    pthread_rwlock_unlock(&g_index.lock);
+    bitmap_free(&w);
+    if(rc!=0) send_line(&j->reply,"ERR:out of memory\n");
+    else send_bitmap(r,&j->reply,&acc);
+    bitmap_free(&acc);
+}
+
+// BELOW_PCT: per student, P marks over all marks (in CODE, or everywhere),
+// counted by walking each day's bitmaps into two arrays indexed by id.
+static void run_below(Reader* r, Job* j){
+    if(j->fcnt<1 || j->fcnt>2){ send_line(&j->reply,"ERR:need PCT[|CODE]\n"); return; }
+    char* end;
+    double pct=strtod(j->fields[0],&end);
+    if(end==j->fields[0] || *end || !(pct>=0 && pct<=100)){ send_line(&j->reply,"ERR:PCT must be 0..100\n"); return; }
+    int cid=-1;
+    if(j->fcnt==2 && (cid=course_id(r,j->fields[1]))<0){ send_line(&j->reply,"ERR:no such course\n"); return; }
+
+    pthread_rwlock_rdlock(&g_index.lock);
+    size_t nid=(size_t)g_index.max_student+1;
+    uint32_t* present=calloc(nid,sizeof *present);
+    uint32_t* marked=calloc(nid,sizeof *marked);
+    uint32_t* ids=malloc(nid*sizeof *ids);
+    if(present && marked && ids){
+        for(size_t i=0;i<g_index.cap;++i){
+            const AttDay* e=g_index.slots[i];
+            if(!e || (cid>=0 && e->course_id!=cid)) continue;
+            for(int s=0;s<ATT_NSTATUS;++s){
+                size_t k=bitmap_to_array(&e->st[s],ids);
+                uint32_t* cnt = s==ATT_P ? present : NULL;
+                for(size_t m=0;m<k;++m){ marked[ids[m]]++; if(cnt) cnt[ids[m]]++; }
+            }
+        }
+    }
+    pthread_rwlock_unlock(&g_index.lock);
+    if(!present || !marked || !ids){ free(present); free(marked); free(ids); send_line(&j->reply,"ERR:out of memory\n"); return; }
+
+    size_t n=0;
+    for(size_t id=0;id<nid;++id)
+        if(marked[id] && 100.0*present[id] < pct*marked[id]) ids[n++]=(uint32_t)id;
+    char (*extra)[48]=malloc((n?n:1)*sizeof *extra);
+    if(extra){
+        for(size_t i=0;i<n;++i)
+            snprintf(extra[i],sizeof extra[i]," | %u | %u | %.1f", present[ids[i]], marked[ids[i]], 100.0*present[ids[i]]/marked[ids[i]]);
+        send_students(r,&j->reply,ids,n,extra);
+    }
+    else send_line(&j->reply,"ERR:out of memory\n");
+    free(extra); free(present); free(marked); free(ids);
+}
+
+// ---- EXPORT ----
+
+// EXPORT [FROM|TO]: the marks in range as a column file, written to an
+// unlinked temporary file that the I/O thread sendfile()s after the reply.
+static void run_export(Reader* r, Job* j){
+    int64_t from=INT64_MIN, to=INT64_MAX;
+    if(j->fcnt!=0 && !(j->fcnt==2 && parse_ymd(j->fields[0],strlen(j->fields[0]),&from)==0 &&
+                                     parse_ymd(j->fields[1],strlen(j->fields[1]),&to)==0)){
+        send_line(&j->reply,"ERR:need nothing or FROM|TO\n"); return;
+    }
+    const char* dir=getenv("TMPDIR");
+    char path[512];
+    snprintf(path,sizeof(path),"%s/att_export.XXXXXX", dir && dir[0] ? dir : "/tmp");
+    int fd=mkostemp(path,O_CLOEXEC);
+    if(fd<0){ send_line(&j->reply,"ERR:no temporary file\n"); return; }
+    unlink(path);
+    int64_t rows=colfile_export(r->db,fd,from,to);
+    off_t len=lseek(fd,0,SEEK_END);
+    if(rows<0 || len<=0){ close(fd); send_line(&j->reply,"ERR:export failed\n"); return; }
+    char line[96];
+    snprintf(line,sizeof(line),"OK rows=%lld bytes=%lld\n",(long long)rows,(long long)len);
+    send_line(&j->reply,line);
+    j->file=fd; j->foff=0; j->flen=len;
+}
+
+static const char* const WOP_NAMES[WOP_COUNT]={
+    [WOP_ADD_STUDENT]="ADD_STUDENT", [WOP_ADD_COURSE]="ADD_COURSE", [WOP_ENROLL]="ENROLL",
+    [WOP_MARK]="MARK", [WOP_LIST_STUDENTS]="LIST_STUDENTS", [WOP_LIST_COURSES]="LIST_COURSES",
+    [WOP_REPORT_BY_ROLL]="REPORT_BY_ROLL", [WOP_REPORT_BY_CODE]="REPORT_BY_CODE",
+    [WOP_PAGE_STUDENTS]="PAGE_STUDENTS", [WOP_PAGE_BY_ROLL]="PAGE_BY_ROLL", [WOP_PAGE_BY_CODE]="PAGE_BY_CODE",
+    [WOP_SUMMARY]="SUMMARY", [WOP_REBUILD_COUNTS]="REBUILD_COUNTS",
+    [WOP_SET_QUERY]="SET_QUERY", [WOP_SET_COUNT]="SET_COUNT",
+    [WOP_ABSENT_STREAK]="ABSENT_STREAK", [WOP_BELOW_PCT]="BELOW_PCT",
+    [WOP_IMPORT]="IMPORT", [WOP_EXPORT]="EXPORT",
+};
+
+static int is_write(int op){
+    return op==WOP_ADD_STUDENT || op==WOP_ADD_COURSE || op==WOP_ENROLL || op==WOP_MARK || op==WOP_REBUILD_COUNTS ||
+           op==WOP_IMPORT;
+}
+
+static long long count_rows(sqlite3* db, const char* sql){
+    sqlite3_stmt* st;
+    long long n=-1;
+    if(sqlite3_prepare_v2(db,sql,-1,&st,NULL)!=SQLITE_OK) return -1;
+    if(sqlite3_step(st)==SQLITE_ROW) n=sqlite3_column_int64(st,0);
     sqlite3_finalize(st);
-    send_line(s,".\n");
+    return n;
+}
+
+static void handle_rebuild_counts(StmtCache* sc, OutBuf* out){
+    if(sqlite3_exec(sc->db,COUNTS_REBUILD,NULL,NULL,NULL)!=SQLITE_OK){
+        fprintf(stderr,"rebuild counts: %s\n", sqlite3_errmsg(sc->db));
+        sqlite3_exec(sc->db,"ROLLBACK TO rebuild_counts; RELEASE rebuild_counts",NULL,NULL,NULL);
+        send_line(out,"ERR:rebuild failed\n"); return;
+    }
+    char line[96];
+    snprintf(line,sizeof(line),"OK days=%lld pairs=%lld\n",
+             count_rows(sc->db,"SELECT count(*) FROM course_day_counts"),
+             count_rows(sc->db,"SELECT count(*) FROM student_course_counts"));
+    send_line(out,line);
+}
+
+// Writes, on the writer thread; everything it says goes into out.
+static void dispatch(StmtCache* sc, OutBuf* out, int op, char** fields, int fcnt){
+    switch(op){
+    case WOP_ADD_STUDENT:
+        if(fcnt!=2) send_line(out,"ERR:need ROLL|NAME\n");
+        else handle_add_student(sc,out,fields[0],fields[1]);
+        break;
+    case WOP_ADD_COURSE:
+        if(fcnt!=2) send_line(out,"ERR:need CODE|TITLE\n");
+        else handle_add_course(sc,out,fields[0],fields[1]);
+        break;
+    case WOP_ENROLL:
+        if(fcnt!=2) send_line(out,"ERR:need ROLL|CODE\n");
+        else handle_enroll(sc,out,fields[0],fields[1]);
+        break;
+    case WOP_MARK:
+        if(fcnt!=4) send_line(out,"ERR:need ROLL|CODE|DATE|STATUS\n");
+        else handle_mark(sc,out,fields[0],fields[1],fields[2],fields[3]);
+        break;
+    case WOP_REBUILD_COUNTS:
+        handle_rebuild_counts(sc,out);
+        break;
+    default:
+        send_line(out,"ERR:unknown opcode\n");
+    }
+}
+
+// ---- IMPORT ----
+
+// Marks of the import's open transaction, for g_index once it commits.
+static struct { int sid, cid; int32_t day; char status; }* g_imarks;
+static size_t g_nimarks, g_capimarks;
+
+static void import_mark(void* ctx, int sid, int cid, int32_t day, char status){
+    (void)ctx;
+    if(g_nimarks==g_capimarks){
+        size_t cap=g_capimarks?g_capimarks*2:4096;
+        void* p=realloc(g_imarks,cap*sizeof(*g_imarks));
+        if(!p){ fprintf(stderr,"attendance index: out of memory\n"); return; }
+        g_imarks=p; g_capimarks=cap;
+    }
+    g_imarks[g_nimarks].sid=sid; g_imarks[g_nimarks].cid=cid;
+    g_imarks[g_nimarks].day=day; g_imarks[g_nimarks].status=status;
+    g_nimarks++;
+}
+
+static void import_commit(void* ctx, int ok){
+    (void)ctx;
+    if(ok && g_nimarks){
+        pthread_rwlock_wrlock(&g_index.lock);
+        for(size_t i=0;i<g_nimarks;++i)
+            if(attindex_mark(&g_index,g_imarks[i].cid,g_imarks[i].day,g_imarks[i].sid,g_imarks[i].status)!=0)
+                fprintf(stderr,"attendance index: out of memory\n");
+        pthread_rwlock_unlock(&g_index.lock);
+    }
+    g_nimarks=0;
+}
+
+typedef struct {
+    OutBuf rows;        // "LINE | REASON" lines
+    long   listed;
+    char   fatal[160];  // why the import stopped, if it did
+} ImportLog;
+
+static void import_error(void* ctx, long line, const char* msg){
+    ImportLog* log=ctx;
+    char row[192];
+    if(line<=1){ snprintf(log->fatal,sizeof(log->fatal),"%s",msg); return; }   // the header, or the database
+    if(log->listed++>=IMPORT_ERRORS) return;
+    snprintf(row,sizeof(row),"%ld | %s\n",line,msg);
+    send_line(&log->rows,row);
+}
+
+static void handle_import(StmtCache* sc, Job* j){
+    ImportLog log={0};
+    CsvImport im={ .db=sc->db, .students=&g_students, .courses=&g_courses, .enrolled=&g_enrolled,
+                   .defer=CSV_DEFER_AUTO, .on_error=import_error, .on_mark=import_mark,
+                   .on_commit=import_commit, .ctx=&log };
+    int rc=csv_import(&im,j->data,j->dlen);
+    free(j->data); j->data=NULL;
+    char line[256];
+    if(rc!=0){
+        snprintf(line,sizeof(line),"ERR:import stopped: %s (imported=%ld)\n",log.fatal[0]?log.fatal:"database error",im.imported);
+        send_line(&j->reply,line);
+        warm_caches(sc);   // ids of a rolled-back chunk are gone
+    }else{
+        snprintf(line,sizeof(line),"OK kind=%s rows=%ld imported=%ld failed=%ld\n",im.kind,im.rows,im.imported,im.failed);
+        send_line(&j->reply,line);
+        outbuf_append(&j->reply,outbuf_data(&log.rows),outbuf_pending(&log.rows));
+        if(log.listed>IMPORT_ERRORS){
+            snprintf(line,sizeof(line),"... | %ld more\n",log.listed-IMPORT_ERRORS);
+            send_line(&j->reply,line);
+        }
+        send_line(&j->reply,".\n");
+    }
+    outbuf_free(&log.rows);
+}
+
+// ---- worker threads ----
+
+// Hand a finished job back to the reactor of its client.
+static void job_done(Job* j){ doneq_push(&j->c->rx->done,&j->link); }
+
+// The only thread that writes: takes what is queued (up to WRITE_BATCH) and
+// applies it in one transaction. Statement errors only fail their own
+// request; a failed COMMIT fails them all and reloads the caches. An IMPORT
+// runs alone, with its own transactions: it ends the batch it is popped
+// into and starts the next round.
+static void* writer_main(void* arg){
+    StmtCache* sc=arg;
+    Job* batch[WRITE_BATCH];
+    Job* next=NULL;
+    WorkItem* it;
+    while(next || (it=mpscq_pop(&g_writeq,NULL))){
+        Job* first=next?next:(Job*)it;
+        next=NULL;
+        if(first->op==WOP_IMPORT){
+            handle_import(sc,first);
+            job_done(first);
+            continue;
+        }
+        int n=0; batch[n++]=first;
+        struct timespec now=workq_deadline(0);
+        while(n<WRITE_BATCH && (it=mpscq_pop(&g_writeq,&now))){
+            if(((Job*)it)->op==WOP_IMPORT){ next=(Job*)it; break; }
+            batch[n++]=(Job*)it;
+        }
+        int in_txn = n>1 && sqlite3_exec(sc->db,"BEGIN IMMEDIATE",NULL,NULL,NULL)==SQLITE_OK;
+        for(int i=0;i<n;++i) dispatch(sc,&batch[i]->reply,batch[i]->op,batch[i]->fields,batch[i]->fcnt);
+        if(in_txn && sqlite3_exec(sc->db,"COMMIT",NULL,NULL,NULL)!=SQLITE_OK){
+            fprintf(stderr,"commit: %s\n", sqlite3_errmsg(sc->db));
+            sqlite3_exec(sc->db,"ROLLBACK",NULL,NULL,NULL);
+            warm_caches(sc);
+            for(int i=0;i<n;++i){ outbuf_free(&batch[i]->reply); send_line(&batch[i]->reply,"ERR:commit failed\n"); }
+            g_nmarked=0;
+        }
+        index_marks();
+        for(int i=0;i<n;++i) job_done(batch[i]);
+    }
+    return NULL;
+}
+
+static void* reader_main(void* arg){
+    Reader* r=arg;
+    WorkItem* it;
+    while((it=mpscq_pop(&r->q,NULL))){
+        Job* j=(Job*)it;
+        switch(j->op){
+        case WOP_PAGE_STUDENTS: case WOP_PAGE_BY_ROLL: case WOP_PAGE_BY_CODE: run_page(r,j); break;
+        case WOP_SUMMARY: run_summary(r,j); break;
+        case WOP_SET_QUERY: case WOP_SET_COUNT: run_set(r,j); break;
+        case WOP_ABSENT_STREAK: run_streak(r,j); break;
+        case WOP_BELOW_PCT: run_below(r,j); break;
+        case WOP_EXPORT: run_export(r,j); break;
+        default: run_report(r,j);
+        }
+        job_done(j);
+    }
+    return NULL;
+}
+
+// ---- I/O thread ----
+
+// A job with everything but buf zeroed, from the pool while it lasts.
+static Job* job_new(Reactor* rx){
+    Job* j=objpool_get(&rx->jobs);
+    if(!j) return calloc(1,sizeof(Job));
+    memset(j,0,offsetof(Job,buf));
+    return j;
+}
+
+static void job_free(Reactor* rx, Job* j){
+    if(objpool_owns(&rx->jobs,j)) objpool_put(&rx->jobs,j);
+    else free(j);
+}
+
+static void free_client(Client* c){
+    linebuf_free(&c->in); outbuf_free(&c->out);
+    if(c->body){ free(c->body->data); job_free(c->rx,c->body); }
+    free(c);
+}
+
+// Append a job to the client's in-order list.
+static void track(Client* c, Job* j){
+    j->c=c; j->next=NULL;
+    if(c->tail) c->tail->next=j; else c->head=j;
+    c->tail=j; c->inflight++;
+}
+
+static void pop_head(Client* c){
+    Job* j=c->head;
+    c->head=j->next; if(!c->head) c->tail=NULL;
+    c->inflight--;
+    if(j->flen) close(j->file);
+    outbuf_free(&j->reply); free(j->data); job_free(c->rx,j);
+}
+
+static void stall(Client* c){
+    if(c->stalled) return;
+    c->stalled=1; c->next_stalled=c->rx->stalled; c->rx->stalled=c;
+}
+
+// The reactor's reader with the fewest jobs out; new reads go there.
+static Reader* pick_reader(Reactor* rx){
+    Reader* best=&rx->readers[0];
+    for(int i=1;i<rx->nreaders;++i) if(rx->readers[i].load<best->load) best=&rx->readers[i];
+    return best;
+}
+
+// Hand held jobs to the workers, in order, as long as none of them would run
+// beside an unfinished job of the other kind from the same client.
+static void release_held(Client* c){
+    while(c->held){
+        Job* j=c->held;
+        if(!j->done){
+            int w=is_write(j->op);
+            if(w ? c->reads : c->writes) return;
+            if(w){
+                if(mpscq_push(&g_writeq,&j->link)!=0){ stall(c); return; }
+                c->writes++;
+            }else{
+                j->owner=pick_reader(c->rx);
+                if(mpscq_push(&j->owner->q,&j->link)!=0){ stall(c); return; }
+                j->owner->load++; c->reads++;
+            }
+        }
+        c->held=j->next;
+    }
+}
+
+// Send a report back to the reader holding its cursor: for the next chunk,
+// or to close it if the client is gone. Parks the client if that queue is full.
+static void resume_job(Client* c, Job* j){
+    j->done=0; j->cancel=c->dead;
+    if(mpscq_push(&j->owner->q,&j->link)!=0){ c->resume=j; stall(c); return; }
+    j->owner->load++;
+    c->resume=NULL;
+}
+
+// Pass on the replies that are next in line. Small ones are copied into out;
+// a large one (a report chunk, or an export with its file) becomes c->sending
+// and stops the walk until flush_client has written it. A dropped client's
+// replies are discarded and its open report closed.
+static void drain_replies(Client* c){
+    while(!c->sending && c->head && c->head->done){
+        Job* j=c->head;
+        if(c->dead){ if(j->more){ resume_job(c,j); return; } }
+        else if(j->more || j->flen || outbuf_pending(&j->reply)>COPY_MAX){ c->sending=j; return; }
+        else outbuf_append(&c->out,outbuf_data(&j->reply),outbuf_pending(&j->reply));
+        pop_head(c);
+    }
+}
+
+// The chunk is in the kernel: fetch the next one, or move on to the next reply.
+static void finish_sending(Client* c){
+    Job* j=c->sending; c->sending=NULL;
+    if(j->more){ resume_job(c,j); return; }
+    pop_head(c);
+    drain_replies(c);
+}
+
+// Write out and then the chunk being sent, with one writev while both are
+// pending, then an export's file with sendfile. Stops at EAGAIN; EPOLLOUT
+// calls it again.
+static int flush_client(Client* c){
+    for(;;){
+        struct iovec iov[2]; int n=0;
+        if(outbuf_pending(&c->out)) iov[n++]=(struct iovec){ (void*)outbuf_data(&c->out), outbuf_pending(&c->out) };
+        if(c->sending){
+            Job* j=c->sending;
+            OutBuf* r=&j->reply;
+            if(outbuf_pending(r)) iov[n++]=(struct iovec){ (void*)outbuf_data(r), outbuf_pending(r) };
+            else if(j->foff<j->flen){
+                if(!n){
+                    ssize_t w=sendfile(c->fd,j->file,&j->foff,(size_t)(j->flen-j->foff));
+                    if(w<0){
+                        if(errno==EINTR) continue;
+                        if(errno==EAGAIN || errno==EWOULDBLOCK) return 0;
+                        return -1;
+                    }
+                    if(w==0) return -1;   // file shorter than it was
+                    continue;
+                }
+            }else{ finish_sending(c); continue; }
+        }
+        if(!n) return 0;
+        ssize_t w=writev(c->fd,iov,n);
+        if(w<0){
+            if(errno==EINTR) continue;
+            if(errno==EAGAIN || errno==EWOULDBLOCK) return 0;
+            return -1;
+        }
+        size_t k=outbuf_pending(&c->out);
+        if(k>(size_t)w) k=(size_t)w;
+        outbuf_consume(&c->out,k);
+        if(c->sending) outbuf_consume(&c->sending->reply,(size_t)w-k);
+    }
+}
+
+// Workers may still hold jobs of this client: it is only freed once the
+// last one has come back (and it is off the stalled list).
+static void drop_client(Client* c){
+    epoll_ctl(c->rx->ep,EPOLL_CTL_DEL,c->fd,NULL);
+    close(c->fd); c->fd=-1;
+    c->dead=1;
+    c->sending=NULL;
+    drain_replies(c);
+    if(!c->inflight && !c->stalled) free_client(c);
+}
+
+// Reply now, or behind the requests this client still has in flight.
+static void client_reply(Client* c, const char* line){
+    if(!c->head){ send_line(&c->out,line); return; }
+    Job* j=job_new(c->rx);
+    if(!j) return;
+    send_line(&j->reply,line);
+    j->done=1;
+    track(c,j);
+}
+
+static void submit(Client* c, Job* j){
+    track(c,j);
+    if(!c->held) c->held=j;
+    release_held(c);
+}
+
+// Room for one more request? Checked before a line is consumed, so input
+// stays in the socket instead of piling up as held jobs.
+static int can_submit(Client* c){
+    return c->inflight<MAX_INFLIGHT && !c->held && !c->resume && !mpscq_full(&g_writeq) && !mpscq_full(&pick_reader(c->rx)->q);
+}
+
+static int op_code(const char* name){
+    for(int i=1;i<WOP_COUNT;++i) if(strcmp(WOP_NAMES[i],name)==0) return i;
+    return 0;
+}
+
+// IMPORT: the request gives the file's size and the file follows as is; it
+// is collected into the job before the job is submitted. A bad size is
+// answered and the client dropped, since what follows cannot be framed.
+static int begin_body(Client* c, Job* j){
+    const char* f=j->fcnt==1?j->fields[0]:"";
+    char* end;
+    unsigned long long n=strtoull(f,&end,10);
+    if(!(f[0]>='0' && f[0]<='9') || *end || n>IMPORT_MAX){
+        job_free(c->rx,j); client_reply(c,"ERR:need BYTES, at most 268435456\n"); return -1;
+    }
+    if(!(j->data=malloc(n?n:1))){ job_free(c->rx,j); client_reply(c,"ERR:out of memory\n"); return -1; }
+    j->dlen=n;
+    c->body=j; c->body_have=0;
+    return 0;
 }
 
-static void process_command(sqlite3* db, SOCKET s, const char* line){
+static int process_command(Client* c, const char* line){
     // line format: OPCODE SP HEX\n
     char op[64]; const char* sp = strchr(line,' ');
     if(sp){
         size_t n = (size_t)(sp - line);
-        if(n >= sizeof(op)) { send_line(s,"ERR:bad opcode\n"); return; }
+        if(n >= sizeof(op)) { client_reply(c,"ERR:bad opcode\n"); return 0; }
         memcpy(op, line, n); op[n]=0;
     }else{
         strncpy(op, line, sizeof(op)-1); op[sizeof(op)-1]=0;
@@ -288,125 +1413,312 @@ static void process_command(sqlite3* db, SOCKET s, const char* line){
     // strip trailing newline(s)
     for(int i=(int)strlen(op)-1; i>=0 && (op[i]=='\r'||op[i]=='\n'); --i) op[i]=0;
 
-    unsigned char payload[MAXLINE];
+    if(strcmp(op,"BIN")==0){ c->binary=1; client_reply(c,"OK\n"); return 0; }
+    int wop=op_code(op);
+    if(!wop){ client_reply(c,"ERR:unknown opcode\n"); return 0; }
+
+    Job* j=job_new(c->rx);
+    if(!j){ client_reply(c,"ERR:out of memory\n"); return 0; }
+    j->op=wop;
     int plen=0;
     if(sp){
         const char* hex = sp+1;
         // trim newline
         int L = (int)strlen(hex);
         while(L>0 && (hex[L-1]=='\r'||hex[L-1]=='\n')) L--;
-        char tmp[MAXLINE*2+4];
-        if(L >= (int)sizeof(tmp)) { send_line(s,"ERR:payload too big\n"); return; }
-        memcpy(tmp, hex, L); tmp[L]=0;
-        plen = hex_to_bytes(tmp, payload, (int)sizeof(payload));
-        if(plen<0){ send_line(s,"ERR:bad hex\n"); return; }
-    }
-
-    // make a modifiable ASCII payload string
-    char *pstr=NULL;
-    if(plen>0){
-        pstr=(char*)malloc(plen+1);
-        memcpy(pstr,payload,plen); pstr[plen]=0;
-    }else{
-        pstr=strdup("");
+        if(L >= MAXLINE*2+4) { job_free(c->rx,j); client_reply(c,"ERR:payload too big\n"); return 0; }
+        plen = hex_decode(hex, (size_t)L, (unsigned char*)j->buf, MAXLINE);
+        if(plen<0){ job_free(c->rx,j); client_reply(c,"ERR:bad hex\n"); return 0; }
     }
+    j->buf[plen]=0;
 
     // split by '|'
-    char* fields[8]; int fcnt=0;
     char* save=NULL;
-    char* tok = strtok_s(pstr, "|", &save);
-    while(tok && fcnt<8){ fields[fcnt++]=tok; tok=strtok_s(NULL,"|",&save); }
-
-    if(strcmp(op,"ADD_STUDENT")==0){
-        if(fcnt!=2) send_line(s,"ERR:need ROLL|NAME\n");
-        else handle_add_student(db,s,fields[0],fields[1]);
-    }else if(strcmp(op,"ADD_COURSE")==0){
-        if(fcnt!=2) send_line(s,"ERR:need CODE|TITLE\n");
-        else handle_add_course(db,s,fields[0],fields[1]);
-    }else if(strcmp(op,"ENROLL")==0){
-        if(fcnt!=2) send_line(s,"ERR:need ROLL|CODE\n");
-        else handle_enroll(db,s,fields[0],fields[1]);
-    }else if(strcmp(op,"MARK")==0){
-        if(fcnt!=4) send_line(s,"ERR:need ROLL|CODE|DATE|STATUS\n");
-        else handle_mark(db,s,fields[0],fields[1],fields[2],fields[3]);
-    }else if(strcmp(op,"LIST_STUDENTS")==0){
-        handle_list_students(db,s);
-    }else if(strcmp(op,"LIST_COURSES")==0){
-        handle_list_courses(db,s);
-    }else if(strcmp(op,"REPORT_BY_ROLL")==0){
-        if(fcnt!=1) send_line(s,"ERR:need ROLL\n");
-        else handle_report_by_roll(db,s,fields[0]);
-    }else if(strcmp(op,"REPORT_BY_CODE")==0){
-        if(fcnt!=1) send_line(s,"ERR:need CODE\n");
-        else handle_report_by_code(db,s,fields[0]);
-    }else{
-        send_line(s,"ERR:unknown opcode\n");
-    }
+    char* tok = strtok_r(j->buf, "|", &save);
+    while(tok && j->fcnt<8){ j->fields[j->fcnt++]=tok; tok=strtok_r(NULL,"|",&save); }
+    if(wop==WOP_IMPORT) return begin_body(c,j);
+    submit(c,j);
+    return 0;
+}
 
-    free(pstr);
+// Binary request: unpack the fields straight from the frame, no hex pass.
+static int process_frame(Client* c, uint8_t op, const uint8_t* p, size_t n){
+    if(op==0 || op>=WOP_COUNT){ client_reply(c,"ERR:unknown opcode\n"); return 0; }
+    Job* j=job_new(c->rx);
+    if(!j){ client_reply(c,"ERR:out of memory\n"); return 0; }
+    j->op=op;
+    char* w=j->buf;
+    WireReader rd={p,p+n,0};
+    while(rd.p<rd.end && j->fcnt<(op==WOP_MARK?2:8)){
+        size_t len; const char* f=wire_get_str(&rd,&len);
+        if(rd.bad) break;
+        memcpy(w,f,len); w[len]=0; j->fields[j->fcnt++]=w; w+=len+1;
+    }
+    if(op==WOP_MARK && !rd.bad){
+        uint32_t epoch=wire_get_u32(&rd);
+        uint8_t st=wire_get_u8(&rd);
+        format_ymd(epoch/86400, w); j->fields[j->fcnt++]=w; w+=11;
+        w[0]=(char)st; w[1]=0; j->fields[j->fcnt++]=w;
+    }
+    if(rd.bad || rd.p!=rd.end){ job_free(c->rx,j); client_reply(c,"ERR:bad frame\n"); return 0; }
+    if(op==WOP_IMPORT) return begin_body(c,j);
+    submit(c,j);
+    return 0;
 }
 
-int main(int argc, char** argv){
-    if(argc!=4){
-        fprintf(stderr,"Usage: %s <bind-ip> <port> <sqlite_db>\n", argv[0]);
-        return 1;
+// Run every complete line/frame in arrival order while there is room.
+// Returns -1 if the client must be dropped.
+static int process_input(Client* c){
+    char line[MAXREQ];
+    uint8_t op, payload[MAXLINE];
+    int len;
+    for(;;){
+        if(c->body){
+            Job* j=c->body;
+            size_t got=linebuf_peek(&c->in,j->data+c->body_have,j->dlen-c->body_have);
+            linebuf_drop(&c->in,got);
+            if((c->body_have+=got)<j->dlen) return 0;
+            c->body=NULL;
+            submit(c,j);
+        }
+        if(!can_submit(c)){ stall(c); return 0; }
+        if(!c->binary){
+            if((len=linebuf_getline(&c->in,line,sizeof(line)))==LB_NOLINE) return 0;
+            if(len==LB_TOOLONG) client_reply(c,"ERR:line too long\n");
+            else if(len>0 && process_command(c,line)!=0){ flush_client(c); return -1; }
+        }else{
+            if((len=wire_next_frame(&c->in,&op,payload,sizeof(payload),NULL,NULL))==LB_NOLINE) return 0;
+            if(len==WIRE_BAD || process_frame(c,op,payload,(size_t)len)!=0){
+                if(len==WIRE_BAD) client_reply(c,"ERR:bad frame\n");
+                flush_client(c); return -1;
+            }
+        }
     }
-    const char* bind_ip=argv[1]; int port=atoi(argv[2]); const char* dbfile=argv[3];
+}
 
-    sqlite3* db=NULL;
-    if(sqlite3_open(dbfile,&db)!=SQLITE_OK) die("open db failed");
-    init_schema(db);
+// Drain the socket (edge-triggered) unless the client gets parked.
+static int on_readable(Client* c){
+    for(;;){
+        char* room; size_t cap;
+        // an IMPORT file goes straight into its job once the ring is empty
+        int direct=c->body && !linebuf_used(&c->in) && c->body_have<c->body->dlen;
+        if(direct){ room=c->body->data+c->body_have; cap=c->body->dlen-c->body_have; }
+        else cap=linebuf_space(&c->in,&room);
+        if(cap==0){
+            if(process_input(c)!=0) return -1;
+            if(c->stalled) break;   // resume_stalled() reads the rest
+            continue;
+        }
+        ssize_t n=recv(c->fd,room,cap,0);
+        if(n==0){ c->eof=1; break; }
+        if(n<0){
+            if(errno==EINTR) continue;
+            if(errno==EAGAIN || errno==EWOULDBLOCK) break;
+            return -1;
+        }
+        if(direct) c->body_have+=(size_t)n;
+        else linebuf_commit(&c->in,(size_t)n);
+    }
+    if(!c->stalled && process_input(c)!=0) return -1;
+    if(flush_client(c)!=0) return -1;
+    return c->eof && !c->inflight && !c->stalled ? -1 : 0;
+}
 
-    WSADATA wsa; if(WSAStartup(MAKEWORD(2,2),&wsa)!=0) die("WSAStartup failed");
-    SOCKET ls = socket(AF_INET,SOCK_STREAM,0); if(ls==INVALID_SOCKET) die("socket failed");
-    int opt=1; setsockopt(ls,SOL_SOCKET,SO_REUSEADDR,(char*)&opt,sizeof(opt));
+// Collect finished jobs, then hand each client the replies that are now
+// next in line. Clients are shut down rather than dropped here: they may
+// still be in this round's epoll events, and the hangup drops them there.
+static void on_done(Reactor* rx){
+    Client* touched=NULL;
+    for(WorkItem* it=doneq_take(&rx->done); it; ){
+        Job* j=(Job*)it; it=it->next;
+        j->done=1;
+        Client* c=j->c;
+        if(is_write(j->op)) c->writes--;
+        else{ j->owner->load--; if(!j->more) c->reads--; }
+        if(!c->flushing){ c->flushing=1; c->next_flush=touched; touched=c; }
+    }
+    while(touched){
+        Client* c=touched; touched=c->next_flush; c->flushing=0;
+        drain_replies(c);
+        if(c->dead){ if(!c->inflight && !c->stalled) free_client(c); continue; }
+        release_held(c);
+        if(flush_client(c)!=0 || (c->eof && !c->inflight && !c->stalled)) shutdown(c->fd,SHUT_RDWR);
+    }
+}
 
-    struct sockaddr_in addr; addr.sin_family=AF_INET; addr.sin_port=htons((u_short)port);
-    addr.sin_addr.s_addr=inet_addr(bind_ip);
-    if(bind(ls,(struct sockaddr*)&addr,sizeof(addr))==SOCKET_ERROR) die("bind failed");
-    if(listen(ls,SOMAXCONN)==SOCKET_ERROR) die("listen failed");
-    printf("Attendance server on %s:%d DB=%s\n", bind_ip, port, dbfile);
+// Replies drained or the retry timer ran out: let parked clients continue
+// where they stopped.
+static void resume_stalled(Reactor* rx){
+    Client* list=rx->stalled; rx->stalled=NULL;
+    while(list){
+        Client* c=list; list=c->next_stalled; c->stalled=0;
+        if(c->resume){ resume_job(c,c->resume); if(c->stalled) continue; }
+        if(c->dead){ if(!c->inflight) free_client(c); continue; }
+        release_held(c);
+        if(!can_submit(c)){ stall(c); continue; }
+        if(on_readable(c)!=0) shutdown(c->fd,SHUT_RDWR);
+    }
+}
 
-    Client clients[MAX_CLIENTS];
-    for(int i=0;i<MAX_CLIENTS;++i){ clients[i].sock=INVALID_SOCKET; clients[i].ibuf[0]=0; }
+static void accept_all(Reactor* rx){
+    for(;;){
+        int cs=accept4(rx->ls,NULL,NULL,SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if(cs<0){
+            if(errno==EINTR || errno==ECONNABORTED) continue;
+            if(errno!=EAGAIN && errno!=EWOULDBLOCK) perror("accept");
+            return;
+        }
+        Client* c=calloc(1,sizeof(Client));
+        if(!c || linebuf_init(&c->in, 2*MAXREQ)!=0){ free(c); close(cs); continue; }
+        c->fd=cs; c->rx=rx;
+        struct epoll_event ev={ .events=EPOLLIN|EPOLLOUT|EPOLLRDHUP|EPOLLET, .data.ptr=c };
+        if(epoll_ctl(rx->ep,EPOLL_CTL_ADD,cs,&ev)<0){ perror("epoll_ctl"); close(cs); free_client(c); }
+    }
+}
 
-    fd_set rset;
+static void* reactor_main(void* arg){
+    Reactor* rx=arg;
+    if(rx->cpu>=0){
+        cpu_set_t set; CPU_ZERO(&set); CPU_SET(rx->cpu,&set);
+        if(pthread_setaffinity_np(pthread_self(),sizeof(set),&set)!=0) fprintf(stderr,"could not pin to CPU %d\n", rx->cpu);
+    }
+    struct epoll_event evs[MAX_EVENTS];
     while(1){
-        FD_ZERO(&rset); FD_SET(ls,&rset);
-        SOCKET maxfd=ls;
-        for(int i=0;i<MAX_CLIENTS;++i) if(clients[i].sock!=INVALID_SOCKET){ FD_SET(clients[i].sock,&rset); if(clients[i].sock>maxfd) maxfd=clients[i].sock; }
-        int ready=select(0,&rset,NULL,NULL,NULL);
-        if(ready==SOCKET_ERROR){ fprintf(stderr,"select error\n"); break; }
-
-        if(FD_ISSET(ls,&rset)){
-            struct sockaddr_in cli; int clen=sizeof(cli);
-            SOCKET cs = accept(ls,(struct sockaddr*)&cli,&clen);
-            if(cs!=INVALID_SOCKET){
-                int slot=-1; for(int i=0;i<MAX_CLIENTS;++i){ if(clients[i].sock==INVALID_SOCKET){ slot=i; break; } }
-                if(slot<0){ const char* msg="ERR:server full\n"; send(cs,msg,(int)strlen(msg),0); closesocket(cs); }
-                else { clients[slot].sock=cs; clients[slot].ibuf[0]=0; }
+        if(rx->stalled) resume_stalled(rx);
+        int n=epoll_wait(rx->ep,evs,MAX_EVENTS,rx->stalled?STALL_RETRY_MS:-1);
+        if(n<0){ if(errno==EINTR) continue; perror("epoll_wait"); break; }
+        for(int i=0;i<n;++i){
+            if(!evs[i].data.ptr){ accept_all(rx); continue; }
+            if(evs[i].data.ptr==&rx->done){ on_done(rx); resume_stalled(rx); continue; }
+            Client* c=evs[i].data.ptr;
+            uint32_t e=evs[i].events;
+            int dead=(e&EPOLLERR)!=0;
+            if(!dead && (e&(EPOLLIN|EPOLLRDHUP|EPOLLHUP))) dead=on_readable(c)!=0;
+            if(!dead && (e&EPOLLOUT) && (outbuf_pending(&c->out) || c->sending)){
+                dead=flush_client(c)!=0;
+                if(!dead && c->eof && !c->inflight && !c->stalled) dead=1;
             }
-            if(--ready<=0) continue;
+            if(dead) drop_client(c);
         }
+    }
+    return NULL;
+}
 
-        for(int i=0;i<MAX_CLIENTS && ready>0; ++i){
-            SOCKET s=clients[i].sock; if(s==INVALID_SOCKET) continue;
-            if(!FD_ISSET(s,&rset)) continue; ready--;
+// A listener on ip:port; with reuseport several can share the address and
+// the kernel balances new connections over them.
+static int listen_on(const char* ip, int port, int reuseport){
+    int ls = socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0); if(ls<0) die("socket failed");
+    int opt=1; setsockopt(ls,SOL_SOCKET,SO_REUSEADDR,&opt,sizeof(opt));
+    if(reuseport && setsockopt(ls,SOL_SOCKET,SO_REUSEPORT,&opt,sizeof(opt))<0) die("SO_REUSEPORT failed");
+    struct sockaddr_in addr={0}; addr.sin_family=AF_INET; addr.sin_port=htons((uint16_t)port);
+    if(inet_pton(AF_INET,ip,&addr.sin_addr)!=1) die("bad bind address");
+    if(bind(ls,(struct sockaddr*)&addr,sizeof(addr))<0) die("bind failed");
+    if(listen(ls,SOMAXCONN)<0) die("listen failed");
+    return ls;
+}
 
-            char buf[1024]; int n=recv(s,buf,sizeof(buf)-1,0);
-            if(n<=0){ closesocket(s); clients[i].sock=INVALID_SOCKET; clients[i].ibuf[0]=0; continue; }
-            buf[n]=0;
+// The i-th CPU (modulo their count) this process may run on, or -1.
+static int nth_cpu(int i){
+    cpu_set_t set;
+    if(sched_getaffinity(0,sizeof(set),&set)!=0) return -1;
+    int n=CPU_COUNT(&set);
+    if(n<1) return -1;
+    i%=n;
+    for(int cpu=0;cpu<CPU_SETSIZE;++cpu) if(CPU_ISSET(cpu,&set) && i--==0) return cpu;
+    return -1;
+}
 
-            // simple line-based: assume one command per line
-            // (for robust framing, accumulate until '\n')
-            char line[MAXLINE];
-            snprintf(line,sizeof(line),"%s",buf);
-            process_command(db,s,line);
+int main(int argc, char** argv){
+    if(argc<4){
+        fprintf(stderr,"Usage: %s <bind-ip> <port> <sqlite_db> [--readers N] [--reactors N] [--pin] [--migrate-dates] " DBTUNE_USAGE "\n", argv[0]);
+        return 1;
+    }
+    const char* bind_ip=argv[1]; int port=atoi(argv[2]); const char* dbfile=argv[3];
+    int nreaders=4, nreactors=1, pin=0, migrate=0;
+    DbTune tune=DBTUNE_DEFAULTS;
+    for(int i=4;i<argc;++i){
+        int r;
+        if(strcmp(argv[i],"--readers")==0 && i+1<argc) nreaders=atoi(argv[++i]);
+        else if(strcmp(argv[i],"--reactors")==0 && i+1<argc) nreactors=atoi(argv[++i]);
+        else if(strcmp(argv[i],"--pin")==0) pin=1;
+        else if(strcmp(argv[i],"--migrate-dates")==0) migrate=1;
+        else if((r=dbtune_option(&tune,argc,argv,&i))<0){ fprintf(stderr,"bad value for %s\n", argv[i-1]); return 1; }
+        else if(r==0){ fprintf(stderr,"unknown option %s\n", argv[i]); return 1; }
+    }
+    if(nreaders<1 || nreaders>MAX_READERS) die("--readers must be 1..64");
+    if(nreactors==0) nreactors=(int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(nreactors<1 || nreactors>MAX_REACTORS) die("--reactors must be 0..64");
+
+    sqlite3* db=NULL;
+    if(sqlite3_open(dbfile,&db)!=SQLITE_OK) die("open db failed");
+    sqlite3_busy_timeout(db,5000);
+    if(dbtune_apply(db,&tune)!=0) die("storage settings failed");
+    init_schema(db,migrate);
+    StmtCache sc;
+    if(stmtcache_init(&sc,db,SQL,Q_COUNT)!=0) die("prepare statements failed");
+    if(idmap_init(&g_students,1024)||idmap_init(&g_courses,64)||pairset_init(&g_enrolled,4096)) die("out of memory");
+    warm_caches(&sc);
+    if(attindex_init(&g_index,4096)!=0) die("out of memory");
+    load_index(db);
+
+    Checkpointer ckpt;
+    if(checkpointer_start(&ckpt,dbfile,&tune)!=0) die("checkpointer failed");
+    if(mpscq_init(&g_writeq,QUEUE_CAP)) die("queue init failed");
+    pthread_t writer;
+    if(pthread_create(&writer,NULL,writer_main,&sc)!=0) die("writer thread failed");
+
+    signal(SIGPIPE,SIG_IGN);
+    Reactor* rxs=calloc((size_t)nreactors,sizeof(Reactor));
+    if(!rxs) die("out of memory");
+    for(int k=0;k<nreactors;++k){
+        Reactor* rx=&rxs[k];
+        rx->cpu=pin?nth_cpu(k):-1;
+        rx->nreaders=nreaders;
+        if(objpool_init(&rx->jobs,JOB_POOL,sizeof(Job))) die("out of memory");
+        if(!(rx->readers=calloc((size_t)nreaders,sizeof(Reader)))) die("out of memory");
+        for(int i=0;i<nreaders;++i){
+            Reader* r=&rx->readers[i];
+            if(mpscq_init(&r->q,QUEUE_CAP)) die("queue init failed");
+            if(sqlite3_open_v2(dbfile,&r->db,SQLITE_OPEN_READONLY|SQLITE_OPEN_NOMUTEX,NULL)!=SQLITE_OK) die("open read connection failed");
+            sqlite3_busy_timeout(r->db,5000);
+            if(dbtune_apply_reader(r->db,&tune)!=0) die("storage settings failed");
+            if(stmtcache_init(&r->sc,r->db,SQL,Q_COUNT)!=0) die("prepare statements failed");
+            if(pthread_create(&r->tid,NULL,reader_main,r)!=0) die("reader thread failed");
         }
+        rx->ls=listen_on(bind_ip,port,nreactors>1);
+        if(doneq_init(&rx->done)) die("queue init failed");
+        if((rx->ep=epoll_create1(EPOLL_CLOEXEC))<0) die("epoll_create1 failed");
+        // data.ptr: NULL = listener, &rx->done = worker replies, else a Client
+        struct epoll_event lev={ .events=EPOLLIN|EPOLLET, .data.ptr=NULL };
+        struct epoll_event dev={ .events=EPOLLIN, .data.ptr=&rx->done };
+        if(epoll_ctl(rx->ep,EPOLL_CTL_ADD,rx->ls,&lev)<0 || epoll_ctl(rx->ep,EPOLL_CTL_ADD,rx->done.efd,&dev)<0) die("epoll_ctl failed");
     }
+    printf("Attendance server on %s:%d DB=%s reactors=%d%s readers=%d each\n",
+           bind_ip, port, dbfile, nreactors, pin?" (pinned)":"", nreaders);
+    fflush(stdout);
+    for(int k=0;k<nreactors;++k)
+        if(pthread_create(&rxs[k].tid,NULL,reactor_main,&rxs[k])!=0) die("reactor thread failed");
+    for(int k=0;k<nreactors;++k) pthread_join(rxs[k].tid,NULL);
 
-    closesocket(ls);
-    WSACleanup();
+    mpscq_close(&g_writeq);
+    for(int k=0;k<nreactors;++k)
+        for(int i=0;i<rxs[k].nreaders;++i) mpscq_close(&rxs[k].readers[i].q);
+    pthread_join(writer,NULL);
+    for(int k=0;k<nreactors;++k){
+        Reactor* rx=&rxs[k];
+        for(int i=0;i<rx->nreaders;++i){
+            Reader* r=&rx->readers[i];
+            pthread_join(r->tid,NULL); stmtcache_free(&r->sc); sqlite3_close(r->db); mpscq_free(&r->q);
+        }
+        free(rx->readers); doneq_free(&rx->done); objpool_free(&rx->jobs);
+        close(rx->ep); close(rx->ls);
+    }
+    free(rxs);
+    checkpointer_stop(&ckpt);
+    mpscq_free(&g_writeq);
+    idmap_free(&g_students); idmap_free(&g_courses); pairset_free(&g_enrolled);
+    attindex_free(&g_index);
+    stmtcache_free(&sc);
     sqlite3_close(db);
     return 0;
 }
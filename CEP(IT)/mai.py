@@ -14,6 +14,8 @@ class Database:
     def __init__(self, db_path=DB_FILE):
         self.conn = sqlite3.connect(db_path)
         self.conn.row_factory = sqlite3.Row
+        # the rows ON CONFLICT REPLACE removes must reach the delete trigger
+        self.conn.execute("PRAGMA recursive_triggers = ON")
         self.create_tables()
 
     def create_tables(self):
@@ -39,8 +41,55 @@ class Database:
                 FOREIGN KEY(student_id) REFERENCES students(id) ON DELETE CASCADE
             )
         """)
+        # Counters for the status bar, kept by triggers so today_counts()
+        # reads two rows instead of counting the tables
+        fresh = cur.execute(
+            "SELECT 1 FROM sqlite_master WHERE type='trigger' AND name='att_count_ins'"
+        ).fetchone() is None
+        cur.executescript("""
+            CREATE TABLE IF NOT EXISTS day_counts (
+                date TEXT PRIMARY KEY,
+                present INTEGER NOT NULL,
+                absent INTEGER NOT NULL
+            ) WITHOUT ROWID;
+            CREATE TABLE IF NOT EXISTS counts (
+                name TEXT PRIMARY KEY,
+                n INTEGER NOT NULL
+            ) WITHOUT ROWID;
+            CREATE TRIGGER IF NOT EXISTS att_count_ins AFTER INSERT ON attendance BEGIN
+                INSERT INTO day_counts VALUES (NEW.date, NEW.status='Present', NEW.status='Absent')
+                ON CONFLICT(date) DO UPDATE SET
+                    present = present + excluded.present, absent = absent + excluded.absent;
+            END;
+            CREATE TRIGGER IF NOT EXISTS att_count_del AFTER DELETE ON attendance BEGIN
+                UPDATE day_counts SET present = present - (OLD.status='Present'),
+                                      absent = absent - (OLD.status='Absent')
+                WHERE date = OLD.date;
+            END;
+            CREATE TRIGGER IF NOT EXISTS student_count_ins AFTER INSERT ON students BEGIN
+                UPDATE counts SET n = n + 1 WHERE name = 'students';
+            END;
+            CREATE TRIGGER IF NOT EXISTS student_count_del AFTER DELETE ON students BEGIN
+                UPDATE counts SET n = n - 1 WHERE name = 'students';
+            END;
+        """)
+        if fresh:
+            self.rebuild_counts()
         self.conn.commit()
 
+    def rebuild_counts(self):
+        """Recount day_counts and counts from the tables."""
+        with self.conn:
+            self.conn.execute("DELETE FROM day_counts")
+            self.conn.execute("""
+                INSERT INTO day_counts
+                SELECT date, SUM(status='Present'), SUM(status='Absent')
+                FROM attendance GROUP BY date
+            """)
+            self.conn.execute(
+                "INSERT OR REPLACE INTO counts VALUES ('students', (SELECT COUNT(*) FROM students))"
+            )
+
     # --- Students
     def add_student(self, name: str, roll: str, dept: str) -> bool:
         try:
@@ -94,20 +143,13 @@ class Database:
     def today_counts(self):
         today = date.today().isoformat()
         cur = self.conn.cursor()
-        total_students = cur.execute("SELECT COUNT(*) AS c FROM students").fetchone()["c"]
-        present = cur.execute(
-            "SELECT COUNT(*) AS c FROM attendance WHERE date=? AND status='Present'",
-            (today,),
-        ).fetchone()["c"]
-        absent = cur.execute(
-            "SELECT COUNT(*) AS c FROM attendance WHERE date=? AND status='Absent'",
-            (today,),
-        ).fetchone()["c"]
-        marked = cur.execute(
-            "SELECT COUNT(*) AS c FROM attendance WHERE date=?",
-            (today,),
-        ).fetchone()["c"]
-        return total_students, present, absent, marked
+        row = cur.execute("SELECT n FROM counts WHERE name='students'").fetchone()
+        total_students = row["n"] if row else 0
+        row = cur.execute(
+            "SELECT present, absent FROM day_counts WHERE date=?", (today,)
+        ).fetchone()
+        present, absent = (row["present"], row["absent"]) if row else (0, 0)
+        return total_students, present, absent, present + absent
 
 
 # ----------------------------- GUI Layer -----------------------------